@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "batch_analyzer.h"
+#include "cinder/Filesystem.h"
+
+// Analyze every audio file of a directory without a display, and write one
+// feature file per track. The files use the analysis cache format, so an
+// output directory can serve as the cache directory of the app.
+//
+// Usage: visual-music-batch <input directory> <output directory>
+//            [--workers <n>] [--memory-mb <n>] [--sample-rate <n>]
+//            [--band-scale linear|log|mel|cq] [--bands <n>]
+//            [--fft cinder|fixed]
+
+using namespace ci;
+using visualmusic::BatchAnalyzer;
+
+namespace {
+
+void PrintUsage(const char *program) {
+  std::cerr << "Usage: " << program
+            << " <input directory> <output directory> [--workers <n>]"
+               " [--memory-mb <n>] [--sample-rate <n>]"
+               " [--band-scale linear|log|mel|cq] [--bands <n>]"
+               " [--fft cinder|fixed]"
+            << std::endl;
+}
+
+auto ParseSize(const char *text) -> size_t {
+  return static_cast<size_t>(std::strtoull(text, nullptr, 10));
+}
+
+auto ParseBandScale(const std::string &text, visualmusic::BandScale *scale)
+    -> bool {
+  if (text == "linear") {
+    *scale = visualmusic::BandScale::kLinear;
+  } else if (text == "log") {
+    *scale = visualmusic::BandScale::kLog;
+  } else if (text == "mel") {
+    *scale = visualmusic::BandScale::kMel;
+  } else if (text == "cq") {
+    *scale = visualmusic::BandScale::kConstantQ;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  // Every option takes a value, so a trailing one is missing it
+  if (argc < 3 || (argc - 3) % 2 != 0) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  visualmusic::BatchSettings settings;
+  settings.output_directory = argv[2];
+  size_t sample_rate = 44100;
+
+  // The bands and the Fft the app uses by default
+  visualmusic::BandSettings bands;
+  bands.scale = visualmusic::BandScale::kLog;
+  bands.num_bands = 128;
+  visualmusic::FftBackend fft_backend = visualmusic::FftBackend::kFixed;
+
+  for (int i = 3; i < argc; i += 2) {
+    const std::string option = argv[i];
+    if (option == "--workers") {
+      settings.num_workers = ParseSize(argv[i + 1]);
+    } else if (option == "--memory-mb") {
+      settings.memory_budget = ParseSize(argv[i + 1]) << 20;
+    } else if (option == "--sample-rate") {
+      sample_rate = ParseSize(argv[i + 1]);
+    } else if (option == "--band-scale") {
+      if (!ParseBandScale(argv[i + 1], &bands.scale)) {
+        std::cerr << "Unknown band scale " << argv[i + 1] << std::endl;
+        return 1;
+      }
+    } else if (option == "--bands") {
+      bands.num_bands = ParseSize(argv[i + 1]);
+    } else if (option == "--fft") {
+      const std::string backend = argv[i + 1];
+      if (backend != "cinder" && backend != "fixed") {
+        std::cerr << "Unknown Fft " << backend << std::endl;
+        return 1;
+      }
+      fft_backend = backend == "fixed" ? visualmusic::FftBackend::kFixed
+                                       : visualmusic::FftBackend::kCinder;
+    } else {
+      std::cerr << "Unknown option " << option << std::endl;
+      return 1;
+    }
+  }
+
+  // Tracks are decoded at the rate the app plays them, so keys match
+  settings.parameters = visualmusic::TrackAnalyzer::MakeDisplayParameters(
+      sample_rate, bands, fft_backend);
+  fs::create_directories(settings.output_directory);
+
+  std::vector<std::string> paths;
+  for (fs::directory_iterator entry(argv[1]);
+       entry != fs::directory_iterator(); ++entry) {
+    if (fs::is_regular_file(entry->path())) {
+      paths.push_back(entry->path().string());
+    }
+  }
+  std::sort(paths.begin(), paths.end());
+
+  BatchAnalyzer::ProbeFunction probe =
+      [sample_rate](const std::string &path, visualmusic::TrackInfo *info) {
+        audio::SourceFileRef source =
+            audio::load(loadFile(path), sample_rate);
+        info->num_frames = source->getNumFrames();
+        info->num_channels = source->getNumChannels();
+        return true;
+      };
+  BatchAnalyzer::DecodeFunction decode = [sample_rate](
+                                             const std::string &path) {
+    return audio::load(loadFile(path), sample_rate)->loadBuffer();
+  };
+
+  BatchAnalyzer analyzer(settings, probe, decode);
+  auto start = std::chrono::steady_clock::now();
+  std::vector<visualmusic::TrackResult> results = analyzer.Run(paths);
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  size_t num_analyzed = 0;
+  for (const visualmusic::TrackResult &result : results) {
+    if (result.analyzed) {
+      num_analyzed++;
+      std::cout << result.path << " -> " << result.output_path << std::endl;
+    } else {
+      std::cerr << result.path << ": " << result.error << std::endl;
+    }
+  }
+
+  std::cout << num_analyzed << " of " << results.size() << " tracks in "
+            << elapsed.count() << " s, peak reserved "
+            << (analyzer.GetPeakReservedBytes() >> 20) << " MB" << std::endl;
+  return num_analyzed == results.size() ? 0 : 2;
+}
@@ -0,0 +1,534 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio_visualizer.h"
+#include "sample_file.h"
+#include "test_signals.h"
+
+// Headless benchmark of the analysis and of the per-frame geometry. Nothing
+// here opens a window or touches OpenGL, so it runs on machines without a
+// display or GPU.
+//
+// Usage: visual-music-bench [--full] [--filter <text>] [--frames <n>]
+//                           [--seeks <n>] [--lazy] [--views] [--json <path>]
+//                           [--fft] [--mapped]
+
+using namespace ci;
+
+namespace {
+
+enum class Signal { kSweep, kNoise };
+
+/**
+ * One synthetic track
+ */
+struct BenchCase {
+  std::string name;
+  Signal signal;
+  size_t seconds;
+  size_t num_channels;
+  size_t sample_rate;
+  bool full_only;  // Only run with --full, the buffer takes gigabytes
+};
+
+/**
+ * Timings of one case
+ */
+struct BenchResult {
+  std::string name;
+  size_t num_samples = 0;  // Frames times channels
+  double load_seconds = 0.0;
+  double envelope_seconds = 0.0;
+  double spectral_seconds = 0.0;
+  double views_seconds = 0.0;         // Every channel view on every core
+  double views_serial_seconds = 0.0;  // The same on one core
+  double mapped_load_seconds = 0.0;   // Load through a sample file
+  std::vector<double> frame_micros;  // Geometry time per display frame
+  std::vector<double> seek_micros;   // Seek to its first complete frame
+  std::vector<double> scrub_micros;  // Geometry time per frame while seeking
+};
+
+/**
+ * Throughput of both Fft backends at one size
+ */
+struct FftResult {
+  size_t fft_size = 0;
+  double cinder_frames_per_second = 0.0;
+  double fixed_frames_per_second = 0.0;
+  double rhythm_frames_per_second = 0.0;  // Onsets, tempo and beats
+};
+
+struct Options {
+  bool full = false;
+  std::string filter;
+  size_t num_display_frames = 600;
+  size_t num_seeks = 200;
+  bool lazy = false;  // Compute the spectra in tiles around the playhead
+  bool views = false;  // Time the channel views on one and every core
+  std::string json_path;
+  bool fft = false;  // Time the Fft backends instead of the cases
+  bool mapped = false;  // Time a load through a sample file as well
+};
+
+const BenchCase kCases[] = {
+    {"sweep-1min-mono-44k", Signal::kSweep, 60, 1, 44100, false},
+    {"noise-1min-stereo-48k", Signal::kNoise, 60, 2, 48000, false},
+    {"sweep-10min-stereo-44k", Signal::kSweep, 600, 2, 44100, false},
+    {"noise-5min-6ch-96k", Signal::kNoise, 300, 6, 96000, false},
+    {"sweep-1min-8ch-192k", Signal::kSweep, 60, 8, 192000, false},
+    {"sweep-1h-stereo-44k", Signal::kSweep, 3600, 2, 44100, true},
+    {"noise-3h-mono-44k", Signal::kNoise, 3 * 3600, 1, 44100, true},
+};
+
+/**
+ * Fill a buffer with a logarithmic sine sweep from 20 Hz to 20 kHz, or with
+ * white noise, shifted per channel so the channels differ
+ * @param bench_case
+ * @return buffer
+ */
+auto MakeBuffer(const BenchCase &bench_case) -> audio::Buffer {
+  const size_t num_frames = bench_case.seconds * bench_case.sample_rate;
+  audio::Buffer buffer(num_frames, bench_case.num_channels);
+
+  const double kPi = 3.14159265358979323846;
+  const double rate = static_cast<double>(bench_case.sample_rate);
+  const double growth =
+      std::log(20000.0 / 20.0) / static_cast<double>(num_frames);
+
+  for (size_t channel = 0; channel < bench_case.num_channels; channel++) {
+    float *data = buffer.getChannel(channel);
+
+    if (bench_case.signal == Signal::kSweep) {
+      double phase = static_cast<double>(channel);
+      for (size_t i = 0; i < num_frames; i++) {
+        const double frequency =
+            20.0 * std::exp(growth * static_cast<double>(i));
+        phase += 2.0 * kPi * frequency / rate;
+        data[i] = static_cast<float>(0.8 * std::sin(phase));
+      }
+    } else {
+      const std::vector<float> noise = MakeNoise(
+          num_frames, static_cast<uint32_t>(channel + 1) * 2654435761u);
+      std::copy(noise.begin(), noise.end(), data);
+    }
+  }
+
+  return buffer;
+}
+
+auto SecondsSince(const std::chrono::steady_clock::time_point &start)
+    -> double {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+/**
+ * Returns a percentile of sorted values
+ * @param sorted
+ * @param percentile In [0, 100]
+ * @return value
+ */
+auto Percentile(const std::vector<double> &sorted, const double &percentile)
+    -> double {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  const size_t index = static_cast<size_t>(
+      percentile / 100.0 * static_cast<double>(sorted.size() - 1) + 0.5);
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+
+// Time between two pictures at 60 Hz
+const double kFrameBudgetMicros = 1e6 / 60.0;
+
+// Frames a seek may take before the scrub gives up on it
+const size_t kMaxSeekFrames = 120;
+
+/**
+ * Build the geometry of a display frame into a reused buffer, as the
+ * geometry thread of the app does
+ * @param visualizer
+ * @param frame
+ * @param geometry Buffer of the previous frames
+ * @return number of points and rows built, so the calls are not optimized
+ * away
+ */
+auto BuildGeometry(const visualmusic::AudioVisualizer &visualizer,
+                   const size_t &frame, visualmusic::FrameGeometry *geometry)
+    -> size_t {
+  visualizer.BuildGeometry(frame, geometry);
+  size_t checksum = geometry->num_general_points + geometry->rows.size();
+  for (const std::vector<vec2> &points : geometry->instant) {
+    checksum += points.size();
+  }
+  return checksum;
+}
+
+/**
+ * Time the analysis of every channel view of a buffer
+ * @param buffer
+ * @param num_threads 0 for every core
+ * @return seconds
+ */
+auto TimeChannelViews(const audio::Buffer &buffer, const size_t &num_threads)
+    -> double {
+  visualmusic::StftSettings settings;
+  settings.num_threads = num_threads;
+  settings.backend = visualmusic::FftBackend::kFixed;
+
+  visualmusic::ChannelAnalysis analysis;
+  const auto start = std::chrono::steady_clock::now();
+  analysis.Reset(buffer.getNumFrames(), buffer.getNumChannels(), settings,
+                 nullptr);
+  analysis.Append(buffer, 0, buffer.getNumFrames(), buffer.getNumFrames());
+  analysis.Finish();
+  return SecondsSince(start);
+}
+
+/**
+ * Write a track into a sample file and time its load through the mapping.
+ * The file was just written, so its pages are cached and the time is the
+ * cost of the mapping rather than of the disk.
+ * @param buffer
+ * @param sample_rate
+ * @param options
+ * @return seconds, 0 if the file cannot be written
+ */
+auto TimeMappedLoad(const audio::Buffer &buffer, const size_t &sample_rate,
+                    const Options &options) -> double {
+  const char *kPath = "visual-music-bench.vmsamples";
+  visualmusic::SampleFile file;
+  if (!file.Create(kPath, buffer.getNumFrames(), buffer.getNumChannels(),
+                   sample_rate)) {
+    return 0.0;
+  }
+  file.Write(buffer, 0, buffer.getNumFrames());
+  file.Finish();
+  file.Close();
+
+  visualmusic::AudioVisualizer visualizer;
+  visualizer.SetLazySpectra(options.lazy);
+  const auto start = std::chrono::steady_clock::now();
+  const bool loaded =
+      visualizer.LoadSampleFile(kPath, 0, Rectf(vec2(0, 0), vec2(1280, 720)));
+  const double seconds = SecondsSince(start);
+
+  // The mapping is dropped before its file
+  visualizer.Load(audio::Buffer(), Rectf(vec2(0, 0), vec2(1280, 720)),
+                  sample_rate);
+  std::remove(kPath);
+  return loaded ? seconds : 0.0;
+}
+
+/**
+ * Analyze one track, time the geometry of evenly spread display frames, then
+ * scrub to random targets and time each seek to its first complete frame
+ * @param bench_case
+ * @param options
+ * @return timings
+ */
+auto RunCase(const BenchCase &bench_case, const Options &options)
+    -> BenchResult {
+  BenchResult result;
+  result.name = bench_case.name;
+
+  audio::Buffer buffer = MakeBuffer(bench_case);
+  const size_t num_frames = buffer.getNumFrames();
+  result.num_samples = buffer.getSize();
+
+  const Rectf bounds(vec2(0, 0), vec2(1280, 720));
+  visualmusic::AudioVisualizer visualizer;
+  visualizer.SetLazySpectra(options.lazy);
+
+  auto start = std::chrono::steady_clock::now();
+  visualizer.Load(buffer, bounds, bench_case.sample_rate);
+  result.load_seconds = SecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  visualizer.ConstructEnvelopePyramid();
+  result.envelope_seconds = SecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  visualizer.ConstructBufferSpectralArray(1024);
+  result.spectral_seconds = SecondsSince(start);
+
+  if (options.views) {
+    result.views_seconds = TimeChannelViews(buffer, 0);
+    result.views_serial_seconds = TimeChannelViews(buffer, 1);
+  }
+  if (options.mapped) {
+    result.mapped_load_seconds =
+        TimeMappedLoad(buffer, bench_case.sample_rate, options);
+  }
+
+  // The envelope was rebuilt, so the layout of the general graph is redone
+  visualizer.Resize(bounds);
+
+  size_t checksum = 0;
+  visualmusic::FrameGeometry geometry;
+  for (size_t i = 0; i < options.num_display_frames; i++) {
+    const size_t frame = num_frames * i / options.num_display_frames;
+
+    start = std::chrono::steady_clock::now();
+    checksum += BuildGeometry(visualizer, frame, &geometry);
+    result.frame_micros.push_back(SecondsSince(start) * 1e6);
+  }
+
+  // Each target is drawn once per display frame until it is complete, as
+  // the app does while the audio thread applies the seek
+  uint32_t state = 7;
+  for (size_t i = 0; i < options.num_seeks; i++) {
+    state = state * 1664525u + 1013904223u;
+    const size_t target = static_cast<size_t>(
+        static_cast<double>(state >> 8) / static_cast<double>(1 << 24) *
+        static_cast<double>(num_frames));
+    const size_t num_seeks = visualizer.GetSeekLatency().num_seeks;
+    visualizer.BeginSeek(target);
+
+    for (size_t attempt = 0; attempt < kMaxSeekFrames &&
+                             visualizer.GetSeekLatency().num_seeks == num_seeks;
+         attempt++) {
+      start = std::chrono::steady_clock::now();
+      checksum += BuildGeometry(visualizer, target, &geometry);
+      visualizer.MarkFrameDisplayed(target);
+      const double micros = SecondsSince(start) * 1e6;
+      result.scrub_micros.push_back(micros);
+
+      // Lazy tiles are computed while waiting for the next picture
+      std::this_thread::sleep_for(std::chrono::microseconds(
+          static_cast<int64_t>(std::fmax(0.0, kFrameBudgetMicros - micros))));
+    }
+
+    const visualmusic::SeekLatency latency = visualizer.GetSeekLatency();
+    result.seek_micros.push_back(latency.num_seeks > num_seeks
+                                     ? latency.last * 1e6
+                                     : kMaxSeekFrames * kFrameBudgetMicros);
+  }
+
+  // Keeps the calls from being optimized away
+  if (checksum == 0) {
+    std::cerr << bench_case.name << ": empty geometry" << std::endl;
+  }
+
+  std::sort(result.frame_micros.begin(), result.frame_micros.end());
+  std::sort(result.seek_micros.begin(), result.seek_micros.end());
+  std::sort(result.scrub_micros.begin(), result.scrub_micros.end());
+  return result;
+}
+
+/**
+ * Time a single-threaded STFT of white noise with each Fft backend, at every
+ * size the fixed backend supports
+ * @return throughput per size
+ */
+auto RunFftBench() -> std::vector<FftResult> {
+  const size_t num_samples = static_cast<size_t>(1) << 22;
+  const std::vector<float> signal = MakeNoise(num_samples, 1);
+
+  std::vector<FftResult> results;
+  for (size_t fft_size = 256; fft_size <= 8192; fft_size *= 2) {
+    visualmusic::StftSettings settings;
+    settings.fft_size = fft_size;
+    settings.hop_size = fft_size;
+    settings.window = visualmusic::WindowType::kHann;
+    settings.num_threads = 1;
+
+    FftResult result;
+    result.fft_size = fft_size;
+    const visualmusic::FftBackend backends[] = {
+        visualmusic::FftBackend::kCinder, visualmusic::FftBackend::kFixed};
+    for (const visualmusic::FftBackend &backend : backends) {
+      settings.backend = backend;
+      visualmusic::StftEngine engine(settings);
+      const visualmusic::FrameView frames =
+          engine.MakeFrameView(signal.data(), num_samples);
+      std::vector<float> output(frames.GetNumFrames() * engine.GetNumBins());
+
+      // The first pass warms the tables and the caches
+      engine.Analyze(frames, output.data());
+      auto start = std::chrono::steady_clock::now();
+      engine.Analyze(frames, output.data());
+      const double frames_per_second =
+          static_cast<double>(frames.GetNumFrames()) / SecondsSince(start);
+
+      if (backend == visualmusic::FftBackend::kCinder) {
+        result.cinder_frames_per_second = frames_per_second;
+        continue;
+      }
+      result.fixed_frames_per_second = frames_per_second;
+
+      // The rhythm tracker reads the spectra just computed
+      visualmusic::RhythmTracker rhythm;
+      rhythm.Reset(engine.GetNumBins(), fft_size, 44100,
+                   frames.GetNumFrames());
+      start = std::chrono::steady_clock::now();
+      rhythm.AddFrames(output.data(), engine.GetNumBins(),
+                       frames.GetNumFrames());
+      rhythm.Finish();
+      result.rhythm_frames_per_second =
+          static_cast<double>(frames.GetNumFrames()) / SecondsSince(start);
+    }
+
+    std::printf("fft %5zu  cinder %10.0f frames/s  fixed %10.0f frames/s  "
+                "x%.2f  rhythm %5.1f %% of fixed\n",
+                fft_size, result.cinder_frames_per_second,
+                result.fixed_frames_per_second,
+                result.fixed_frames_per_second /
+                    result.cinder_frames_per_second,
+                100.0 * result.fixed_frames_per_second /
+                    result.rhythm_frames_per_second);
+    std::fflush(stdout);
+    results.push_back(result);
+  }
+
+  return results;
+}
+
+void PrintResult(const BenchResult &result) {
+  const double samples = static_cast<double>(result.num_samples);
+  std::printf(
+      "%-24s load %8.3f s %7.1f Msamples/s | envelope %7.1f Msamples/s | "
+      "spectra %7.1f Msamples/s | frame us p50 %7.1f p95 %7.1f p99 %7.1f "
+      "max %7.1f | seek us p50 %8.1f p99 %8.1f max %8.1f | scrub frame "
+      "max %7.1f us of %.0f\n",
+      result.name.c_str(), result.load_seconds,
+      samples / result.load_seconds / 1e6,
+      samples / result.envelope_seconds / 1e6,
+      samples / result.spectral_seconds / 1e6,
+      Percentile(result.frame_micros, 50),
+      Percentile(result.frame_micros, 95),
+      Percentile(result.frame_micros, 99),
+      Percentile(result.frame_micros, 100), Percentile(result.seek_micros, 50),
+      Percentile(result.seek_micros, 99), Percentile(result.seek_micros, 100),
+      Percentile(result.scrub_micros, 100), kFrameBudgetMicros);
+  if (result.views_seconds > 0.0) {
+    std::printf("%-24s views %7.1f Msamples/s, x%.2f over one core\n", "",
+                samples / result.views_seconds / 1e6,
+                result.views_serial_seconds / result.views_seconds);
+  }
+  if (result.mapped_load_seconds > 0.0) {
+    std::printf("%-24s mapped load %7.1f Msamples/s, %5.1f %% of in memory\n",
+                "", samples / result.mapped_load_seconds / 1e6,
+                100.0 * result.load_seconds / result.mapped_load_seconds);
+  }
+  std::fflush(stdout);
+}
+
+void WriteJson(const std::vector<BenchResult> &results,
+               const std::vector<FftResult> &fft_results,
+               const std::string &path) {
+  std::ofstream out(path);
+  out << "{\n  \"fft\": [\n";
+  for (size_t i = 0; i < fft_results.size(); i++) {
+    out << "    {\"size\": " << fft_results[i].fft_size
+        << ", \"cinder_frames_per_second\": "
+        << fft_results[i].cinder_frames_per_second
+        << ", \"fixed_frames_per_second\": "
+        << fft_results[i].fixed_frames_per_second
+        << ", \"rhythm_frames_per_second\": "
+        << fft_results[i].rhythm_frames_per_second << "}"
+        << (i + 1 < fft_results.size() ? "," : "") << "\n";
+  }
+  out << "  ],\n  \"cases\": [\n";
+
+  for (size_t i = 0; i < results.size(); i++) {
+    const BenchResult &result = results[i];
+    const double samples = static_cast<double>(result.num_samples);
+    out << "    {\"name\": \"" << result.name << "\""
+        << ", \"samples\": " << result.num_samples
+        << ", \"load_seconds\": " << result.load_seconds
+        << ", \"load_samples_per_second\": " << samples / result.load_seconds
+        << ", \"envelope_samples_per_second\": "
+        << samples / result.envelope_seconds
+        << ", \"spectral_samples_per_second\": "
+        << samples / result.spectral_seconds
+        << ", \"views_seconds\": " << result.views_seconds
+        << ", \"views_serial_seconds\": " << result.views_serial_seconds
+        << ", \"mapped_load_seconds\": " << result.mapped_load_seconds
+        << ", \"frame_us\": {\"p50\": " << Percentile(result.frame_micros, 50)
+        << ", \"p95\": " << Percentile(result.frame_micros, 95)
+        << ", \"p99\": " << Percentile(result.frame_micros, 99)
+        << ", \"max\": " << Percentile(result.frame_micros, 100) << "}"
+        << ", \"seek_us\": {\"p50\": " << Percentile(result.seek_micros, 50)
+        << ", \"p99\": " << Percentile(result.seek_micros, 99)
+        << ", \"max\": " << Percentile(result.seek_micros, 100) << "}"
+        << ", \"scrub_frame_max_us\": " << Percentile(result.scrub_micros, 100)
+        << "}"
+        << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+
+  out << "  ]\n}\n";
+}
+
+auto ParseOptions(int argc, char **argv, Options *options) -> bool {
+  for (int i = 1; i < argc; i++) {
+    const std::string argument = argv[i];
+    const bool has_value = i + 1 < argc;
+
+    if (argument == "--full") {
+      options->full = true;
+    } else if (argument == "--filter" && has_value) {
+      options->filter = argv[++i];
+    } else if (argument == "--frames" && has_value) {
+      options->num_display_frames =
+          std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+    } else if (argument == "--seeks" && has_value) {
+      options->num_seeks = std::strtoul(argv[++i], nullptr, 10);
+    } else if (argument == "--lazy") {
+      options->lazy = true;
+    } else if (argument == "--views") {
+      options->views = true;
+    } else if (argument == "--json" && has_value) {
+      options->json_path = argv[++i];
+    } else if (argument == "--fft") {
+      options->fft = true;
+    } else if (argument == "--mapped") {
+      options->mapped = true;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: " << argv[0]
+              << " [--full] [--filter <text>] [--frames <n>] [--seeks <n>]"
+                 " [--lazy] [--views] [--json <path>] [--fft] [--mapped]"
+              << std::endl;
+    return 1;
+  }
+
+  std::vector<BenchResult> results;
+  std::vector<FftResult> fft_results;
+  if (options.fft) {
+    fft_results = RunFftBench();
+  }
+
+  for (const BenchCase &bench_case : kCases) {
+    if (options.fft || (bench_case.full_only && !options.full) ||
+        bench_case.name.find(options.filter) == std::string::npos) {
+      continue;
+    }
+    results.push_back(RunCase(bench_case, options));
+    PrintResult(results.back());
+  }
+
+  if (!options.json_path.empty()) {
+    WriteJson(results, fft_results, options.json_path);
+  }
+  return 0;
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "band_mapper.h"
+#include "cinder/audio/audio.h"
+#include "envelope_pyramid.h"
+#include "mapped_file.h"
+#include "stft_engine.h"
+
+namespace visualmusic {
+
+using namespace ci;
+
+/**
+ * Parameters that change the result of an analysis, part of the cache key
+ */
+struct AnalysisParameters {
+  size_t sample_rate = 0;
+  size_t instant_display_rate = 0;
+  size_t general_display_rate = 0;
+  size_t three_dimension_display_rate = 0;
+  size_t fft_size = 0;
+  size_t hop_size = 0;
+  WindowType window = WindowType::kRectangular;
+  FftBackend fft_backend = FftBackend::kCinder;
+  BandScale band_scale = BandScale::kLinear;
+  size_t num_bands = 0;
+  float min_frequency = 0.0f;
+};
+
+/**
+ * Results of an analysis, as pointers into memory owned by someone else
+ */
+struct AnalysisProducts {
+  size_t num_frames = 0;  // Frames summarized by the envelope
+  const EnvelopePyramid::Bucket *envelope = nullptr;  // Every level, flat
+  size_t num_envelope_buckets = 0;
+
+  const float *spectral_rows = nullptr;
+  size_t num_spectral_frames = 0;
+  size_t num_spectral_bins = 0;
+  size_t spectral_row_stride = 0;  // Floats between two rows
+  size_t spectral_hop_size = 0;
+
+  // Spectra reduced to frequency bands, one row per spectral frame, or none
+  const float *band_rows = nullptr;
+  size_t num_bands = 0;
+  size_t band_row_stride = 0;  // Floats between two rows
+
+  float max_magnitude_general = 0.0f;
+  float max_magnitude_fft = 0.0f;
+  float max_magnitude_bands = 0.0f;
+};
+
+/**
+ * This class reads and writes analysis cache files. A cache file holds a
+ * versioned header, the envelope pyramid, the spectral frames and their
+ * frequency bands, and is memory-mapped when opened, so a cache hit does no
+ * analysis and copies no spectra. Files are named after a hash of the decoded
+ * samples and of the analysis parameters.
+ */
+class AnalysisCache {
+ public:
+  // Increase whenever the file layout or the analysis changes
+  static const uint32_t kVersion = 3;
+
+  /**
+   * Initialize a closed cache
+   */
+  AnalysisCache();
+
+  /**
+   * Returns the key of an analysis: a hash of the samples and parameters
+   * @param buffer
+   * @param parameters
+   * @return key
+   */
+  static auto ComputeKey(const audio::Buffer &buffer,
+                         const AnalysisParameters &parameters) -> uint64_t;
+
+  /**
+   * Returns the key of an analysis of planar channels, equal to the key of
+   * a buffer holding the same samples
+   * @param channels Pointers to the first frame of each channel
+   * @param num_channels
+   * @param num_frames
+   * @param parameters
+   * @return key
+   */
+  static auto ComputeKey(const float *const *channels,
+                         const size_t &num_channels, const size_t &num_frames,
+                         const AnalysisParameters &parameters) -> uint64_t;
+
+  /**
+   * Returns the name of the cache file of a key
+   * @param key
+   * @return file name
+   */
+  static auto GetFileName(const uint64_t &key) -> std::string;
+
+  /**
+   * Write a cache file. The file is written next to its final path and then
+   * renamed, so a reader never sees a partial file.
+   * @param path
+   * @param key
+   * @param products
+   * @return true if the file is written
+   */
+  static auto Write(const std::string &path, const uint64_t &key,
+                    const AnalysisProducts &products) -> bool;
+
+  /**
+   * Map a cache file. Files of another version or key, truncated files and
+   * files with a wrong checksum are rejected.
+   * @param path
+   * @param key
+   * @return true if the file is valid and mapped
+   */
+  auto Open(const std::string &path, const uint64_t &key) -> bool;
+
+  /**
+   * Unmap the cache file
+   */
+  void Close();
+
+  auto IsOpen() const -> bool {
+    return file_.IsOpen();
+  }
+
+  /**
+   * Returns the size of the mapped file, which the system pages in and out
+   * on its own
+   * @return size in bytes, 0 when closed
+   */
+  auto GetMappedBytes() const -> size_t {
+    return file_.IsOpen() ? file_.GetSize() : 0;
+  }
+
+  /**
+   * Returns the products stored in the mapped file
+   * @return products, valid until Close
+   */
+  auto GetProducts() const -> const AnalysisProducts & {
+    return products_;
+  }
+
+ private:
+  MappedFile file_;
+  AnalysisProducts products_;
+
+  /**
+   * Hash a block of memory, continuing from a previous hash
+   * @param data
+   * @param size Number of bytes
+   * @param hash
+   * @return hash
+   */
+  static auto Hash(const void *data, const size_t &size, uint64_t hash)
+      -> uint64_t;
+
+  /**
+   * Returns the checksum of the payload: a sample of the envelope buckets, of
+   * the spectral rows and of the band rows, cheap enough to verify on every
+   * open
+   * @param products
+   * @return checksum
+   */
+  static auto ComputeChecksum(const AnalysisProducts &products) -> uint64_t;
+};
+
+}  // namespace visualmusic
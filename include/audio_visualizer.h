@@ -1,26 +1,113 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "analysis_cache.h"
+#include "band_mapper.h"
+#include "channel_analysis.h"
 #include "cinder/app/App.h"
 #include "cinder/app/RendererGl.h"
 #include "cinder/audio/Voice.h"
 #include "cinder/audio/audio.h"
 #include "cinder/gl/gl.h"
+#include "envelope_pyramid.h"
+#include "live_analyzer.h"
+#include "quantized_spectra.h"
+#include "rhythm_tracker.h"
+#include "sample_file.h"
+#include "simd_kernels.h"
+#include "spectral_arena.h"
+#include "spectral_tile_cache.h"
+#include "stft_engine.h"
+#include "track_analyzer.h"
 
 namespace visualmusic {
 
 using namespace ci;
 using namespace ci::app;
 
+/**
+ * Bytes held by each analysis product of a visualizer
+ */
+struct MemoryUsage {
+  size_t samples = 0;   // Decoded track
+  size_t envelope = 0;  // Envelope pyramid
+  size_t spectra = 0;   // Magnitude spectra, as floats or codes
+  size_t bands = 0;     // Frequency bands
+  size_t graphs = 0;    // Points of the general and 3D graphs
+  size_t channel_views = 0;  // Signals, envelopes and rows of the views
+  size_t rhythm = 0;    // Onset and beat timeline
+  size_t mapped = 0;    // Cache and sample files the products and samples
+                        // are read from, not counted in the total as the
+                        // system pages them in and out
+
+  /**
+   * Returns the bytes held by every product
+   * @return total in bytes
+   */
+  auto GetTotal() const -> size_t {
+    return samples + envelope + spectra + bands + graphs + channel_views +
+           rhythm;
+  }
+};
+
+/**
+ * Time from a seek to the first displayed frame that shows its target
+ */
+struct SeekLatency {
+  double last = 0.0;  // Seconds
+  double max = 0.0;
+  size_t num_seeks = 0;  // Seeks that reached the screen
+};
+
+/**
+ * Vertex data of one picture, built without any GL call so that it can be
+ * prepared on another thread while the previous picture is drawn. A buffer
+ * reused for later frames only copies the points that changed since.
+ */
+struct FrameGeometry {
+  size_t frame = 0;       // Frame the picture shows
+  bool complete = false;  // Every graph is complete at frame
+
+  // Instant graph, one line per channel
+  std::vector<std::vector<vec2>> instant;
+
+  // General graph: every column computed so far, of which the first
+  // num_general_points are drawn. A new generation drops the old points.
+  uint64_t general_generation = 0;
+  std::vector<vec2> general;
+  size_t num_general_points = 0;
+
+  // Ring of 3D rows, slot (index % size) holding spectral frame index
+  uint64_t rows_generation = 0;
+  std::vector<vec2> rows;
+  std::vector<size_t> row_indices;
+  float max_magnitude = 1.0f;  // Vertical scale of the rows
+};
+
 /**
  * This class visualizes the audio buffer
  */
 class AudioVisualizer {
  public:
+  // View of every channel, drawn with the spectra of the first one
+  static const size_t kAllChannels = static_cast<size_t>(-1);
+
   /**
    * Initialize the visualizer
    */
   AudioVisualizer();
 
+  /**
+   * Stop building the channel views of a track loaded from the cache
+   */
+  ~AudioVisualizer();
+
   /**
    * Load audio buffer and bounds of the visualizer
    * @param buffer
@@ -31,9 +118,265 @@ class AudioVisualizer {
    */
   void Load(const audio::Buffer &buffer, const Rectf &bounds,
             const size_t &sample_rate,
-            const size_t &instant_display_rate_time_domain = 20,
-            const size_t &general_display_rate_time_domain = 100,
-            const size_t &three_dimension_display_rate = 50);
+            const size_t &instant_display_rate_time_domain =
+                TrackAnalyzer::kInstantDisplayRate,
+            const size_t &general_display_rate_time_domain =
+                TrackAnalyzer::kGeneralDisplayRate,
+            const size_t &three_dimension_display_rate =
+                TrackAnalyzer::kThreeDimensionDisplayRate);
+
+  /**
+   * Load a track decoded into a sample file, reading its samples through
+   * the mapping instead of holding them in memory. The track is analyzed
+   * like a loaded buffer, at the sample rate of the file, with the mapping
+   * advised for one sequential pass and released after it, so that only
+   * the frames the graphs draw stay resident.
+   * @param path File written by a progressive load, see SetSampleFile
+   * @param source_stamp Stamp of the source the file was decoded from, see
+   * SampleFile::GetSourceStamp
+   * @param bounds
+   * @param instant_display_rate_time_domain
+   * @param general_display_rate_time_domain
+   * @param three_dimension_display_rate
+   * @return false if the file is missing, unfinished, of another version or
+   * decoded from another version of the source, in which case nothing is
+   * loaded
+   */
+  auto LoadSampleFile(const std::string &path, const uint64_t &source_stamp,
+                      const Rectf &bounds,
+                      const size_t &instant_display_rate_time_domain =
+                          TrackAnalyzer::kInstantDisplayRate,
+                      const size_t &general_display_rate_time_domain =
+                          TrackAnalyzer::kGeneralDisplayRate,
+                      const size_t &three_dimension_display_rate =
+                          TrackAnalyzer::kThreeDimensionDisplayRate)
+      -> bool;
+
+  /**
+   * Decode the next progressive loads into a sample file instead of memory.
+   * Each chunk is written through the mapping and released once analyzed,
+   * and EndStream marks the file complete so that LoadSampleFile can map it
+   * again. A file that cannot be created falls back to memory.
+   * @param path File to create, empty to keep the samples in memory
+   * @param source_stamp Stamp of the source the file is decoded from
+   */
+  void SetSampleFile(const std::string &path,
+                     const uint64_t &source_stamp = 0);
+
+  /**
+   * Returns the sample file the samples of the track are read from
+   * @return sample file, closed when the samples are in memory
+   */
+  auto GetSampleFile() const -> const SampleFile &;
+
+  /**
+   * Keep the samples the player is about to read resident, so the audio
+   * callback does not wait for the disk. Only frames that entered the
+   * read-ahead window since the last call are requested. Does nothing when
+   * the samples are in memory. Must be called from one thread, once the
+   * track is loaded.
+   * @param frame Read position of the player
+   */
+  void PrefetchSamples(const size_t &frame) const;
+
+  /**
+   * Keep analysis results in cache files inside a directory. Load then maps
+   * the results of a track it has seen before instead of analyzing it.
+   * @param directory Existing directory, empty to disable the cache
+   */
+  void SetCacheDirectory(const std::string &directory);
+
+  /**
+   * Reduce the spectra to frequency bands, which the frequency and 3D graphs
+   * then draw instead of every bin. The bands are computed with the spectra
+   * and cached with them. Takes effect at the next Load or BeginStream.
+   * @param settings BandScale::kLinear draws every bin
+   */
+  void SetFrequencyBands(const BandSettings &settings);
+
+  /**
+   * Select the Fft the spectra are computed with. Takes effect at the next
+   * Load or BeginStream.
+   * @param backend FftBackend::kFixed transforms batches of frames
+   */
+  void SetFftBackend(const FftBackend &backend);
+
+  /**
+   * Select how the spectra and bands are kept in memory. Compact storages are
+   * decoded as they are drawn, and are not written to the cache. Takes effect
+   * at the next Load or BeginStream.
+   * @param storage SpectralStorage::kDecibel8 needs a quarter of the memory
+   */
+  void SetSpectralStorage(const SpectralStorage &storage);
+
+  /**
+   * Compute the spectra of a loaded track in tiles around the playhead
+   * instead of all at once. The 3D graph requests the tiles it draws and the
+   * ones ahead of it from a background worker, and skips rows that are not
+   * computed yet. The graphs scale to the loudest tile computed so far.
+   * Lazy spectra are not written to the cache. Takes effect at the next Load;
+   * progressive loads analyze every frame.
+   * @param enabled
+   * @param settings Size of the tiles and of the cache
+   */
+  void SetLazySpectra(const bool &enabled,
+                      const TileSettings &settings = TileSettings());
+
+  /**
+   * Analyze every view of a multichannel track as well: its mix, each of
+   * its channels and the side signal of a stereo track, each with its own
+   * envelope and spectra. The views are analyzed with the track in one
+   * parallel pass and kept as floats, so a track loaded from a sample file,
+   * with lazy spectra or with a compact storage has none. They are not
+   * cached: a track loaded from the cache builds them in the background.
+   * Takes effect at the next Load or BeginStream.
+   * @param enabled
+   */
+  void SetChannelViews(const bool &enabled);
+
+  /**
+   * Returns the number of views the graphs can draw
+   * @return number of views, 0 without channel views or while they are
+   * built in the background
+   */
+  auto GetNumChannelViews() const -> size_t;
+
+  /**
+   * Wait until the views of a track loaded from the cache are built
+   */
+  void WaitChannelViews();
+
+  /**
+   * Returns the name of a view
+   * @param view
+   * @return name
+   */
+  auto GetChannelViewName(const size_t &view) const -> std::string;
+
+  /**
+   * Draw one view of the track: the instant graph draws its signal, the
+   * general graph its envelope, and the frequency and 3D graphs its spectra.
+   * Load and BeginStream select kAllChannels. Must be called from the thread
+   * that builds geometry.
+   * @param view Below GetNumChannelViews(), anything else selects
+   * kAllChannels
+   */
+  void SelectChannelView(const size_t &view);
+
+  /**
+   * Returns the view the graphs draw
+   * @return view, or kAllChannels
+   */
+  auto GetSelectedChannelView() const -> size_t;
+
+  /**
+   * Returns the analysis of the channel views
+   * @return analysis, without views unless enabled
+   */
+  auto GetChannelAnalysis() const -> const ChannelAnalysis &;
+
+  /**
+   * Returns the onsets, tempo and beats tracked from the spectra of the
+   * track as they are computed, or from those of the live input. Lazy
+   * spectra are not computed in order, so they have no rhythm.
+   * @return rhythm tracker
+   */
+  auto GetRhythm() const -> const RhythmTracker &;
+
+  /**
+   * Returns the rhythm at a frame of the track, or the newest rhythm of the
+   * live input
+   * @param frame
+   * @param rhythm Receives the rhythm of the spectral frame holding frame
+   * @return false if that spectral frame is not tracked yet
+   */
+  auto GetRhythmAt(const size_t &frame, RhythmFrame *rhythm) const -> bool;
+
+  /**
+   * Returns the tiles of the lazy spectra
+   * @return tile cache, inactive without lazy spectra
+   */
+  auto GetSpectralTiles() const -> const SpectralTileCache &;
+
+  /**
+   * Returns the bytes held by each analysis product
+   * @return memory usage
+   */
+  auto GetMemoryUsage() const -> MemoryUsage;
+
+  /**
+   * Returns whether the last Load was served by the cache
+   * @return true on a cache hit
+   */
+  auto IsLoadedFromCache() const -> bool;
+
+  /**
+   * Start a progressive load of a track of known length. Frames are handed in
+   * with AppendFrames, and Display renders whatever is analyzed so far.
+   * AppendFrames and EndStream may run on a loader thread while Display runs
+   * on the main thread.
+   * @param num_frames Total number of frames of the track
+   * @param num_channels
+   * @param bounds
+   * @param sample_rate
+   * @param instant_display_rate_time_domain
+   * @param general_display_rate_time_domain
+   * @param three_dimension_display_rate
+   */
+  void BeginStream(const size_t &num_frames, const size_t &num_channels,
+                   const Rectf &bounds, const size_t &sample_rate,
+                   const size_t &instant_display_rate_time_domain =
+                       TrackAnalyzer::kInstantDisplayRate,
+                   const size_t &general_display_rate_time_domain =
+                       TrackAnalyzer::kGeneralDisplayRate,
+                   const size_t &three_dimension_display_rate =
+                       TrackAnalyzer::kThreeDimensionDisplayRate);
+
+  /**
+   * Append the next decoded frames of a progressive load, and extend the
+   * envelope, the spectra and the maximum magnitudes over them
+   * @param chunk
+   * @param num_frames Number of valid frames in chunk
+   */
+  void AppendFrames(const audio::Buffer &chunk, const size_t &num_frames);
+
+  /**
+   * Finish a progressive load, analyzing the frames at the end of the track
+   */
+  void EndStream();
+
+  /**
+   * Display a live input instead of a track. The rates of the graphs are the
+   * rates of the analyzer.
+   * @param analyzer Must outlive the live mode, which lasts until the next
+   * Load or BeginStream
+   * @param bounds
+   */
+  void BeginLive(LiveAnalyzer *analyzer, const Rectf &bounds);
+
+  /**
+   * Drain the live input and rescale the graphs to its rolling maximums.
+   * Called on the display thread before each Display.
+   */
+  void UpdateLive();
+
+  /**
+   * Returns whether a live input is displayed
+   * @return true in live mode
+   */
+  auto IsLive() const -> bool;
+
+  /**
+   * Returns the number of frames that can be displayed
+   * @return number of frames
+   */
+  auto GetReadyFrames() const -> size_t;
+
+  /**
+   * Returns whether the whole track has been analyzed
+   * @return true if loaded
+   */
+  auto IsLoaded() const -> bool;
 
   /**
    * Resize the visualizer
@@ -42,14 +385,69 @@ class AudioVisualizer {
   void Resize(Rectf bounds);
 
   /**
-   * Display everything inside the visualizer at a specific frame
+   * Display everything inside the visualizer at a specific frame: build its
+   * geometry, then draw it
    * @param frame
    */
   void Display(const size_t &frame) const;
 
+  /**
+   * Bring a geometry buffer up to a frame. Makes no GL call, so a producer
+   * thread may build the next picture while the display draws the last one,
+   * as long as it is the only thread building.
+   * @param frame Ignored by a live input, which shows its newest spectra
+   * @param geometry Buffer last built by this visualizer, or a new one
+   */
+  void BuildGeometry(const size_t &frame, FrameGeometry *geometry) const;
+
+  /**
+   * Draw a built geometry, uploading the points that changed since the last
+   * one, and record it as displayed. Must be called from the display thread.
+   * @param geometry
+   */
+  void DisplayGeometry(const FrameGeometry &geometry) const;
+
+  /**
+   * Start measuring a seek, replacing the one in flight. Lazy tiles around
+   * the target are requested at once, so the next Display can draw it from
+   * what is already analyzed. Must be called from the display thread.
+   * @param frame Target of the seek
+   */
+  void BeginSeek(const size_t &frame);
+
+  /**
+   * Returns whether every graph is complete at a frame: its samples are
+   * analyzed and every 3D row on screen is computed
+   * @param frame
+   * @return true if complete
+   */
+  auto IsFrameComplete(const size_t &frame) const -> bool;
+
+  /**
+   * Record that a frame reached the screen. The seek in flight ends at the
+   * first complete frame within kSeekTolerance of its target. Display calls
+   * it after drawing. Must be called from the thread that builds geometry.
+   * @param frame
+   */
+  void MarkFrameDisplayed(const size_t &frame) const;
+
+  /**
+   * Returns the latencies of the seeks
+   * @return latency
+   */
+  auto GetSeekLatency() const -> SeekLatency;
+
+  /**
+   * Collapse the window of the instant graph into a min/max pair per pixel
+   * column when it holds more frames than the graph has pixels. Enabled by
+   * default.
+   * @param enabled
+   */
+  void SetInstantGraphDecimation(const bool &enabled);
+
   /**
    * Returns a graph that represent the instant data at current frame (time
-   * domain).
+   * domain). With decimation it has at most two points per pixel column.
    * @param data
    * @param frame
    * @return PolyLine2f
@@ -59,13 +457,85 @@ class AudioVisualizer {
       -> PolyLine2f;
 
   /**
-   * Returns a graph that represent the instant data at current frame (time
-   * domain).
+   * Compute the instant graph into points kept by the caller, which are not
+   * reallocated once they hold a window. Must be called from the thread
+   * that builds geometry.
+   * @param data
    * @param frame
-   * @return PolyLine2f
+   * @param points Receives the points
+   */
+  void CalculateInstantGraphInTimeDomain(const float *data,
+                                         const size_t &frame,
+                                         std::vector<vec2> *points) const;
+
+  /**
+   * Returns how many points of the general graph (time domain) are drawn at
+   * the current frame. The points are computed once per Load or Resize and
+   * extended as the analysis progresses, so only this prefix changes while
+   * playing. Must be called from the thread that builds geometry.
+   * @param frame
+   * @return number of leading points of GetGeneralGraphPoints()
    */
   auto CalculateGeneralGraphInTimeDomain(const size_t &frame) const
-      -> PolyLine2f;
+      -> size_t;
+
+  /**
+   * Returns the points of the general graph computed so far, a vertical
+   * stroke from max to min per column
+   * @return points
+   */
+  auto GetGeneralGraphPoints() const -> const std::vector<vec2> &;
+
+  /**
+   * Returns the rolling envelope of a live input, a vertical stroke from max
+   * to min per bucket with the newest bucket at the right edge
+   * @return PolyLine2f
+   */
+  auto CalculateLiveGeneralGraph() const -> PolyLine2f;
+
+  /**
+   * Compute the rolling envelope of a live input into points kept by the
+   * caller
+   * @param points Receives the points, none without a live input
+   */
+  void CalculateLiveGeneralGraph(std::vector<vec2> *points) const;
+
+  /**
+   * Bring the rows of the 3D graph up to a frame. Each row holds a spectrum
+   * or its bands as (bin / num_bins, magnitude) points, and is placed by a
+   * per-row transform when drawn, so a row is computed once for as long as
+   * it stays on screen. Must be called from the thread that builds geometry.
+   * @param frame
+   * @return number of rows computed by this call
+   */
+  auto Update3DGraph(const size_t &frame) const -> size_t;
+
+  /**
+   * Returns a row of the 3D graph
+   * @param index Spectral frame of the row, which must be on screen
+   * @return points, empty if the row is not computed
+   */
+  auto Get3DGraphRow(const size_t &index) const -> std::vector<vec2>;
+
+  /**
+   * Returns the bounds of the i-th row of the 3D graph, the newest being 0.
+   * Row i starts i steps right of and above the newest, and ends at the
+   * right edge.
+   * @param i
+   * @return bounds, inside which the row is drawn like the frequency graph
+   */
+  auto Get3DGraphRowBounds(const size_t &i) const -> Rectf;
+
+  /**
+   * Returns the transform that draws the points of a row inside
+   * Get3DGraphRowBounds(i): (x, y) is drawn at (x_origin + x * x_step,
+   * y_origin + y * y_scale)
+   * @param i
+   * @param max_magnitude Magnitude drawn at the bottom of the row
+   * @return mapping
+   */
+  auto Get3DGraphRowMapping(const size_t &i, const float &max_magnitude) const
+      -> simd::ScreenMapping;
 
   /**
    * Returns a frequency graph at index (frame / frequency_range)
@@ -77,16 +547,63 @@ class AudioVisualizer {
       -> PolyLine2f;
 
   /**
-   * Compress the buffer to data per range
+   * Construct the min/max/RMS envelope pyramid of the buffer
    */
-  void ConstructCompressedBuffer();
+  void ConstructEnvelopePyramid();
 
   /**
    * Construct an array of buffer spectral (Frequency Domain)
    * @param fft_size Size of Fft for transformation from time domain to
    * frequency domain
+   * @param hop_size Distance between two frames, 0 means fft_size
+   * @param window Window function applied before each Fft
+   */
+  void ConstructBufferSpectralArray(
+      const size_t &fft_size, const size_t &hop_size = 0,
+      const WindowType &window = WindowType::kRectangular);
+
+  /**
+   * Returns the magnitude spectrum of a spectral frame. A compact storage
+   * decodes it into a buffer that the next call overwrites, and lazy spectra
+   * copy it there, waiting for its tile.
+   * @param index
+   * @return pointer to GetNumSpectralBins() magnitudes
+   */
+  auto GetSpectralFrame(const size_t &index) const -> const float *;
+
+  /**
+   * Returns the number of spectral frames
+   * @return number of frames
+   */
+  auto GetNumSpectralFrames() const -> size_t;
+
+  /**
+   * Returns the number of magnitude bins per spectral frame
+   * @return number of bins
+   */
+  auto GetNumSpectralBins() const -> size_t;
+
+  /**
+   * Returns the frequency bands of a spectral frame. A compact storage
+   * decodes them into a buffer that the next call overwrites, and lazy
+   * spectra copy them there, waiting for their tile.
+   * @param index
+   * @return pointer to GetNumBands() magnitudes, nullptr without bands
+   */
+  auto GetBandFrame(const size_t &index) const -> const float *;
+
+  /**
+   * Returns the number of frequency bands per spectral frame
+   * @return number of bands, 0 when every bin is drawn
    */
-  void ConstructBufferSpectralArray(const size_t &fft_size);
+  auto GetNumBands() const -> size_t;
+
+  /**
+   * Returns the arena holding every spectral frame as floats. With a compact
+   * storage it only stages the frames being quantized.
+   * @return arena
+   */
+  auto GetSpectralArena() const -> const SpectralArena &;
 
   /**
    * Set a custom maximum magnitude
@@ -95,10 +612,111 @@ class AudioVisualizer {
   void SetMaxMagnitude(const float &magnitude);
 
  private:
+  // Samples of the track, held by buffer_ or mapped from sample_file_. The
+  // analysis and the graphs only read them through track_channels_.
   audio::Buffer buffer_;
-  std::vector<audio::BufferSpectral *> buffer_spectral_arr_;
+  SampleFile sample_file_;
+  std::string sample_file_path_;  // Created by the next BeginStream
+  uint64_t sample_source_stamp_ = 0;
+  std::vector<const float *> track_channels_;
+  size_t track_frames_ = 0;
   Rectf bounds_;
 
+  // Magnitude spectra, one arena row per spectral frame
+  SpectralArena spectral_arena_;
+  size_t spectral_hop_size_ = 1;
+
+  // Compact spectra and bands, quantized from the arenas a chunk at a time
+  SpectralStorage spectral_storage_ = SpectralStorage::kFloat32;
+  bool spectra_quantized_ = false;
+  QuantizedSpectra quantized_spectra_;
+  QuantizedSpectra quantized_bands_;
+  mutable std::vector<float> decoded_spectrum_;
+  mutable std::vector<float> decoded_bands_;
+  static const size_t kStagingRows = 256;
+
+  // Spectral frames in use, inside spectral_arena_ or the mapped cache_
+  const float *spectral_rows_ = nullptr;
+  size_t spectral_num_rows_ = 0;
+  size_t spectral_num_bins_ = 0;
+  size_t spectral_row_stride_ = 0;
+
+  // Frequency bands of the spectral frames, inside band_arena_ or the cache_
+  BandSettings band_settings_;
+  BandMapper band_mapper_;
+  SpectralArena band_arena_;
+  const float *band_rows_ = nullptr;
+  size_t band_num_bands_ = 0;
+  size_t band_row_stride_ = 0;
+
+  // Onsets, tempo and beats, fed with each spectral frame as it is written
+  RhythmTracker rhythm_;
+
+  // Views of a multichannel track, drawn instead of the track when one is
+  // selected. Their rows are reduced with their own band mapper.
+  bool channel_views_enabled_ = false;
+  ChannelAnalysis channel_analysis_;
+  BandMapper channel_band_mapper_;
+  size_t channel_view_ = kAllChannels;
+
+  // Builds the views of a track loaded from the cache, whose products are
+  // ready without them. The views are readable once channel_views_ready_.
+  static const size_t kChannelViewChunk = 1 << 16;
+  std::thread channel_views_thread_;
+  std::atomic<bool> channel_views_ready_;
+  std::atomic<bool> channel_views_stopping_;
+
+  // Cache of analysis results
+  std::string cache_directory_;
+  AnalysisCache cache_;
+  std::unique_ptr<StftEngine> stft_engine_;
+  FftBackend fft_backend_ = FftBackend::kCinder;
+
+  // Lazy spectra, declared after everything the worker reads so that it
+  // stops first. The display requests and reads tiles.
+  bool lazy_spectra_ = false;
+  bool spectra_tiled_ = false;
+  TileSettings tile_settings_;
+  mutable SpectralTileCache spectral_tiles_;
+  mutable std::vector<float> tile_row_;  // Row the display copies from a tile
+  mutable size_t prefetch_index_ = 0;
+  mutable int prefetch_direction_ = 1;
+
+  // Seek in flight, ended by the display thread
+  const double kSeekTolerance = 0.25;  // Seconds around the target
+  mutable bool seeking_ = false;
+  size_t seek_target_ = 0;
+  std::chrono::steady_clock::time_point seek_start_;
+  mutable SeekLatency seek_latency_;
+
+  // Geometry of Display, and the GL objects the display thread uploads it to
+  mutable FrameGeometry geometry_;
+  mutable PolyLine2f instant_line_;  // Line of a channel being drawn
+  mutable PolyLine2f live_general_line_;  // Envelope of a live input
+  mutable gl::VboMeshRef general_graph_mesh_;
+  mutable size_t general_graph_mesh_capacity_ = 0;
+  mutable size_t general_graph_mesh_points_ = 0;
+  mutable uint64_t general_graph_mesh_generation_ = 0;
+  mutable std::vector<gl::VboMeshRef> three_dimension_meshes_;
+  mutable std::vector<size_t> three_dimension_mesh_indices_;
+  mutable size_t three_dimension_mesh_bins_ = 0;
+  mutable uint64_t three_dimension_mesh_generation_ = 0;
+
+  // Progress of the analysis, published to the display with release stores
+  std::atomic<size_t> ready_frames_;
+  std::atomic<size_t> ready_spectral_frames_;
+  std::atomic<bool> loaded_;
+
+  // Loader side progress of a progressive load
+  size_t written_frames_ = 0;
+  size_t released_frames_ = 0;  // Frames of the sample file released so far
+
+  // Frames of the sample file requested ahead of the player
+  static const size_t kReadAheadSeconds = 2;
+  mutable size_t prefetched_first_ = 0;
+  mutable size_t prefetched_last_ = 0;
+  size_t written_spectral_frames_ = 0;
+
   size_t sample_rate_;                       // Number of frames per second
   size_t instant_time_domain_display_rate_;  // Rate of instant display (time
                                              // domain)
@@ -107,38 +725,166 @@ class AudioVisualizer {
   size_t three_dimension_display_rate_;      // Rate of general display (time
   // domain)
 
-  std::vector<float> compressed_buffer_;  // The compressed version of buffer
+  EnvelopePyramid envelope_;  // Multi-resolution envelope of buffer
+  LiveAnalyzer *live_ = nullptr;  // Rolling analysis of a live input
+  bool decimate_instant_graph_ = true;  // Min/max per pixel column
+  mutable std::vector<float> instant_mins_;  // Per column, reused
+  mutable std::vector<float> instant_maxs_;
+
+  // General graph, two points per column, persistent across frames. The
+  // thread that builds geometry extends it up to the readable columns.
+  size_t general_num_columns_ = 1;
+  size_t general_frames_per_column_ = 1;
+  size_t general_level_ = 0;
+  mutable std::vector<vec2> general_graph_points_;
+  mutable size_t general_graph_columns_ = 0;
+  mutable float general_graph_max_magnitude_ = 0.0f;
+  mutable uint64_t general_graph_generation_ = 0;  // Raised when dropped
+
+  // Rows of the 3D graph, a ring of three_dimension_display_rate_ slots.
+  // Slot (index % size) holds spectral frame index, or kNoRow.
+  static const size_t kNoRow = static_cast<size_t>(-1);
+  mutable std::vector<vec2> three_dimension_rows_;
+  mutable std::vector<size_t> three_dimension_row_indices_;
+  uint64_t three_dimension_generation_ = 0;  // Raised when dropped
 
   // Graph boundaries
   Rectf instant_time_domain_graph_bounds_;
   Rectf general_time_domain_graph_bounds_;
   Rectf three_dimension_graph_bounds_;
 
-  // Maximum magnitudes
-  float max_magnitude_general_;
-  float max_magnitude_compressed_;
-  float max_magnitude_fft_;
+  // Maximum magnitudes, raised by the loader while the display reads them
+  std::atomic<float> max_magnitude_general_;
+  std::atomic<float> max_magnitude_fft_;
+  std::atomic<float> max_magnitude_bands_;
 
   // Frequency range
-  const size_t kFrequencyRange = static_cast<size_t>(pow(2, 10));
+  const size_t kFrequencyRange = TrackAnalyzer::kFftSize;
+
+  // Smallest scale of a live input, so silence is not magnified
+  const float kMinLiveMagnitude = 1e-3f;
 
   /**
-   * Display the instant audio magnitude in time domain at a specific frame
-   * @param frame
+   * Returns the number of channels of the track or of the live input
+   * @return number of channels
+   */
+  auto GetNumChannels() const -> size_t;
+
+  /**
+   * Returns the samples of a channel, the instant window of a live input
+   * @param channel
+   * @return pointer to the first sample
+   */
+  auto GetChannelData(const size_t &channel) const -> const float *;
+
+  /**
+   * Returns whether the graphs draw a channel view
+   * @return true if a view is selected
+   */
+  auto IsChannelViewSelected() const -> bool;
+
+  /**
+   * Returns the envelope the general graph draws, of the selected view or of
+   * the whole track
+   * @return envelope
+   */
+  auto GetEnvelope() const -> const EnvelopePyramid &;
+
+  /**
+   * Allocate the channel views of the track, or release them when disabled
+   */
+  void ResetChannelViews();
+
+  /**
+   * Analyze the channel views of the whole track, in the background when
+   * the track is loaded from the cache
+   */
+  void BuildChannelViews();
+
+  /**
+   * Wait for the background build of the channel views to stop, before the
+   * samples it reads are replaced
+   */
+  void StopChannelViews();
+
+  /**
+   * Map the row the frequency and 3D graphs draw for a spectral frame to
+   * screen points: its bands, or its bins without bands. Compact rows are
+   * decoded a block at a time on the stack, lazy rows are copied from their
+   * tile.
+   * @param index
+   * @param mapping
+   * @param points Receives GetNumDisplayBins() points
+   * @return false if the tile of a lazy row is not computed yet
    */
-  void DisplayInstantGraphInTimeDomain(const size_t &frame) const;
+  auto MapDisplayRow(const size_t &index, const simd::ScreenMapping &mapping,
+                     vec2 *points) const -> bool;
 
   /**
-   * Display the general magnitude in time domain at a specific frame
+   * Returns the number of points of a frequency graph
+   * @return number of bands, or of bins without bands
+   */
+  auto GetNumDisplayBins() const -> size_t;
+
+  /**
+   * Returns the largest magnitude of the rows the graphs draw
+   * @return max magnitude
+   */
+  auto GetDisplayMaxMagnitude() const -> float;
+
+  /**
+   * Display the rolling envelope of the live input
+   */
+  void DisplayLiveGeneralGraph() const;
+
+  /**
+   * Display the instant audio magnitude in time domain
+   * @param geometry
+   */
+  void DisplayInstantGraphInTimeDomain(const FrameGeometry &geometry) const;
+
+  /**
+   * Returns the instant graph as a vertical stroke from max to min per pixel
+   * column, so peaks between two columns stay visible
+   * @param data
    * @param frame
+   * @param num_columns
+   * @param points Receives the points
    */
-  void DisplayGeneralGraphInTimeDomain(const size_t &frame) const;
+  void CalculateDecimatedInstantGraph(const float *data, const size_t &frame,
+                                      const size_t &num_columns,
+                                      std::vector<vec2> *points) const;
+
+  /**
+   * Display the general magnitude in time domain
+   * @param geometry
+   */
+  void DisplayGeneralGraphInTimeDomain(const FrameGeometry &geometry) const;
 
   /**
    * Display the 3d audio graph - frequency & time domain
+   * @param geometry
+   */
+  void Display3DGraph(const FrameGeometry &geometry) const;
+
+  /**
+   * End the seek in flight if a displayed frame shows its target
    * @param frame
+   * @param complete Whether every graph was complete at frame
+   */
+  void RecordSeekFrame(const size_t &frame, const bool &complete) const;
+
+  /**
+   * Returns the mapping that places magnitudes inside a graph, the
+   * vectorized form of ConvertMagnitudeToDisplayableRatio
+   * @param bounds
+   * @param x_step Distance between two points
+   * @param max_magnitude
+   * @return mapping
    */
-  void Display3DGraph(const size_t &frame) const;
+  auto MakeScreenMapping(const Rectf &bounds, const float &x_step,
+                         const float &max_magnitude) const
+      -> simd::ScreenMapping;
 
   /**
    * Convert the magnitude to a displayable ratio. Magnitude range: [-1, 1]
@@ -165,18 +911,110 @@ class AudioVisualizer {
 
   /**
    * Find the maximum magnitude
-   * @param buffer
+   * @param data
+   * @param size
    * @return max magnitude
    */
-  auto FindMaximumMagnitude(const audio::BufferSpectral *buffer) const -> float;
+  auto FindMaximumMagnitude(const float *data, const size_t &size) const
+      -> float;
+
+  /**
+   * Point the samples of the track at the sample file when it is open, or
+   * else at the buffer
+   */
+  void BindTrackSamples();
+
+  /**
+   * Analyze the whole bound track, or map its analysis from the cache, as
+   * Load and LoadSampleFile do
+   */
+  void AnalyzeTrack();
+
+  /**
+   * Request the read-ahead window of frame 0 of the sample file, after its
+   * pages were released
+   */
+  void ResetReadAhead();
+
+  /**
+   * Store the rates and bounds shared by Load and BeginStream
+   * @param bounds
+   * @param sample_rate
+   * @param instant_display_rate_time_domain
+   * @param general_display_rate_time_domain
+   * @param three_dimension_display_rate
+   */
+  void Configure(const Rectf &bounds, const size_t &sample_rate,
+                 const size_t &instant_display_rate_time_domain,
+                 const size_t &general_display_rate_time_domain,
+                 const size_t &three_dimension_display_rate);
+
+  /**
+   * Returns the cache key of the loaded buffer and analysis settings
+   * @return key
+   */
+  auto ComputeCacheKey() const -> uint64_t;
+
+  /**
+   * Returns the path of the cache file of a key
+   * @param key
+   * @return path
+   */
+  auto GetCachePath(const uint64_t &key) const -> std::string;
+
+  /**
+   * Map the analysis results from the cache
+   * @param key
+   * @return true on a cache hit
+   */
+  auto LoadFromCache(const uint64_t &key) -> bool;
+
+  /**
+   * Write the analysis results to the cache
+   * @param key
+   */
+  void StoreInCache(const uint64_t &key) const;
+
+  /**
+   * Returns the number of columns of the general graph
+   * @return number of columns
+   */
+  auto GetNumGeneralColumns() const -> size_t;
+
+  /**
+   * Lay out the columns of the general graph and drop its points. Called
+   * whenever the envelope or the bounds change.
+   */
+  void ResetGeneralGraph();
+
+  /**
+   * Extend the general graph over the columns that became readable, and
+   * recompute it if the maximum magnitude has changed since
+   */
+  void UpdateGeneralGraph() const;
+
+  /**
+   * Drop the rows of the 3D graph. Called whenever the spectra change.
+   */
+  void Reset3DGraph();
+
+  /**
+   * Prepare the Fft engine and an arena sized for the whole track, staging
+   * arenas and quantized stores with a compact storage, or the tile cache
+   * with lazy spectra
+   * @param fft_size
+   * @param hop_size Distance between two frames, 0 means fft_size
+   * @param window
+   */
+  void ResetBufferSpectralArray(const size_t &fft_size, const size_t &hop_size,
+                                const WindowType &window);
 
   /**
-   * Divide buffer data into smaller buffers (per second)
-   * @param range_size
-   * @return list of smaller buffers
+   * Transform the spectral frames [written_spectral_frames_, last_frame) and
+   * reduce them to bands
+   * @param last_frame
    */
-  auto GenerateBufferPerRange(const size_t &range_size) const
-      -> std::vector<audio::Buffer *>;
+  void AnalyzeSpectralFrames(const size_t &last_frame);
 
   /**
    * Construct the boundaries of smaller entities inside the window
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace visualmusic {
+
+/**
+ * Frequency scales the spectra can be reduced to
+ */
+enum class BandScale {
+  kLinear,     // No reduction, every Fft bin is drawn
+  kLog,        // Bands of equal width in octaves, averaging their bins
+  kMel,        // Triangular filters of equal width in mels
+  kConstantQ,  // Bands of constant quality factor, Hann weighted
+};
+
+/**
+ * Settings of a band reduction
+ */
+struct BandSettings {
+  BandScale scale = BandScale::kLinear;
+  size_t num_bands = 128;
+  float min_frequency = 20.0f;  // Hz, the bands end at the Nyquist frequency
+};
+
+/**
+ * This class reduces a magnitude spectrum to frequency bands with a sparse
+ * filterbank. Each band holds the weights of a contiguous run of bins,
+ * normalized to a sum of 1, so a band is a weighted mean of magnitudes and
+ * keeps the scale of the spectrum. The weights are computed once, and
+ * applying them is one dot product per band.
+ */
+class BandMapper {
+ public:
+  /**
+   * Initialize a mapper without bands
+   */
+  BandMapper();
+
+  /**
+   * Compute the filterbank of a spectrum
+   * @param settings
+   * @param num_bins Magnitudes per spectrum (fft_size / 2)
+   * @param sample_rate
+   */
+  void Configure(const BandSettings &settings, const size_t &num_bins,
+                 const size_t &sample_rate);
+
+  /**
+   * Returns whether spectra are reduced
+   * @return false for BandScale::kLinear
+   */
+  auto IsEnabled() const -> bool;
+
+  /**
+   * Returns the settings of the filterbank
+   * @return settings
+   */
+  auto GetSettings() const -> const BandSettings &;
+
+  /**
+   * Returns the number of bands
+   * @return number of bands, 0 when disabled
+   */
+  auto GetNumBands() const -> size_t;
+
+  /**
+   * Returns the bins a band reads
+   * @param band
+   * @param first_bin Receives the first bin
+   * @param num_bins Receives the number of bins
+   */
+  void GetBandBins(const size_t &band, size_t *first_bin,
+                   size_t *num_bins) const;
+
+  /**
+   * Returns the weights of a band, one per bin it reads
+   * @param band
+   * @return pointer to the weights
+   */
+  auto GetBandWeights(const size_t &band) const -> const float *;
+
+  /**
+   * Reduce a spectrum
+   * @param magnitudes Spectrum of the configured number of bins
+   * @param bands Receives GetNumBands() values
+   * @return largest band
+   */
+  auto Apply(const float *magnitudes, float *bands) const -> float;
+
+  /**
+   * Reduce the spectra [first_row, last_row) of an arena
+   * @param rows First spectrum
+   * @param row_stride Floats between two spectra
+   * @param first_row
+   * @param last_row
+   * @param band_rows Receives the bands of row r at r * band_row_stride
+   * @param band_row_stride Floats between two band rows
+   * @return largest band
+   */
+  auto ApplyRows(const float *rows, const size_t &row_stride,
+                 const size_t &first_row, const size_t &last_row,
+                 float *band_rows, const size_t &band_row_stride) const
+      -> float;
+
+ private:
+  BandSettings settings_;
+  size_t num_bins_ = 0;
+
+  // Sparse rows: band b weighs bins [first_bins_[b], first_bins_[b] +
+  // weight_offsets_[b + 1] - weight_offsets_[b])
+  std::vector<size_t> first_bins_;
+  std::vector<size_t> weight_offsets_;
+  std::vector<float> weights_;
+
+  /**
+   * Append a band from the weight of every bin, dropping the zero weights
+   * at both ends. An empty band reads the bin nearest to its center.
+   * @param bin_weights One weight per bin
+   * @param center_bin
+   */
+  void AddBand(const std::vector<float> &bin_weights,
+               const double &center_bin);
+};
+
+}  // namespace visualmusic
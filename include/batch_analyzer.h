@@ -0,0 +1,115 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cinder/audio/audio.h"
+#include "track_analyzer.h"
+
+namespace visualmusic {
+
+using namespace ci;
+
+/**
+ * Size of a track, known before it is decoded
+ */
+struct TrackInfo {
+  size_t num_frames = 0;
+  size_t num_channels = 0;
+};
+
+/**
+ * Settings of a batch analysis
+ */
+struct BatchSettings {
+  size_t num_workers = 0;  // 0 means one worker per hardware thread
+  size_t memory_budget = static_cast<size_t>(1) << 30;  // Bytes in flight
+  std::string output_directory;
+  AnalysisParameters parameters;
+};
+
+/**
+ * Outcome of one track of a batch
+ */
+struct TrackResult {
+  std::string path;
+  bool analyzed = false;
+  uint64_t key = 0;
+  std::string output_path;
+  std::string error;
+};
+
+/**
+ * This class analyzes many tracks on a pool of workers and writes one
+ * feature file per track, in the cache format of AnalysisCache. Each worker
+ * takes the next queued track, so long and short tracks balance out. Before
+ * decoding, a worker reserves the estimated memory of its track from a
+ * shared budget, so the memory in flight stays bounded however many tracks
+ * are queued. A track larger than the whole budget runs alone.
+ */
+class BatchAnalyzer {
+ public:
+  // Reads the size of a track without decoding it, false on failure
+  typedef std::function<bool(const std::string &, TrackInfo *)> ProbeFunction;
+
+  // Decodes a whole track, nullptr on failure
+  typedef std::function<audio::BufferRef(const std::string &)> DecodeFunction;
+
+  /**
+   * Initialize the batch
+   * @param settings
+   * @param probe
+   * @param decode
+   */
+  BatchAnalyzer(const BatchSettings &settings, ProbeFunction probe,
+                DecodeFunction decode);
+
+  /**
+   * Analyze every track and wait for the workers
+   * @param paths
+   * @return one result per path, in the same order
+   */
+  auto Run(const std::vector<std::string> &paths) -> std::vector<TrackResult>;
+
+  /**
+   * Returns the largest estimate reserved from the budget at once during the
+   * last Run. It bounds the estimates, not the memory actually in use.
+   * @return number of bytes
+   */
+  auto GetPeakReservedBytes() const -> size_t;
+
+ private:
+  BatchSettings settings_;
+  ProbeFunction probe_;
+  DecodeFunction decode_;
+
+  // Memory budget shared by the workers
+  std::mutex budget_mutex_;
+  std::condition_variable budget_released_;
+  size_t reserved_bytes_ = 0;
+  size_t peak_reserved_bytes_ = 0;
+
+  /**
+   * Probe, decode, analyze and write one track
+   * @param path
+   * @return result
+   */
+  auto AnalyzeTrack(const std::string &path) -> TrackResult;
+
+  /**
+   * Wait until the budget can hold a reservation, then take it
+   * @param bytes At most the whole budget
+   */
+  void Reserve(const size_t &bytes);
+
+  /**
+   * Give a reservation back to the budget
+   * @param bytes
+   */
+  void Release(const size_t &bytes);
+};
+
+}  // namespace visualmusic
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "band_mapper.h"
+#include "cinder/audio/audio.h"
+#include "envelope_pyramid.h"
+#include "spectral_arena.h"
+#include "stft_engine.h"
+#include "worker_pool.h"
+
+namespace visualmusic {
+
+using namespace ci;
+
+/**
+ * Signals a track can be viewed as
+ */
+enum class ChannelViewKind {
+  kMix,      // Average of every channel, the mid signal of a stereo track
+  kChannel,  // One channel
+  kSide,     // Half the difference of the two channels of a stereo track
+};
+
+/**
+ * One signal of a track
+ */
+struct ChannelView {
+  ChannelViewKind kind = ChannelViewKind::kMix;
+  size_t channel = 0;  // Of a kChannel view
+};
+
+/**
+ * This class analyzes every view of a multichannel track at once: the mix,
+ * each channel and, for a stereo track, the side signal. Each view has its
+ * own envelope pyramid and display rows, the bands of its spectra or the
+ * spectra themselves without bands.
+ *
+ * A chunk of the track is analyzed in one pass over its planar channels:
+ * the mix and side signals are derived, then the envelope of every view and
+ * blocks of its spectral frames are spread over a shared set of workers, so
+ * N channels take N times the work but not N times as long on N cores.
+ *
+ * Frames are appended in order by one thread while another reads the rows
+ * that are analyzed, as the visualizer publishes them.
+ */
+class ChannelAnalysis {
+ public:
+  /**
+   * Initialize an empty analysis
+   */
+  ChannelAnalysis() = default;
+
+  ChannelAnalysis(const ChannelAnalysis &) = delete;
+  auto operator=(const ChannelAnalysis &) -> ChannelAnalysis & = delete;
+
+  /**
+   * Returns the views of a track: the mix, then each channel of a
+   * multichannel track, then the side signal of a stereo track
+   * @param num_channels
+   * @return views
+   */
+  static auto MakeViews(const size_t &num_channels)
+      -> std::vector<ChannelView>;
+
+  /**
+   * Returns the name of a view
+   * @param view
+   * @param num_channels Of the track, which names the channels of a stereo
+   * track left and right, and its mix mid
+   * @return name
+   */
+  static auto GetViewName(const ChannelView &view,
+                          const size_t &num_channels) -> std::string;
+
+  /**
+   * Allocate every view for a track and forget the previous one
+   * @param num_frames
+   * @param num_channels
+   * @param settings Of the spectra. Its threads are the workers of Append.
+   * @param bands Configured mapper the rows are reduced with, or nullptr.
+   * Must outlive the analysis or the next Reset.
+   */
+  void Reset(const size_t &num_frames, const size_t &num_channels,
+             const StftSettings &settings, const BandMapper *bands);
+
+  /**
+   * Free every view
+   */
+  void Release();
+
+  /**
+   * Analyze frames [first_frame, last_frame) of a track that were just
+   * written, and the spectral frames up to last_spectral_frame, which must
+   * lie inside the written frames unless the track is complete
+   * @param buffer The whole track, which must outlive the analysis
+   * @param first_frame
+   * @param last_frame
+   * @param last_spectral_frame
+   */
+  void Append(const audio::Buffer &buffer, const size_t &first_frame,
+              const size_t &last_frame, const size_t &last_spectral_frame);
+
+  /**
+   * Analyze frames [first_frame, last_frame) of planar channels, as Append
+   * of a buffer does
+   * @param channels Pointers to the first frame of each channel, which must
+   * outlive the analysis
+   * @param first_frame
+   * @param last_frame
+   * @param last_spectral_frame
+   */
+  void Append(const float *const *channels, const size_t &first_frame,
+              const size_t &last_frame, const size_t &last_spectral_frame);
+
+  /**
+   * Mark the end of the track, making the last partial envelope buckets
+   * readable
+   */
+  void Finish();
+
+  /**
+   * Returns the number of views
+   * @return number of views, 0 before Reset
+   */
+  auto GetNumViews() const -> size_t;
+
+  /**
+   * Returns a view
+   * @param view
+   * @return view
+   */
+  auto GetView(const size_t &view) const -> const ChannelView &;
+
+  /**
+   * Returns the samples of a view
+   * @param view
+   * @return pointer to the first frame, valid once appended
+   */
+  auto GetSignal(const size_t &view) const -> const float *;
+
+  /**
+   * Returns the envelope of a view
+   * @param view
+   * @return envelope
+   */
+  auto GetEnvelope(const size_t &view) const -> const EnvelopePyramid &;
+
+  /**
+   * Returns the display rows of a view, one per spectral frame
+   * @param view
+   * @return rows of GetRowSize() magnitudes
+   */
+  auto GetRows(const size_t &view) const -> const SpectralArena &;
+
+  /**
+   * Returns the number of magnitudes per row
+   * @return number of bands, or of bins without bands
+   */
+  auto GetRowSize() const -> size_t;
+
+  /**
+   * Returns the largest magnitude of the rows of a view analyzed so far
+   * @param view
+   * @return max magnitude
+   */
+  auto GetMaxMagnitude(const size_t &view) const -> float;
+
+  /**
+   * Returns the number of spectral frames analyzed
+   * @return number of frames
+   */
+  auto GetNumAnalyzedFrames() const -> size_t;
+
+  /**
+   * Returns the bytes held by the derived signals, the envelopes and the
+   * rows
+   * @return capacity in bytes
+   */
+  auto GetCapacityBytes() const -> size_t;
+
+ private:
+  /**
+   * Products of one view
+   */
+  struct ViewData {
+    ChannelView view;
+    std::vector<float> signal;  // Mix and side only, channels are read
+                                // from the track
+    const float *samples = nullptr;
+    EnvelopePyramid envelope;
+    SpectralArena rows;
+    std::atomic<float> max_magnitude{0.0f};
+  };
+
+  std::vector<std::unique_ptr<ViewData>> views_;
+  std::unique_ptr<StftEngine> engine_;  // Single threaded, run by workers
+  const BandMapper *bands_ = nullptr;
+  size_t num_frames_ = 0;
+  size_t num_channels_ = 0;
+  size_t num_spectral_frames_ = 0;
+  size_t analyzed_frames_ = 0;
+
+  // Workers of Append, kept across tracks, and the scratch of each, kept
+  // while the fft size stays the same
+  std::unique_ptr<WorkerPool> pool_;
+  std::vector<std::unique_ptr<StftEngine::Scratch>> scratches_;
+  size_t scratch_fft_size_ = 0;
+
+  /**
+   * Run tasks [0, num_tasks) on the workers, or on this thread without them
+   * @param num_tasks
+   * @param task Called with the index of the task and of the worker
+   */
+  void RunTasks(const size_t &num_tasks,
+                const std::function<void(size_t, size_t)> &task);
+
+  /**
+   * Returns the number of workers of Append
+   * @return number of workers, 1 without a pool
+   */
+  auto GetNumWorkers() const -> size_t;
+
+  /**
+   * Write frames [first_frame, last_frame) of the mix and side signals
+   * @param channels
+   * @param first_frame
+   * @param last_frame
+   */
+  void DeriveSignals(const float *const *channels, const size_t &first_frame,
+                     const size_t &last_frame);
+
+  /**
+   * Transform spectral frames [first, last) of a view into its rows
+   * @param view
+   * @param first
+   * @param last
+   * @param worker Worker running the block, whose scratch is used
+   * @return largest magnitude of the rows
+   */
+  auto AnalyzeBlock(ViewData *view, const size_t &first, const size_t &last,
+                    const size_t &worker) -> float;
+};
+
+}  // namespace visualmusic
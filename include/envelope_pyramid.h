@@ -0,0 +1,205 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "cinder/audio/audio.h"
+
+namespace visualmusic {
+
+using namespace ci;
+
+/**
+ * This class keeps a mip-mapped min/max/RMS envelope of the channel mix of a
+ * track. Level 0 summarizes kBaseBucketFrames frames per bucket and every
+ * level above halves the number of buckets, so a view of any width and zoom
+ * reads O(width) buckets.
+ *
+ * Frames can be appended in order while another thread queries the envelope;
+ * queries only read buckets whose frames are all appended, which are never
+ * written again.
+ */
+class EnvelopePyramid {
+ public:
+  // Number of frames summarized by one bucket of level 0
+  static const size_t kBaseBucketFrames = 256;
+
+  /**
+   * Summary of a range of frames
+   */
+  struct Bucket {
+    float min;
+    float max;
+    float sum_squares;  // Sum of the squared mix over the range
+  };
+
+  /**
+   * Initialize an empty pyramid
+   */
+  EnvelopePyramid();
+
+  /**
+   * Returns the number of buckets over every level for a track
+   * @param num_frames
+   * @return number of buckets
+   */
+  static auto CountBuckets(const size_t &num_frames) -> size_t;
+
+  /**
+   * Allocate every level for a track and forget the previous one
+   * @param num_frames
+   */
+  void Reset(const size_t &num_frames);
+
+  /**
+   * Build the whole pyramid of a buffer in one parallel pass
+   * @param buffer
+   * @param num_threads 0 means one worker per hardware thread
+   */
+  void Build(const audio::Buffer &buffer, const size_t &num_threads = 0);
+
+  /**
+   * Build the whole pyramid of planar channels in one parallel pass
+   * @param channels Pointers to the first frame of each channel
+   * @param num_channels
+   * @param num_frames
+   * @param num_threads 0 means one worker per hardware thread
+   */
+  void Build(const float *const *channels, const size_t &num_channels,
+             const size_t &num_frames, const size_t &num_threads = 0);
+
+  /**
+   * Summarize frames [first_frame, last_frame) of a buffer that were just
+   * written. Frames must be appended in order, after Reset.
+   * @param buffer The whole track
+   * @param first_frame
+   * @param last_frame
+   */
+  void Append(const audio::Buffer &buffer, const size_t &first_frame,
+              const size_t &last_frame);
+
+  /**
+   * Summarize frames [first_frame, last_frame) of planar channels that were
+   * just written. Frames must be appended in order, after Reset.
+   * @param channels Pointers to the first frame of each channel
+   * @param num_channels Must be positive
+   * @param first_frame
+   * @param last_frame
+   */
+  void Append(const float *const *channels, const size_t &num_channels,
+              const size_t &first_frame, const size_t &last_frame);
+
+  /**
+   * Mark the end of the track, making its last partial buckets readable
+   */
+  void Finish();
+
+  /**
+   * Copy a pyramid from a flat array of every level, as returned by GetData
+   * @param num_frames
+   * @param buckets
+   */
+  void Assign(const size_t &num_frames, const Bucket *buckets);
+
+  /**
+   * Returns the level whose buckets best match a number of frames per column
+   * (the coarsest level with buckets no larger than a column)
+   * @param frames_per_column
+   * @return level
+   */
+  auto SelectLevel(const size_t &frames_per_column) const -> size_t;
+
+  /**
+   * Summarize frames [first_frame, last_frame) using one level. Ranges
+   * smaller than a bucket of the level return the bucket that contains
+   * first_frame.
+   * @param level
+   * @param first_frame
+   * @param last_frame
+   * @param result
+   * @return false if no readable bucket covers first_frame
+   */
+  auto Query(const size_t &level, const size_t &first_frame,
+             const size_t &last_frame, Bucket *result) const -> bool;
+
+  /**
+   * Returns the number of frames whose buckets can be read at a level
+   * @param level
+   * @return number of frames
+   */
+  auto GetReadableFrames(const size_t &level) const -> size_t;
+
+  /**
+   * Returns the largest absolute value of the mix seen so far
+   * @return max magnitude
+   */
+  auto GetMaxMagnitude() const -> float;
+
+  auto GetNumFrames() const -> size_t {
+    return num_frames_;
+  }
+
+  auto GetNumLevels() const -> size_t {
+    return level_offsets_.size();
+  }
+
+  auto GetLevelSize(const size_t &level) const -> size_t {
+    return level_sizes_[level];
+  }
+
+  auto GetBucketFrames(const size_t &level) const -> size_t {
+    return kBaseBucketFrames << level;
+  }
+
+  auto GetLevel(const size_t &level) const -> const Bucket * {
+    return buckets_.data() + level_offsets_[level];
+  }
+
+  /**
+   * Returns every level, level 0 first, as one flat array
+   * @return buckets
+   */
+  auto GetData() const -> const Bucket * {
+    return buckets_.data();
+  }
+
+  auto GetNumBuckets() const -> size_t {
+    return buckets_.size();
+  }
+
+ private:
+  std::vector<Bucket> buckets_;
+  std::vector<size_t> level_offsets_;
+  std::vector<size_t> level_sizes_;
+  size_t num_frames_;
+
+  // Published progress, read by queries on other threads
+  std::atomic<size_t> appended_frames_;
+  std::atomic<bool> finished_;
+  std::atomic<float> max_magnitude_;
+
+  /**
+   * Compute the level 0 buckets [first_bucket, last_bucket) from planar
+   * channels, counting frames below end_frame only
+   * @param channels Pointers to the first frame of each channel
+   * @param num_channels
+   * @param first_bucket
+   * @param last_bucket
+   * @param end_frame
+   * @return largest absolute value of the mix in the buckets
+   */
+  auto SummarizeFrames(const float *const *channels,
+                       const size_t &num_channels, const size_t &first_bucket,
+                       const size_t &last_bucket, const size_t &end_frame)
+      -> float;
+
+  /**
+   * Recompute the buckets of every level above 0 that cover the level 0
+   * buckets [first_bucket, last_bucket)
+   * @param first_bucket
+   * @param last_bucket
+   */
+  void SummarizeLevels(size_t first_bucket, size_t last_bucket);
+};
+
+}  // namespace visualmusic
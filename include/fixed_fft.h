@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace visualmusic {
+
+/**
+ * Fft implementations a short-time Fourier transform can run on
+ */
+enum class FftBackend {
+  kCinder,  // audio::dsp::Fft, one frame at a time
+  kFixed,   // FixedFft, batches of frames, sizes 256 to 8192 only
+};
+
+/**
+ * This class is a real-input Fft specialized for one power-of-two size. A
+ * frame of N samples is packed into N / 2 complex values and transformed by
+ * an iterative radix-2 Fft whose twiddles and bit reversal come from tables
+ * built once per size. Frames are transformed in batches of kNumLanes,
+ * interleaved so that every butterfly runs over kNumLanes contiguous floats,
+ * which the compiler turns into vector instructions.
+ *
+ * Spectra follow the layout of audio::dsp::Fft: real[0] is the DC component
+ * and imag[0] holds the Nyquist component.
+ */
+template <size_t N>
+class FixedFft {
+  static_assert(N >= 256 && N <= 8192 && (N & (N - 1)) == 0,
+                "FixedFft sizes are powers of 2 from 256 to 8192");
+
+ public:
+  static const size_t kSize = N;
+  static const size_t kNumBins = N / 2;
+
+  // Frames per batch, fewer for large sizes so a batch stays in the L2 cache
+  static const size_t kNumLanes = N <= 2048 ? 8 : 4;
+
+  // Floats of workspace a batched transform needs
+  static const size_t kWorkspaceSize = 2 * (N / 2) * kNumLanes;
+
+  /**
+   * Transform one frame
+   * @param input N samples
+   * @param real Receives N / 2 values
+   * @param imag Receives N / 2 values
+   */
+  static void Forward(const float *input, float *real, float *imag);
+
+  /**
+   * Transform frames and keep the magnitude of each bin. Frame i starts at
+   * frames + i * frame_stride, and its N / 2 magnitudes are written at
+   * magnitudes + i * row_stride.
+   * @param frames
+   * @param frame_stride Floats between two frames
+   * @param num_frames
+   * @param magnitudes
+   * @param row_stride Floats between two magnitude rows
+   * @param workspace kWorkspaceSize floats
+   * @return largest magnitude
+   */
+  static auto ForwardMagnitudes(const float *frames,
+                                const size_t &frame_stride,
+                                const size_t &num_frames, float *magnitudes,
+                                const size_t &row_stride, float *workspace)
+      -> float;
+
+ private:
+  /**
+   * Twiddles and bit reversal of a size
+   */
+  struct Tables {
+    Tables();
+
+    std::vector<float> twiddle_real;  // exp(-2 pi i k / (N / 2)), k < N / 4
+    std::vector<float> twiddle_imag;
+    std::vector<float> split_real;  // exp(-2 pi i k / N), k < N / 2
+    std::vector<float> split_imag;
+    std::vector<size_t> bit_reverse;  // Of N / 2 indices
+  };
+
+  /**
+   * Returns the tables of the size, built on first use
+   * @return tables
+   */
+  static auto GetTables() -> const Tables &;
+
+  /**
+   * Run the complex Fft of a batch in place
+   * @param frames
+   * @param frame_stride
+   * @param num_frames At most kNumLanes, the other lanes are zero
+   * @param real Workspace of N / 2 * kNumLanes floats
+   * @param imag Workspace of N / 2 * kNumLanes floats
+   */
+  static void TransformBatch(const float *frames, const size_t &frame_stride,
+                             const size_t &num_frames, float *real,
+                             float *imag);
+};
+
+template <size_t N>
+const size_t FixedFft<N>::kSize;
+template <size_t N>
+const size_t FixedFft<N>::kNumBins;
+template <size_t N>
+const size_t FixedFft<N>::kNumLanes;
+template <size_t N>
+const size_t FixedFft<N>::kWorkspaceSize;
+
+// Every size is compiled once, in fixed_fft.cc
+extern template class FixedFft<256>;
+extern template class FixedFft<512>;
+extern template class FixedFft<1024>;
+extern template class FixedFft<2048>;
+extern template class FixedFft<4096>;
+extern template class FixedFft<8192>;
+
+/**
+ * A FixedFft chosen at run time
+ */
+struct FixedFftKernel {
+  size_t fft_size;
+  size_t num_lanes;
+  size_t workspace_size;
+  float (*forward_magnitudes)(const float *frames, const size_t &frame_stride,
+                              const size_t &num_frames, float *magnitudes,
+                              const size_t &row_stride, float *workspace);
+};
+
+/**
+ * Returns the FixedFft of a size
+ * @param fft_size
+ * @return kernel, nullptr if the size has no specialization
+ */
+auto GetFixedFftKernel(const size_t &fft_size) -> const FixedFftKernel *;
+
+}  // namespace visualmusic
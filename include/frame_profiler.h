@@ -0,0 +1,226 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace visualmusic {
+
+/**
+ * Stages of a frame that are timed
+ */
+enum class FrameStage {
+  kUpdate,               // MusicVisualApp::update
+  kDraw,                 // MusicVisualApp::draw
+  kDisplay,              // AudioVisualizer::DisplayGeometry
+  kDisplayInstantGraph,  // AudioVisualizer::DisplayInstantGraphInTimeDomain
+  kDisplayGeneralGraph,  // AudioVisualizer::DisplayGeneralGraphInTimeDomain
+  kDisplay3DGraph,       // AudioVisualizer::Display3DGraph
+  kBuildGeometry,        // AudioVisualizer::BuildGeometry
+  kInstantGraph,         // AudioVisualizer::CalculateInstantGraphInTimeDomain
+  kGeneralGraph,         // AudioVisualizer::CalculateGeneralGraphInTimeDomain
+  kLiveGeneralGraph,     // AudioVisualizer::CalculateLiveGeneralGraph
+  kFrequencyGraph,  // AudioVisualizer::CalculateInstantGraphInFrequencyDomain
+  k3DGraph,         // AudioVisualizer::Update3DGraph
+  kText,            // Info board and guidance
+};
+
+// Number of values of FrameStage
+const size_t kNumFrameStages = 13;
+
+/**
+ * Percentiles of the durations of a stage
+ */
+struct StageStats {
+  uint64_t count = 0;
+  double mean = 0.0;  // Microseconds
+  double p50 = 0.0;
+  double p95 = 0.0;
+  double p99 = 0.0;
+  double max = 0.0;
+};
+
+/**
+ * This class counts durations in logarithmic buckets: 8 buckets per power of
+ * two, so a percentile is within 6.25 % of the true duration. Any number of
+ * threads may record at once; recording is a few relaxed atomic increments
+ * and never waits.
+ */
+class StageHistogram {
+ public:
+  // Buckets up to 2^kMaxExponent nanoseconds, about 18 minutes. Longer
+  // durations go to the last bucket.
+  static const size_t kSubBuckets = 8;
+  static const size_t kMaxExponent = 40;
+  static const size_t kNumBuckets = (kMaxExponent - 2) * kSubBuckets;
+
+  /**
+   * Initialize an empty histogram
+   */
+  StageHistogram();
+
+  StageHistogram(const StageHistogram &) = delete;
+  auto operator=(const StageHistogram &) -> StageHistogram & = delete;
+
+  /**
+   * Count a duration
+   * @param nanoseconds
+   */
+  void Record(const uint64_t &nanoseconds);
+
+  /**
+   * Forget every duration. Durations recorded meanwhile may be kept.
+   */
+  void Reset();
+
+  /**
+   * Returns the number of durations
+   * @return count
+   */
+  auto GetCount() const -> uint64_t;
+
+  /**
+   * Returns the largest duration, exactly
+   * @return nanoseconds
+   */
+  auto GetMax() const -> uint64_t;
+
+  /**
+   * Returns a percentile of the durations: the middle of the bucket that
+   * holds it
+   * @param percentile In [0, 100]
+   * @return nanoseconds, 0 without durations
+   */
+  auto GetPercentile(const double &percentile) const -> double;
+
+  /**
+   * Returns the count, mean, percentiles and maximum in microseconds
+   * @return stats
+   */
+  auto GetStats() const -> StageStats;
+
+  /**
+   * Returns the bucket of a duration
+   * @param nanoseconds
+   * @return bucket
+   */
+  static auto GetBucket(const uint64_t &nanoseconds) -> size_t;
+
+  /**
+   * Returns the first duration of a bucket
+   * @param bucket
+   * @return nanoseconds
+   */
+  static auto GetBucketStart(const size_t &bucket) -> uint64_t;
+
+ private:
+  std::atomic<uint64_t> buckets_[kNumBuckets];
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_;
+  std::atomic<uint64_t> max_;
+};
+
+/**
+ * This class keeps a histogram per frame stage. The stages of the app record
+ * into one shared profiler, GetFrameProfiler(), through
+ * VISUALMUSIC_PROFILE_STAGE, which compiles to nothing unless
+ * VISUALMUSIC_PROFILING is defined.
+ */
+class FrameProfiler {
+ public:
+  FrameProfiler() = default;
+
+  FrameProfiler(const FrameProfiler &) = delete;
+  auto operator=(const FrameProfiler &) -> FrameProfiler & = delete;
+
+  /**
+   * Count a duration of a stage
+   * @param stage
+   * @param nanoseconds
+   */
+  void Record(const FrameStage &stage, const uint64_t &nanoseconds);
+
+  /**
+   * Forget the durations of every stage
+   */
+  void Reset();
+
+  /**
+   * Returns the histogram of a stage
+   * @param stage
+   * @return histogram
+   */
+  auto GetHistogram(const FrameStage &stage) const -> const StageHistogram &;
+
+  /**
+   * Write a row per stage that has durations: stage, count, mean, p50, p95,
+   * p99 and max, in microseconds
+   * @param path
+   * @return false if the file cannot be written
+   */
+  auto WriteCsv(const std::string &path) const -> bool;
+
+  /**
+   * Returns the name of a stage
+   * @param stage
+   * @return name
+   */
+  static auto GetStageName(const FrameStage &stage) -> const char *;
+
+  /**
+   * Returns the time of a steady clock
+   * @return nanoseconds
+   */
+  static auto GetTime() -> uint64_t;
+
+ private:
+  StageHistogram histograms_[kNumFrameStages];
+};
+
+/**
+ * Returns the profiler the frame stages record into
+ * @return profiler
+ */
+auto GetFrameProfiler() -> FrameProfiler &;
+
+/**
+ * This class records the time from its construction to its destruction
+ */
+class ScopedStageTimer {
+ public:
+  /**
+   * Start timing a stage
+   * @param profiler Must outlive the timer
+   * @param stage
+   */
+  ScopedStageTimer(FrameProfiler *profiler, const FrameStage &stage)
+      : profiler_(profiler), stage_(stage), start_(FrameProfiler::GetTime()) {
+  }
+
+  /**
+   * Record the duration
+   */
+  ~ScopedStageTimer() {
+    profiler_->Record(stage_, FrameProfiler::GetTime() - start_);
+  }
+
+  ScopedStageTimer(const ScopedStageTimer &) = delete;
+  auto operator=(const ScopedStageTimer &) -> ScopedStageTimer & = delete;
+
+ private:
+  FrameProfiler *profiler_;
+  FrameStage stage_;
+  uint64_t start_;
+};
+
+}  // namespace visualmusic
+
+// Time the rest of the enclosing scope as a stage of the frame
+#if defined(VISUALMUSIC_PROFILING)
+#define VISUALMUSIC_PROFILE_STAGE(stage)                  \
+  visualmusic::ScopedStageTimer visualmusic_stage_timer( \
+      &visualmusic::GetFrameProfiler(), stage)
+#else
+#define VISUALMUSIC_PROFILE_STAGE(stage) static_cast<void>(0)
+#endif
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+namespace visualmusic {
+
+/**
+ * A read-only view of overlapping frames inside one planar channel. Frame i
+ * starts at sample i * hop_size; no sample is copied.
+ */
+class FrameView {
+ public:
+  /**
+   * Initialize the view
+   * @param data First sample of the channel
+   * @param num_samples Number of samples in the channel
+   * @param frame_size Number of samples per frame
+   * @param hop_size Distance between the starts of two frames
+   */
+  FrameView(const float *data, const size_t &num_samples,
+            const size_t &frame_size, const size_t &hop_size)
+      : data_(data),
+        num_samples_(num_samples),
+        frame_size_(frame_size),
+        hop_size_(hop_size) {
+  }
+
+  /**
+   * Returns the number of frames, the last one may be shorter than frame_size
+   * @return number of frames
+   */
+  auto GetNumFrames() const -> size_t {
+    return (num_samples_ + hop_size_ - 1) / hop_size_;
+  }
+
+  /**
+   * Returns the first sample of a frame
+   * @param index
+   * @return pointer into the channel
+   */
+  auto GetFrame(const size_t &index) const -> const float * {
+    return data_ + index * hop_size_;
+  }
+
+  /**
+   * Returns the number of valid samples of a frame (frame_size except near
+   * the end of the channel)
+   * @param index
+   * @return number of samples
+   */
+  auto GetFrameLength(const size_t &index) const -> size_t {
+    return std::min(frame_size_, num_samples_ - index * hop_size_);
+  }
+
+  auto GetFrameSize() const -> size_t {
+    return frame_size_;
+  }
+
+  auto GetHopSize() const -> size_t {
+    return hop_size_;
+  }
+
+ private:
+  const float *data_;
+  size_t num_samples_;
+  size_t frame_size_;
+  size_t hop_size_;
+};
+
+}  // namespace visualmusic
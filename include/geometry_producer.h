@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+#include "audio_visualizer.h"
+
+namespace visualmusic {
+
+/**
+ * This class builds the geometry of the next picture on a background thread
+ * while the display draws the last one. It cycles three preallocated
+ * buffers: the worker fills the back one, the display draws the front one,
+ * and a finished buffer waits in the middle until the display takes it. Both
+ * sides hand buffers over with a single atomic exchange, so neither waits
+ * for the other.
+ */
+class GeometryProducer {
+ public:
+  /**
+   * Initialize a stopped producer
+   */
+  GeometryProducer();
+
+  /**
+   * Stop the worker
+   */
+  ~GeometryProducer();
+
+  GeometryProducer(const GeometryProducer &) = delete;
+  auto operator=(const GeometryProducer &) -> GeometryProducer & = delete;
+
+  /**
+   * Start building the geometry of a visualizer. Nothing else may build its
+   * geometry, nor resize or reload it, until Stop. Restarted on the same
+   * visualizer, Acquire keeps returning the last geometry until a new one
+   * is built.
+   * @param visualizer Must outlive the producer or the next Stop
+   */
+  void Start(const AudioVisualizer *visualizer);
+
+  /**
+   * Stop the worker. Buffers already built stay readable until the next
+   * Start on another visualizer.
+   */
+  void Stop();
+
+  /**
+   * Returns whether the producer is started
+   * @return true between Start and Stop
+   */
+  auto IsActive() const -> bool;
+
+  /**
+   * Returns the visualizer of the producer
+   * @return visualizer, nullptr before Start
+   */
+  auto GetVisualizer() const -> const AudioVisualizer *;
+
+  /**
+   * Ask for the geometry of a frame, replacing a request that is not
+   * started yet. Called by the display once per picture.
+   * @param frame
+   */
+  void Request(const size_t &frame);
+
+  /**
+   * Returns the newest built geometry, which stays valid until the next
+   * Acquire. Called by the display thread.
+   * @return geometry, nullptr before the first one is built
+   */
+  auto Acquire() -> const FrameGeometry *;
+
+  /**
+   * Wait until every request is built
+   */
+  void WaitIdle() const;
+
+  /**
+   * Returns the number of geometries built since Start
+   * @return number of geometries
+   */
+  auto GetNumBuilt() const -> size_t;
+
+ private:
+  // The middle buffer has not been acquired yet
+  static const int kFresh = 4;
+  static const int kIndexMask = 3;
+
+  const AudioVisualizer *visualizer_ = nullptr;
+  FrameGeometry buffers_[3];
+  int back_ = 0;   // Worker side
+  int front_ = 1;  // Display side
+  std::atomic<int> middle_;  // Buffer handed over, with kFresh
+  bool has_front_ = false;
+
+  // Guards the requests
+  mutable std::mutex mutex_;
+  std::condition_variable requested_;  // Requests or Stop
+  mutable std::condition_variable built_;
+  size_t requested_frame_ = 0;
+  bool pending_ = false;
+  bool busy_ = false;
+  bool stopping_ = false;
+  std::atomic<size_t> num_built_;
+  std::thread worker_;
+
+  /**
+   * Build requested geometries until Stop (worker thread)
+   */
+  void Run();
+};
+
+}  // namespace visualmusic
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "envelope_pyramid.h"
+#include "rhythm_tracker.h"
+#include "sample_ring.h"
+#include "spectral_arena.h"
+#include "stft_engine.h"
+
+namespace visualmusic {
+
+/**
+ * Settings of a live analysis, in the rates of the visualizer
+ */
+struct LiveSettings {
+  size_t sample_rate = 44100;
+  size_t instant_display_rate = 20;   // Instant window of sample_rate / rate
+  size_t general_display_rate = 100;  // Envelope buckets per second
+  size_t general_seconds = 10;        // Duration of the rolling envelope
+  size_t three_dimension_display_rate = 50;  // Number of spectra kept
+  size_t fft_size = 1024;                    // Also the hop size
+  size_t rhythm_seconds = 10;                // Duration of the rhythm kept
+  FftBackend fft_backend = FftBackend::kCinder;
+};
+
+/**
+ * Time from the arrival of samples to the geometry drawn from them
+ */
+struct LiveLatency {
+  double last = 0.0;  // Seconds
+  double mean = 0.0;
+  double max = 0.0;
+  size_t num_measurements = 0;
+};
+
+/**
+ * This class is the display side of a live input. Each Update drains the
+ * sample ring and keeps rolling results over the newest samples: the window
+ * of the instant graph, an envelope of the last seconds for the general
+ * graph, and the spectra of the last hops for the 3D graph. Every buffer is
+ * allocated by the constructor, and an update costs time proportional to
+ * the frames it drains.
+ */
+class LiveAnalyzer {
+ public:
+  // Returns the time in nanoseconds, on the clock of the ring stamps
+  typedef std::function<int64_t()> Clock;
+
+  /**
+   * Initialize the analyzer
+   * @param ring Must outlive the analyzer
+   * @param settings
+   * @param clock Replaced by a fake clock in tests
+   */
+  LiveAnalyzer(SampleRing *ring, const LiveSettings &settings,
+               Clock clock = SampleRing::GetTime);
+
+  LiveAnalyzer(const LiveAnalyzer &) = delete;
+  auto operator=(const LiveAnalyzer &) -> LiveAnalyzer & = delete;
+
+  /**
+   * Drain the frames written so far, and extend the window, the envelope
+   * and the spectra over them
+   * @return number of frames drained
+   */
+  auto Update() -> size_t;
+
+  /**
+   * Record that the geometry of the last Update is built. The latency is
+   * measured from the arrival of the newest drained frames.
+   */
+  void MarkGeometryReady();
+
+  /**
+   * Returns the latency measured so far
+   * @return latency
+   */
+  auto GetLatency() const -> LiveLatency;
+
+  /**
+   * Returns the settings of the analysis
+   * @return settings
+   */
+  auto GetSettings() const -> const LiveSettings &;
+
+  /**
+   * Returns the number of channels
+   * @return number of channels
+   */
+  auto GetNumChannels() const -> size_t;
+
+  /**
+   * Returns the number of frames drained since the start
+   * @return number of frames
+   */
+  auto GetNumFrames() const -> size_t;
+
+  /**
+   * Returns the number of frames of the instant window
+   * @return number of frames
+   */
+  auto GetWindowFrames() const -> size_t;
+
+  /**
+   * Returns the newest frames of a channel, oldest first. Frames before the
+   * start are silent.
+   * @param channel
+   * @return pointer to GetWindowFrames() samples
+   */
+  auto GetWindow(const size_t &channel) const -> const float *;
+
+  /**
+   * Returns the largest magnitude of the rolling envelope
+   * @return max magnitude
+   */
+  auto GetMaxMagnitude() const -> float;
+
+  /**
+   * Returns the number of complete envelope buckets kept
+   * @return number of buckets, at most GetEnvelopeCapacity()
+   */
+  auto GetNumEnvelopeBuckets() const -> size_t;
+
+  /**
+   * Returns the number of envelope buckets of the rolling envelope
+   * @return number of buckets
+   */
+  auto GetEnvelopeCapacity() const -> size_t;
+
+  /**
+   * Returns a bucket of the rolling envelope
+   * @param index 0 is the oldest kept bucket
+   * @return bucket
+   */
+  auto GetEnvelopeBucket(const size_t &index) const
+      -> const EnvelopePyramid::Bucket &;
+
+  /**
+   * Returns the number of spectra computed since the start
+   * @return number of spectra
+   */
+  auto GetNumSpectra() const -> size_t;
+
+  /**
+   * Returns the number of magnitude bins per spectrum
+   * @return number of bins
+   */
+  auto GetNumBins() const -> size_t;
+
+  /**
+   * Returns a spectrum. Only the last three_dimension_display_rate spectra
+   * are kept.
+   * @param index Spectrum number since the start
+   * @return pointer to GetNumBins() magnitudes
+   */
+  auto GetSpectrum(const size_t &index) const -> const float *;
+
+  /**
+   * Returns the largest magnitude of the kept spectra
+   * @return max magnitude
+   */
+  auto GetMaxSpectralMagnitude() const -> float;
+
+  /**
+   * Returns the onsets, tempo and beats of the last rhythm_seconds, tracked
+   * from each spectrum as it is computed
+   * @return rhythm tracker
+   */
+  auto GetRhythm() const -> const RhythmTracker &;
+
+ private:
+  // Frames drained from the ring at once
+  static const size_t kChunkFrames = 1024;
+
+  SampleRing *ring_;
+  LiveSettings settings_;
+  Clock clock_;
+  size_t num_channels_;
+  size_t num_frames_ = 0;
+
+  // Newest frames of each channel, a power of 2 per channel
+  std::vector<float> history_;
+  size_t history_mask_;
+
+  // Drained chunk, mixed chunk and the linear instant window
+  std::vector<float> chunk_;
+  std::vector<const float *> chunk_channels_;
+  std::vector<float> mix_;
+  std::vector<float> window_;
+  size_t window_frames_;
+
+  // Rolling envelope, a ring of buckets and the bucket being filled
+  std::vector<EnvelopePyramid::Bucket> buckets_;
+  size_t num_buckets_ = 0;
+  size_t bucket_frames_;
+  EnvelopePyramid::Bucket partial_bucket_;
+  size_t partial_frames_ = 0;
+  float max_magnitude_ = 0.0f;
+
+  // Rolling spectra, one arena row per kept hop
+  StftEngine stft_engine_;
+  StftEngine::Scratch scratch_;
+  std::vector<float> fft_frame_;
+  SpectralArena spectra_;
+  std::vector<float> spectrum_max_;
+  size_t num_spectra_ = 0;
+  float max_spectral_magnitude_ = 0.0f;
+  RhythmTracker rhythm_;
+
+  // Arrival time of the frames waiting for their geometry
+  int64_t pending_time_ = 0;
+  bool has_pending_ = false;
+  LiveLatency latency_;
+  double latency_sum_ = 0.0;
+
+  /**
+   * Extend the history, the envelope and the spectra over drained frames
+   * @param num_frames Frames at the start of chunk_
+   */
+  void Consume(const size_t &num_frames);
+
+  /**
+   * Close the bucket being filled and recompute the maximum magnitude
+   */
+  void PushBucket();
+
+  /**
+   * Transform the newest fft_size frames of the first channel
+   */
+  void TransformNewest();
+
+  /**
+   * Copy the newest frames of a channel out of the history, oldest first
+   * @param channel
+   * @param num_frames At most the history size
+   * @param output
+   */
+  void CopyNewest(const size_t &channel, const size_t &num_frames,
+                  float *output) const;
+};
+
+}  // namespace visualmusic
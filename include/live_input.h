@@ -0,0 +1,81 @@
+#pragma once
+
+#include "cinder/audio/audio.h"
+#include "sample_ring.h"
+
+namespace visualmusic {
+
+using namespace ci;
+
+/**
+ * This node hands every block of its input, a microphone or a line-in, to a
+ * sample ring. It runs on the audio thread, so it only copies into the
+ * preallocated ring. The node is pulled by the context, so it does not need
+ * to be connected to the output.
+ */
+class LiveInputNode : public audio::NodeAutoPullable {
+ public:
+  /**
+   * Initialize the node
+   * @param ring Must outlive the node
+   * @param format
+   */
+  explicit LiveInputNode(SampleRing *ring, const Format &format = Format());
+
+ protected:
+  /**
+   * Push the block into the ring, stamped with its arrival time
+   * @param buffer
+   */
+  void process(audio::Buffer *buffer) override;
+
+ private:
+  SampleRing *ring_;
+};
+
+typedef std::shared_ptr<LiveInputNode> LiveInputNodeRef;
+
+/**
+ * This class stands in for a live input in tests and benchmarks. It feeds a
+ * decoded file to a sample ring block by block, as an audio callback would,
+ * with arrival times chosen by the caller.
+ */
+class FileDrivenInput {
+ public:
+  /**
+   * Initialize the input
+   * @param buffer Decoded file, must outlive the input
+   * @param ring Must outlive the input
+   * @param frames_per_block Frames of one audio callback
+   */
+  FileDrivenInput(const audio::Buffer &buffer, SampleRing *ring,
+                  const size_t &frames_per_block = 512);
+
+  /**
+   * Push the next block, like one audio callback. It neither locks nor
+   * allocates.
+   * @param time Arrival time of the block
+   * @return number of frames written to the ring, 0 at the end of the file
+   */
+  auto PushBlock(const int64_t &time) -> size_t;
+
+  /**
+   * Returns the number of frames pushed so far, written or dropped
+   * @return number of frames
+   */
+  auto GetPosition() const -> size_t;
+
+  /**
+   * Returns whether every frame of the file has been pushed
+   * @return true at the end of the file
+   */
+  auto IsFinished() const -> bool;
+
+ private:
+  const audio::Buffer &buffer_;
+  SampleRing *ring_;
+  size_t frames_per_block_;
+  size_t position_ = 0;
+};
+
+}  // namespace visualmusic
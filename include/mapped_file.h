@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace visualmusic {
+
+/**
+ * How a range of a mapping is about to be read
+ */
+enum class MappedAccess {
+  kNormal,      // Default read-ahead
+  kSequential,  // Read ahead further, and pages behind may be dropped early
+  kRandom,      // No read-ahead
+  kWillNeed,    // Read the range in now
+  kDontNeed,    // Drop the range from memory; it is read again when touched
+};
+
+/**
+ * This class maps a whole file into memory, read-only or, for a file it
+ * creates, read-write, and unmaps it when it is closed or destroyed
+ */
+class MappedFile {
+ public:
+  /**
+   * Initialize a closed mapping
+   */
+  MappedFile();
+
+  /**
+   * Unmap the file
+   */
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  auto operator=(const MappedFile &) -> MappedFile & = delete;
+
+  /**
+   * Map a file, closing the previous one
+   * @param path
+   * @return true if the file is mapped
+   */
+  auto Open(const std::string &path) -> bool;
+
+  /**
+   * Create a file of a size and map it read-write, closing the previous one.
+   * Writes through GetMutableData reach the file when the system pages them
+   * out, on Flush, or when the file is closed.
+   * @param path Replaced if it exists
+   * @param size Bytes, positive
+   * @return true if the file is mapped
+   */
+  auto Create(const std::string &path, const size_t &size) -> bool;
+
+  /**
+   * Write the modified pages of a range of a created file to the disk
+   * @param offset
+   * @param length
+   * @return true on success
+   */
+  auto Flush(const size_t &offset, const size_t &length) -> bool;
+
+  /**
+   * Tell the system how a range of the mapping is about to be read. The
+   * range is widened to whole pages. Hints are ignored on Windows.
+   * @param access
+   * @param offset
+   * @param length
+   */
+  void Advise(const MappedAccess &access, const size_t &offset,
+              const size_t &length) const;
+
+  /**
+   * Unmap the file
+   */
+  void Close();
+
+  auto IsOpen() const -> bool {
+    return data_ != nullptr;
+  }
+
+  auto GetData() const -> const char * {
+    return data_;
+  }
+
+  auto GetSize() const -> size_t {
+    return size_;
+  }
+
+  /**
+   * Returns the data of a file mapped by Create
+   * @return data, nullptr for a read-only mapping
+   */
+  auto GetMutableData() -> char * {
+    return writable_ ? const_cast<char *>(data_) : nullptr;
+  }
+
+ private:
+  const char *data_;
+  size_t size_;
+  bool writable_;
+
+#ifdef _WIN32
+  void *file_handle_;
+  void *mapping_handle_;
+#endif
+};
+
+}  // namespace visualmusic
@@ -6,6 +6,14 @@
 #include "cinder/audio/Voice.h"
 #include "cinder/audio/audio.h"
 #include "cinder/gl/gl.h"
+#include "frame_profiler.h"
+#include "geometry_producer.h"
+#include "live_analyzer.h"
+#include "live_input.h"
+#include "playhead.h"
+#include "playlist.h"
+#include "streaming_loader.h"
+#include "text_formatter.h"
 
 namespace visualmusic {
 
@@ -51,26 +59,129 @@ class MusicVisualApp : public App {
    */
   void resize() override;
 
+  /**
+   * Detach the audio nodes, which the audio context keeps alive, from the
+   * playhead, the sample file and the ring before they are destroyed
+   */
+  void cleanup() override;
+
  private:
-  // Node for sample audio playback
-  audio::BufferPlayerNodeRef buffer_player_node_;
-  size_t last_saved_frame_;
+  // Node for sample audio playback, publishing its position to playhead_
+  PlayheadPlayerNodeRef buffer_player_node_;
+  Playhead playhead_;
+  size_t last_saved_frame_ = 0;
+  int64_t last_presentation_time_ = 0;  // Predicted time of the last picture
+  size_t displayed_frame_ = 0;          // Frame of the last picture
+  double audio_visual_offset_ = 0.0;    // Of the last picture, in seconds
+  TextFormatter text_;                  // Line being drawn
 
   // Modify this if necessary
   const float kMargin = 50;
+  const bool kStreamingLoad = true;  // Display the track while it is decoded
+  const bool kLiveInput = false;     // Display the default input device
+  const size_t kLiveRingFrames = 8192;  // Frames queued between two updates
+  const BandScale kBandScale = BandScale::kLog;  // Frequency axis of graphs
+  const size_t kNumBands = 128;
+  const FftBackend kFftBackend = FftBackend::kFixed;  // Spectra of a track
+  const SpectralStorage kSpectralStorage = SpectralStorage::kFloat32;
+  const bool kLazySpectra = false;  // Spectra around the playhead only
+  const bool kSampleFile = false;  // Play and analyze samples mapped from
+                                   // the cache instead of held in memory
+  const bool kGeometryThread = true;  // Build the next picture meanwhile
+  const bool kChannelViews = false;  // Each channel, mid and side on 'c'
+  const char *kCacheDirectory = "visual-music-cache";
+  const char *kTrackAsset = "01 Ballade No. 1 in G Minor, Op. 23.m4a";
+  // Assets played in a loop instead of kTrackAsset, when not empty
+  const std::vector<std::string> kPlaylist = {};
+  const bool kShowFrameTimings = true;  // With VISUALMUSIC_PROFILING
+  const char *kFrameTimingsPath = "frame_timings.csv";  // Written on 'T'
 
   // Visualizer that handle and draw audio buffers
   AudioVisualizer visualizer_;
 
+  // Background decoder of the track (streaming load)
+  StreamingLoader loader_;
+
+  // Tracks of kPlaylist, each analyzed while the one before it plays
+  Playlist playlist_;
+
+  // Builds the geometry of the next picture while draw() submits the last
+  GeometryProducer producer_;
+
+  // Live input: the audio thread fills the ring, the analyzer drains it
+  audio::InputDeviceNodeRef input_device_node_;
+  LiveInputNodeRef live_input_node_;
+  std::unique_ptr<SampleRing> live_ring_;
+  std::unique_ptr<LiveAnalyzer> live_analyzer_;
+
+  /**
+   * Apply the analysis settings to a visualizer
+   * @param visualizer
+   */
+  void ConfigureVisualizer(AudioVisualizer *visualizer) const;
+
+  /**
+   * Returns the visualizer of the current track, of the playlist when one
+   * is played
+   * @return visualizer
+   */
+  auto GetVisualizer() -> AudioVisualizer &;
+
+  /**
+   * Swap in the next track of the playlist at the end of the current one
+   */
+  void UpdatePlaylist();
+
+  /**
+   * Follow the current visualizer with the geometry producer, and request
+   * the picture after the next one
+   */
+  void UpdateGeometry();
+
+  /**
+   * Connect the default input device to the visualizer
+   */
+  void SetupLiveInput();
+
+  /**
+   * Display the info board of the live input, including the latency
+   */
+  void DisplayLiveInfoBoard();
+
   /**
    * Display the info board, including: time, frame, fps, etc
    */
   void DisplayInfoBoard();
 
+  /**
+   * Display the tempo and a beat indicator of the displayed frame
+   * @param y Baseline of the line
+   */
+  void DisplayRhythm(const float &y);
+
+  /**
+   * Format a line of text with the formatter kept by the app, so drawing
+   * the boards allocates nothing once the string has grown
+   * @param format printf format
+   * @return the line, valid until the next call
+   */
+  auto FormatText(const char *format, ...) -> const std::string &;
+
   /**
    * Display Guidance
    */
   void DisplayGuidance();
+
+  /**
+   * Display the p50/p95/p99/max time of each stage of the frame
+   */
+  void DisplayFrameTimings();
+
+  /**
+   * Returns the bounds of the visualizer inside the window
+   * @return bounds
+   */
+  auto GetVisualizerBounds() const -> Rectf;
 };
 
 }  // namespace visualmusic
\ No newline at end of file
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "cinder/audio/audio.h"
+#include "sample_file.h"
+
+namespace visualmusic {
+
+using namespace ci;
+
+/**
+ * This class hands the play position from the audio thread to the render
+ * thread. The audio callback publishes the frame it is about to render with
+ * the time of the callback, and the render thread predicts the frame that
+ * is heard when its picture reaches the screen: it extrapolates the
+ * published frame to the presentation time and subtracts the output
+ * latency. Publishing never waits, and reading only retries while a publish
+ * is in progress.
+ *
+ * Seeks go the other way: the render thread requests a target and the audio
+ * thread takes it at its next callback. Requests made between two callbacks
+ * replace each other, so a drag seeks at most once per audio block, to the
+ * latest target.
+ */
+class Playhead {
+ public:
+  /**
+   * Returns the time of a steady clock, the clock of every stamp
+   * @return nanoseconds
+   */
+  static auto GetTime() -> int64_t;
+
+  /**
+   * Initialize the playhead
+   * @param sample_rate
+   */
+  explicit Playhead(const size_t &sample_rate = 44100);
+
+  /**
+   * Set the rate that frames advance at. Called before playback starts.
+   * @param sample_rate
+   */
+  void SetSampleRate(const size_t &sample_rate);
+
+  /**
+   * Set the time from an audio callback to the moment its first frame is
+   * heard
+   * @param seconds
+   */
+  void SetOutputLatency(const double &seconds);
+
+  /**
+   * Returns the output latency
+   * @return seconds
+   */
+  auto GetOutputLatency() const -> double;
+
+  /**
+   * Set how far past the last publish the prediction may run, so it stops
+   * when the callbacks stop
+   * @param seconds
+   */
+  void SetMaxExtrapolation(const double &seconds);
+
+  /**
+   * Publish the position of an audio callback (audio thread only)
+   * @param frame First frame of the block being rendered
+   * @param time Time of the callback
+   */
+  void Publish(const size_t &frame, const int64_t &time);
+
+  /**
+   * Returns whether a position has been published
+   * @return true after the first Publish
+   */
+  auto HasPublished() const -> bool;
+
+  /**
+   * Returns the frame heard at a time
+   * @param presentation_time Time the picture reaches the screen
+   * @return frame, 0 before the first Publish
+   */
+  auto Predict(const int64_t &presentation_time) const -> size_t;
+
+  /**
+   * Returns how far a displayed frame is ahead of the audio. Measured
+   * against the newest publish, so measuring a picture after it was shown
+   * gives the most accurate offset.
+   * @param displayed_frame
+   * @param presentation_time Time the picture reached the screen
+   * @return seconds, negative when the picture lags the audio
+   */
+  auto MeasureOffset(const size_t &displayed_frame,
+                     const int64_t &presentation_time) const -> double;
+
+  /**
+   * Request a seek, replacing a request the audio thread has not taken yet.
+   * Until it is taken, Predict returns the target.
+   * @param frame
+   */
+  void RequestSeek(const size_t &frame);
+
+  /**
+   * Take the latest seek request and publish its target as the position of
+   * the callback (audio thread only). The request stays pending until the
+   * target is published, so Predict never goes back to the old position.
+   * @param time Time of the callback
+   * @param frame Receives the target
+   * @return false if no seek was requested since the last call
+   */
+  auto TakeSeek(const int64_t &time, size_t *frame) -> bool;
+
+  /**
+   * Returns the seek request the audio thread has not taken yet
+   * @param frame Receives the target
+   * @return false if there is none
+   */
+  auto GetPendingSeek(size_t *frame) const -> bool;
+
+  /**
+   * Returns the number of seeks requested
+   * @return number of requests
+   */
+  auto GetNumRequestedSeeks() const -> size_t;
+
+  /**
+   * Returns the number of seeks taken by the audio thread, at most one per
+   * callback
+   * @return number of seeks
+   */
+  auto GetNumAppliedSeeks() const -> size_t;
+
+ private:
+  // Seek target when no seek is pending
+  static const size_t kNoSeek = static_cast<size_t>(-1);
+
+  size_t sample_rate_;
+  double output_latency_ = 0.0;
+  double max_extrapolation_ = 0.1;
+
+  // Sequence lock: odd while a publish is in progress
+  std::atomic<uint64_t> sequence_;
+  std::atomic<size_t> frame_;
+  std::atomic<int64_t> time_;
+
+  std::atomic<size_t> seek_target_;  // kNoSeek when none is pending
+  std::atomic<size_t> num_requested_seeks_;
+  std::atomic<size_t> num_applied_seeks_;
+
+  /**
+   * Read a consistent pair of the last publish
+   * @param frame
+   * @param time
+   * @return false before the first Publish
+   */
+  auto Read(size_t *frame, int64_t *time) const -> bool;
+
+  /**
+   * Returns the fractional frame heard at a time
+   * @param presentation_time
+   * @return frame
+   */
+  auto PredictExact(const int64_t &presentation_time) const -> double;
+};
+
+/**
+ * This player applies the latest seek requested on a playhead and publishes
+ * its read position to it at every audio callback. It plays a buffer, or the
+ * samples of a track mapped from a sample file, which are then paged in one
+ * block at a time instead of held in memory.
+ */
+class PlayheadPlayerNode : public audio::BufferPlayerNode {
+ public:
+  /**
+   * Initialize the node
+   * @param playhead Must outlive the node, or the node must be disabled and
+   * disconnected before it is destroyed, since the audio context shares the
+   * ownership of the node
+   * @param format
+   */
+  explicit PlayheadPlayerNode(Playhead *playhead,
+                              const Format &format = Format());
+
+  /**
+   * Play the samples of a sample file instead of the buffer, from its first
+   * frame. A file with fewer channels than the node plays its last channel
+   * on the others. Waits for the block being rendered, like setBuffer.
+   * @param samples Open file that must stay open until replaced, nullptr to
+   * play the buffer again
+   */
+  void SetSamples(const SampleFile *samples);
+
+  /**
+   * Returns whether a buffer or a sample file is set
+   * @return true if there is a track to play
+   */
+  auto HasTrack() const -> bool;
+
+ protected:
+  /**
+   * Seek if requested, publish the position, then render the block
+   * @param buffer
+   */
+  void process(audio::Buffer *buffer) override;
+
+ private:
+  Playhead *playhead_;
+  const SampleFile *samples_ = nullptr;  // Guarded by the context mutex
+
+  /**
+   * Render a block of the sample file and advance the read position
+   * @param buffer
+   */
+  void ProcessSamples(audio::Buffer *buffer);
+};
+
+typedef std::shared_ptr<PlayheadPlayerNode> PlayheadPlayerNodeRef;
+
+}  // namespace visualmusic
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio_visualizer.h"
+#include "cinder/audio/audio.h"
+
+namespace visualmusic {
+
+using namespace ci;
+
+/**
+ * This class plays a list of tracks in a loop with two visualizers: the
+ * current one is displayed while a background thread decodes and analyzes the
+ * next track into the standby one. At the end of a track the two are swapped,
+ * which only exchanges pointers, and the old visualizer is reused for the
+ * track after. At most two tracks are decoded and analyzed at any time.
+ */
+class Playlist {
+ public:
+  // Decodes a track at the sample rate of the output, or returns nullptr
+  typedef std::function<audio::BufferRef(const std::string &)> Decoder;
+
+  // Applies the settings of the app to a new visualizer
+  typedef std::function<void(AudioVisualizer *)> Configurer;
+
+  /**
+   * Initialize an empty playlist
+   */
+  Playlist();
+
+  /**
+   * Wait for the background analysis
+   */
+  ~Playlist();
+
+  Playlist(const Playlist &) = delete;
+  auto operator=(const Playlist &) -> Playlist & = delete;
+
+  /**
+   * Start analyzing the first track. It becomes current at the first
+   * Advance once analyzed.
+   * @param tracks Names passed to the decoder
+   * @param decoder Called on the background thread
+   * @param configure Called once for each of the two visualizers
+   * @param bounds
+   * @param sample_rate
+   */
+  void Start(const std::vector<std::string> &tracks, const Decoder &decoder,
+             const Configurer &configure, const Rectf &bounds,
+             const size_t &sample_rate);
+
+  /**
+   * Wait for the analysis of the standby track to finish
+   */
+  void WaitForStandby();
+
+  /**
+   * Make the standby track current if it is analyzed, and start analyzing
+   * the one after it. A track that cannot be decoded is skipped, and the one
+   * after it is analyzed instead. Called on the display thread at the end of
+   * the current track.
+   * @return true if the current track changed
+   */
+  auto Advance() -> bool;
+
+  /**
+   * Resize the current visualizer, and the standby one when it is swapped in
+   * @param bounds
+   */
+  void Resize(const Rectf &bounds);
+
+  /**
+   * Returns the visualizer of the current track
+   * @return visualizer, nullptr before the first track is analyzed
+   */
+  auto GetVisualizer() const -> AudioVisualizer *;
+
+  /**
+   * Returns the decoded current track
+   * @return buffer, nullptr before the first track is analyzed
+   */
+  auto GetBuffer() const -> audio::BufferRef;
+
+  /**
+   * Returns the position of the current track in the list
+   * @return index
+   */
+  auto GetCurrentIndex() const -> size_t;
+
+  /**
+   * Returns the number of tracks
+   * @return number of tracks
+   */
+  auto GetNumTracks() const -> size_t;
+
+  /**
+   * Returns whether the standby track is analyzed and can be swapped in
+   * @return true if ready
+   */
+  auto IsStandbyReady() const -> bool;
+
+ private:
+  // Progress of the standby track
+  enum class StandbyState { kEmpty, kAnalyzing, kReady, kFailed };
+
+  std::vector<std::string> tracks_;
+  Decoder decoder_;
+  size_t sample_rate_ = 0;
+  Rectf bounds_;
+
+  std::unique_ptr<AudioVisualizer> current_;
+  audio::BufferRef current_buffer_;
+  size_t current_index_ = 0;
+  bool has_current_ = false;
+
+  // Written by the background thread until standby_state_ leaves kAnalyzing
+  std::unique_ptr<AudioVisualizer> standby_;
+  audio::BufferRef standby_buffer_;
+  size_t standby_index_ = 0;
+  Rectf standby_bounds_;
+  bool standby_resized_ = false;  // Resized since the analysis started
+  std::atomic<StandbyState> standby_state_;
+  std::thread worker_;
+
+  /**
+   * Start analyzing a track into the standby visualizer
+   * @param index
+   */
+  void Prepare(const size_t &index);
+
+  /**
+   * Decode and analyze the standby track (background thread)
+   */
+  void Analyze();
+};
+
+}  // namespace visualmusic
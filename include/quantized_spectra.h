@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace visualmusic {
+
+/**
+ * Formats magnitude spectra can be kept in
+ */
+enum class SpectralStorage {
+  kFloat32,   // Floats in a SpectralArena, exact
+  kFloat16,   // Half floats, half the memory
+  kDecibel8,  // One byte per magnitude on a decibel scale, a quarter
+};
+
+/**
+ * This class keeps magnitude rows in one contiguous block of 8 or 16 bit
+ * codes, and decodes a row into floats when it is drawn.
+ *
+ * With SpectralStorage::kDecibel8, code 0 is silence and codes 1 to 255 cover
+ * kDecibelRange decibels below a reference magnitude in equal steps, so the
+ * relative error is the same at every level. With SpectralStorage::kFloat16,
+ * magnitudes are rounded to the nearest half float.
+ */
+class QuantizedSpectra {
+ public:
+  // Decibels covered by the codes of SpectralStorage::kDecibel8
+  static const float kDecibelRange;
+
+  /**
+   * Initialize an empty store
+   */
+  QuantizedSpectra();
+
+  /**
+   * Resize the store. Contents are unspecified afterwards.
+   * @param num_rows
+   * @param row_size Number of magnitudes per row
+   * @param storage SpectralStorage::kFloat16 or SpectralStorage::kDecibel8
+   * @param reference Largest magnitude kept exactly by
+   * SpectralStorage::kDecibel8, larger ones are clamped to it
+   */
+  void Reset(const size_t &num_rows, const size_t &row_size,
+             const SpectralStorage &storage, const float &reference);
+
+  /**
+   * Free the memory of the store
+   */
+  void Release();
+
+  /**
+   * Quantize the magnitudes of a row
+   * @param index
+   * @param magnitudes GetRowSize() non-negative values
+   */
+  void Encode(const size_t &index, const float *magnitudes);
+
+  /**
+   * Decode the magnitudes of a row
+   * @param index
+   * @param magnitudes Receives GetRowSize() values
+   */
+  void Decode(const size_t &index, float *magnitudes) const;
+
+  /**
+   * Decode magnitudes [first, first + count) of a row
+   * @param index
+   * @param first
+   * @param count
+   * @param magnitudes Receives count values
+   */
+  void DecodeRange(const size_t &index, const size_t &first,
+                   const size_t &count, float *magnitudes) const;
+
+  auto GetStorage() const -> SpectralStorage {
+    return storage_;
+  }
+
+  auto GetNumRows() const -> size_t {
+    return num_rows_;
+  }
+
+  auto GetRowSize() const -> size_t {
+    return row_size_;
+  }
+
+  /**
+   * Returns the largest error of a decoded magnitude relative to the
+   * magnitude, for magnitudes from GetFloor() to the reference
+   * @return relative error
+   */
+  auto GetMaxRelativeError() const -> float;
+
+  /**
+   * Returns the magnitude below which a value may decode to 0. Errors below it
+   * are at most the floor itself.
+   * @return floor
+   */
+  auto GetFloor() const -> float;
+
+  /**
+   * Returns the number of bytes held by the store
+   * @return capacity in bytes
+   */
+  auto GetCapacityBytes() const -> size_t;
+
+  /**
+   * Round a non-negative float to the nearest half float, clamping values
+   * above the largest one
+   * @param value
+   * @return bits of the half float
+   */
+  static auto EncodeHalf(const float &value) -> uint16_t;
+
+  /**
+   * Convert a finite half float to a float
+   * @param half
+   * @return value
+   */
+  static auto DecodeHalf(const uint16_t &half) -> float;
+
+ private:
+  SpectralStorage storage_;
+  size_t num_rows_;
+  size_t row_size_;
+  std::vector<uint8_t> decibel_codes_;  // With SpectralStorage::kDecibel8
+  std::vector<uint16_t> half_codes_;    // With SpectralStorage::kFloat16
+
+  // Decibel scale: code c decodes to decibel_table_[c]
+  float reference_;
+  float decibels_per_code_;
+  std::vector<float> decibel_table_;
+
+  /**
+   * Returns the decibel code of a magnitude
+   * @param magnitude
+   * @return code
+   */
+  auto EncodeDecibel(const float &magnitude) const -> uint8_t;
+};
+
+}  // namespace visualmusic
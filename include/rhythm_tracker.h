@@ -0,0 +1,221 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace visualmusic {
+
+/**
+ * Settings of the onset, tempo and beat tracking
+ */
+struct RhythmSettings {
+  float min_tempo = 60.0f;        // Beats per minute
+  float max_tempo = 200.0f;       // Beats per minute
+  float prior_tempo = 120.0f;     // Favored over its octaves
+  float onset_threshold = 0.02f;  // Flux above 1.5 times its local mean
+  float tempo_half_life = 4.0f;   // Seconds the tempo remembers
+};
+
+/**
+ * Rhythm of one spectral frame
+ */
+struct RhythmFrame {
+  float onset_strength = 0.0f;  // Spectral flux, in log2 magnitude per bin
+  float tempo = 0.0f;           // Beats per minute, 0 until estimated
+  float beat_phase = 0.0f;      // Fraction of a beat since the last one
+  size_t last_beat = static_cast<size_t>(-1);  // Frame of the last beat
+  bool onset = false;
+  bool beat = false;
+};
+
+/**
+ * This class detects onsets and tracks the tempo and beats of a stream of
+ * spectral frames, as they are produced by the spectral analysis. Each
+ * frame costs O(bins): its spectral flux against the previous frame is
+ * picked as an onset when it peaks above its local mean, the flux above
+ * that mean feeds a decaying autocorrelation over the lags of the tempo
+ * range, and beats are placed on the strongest flux near one period after
+ * the last beat.
+ *
+ * A frame is final once the frames it looks ahead at are added, at most
+ * GetLookahead() later, or when Finish is called. Final frames form a
+ * timeline that one thread can read while another adds frames. A tracker
+ * with a smaller capacity than its stream keeps the newest frames only.
+ */
+class RhythmTracker {
+ public:
+  // Last beat of a frame before the first beat
+  static const size_t kNoBeat = static_cast<size_t>(-1);
+
+  /**
+   * Initialize an empty tracker
+   */
+  RhythmTracker();
+
+  RhythmTracker(const RhythmTracker &) = delete;
+  auto operator=(const RhythmTracker &) -> RhythmTracker & = delete;
+
+  /**
+   * Allocate the tracker for a stream of spectra and forget the previous one
+   * @param num_bins Magnitudes per frame
+   * @param hop_size Samples between two frames
+   * @param sample_rate
+   * @param capacity Final frames kept readable, the whole stream if known
+   * @param settings
+   */
+  void Reset(const size_t &num_bins, const size_t &hop_size,
+             const size_t &sample_rate, const size_t &capacity,
+             const RhythmSettings &settings = RhythmSettings());
+
+  /**
+   * Free the timeline
+   */
+  void Release();
+
+  /**
+   * Add the next spectral frame
+   * @param magnitudes num_bins magnitudes
+   */
+  void AddFrame(const float *magnitudes);
+
+  /**
+   * Add the next frames of the stream
+   * @param rows
+   * @param row_stride Distance between two rows
+   * @param num_rows
+   */
+  void AddFrames(const float *rows, const size_t &row_stride,
+                 const size_t &num_rows);
+
+  /**
+   * Mark the end of the stream, making every added frame final
+   */
+  void Finish();
+
+  /**
+   * Returns the number of final frames
+   * @return number of frames since the start of the stream
+   */
+  auto GetNumFrames() const -> size_t;
+
+  /**
+   * Returns the oldest final frame kept
+   * @return frame index
+   */
+  auto GetFirstFrame() const -> size_t;
+
+  /**
+   * Returns the rhythm of a final frame
+   * @param index Frame since the start of the stream
+   * @param frame Receives the rhythm
+   * @return false if the frame is not final yet or no longer kept
+   */
+  auto GetFrame(const size_t &index, RhythmFrame *frame) const -> bool;
+
+  /**
+   * Returns the number of frames added past the newest final frame, before
+   * Finish, at most
+   * @return number of frames
+   */
+  auto GetLookahead() const -> size_t;
+
+  /**
+   * Returns the duration of a frame
+   * @return seconds
+   */
+  auto GetFrameSeconds() const -> float;
+
+  /**
+   * Returns the bytes held by the timeline and the tracking state
+   * @return capacity in bytes
+   */
+  auto GetCapacityBytes() const -> size_t;
+
+ private:
+  RhythmSettings settings_;
+  size_t num_bins_ = 0;
+  float frame_seconds_ = 0.0f;
+
+  // Lags of the tempo range in frames, and the window sizes derived from
+  // the frame duration
+  size_t min_lag_ = 0;
+  size_t max_lag_ = 0;
+  size_t peak_radius_ = 0;  // Frames an onset must dominate on each side
+  size_t mean_frames_ = 0;  // Frames before an onset its mean covers
+  size_t beat_lookahead_ = 0;
+
+  // Compressed magnitudes of the previous frame
+  std::vector<float> previous_;
+
+  // Flux and flux above its local mean of the recent frames, a power of 2
+  std::vector<float> flux_;
+  std::vector<float> excess_;
+  size_t history_mask_ = 0;
+  double flux_sum_ = 0.0;  // Over the frames of the local mean
+
+  // Decaying autocorrelation of the excess flux, weighted by the prior
+  std::vector<float> autocorrelation_;
+  std::vector<float> tempo_prior_;
+  float decay_ = 1.0f;
+  float period_ = 0.0f;  // Frames per beat, 0 until estimated
+
+  // Beat tracking
+  bool tracking_ = false;
+  size_t last_beat_ = kNoBeat;
+  float next_beat_ = 0.0f;
+  size_t num_missed_beats_ = 0;
+
+  // Timeline, a ring of the kept frames and the frames not final yet
+  std::vector<RhythmFrame> frames_;
+  size_t capacity_ = 0;
+  size_t num_added_ = 0;     // Frames added by the caller
+  size_t num_pushed_ = 0;    // Frames through the flux history
+  size_t last_final_beat_ = kNoBeat;
+  std::atomic<size_t> num_final_;
+
+  /**
+   * Push the flux of the next frame, deciding the onset of the frame
+   * peak_radius_ before it and finalizing the frame GetLookahead() before
+   * @param flux
+   */
+  void PushFlux(const float &flux);
+
+  /**
+   * Decide the onset of a frame, update the tempo and track the beats
+   * @param index
+   */
+  void DecideFrame(const size_t &index);
+
+  /**
+   * Re-estimate the beat period from the autocorrelation
+   */
+  void EstimatePeriod();
+
+  /**
+   * Place the next beat once its window is decided
+   * @param index Newest decided frame
+   */
+  void TrackBeats(const size_t &index);
+
+  /**
+   * Mark a frame as a beat
+   * @param index
+   */
+  void MarkBeat(const size_t &index);
+
+  /**
+   * Make a frame final and publish it
+   * @param index
+   */
+  void FinalizeFrame(const size_t &index);
+
+  /**
+   * Returns the timeline slot of a frame
+   * @param index
+   * @return frame
+   */
+  auto Slot(const size_t &index) -> RhythmFrame &;
+};
+
+}  // namespace visualmusic
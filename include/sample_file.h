@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "cinder/audio/audio.h"
+#include "mapped_file.h"
+
+namespace visualmusic {
+
+using namespace ci;
+
+/**
+ * This class keeps the decoded samples of a track in a memory-mapped file,
+ * one plane of floats per channel, so that only the pages being read are
+ * resident. A track is decoded into a file once, a chunk at a time, and
+ * mapped again by later runs. A file is only opened once Finish has marked
+ * every sample as written.
+ */
+class SampleFile {
+ public:
+  // Increase whenever the file layout changes
+  static const uint32_t kVersion = 2;
+
+  /**
+   * Initialize a closed file
+   */
+  SampleFile();
+
+  SampleFile(const SampleFile &) = delete;
+  auto operator=(const SampleFile &) -> SampleFile & = delete;
+
+  /**
+   * Returns the name of the sample file of a source decoded at a rate
+   * @param source Asset or path the track is decoded from
+   * @param sample_rate
+   * @return file name
+   */
+  static auto GetFileName(const std::string &source,
+                          const size_t &sample_rate) -> std::string;
+
+  /**
+   * Returns a stamp of the size and modification time of a source file, so
+   * that a file decoded from an older version of the source is not mapped
+   * @param path Path of the source on the disk
+   * @return stamp, 0 if the source cannot be read
+   */
+  static auto GetSourceStamp(const std::string &path) -> uint64_t;
+
+  /**
+   * Create a file for a track and map it read-write, closing the previous
+   * one. The samples are zero until written.
+   * @param path Replaced if it exists
+   * @param num_frames
+   * @param num_channels Must be positive
+   * @param sample_rate
+   * @param source_stamp Stamp of the source, checked by Open
+   * @return true if the file is mapped
+   */
+  auto Create(const std::string &path, const size_t &num_frames,
+              const size_t &num_channels, const size_t &sample_rate,
+              const uint64_t &source_stamp = 0) -> bool;
+
+  /**
+   * Write decoded frames into a created file
+   * @param chunk Planar frames, with the channels of the file
+   * @param first_frame Frame of the track of the first frame of the chunk
+   * @param num_frames Frames of the chunk to write
+   */
+  void Write(const audio::Buffer &chunk, const size_t &first_frame,
+             const size_t &num_frames);
+
+  /**
+   * Write every sample to the disk and mark the file as complete
+   * @return true on success
+   */
+  auto Finish() -> bool;
+
+  /**
+   * Map a complete file read-only. Files of another version, truncated
+   * files, files that were never finished and files decoded from another
+   * version of the source are rejected.
+   * @param path
+   * @param source_stamp Stamp the file was created with
+   * @return true if the file is valid and mapped
+   */
+  auto Open(const std::string &path, const uint64_t &source_stamp = 0)
+      -> bool;
+
+  /**
+   * Unmap the file
+   */
+  void Close();
+
+  auto IsOpen() const -> bool {
+    return file_.IsOpen();
+  }
+
+  auto GetNumFrames() const -> size_t {
+    return num_frames_;
+  }
+
+  auto GetNumChannels() const -> size_t {
+    return num_channels_;
+  }
+
+  auto GetSampleRate() const -> size_t {
+    return sample_rate_;
+  }
+
+  /**
+   * Returns the mapped samples of a channel
+   * @param channel
+   * @return num_frames samples
+   */
+  auto GetChannel(const size_t &channel) const -> const float *;
+
+  /**
+   * Returns the size of the mapped file, which the system pages in and out
+   * on its own
+   * @return size in bytes, 0 when closed
+   */
+  auto GetMappedBytes() const -> size_t {
+    return file_.GetSize();
+  }
+
+  /**
+   * Tell the system how frames [first_frame, last_frame) of every channel
+   * are about to be read
+   * @param access
+   * @param first_frame
+   * @param last_frame
+   */
+  void Advise(const MappedAccess &access, const size_t &first_frame,
+              const size_t &last_frame) const;
+
+ private:
+  MappedFile file_;
+  size_t num_frames_ = 0;
+  size_t num_channels_ = 0;
+  size_t sample_rate_ = 0;
+  size_t data_offset_ = 0;    // Bytes before the first plane
+  size_t plane_stride_ = 0;   // Bytes between two planes, whole pages
+};
+
+}  // namespace visualmusic
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "cinder/audio/audio.h"
+
+namespace visualmusic {
+
+using namespace ci;
+
+/**
+ * This class is a single-producer/single-consumer lock-free ring of planar
+ * samples. The producer is the audio thread: Write neither locks nor
+ * allocates, and drops the frames that do not fit instead of waiting. The
+ * consumer is the display thread. Each write is stamped with the time its
+ * samples arrived, so the consumer can measure how long they waited.
+ */
+class SampleRing {
+ public:
+  /**
+   * Returns the time of a steady clock, the clock of the write stamps
+   * @return nanoseconds
+   */
+  static auto GetTime() -> int64_t;
+
+  /**
+   * Initialize the ring. Every sample is allocated here.
+   * @param num_channels
+   * @param min_capacity Frames the ring can hold, rounded up to a power of 2
+   */
+  SampleRing(const size_t &num_channels, const size_t &min_capacity);
+
+  SampleRing(const SampleRing &) = delete;
+  auto operator=(const SampleRing &) -> SampleRing & = delete;
+
+  /**
+   * Append frames of planar channels (producer side). Ring channels beyond
+   * the source channels repeat the last source channel.
+   * @param data First sample of the first channel
+   * @param num_channels Number of source channels, must be positive
+   * @param channel_stride Distance between two source channels
+   * @param num_frames
+   * @param time Arrival time of the frames
+   * @return number of frames written, the rest are dropped
+   */
+  auto Write(const float *data, const size_t &num_channels,
+             const size_t &channel_stride, const size_t &num_frames,
+             const int64_t &time) -> size_t;
+
+  /**
+   * Append a whole buffer (producer side)
+   * @param buffer
+   * @param time Arrival time of the frames
+   * @return number of frames written, the rest are dropped
+   */
+  auto Write(const audio::Buffer &buffer, const int64_t &time) -> size_t;
+
+  /**
+   * Remove the oldest frames into planar channels (consumer side)
+   * @param data Receives num_channels ranges of channel_stride floats
+   * @param channel_stride Distance between two output channels
+   * @param num_frames At most channel_stride
+   * @return number of frames read
+   */
+  auto Read(float *data, const size_t &channel_stride,
+            const size_t &num_frames) -> size_t;
+
+  /**
+   * Returns the number of frames waiting to be read (consumer side)
+   * @return number of frames
+   */
+  auto GetReadableFrames() const -> size_t;
+
+  /**
+   * Returns the arrival time of the last write. It is read before the
+   * frames, so it is never newer than the frames that follow it.
+   * @return nanoseconds of GetTime()
+   */
+  auto GetLastWriteTime() const -> int64_t;
+
+  /**
+   * Returns the number of frames dropped because the ring was full
+   * @return number of frames
+   */
+  auto GetDroppedFrames() const -> size_t;
+
+  /**
+   * Returns the number of frames the ring can hold
+   * @return number of frames
+   */
+  auto GetCapacity() const -> size_t;
+
+  /**
+   * Returns the number of channels
+   * @return number of channels
+   */
+  auto GetNumChannels() const -> size_t;
+
+ private:
+  size_t num_channels_;
+  size_t capacity_;
+  size_t mask_;
+  std::unique_ptr<float[]> data_;  // Planar, capacity_ floats per channel
+
+  // Frame counters that only grow, owned by the producer and the consumer.
+  // The padding keeps them on separate cache lines.
+  std::atomic<size_t> write_index_;
+  char producer_padding_[64];
+  std::atomic<size_t> read_index_;
+  char consumer_padding_[64];
+
+  std::atomic<int64_t> last_write_time_;
+  std::atomic<size_t> dropped_frames_;
+};
+
+}  // namespace visualmusic
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace visualmusic {
+
+namespace simd {
+
+/**
+ * Instruction sets a kernel can run on. kScalar is always available.
+ */
+enum class InstructionSet { kScalar, kSse2, kAvx2, kNeon };
+
+/**
+ * Affine mapping from sample values to screen points. Point i of a mapped
+ * range is (x_origin + i * x_step, y_origin + value * y_scale).
+ */
+struct ScreenMapping {
+  float x_origin = 0.0f;
+  float x_step = 1.0f;
+  float y_origin = 0.0f;
+  float y_scale = 1.0f;
+};
+
+/**
+ * Returns whether the processor and the build support an instruction set
+ * @param set
+ * @return true if kernels can run on it
+ */
+auto IsSupported(const InstructionSet &set) -> bool;
+
+/**
+ * Returns every supported instruction set, kScalar first
+ * @return instruction sets
+ */
+auto GetSupportedInstructionSets() -> std::vector<InstructionSet>;
+
+/**
+ * Returns the instruction set the kernels dispatch to. It defaults to the
+ * widest supported one.
+ * @return instruction set
+ */
+auto GetInstructionSet() -> InstructionSet;
+
+/**
+ * Dispatch the kernels to an instruction set, for tests and benchmarks
+ * @param set Must be supported
+ */
+void SetInstructionSet(const InstructionSet &set);
+
+/**
+ * Returns the largest absolute value of a range
+ * @param data
+ * @param size
+ * @return max magnitude, 0 for an empty range
+ */
+auto AbsMax(const float *data, const size_t &size) -> float;
+
+/**
+ * Sum channels sample by sample and scale the sum
+ * @param channels Pointers to num_channels ranges of size samples
+ * @param num_channels Must be positive
+ * @param size
+ * @param scale Applied to the sum, 1 / num_channels for an average
+ * @param output Receives size samples, may alias channels[0]
+ */
+void MixDown(const float *const *channels, const size_t &num_channels,
+             const size_t &size, const float &scale, float *output);
+
+/**
+ * Find the minimum and maximum of one bucket
+ * @param data
+ * @param size Must be positive
+ * @param min
+ * @param max
+ */
+void MinMax(const float *data, const size_t &size, float *min, float *max);
+
+/**
+ * Find the minimum and maximum of consecutive buckets in one call. Bucket i
+ * covers [i * size / num_buckets, (i + 1) * size / num_buckets).
+ * @param data
+ * @param size Must be at least num_buckets
+ * @param num_buckets
+ * @param mins Receives num_buckets minimums
+ * @param maxs Receives num_buckets maximums
+ */
+void MinMaxPerBucket(const float *data, const size_t &size,
+                     const size_t &num_buckets, float *mins, float *maxs);
+
+/**
+ * Find the minimum, maximum and sum of squares of one bucket
+ * @param data
+ * @param size Must be positive
+ * @param min
+ * @param max
+ * @param sum_squares
+ */
+void MinMaxSumSquares(const float *data, const size_t &size, float *min,
+                      float *max, float *sum_squares);
+
+/**
+ * Map samples to interleaved x, y screen coordinates
+ * @param data
+ * @param size
+ * @param mapping
+ * @param points Receives 2 * size floats
+ */
+void MapToScreen(const float *data, const size_t &size,
+                 const ScreenMapping &mapping, float *points);
+
+/**
+ * Returns the sum of the products of two ranges
+ * @param a
+ * @param b
+ * @param size
+ * @return sum, 0 for empty ranges
+ */
+auto DotProduct(const float *a, const float *b, const size_t &size) -> float;
+
+}  // namespace simd
+
+}  // namespace visualmusic
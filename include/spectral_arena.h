@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+namespace visualmusic {
+
+/**
+ * This class owns a contiguous, cache-aligned block of float rows. Every row
+ * starts on a cache line. Resetting to a size that fits the current capacity
+ * reuses the memory, so reloading the same track does not allocate.
+ */
+class SpectralArena {
+ public:
+  // Alignment of the block and of every row, in bytes
+  static const size_t kAlignment = 64;
+
+  /**
+   * Initialize an empty arena
+   */
+  SpectralArena();
+
+  SpectralArena(const SpectralArena &) = delete;
+  auto operator=(const SpectralArena &) -> SpectralArena & = delete;
+
+  /**
+   * Resize the arena, keeping the allocation when it is large enough.
+   * Contents are unspecified afterwards.
+   * @param num_rows
+   * @param row_size Number of floats used per row
+   */
+  void Reset(const size_t &num_rows, const size_t &row_size);
+
+  /**
+   * Free the memory of the arena
+   */
+  void Release();
+
+  /**
+   * Returns the first float of a row
+   * @param index
+   * @return pointer to the row
+   */
+  auto Row(const size_t &index) -> float * {
+    return data_ + index * row_stride_;
+  }
+
+  auto Row(const size_t &index) const -> const float * {
+    return data_ + index * row_stride_;
+  }
+
+  auto GetNumRows() const -> size_t {
+    return num_rows_;
+  }
+
+  auto GetRowSize() const -> size_t {
+    return row_size_;
+  }
+
+  /**
+   * Returns the distance between two rows in floats (row size rounded up to a
+   * cache line)
+   * @return row stride
+   */
+  auto GetRowStride() const -> size_t {
+    return row_stride_;
+  }
+
+  /**
+   * Returns the number of bytes held by the arena
+   * @return capacity in bytes
+   */
+  auto GetCapacityBytes() const -> size_t {
+    return capacity_ * sizeof(float);
+  }
+
+ private:
+  std::unique_ptr<char[]> storage_;  // Unaligned allocation
+  float *data_;                      // Aligned start inside storage_
+  size_t capacity_;                  // Number of floats available at data_
+  size_t num_rows_;
+  size_t row_size_;
+  size_t row_stride_;
+};
+
+}  // namespace visualmusic
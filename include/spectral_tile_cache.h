@@ -0,0 +1,227 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "band_mapper.h"
+#include "spectral_arena.h"
+#include "stft_engine.h"
+
+namespace visualmusic {
+
+/**
+ * Settings of a lazily computed spectrogram
+ */
+struct TileSettings {
+  size_t frames_per_tile = 64;  // Spectral frames computed together
+  size_t max_tiles = 16;        // Tiles kept in memory
+  size_t prefetch_tiles = 4;    // Tiles computed ahead of the playhead
+};
+
+/**
+ * This class computes the spectrogram of a track in tiles of consecutive
+ * frames, only when they are needed. A background worker computes the tiles
+ * requested by Prefetch, nearest to the playhead first, and the display reads
+ * the ones that are ready without ever waiting. At most max_tiles tiles are
+ * kept; the least recently used one is reused for the next.
+ */
+class SpectralTileCache {
+ public:
+  /**
+   * Initialize an empty cache
+   */
+  SpectralTileCache();
+
+  /**
+   * Stop the worker
+   */
+  ~SpectralTileCache();
+
+  SpectralTileCache(const SpectralTileCache &) = delete;
+  auto operator=(const SpectralTileCache &) -> SpectralTileCache & = delete;
+
+  /**
+   * Start computing the tiles of a channel on demand
+   * @param engine Must outlive the cache or the next Stop
+   * @param bands Configured mapper to reduce the tiles to bands, or nullptr.
+   * Must outlive the cache or the next Stop.
+   * @param channel Must outlive the cache or the next Stop
+   * @param num_samples
+   * @param settings
+   */
+  void Start(const StftEngine *engine, const BandMapper *bands,
+             const float *channel, const size_t &num_samples,
+             const TileSettings &settings);
+
+  /**
+   * Stop the worker and free every tile
+   */
+  void Stop();
+
+  /**
+   * Returns whether the cache is started
+   * @return true between Start and Stop
+   */
+  auto IsActive() const -> bool;
+
+  /**
+   * Request the tiles around a spectral frame, replacing the previous
+   * requests. The tile of the frame comes first, then the tiles of the
+   * history drawn behind it, then prefetch_tiles tiles in the direction of
+   * play. Requests beyond max_tiles are dropped.
+   * @param index Spectral frame at the playhead
+   * @param direction 1 when playing forward, -1 when scrubbing backward
+   * @param history Frames before index that are drawn with it
+   */
+  void Prefetch(const size_t &index, const int &direction,
+                const size_t &history);
+
+  /**
+   * Copy the magnitudes of a spectral frame if its tile is computed
+   * @param index
+   * @param bands true for the bands of the frame
+   * @param magnitudes Receives the bins or the bands of the frame
+   * @param wait Compute the tile first instead of failing, before the
+   * requests of Prefetch. The display never waits.
+   * @return false if the tile is not computed yet
+   */
+  auto ReadRow(const size_t &index, const bool &bands, float *magnitudes,
+               const bool &wait) -> bool;
+
+  /**
+   * Wait until every requested tile is computed
+   */
+  void WaitIdle() const;
+
+  /**
+   * Returns whether the tile holding a spectral frame is computed
+   * @param index
+   * @return true if resident
+   */
+  auto IsResident(const size_t &index) const -> bool;
+
+  /**
+   * Returns the number of tiles in memory
+   * @return number of tiles
+   */
+  auto GetNumResidentTiles() const -> size_t;
+
+  /**
+   * Returns the number of tiles computed since Start, a tile computed again
+   * after its eviction counting twice
+   * @return number of tiles
+   */
+  auto GetNumComputedTiles() const -> size_t;
+
+  /**
+   * Returns the largest magnitude of the tiles computed so far
+   * @return max magnitude
+   */
+  auto GetMaxMagnitude() const -> float;
+
+  /**
+   * Returns the largest band of the tiles computed so far
+   * @return max magnitude
+   */
+  auto GetMaxBandMagnitude() const -> float;
+
+  /**
+   * Returns the number of bytes held by the tiles
+   * @param bands true for the bytes of the bands, false for the spectra
+   * @return capacity in bytes
+   */
+  auto GetCapacityBytes(const bool &bands) const -> size_t;
+
+ private:
+  // Slot of a tile that is not in memory
+  static const size_t kNoSlot = static_cast<size_t>(-1);
+
+  /**
+   * Spectra and bands of one tile
+   */
+  struct Tile {
+    size_t tile = kNoSlot;  // Index of the tile held, kNoSlot when free
+    uint64_t last_use = 0;  // Value of use_clock_ at the last use
+    SpectralArena spectra;
+    SpectralArena bands;
+  };
+
+  const StftEngine *engine_ = nullptr;
+  const BandMapper *bands_ = nullptr;
+  const float *channel_ = nullptr;
+  size_t num_samples_ = 0;
+  size_t num_frames_ = 0;
+  size_t num_tiles_ = 0;
+  TileSettings settings_;
+
+  // Guards everything below, the worker only computes outside of it
+  mutable std::mutex mutex_;
+  std::condition_variable requested_;  // Requests or Stop
+  mutable std::condition_variable computed_;  // A tile is in memory or the
+                                              // worker is idle
+  std::vector<std::unique_ptr<Tile>> slots_;
+  std::vector<size_t> slot_of_tile_;  // kNoSlot when not in memory
+  std::vector<size_t> requests_;      // Tiles, most urgent first
+  std::vector<size_t> waiting_;       // Tile of each waiting reader, which
+                                      // Prefetch leaves alone
+  std::vector<size_t> order_;         // Tiles Prefetch wants, reused
+  uint64_t use_clock_ = 0;
+  size_t num_computed_tiles_ = 0;
+  bool busy_ = false;
+  bool stopping_ = false;
+
+  std::atomic<float> max_magnitude_;
+  std::atomic<float> max_band_magnitude_;
+  std::thread worker_;
+
+  /**
+   * Compute requested tiles until Stop (worker thread)
+   */
+  void Run();
+
+  /**
+   * Returns a waited tile that is not in memory. Called with the mutex held.
+   * @param tile Receives the tile
+   * @return false if every waited tile is in memory
+   */
+  auto FindWaitedTile(size_t *tile) const -> bool;
+
+  /**
+   * Returns whether a slot can be taken without evicting the tile of a
+   * waiting reader. Called with the mutex held.
+   * @return true if such a slot exists
+   */
+  auto HasFreeSlot() const -> bool;
+
+  /**
+   * Take the next tile to compute: the tile of a waiting reader first, then
+   * the requests of Prefetch, which wait while every slot holds the tile of
+   * a waiting reader. Called with the mutex held.
+   * @param tile Receives the tile
+   * @return false if there is nothing to compute
+   */
+  auto TakeRequest(size_t *tile) -> bool;
+
+  /**
+   * Returns a free slot, or the least recently used one after evicting its
+   * tile. The tiles of waiting readers are evicted last. Called with the
+   * mutex held.
+   * @return slot
+   */
+  auto TakeSlot() -> size_t;
+
+  /**
+   * Compute the spectra and bands of a tile into a slot
+   * @param tile
+   * @param slot
+   */
+  void ComputeTile(const size_t &tile, Tile *slot);
+};
+
+}  // namespace visualmusic
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "cinder/audio/audio.h"
+#include "fixed_fft.h"
+#include "frame_view.h"
+#include "worker_pool.h"
+
+namespace visualmusic {
+
+using namespace ci;
+
+/**
+ * Window functions that can be applied to each frame before the Fft
+ */
+enum class WindowType { kRectangular, kHann, kHamming, kBlackman };
+
+/**
+ * Settings of a short-time Fourier transform
+ */
+struct StftSettings {
+  size_t fft_size = 1024;  // Number of samples per frame, a power of 2
+  size_t hop_size = 1024;  // Distance between the starts of two frames
+  WindowType window = WindowType::kRectangular;
+  size_t num_threads = 0;  // 0 means one worker per hardware thread
+  FftBackend backend = FftBackend::kCinder;
+};
+
+/**
+ * This class runs a multi-threaded short-time Fourier transform over a view of
+ * one channel. Every worker owns its own Fft and scratch buffers and writes
+ * magnitude spectra into rows provided by the caller, so the result does not
+ * depend on the number of workers. The workers and their scratch buffers
+ * live as long as the engine, so transforming a streamed track a chunk at a
+ * time creates no thread and no Fft per chunk.
+ */
+class StftEngine {
+ public:
+  /**
+   * Fft and buffers of one worker, reused from frame to frame
+   */
+  struct Scratch {
+    explicit Scratch(const size_t &fft_size);
+
+    audio::dsp::Fft fft;
+    audio::Buffer frame;
+    audio::BufferSpectral spectral;
+
+    // Windowed frames and workspace of a FixedFft batch, sized on first use
+    std::vector<float> batch;
+    std::vector<float> workspace;
+  };
+
+  /**
+   * Initialize the engine and start its workers
+   * @param settings FftBackend::kFixed needs an fft size from 256 to 8192
+   */
+  explicit StftEngine(const StftSettings &settings);
+
+  StftEngine(const StftEngine &) = delete;
+  auto operator=(const StftEngine &) -> StftEngine & = delete;
+
+  /**
+   * Returns the number of frames produced for a buffer of num_samples frames
+   * @param num_samples
+   * @return number of frames
+   */
+  auto CountFrames(const size_t &num_samples) const -> size_t;
+
+  /**
+   * Returns the number of magnitude bins per frame (fft_size / 2)
+   * @return number of bins
+   */
+  auto GetNumBins() const -> size_t;
+
+  /**
+   * Returns the settings of the engine
+   * @return settings
+   */
+  auto GetSettings() const -> const StftSettings &;
+
+  /**
+   * Transform the first channel of a buffer. The output must hold
+   * CountFrames(buffer.getNumFrames()) rows of row_stride floats.
+   * @param buffer
+   * @param output
+   * @param row_stride Distance between two output rows, 0 means GetNumBins()
+   * @return maximum magnitude over every frame
+   */
+  auto Analyze(const audio::Buffer &buffer, float *output,
+               const size_t &row_stride = 0) const -> float;
+
+  /**
+   * Transform every frame of a view. The view must use the fft size and hop
+   * size of the engine.
+   * @param frames
+   * @param output
+   * @param row_stride Distance between two output rows, 0 means GetNumBins()
+   * @return maximum magnitude over every frame
+   */
+  auto Analyze(const FrameView &frames, float *output,
+               const size_t &row_stride = 0) const -> float;
+
+  /**
+   * Transform frames [first_frame, last_frame) of a view. Row i of the output
+   * receives frame i, so the output must hold last_frame rows.
+   * @param frames
+   * @param first_frame
+   * @param last_frame
+   * @param output
+   * @param row_stride Distance between two output rows, 0 means GetNumBins()
+   * @return maximum magnitude over the transformed frames
+   */
+  auto AnalyzeFrames(const FrameView &frames, const size_t &first_frame,
+                     const size_t &last_frame, float *output,
+                     const size_t &row_stride = 0) const -> float;
+
+  /**
+   * Transform frames [first_frame, last_frame) of a view on the calling
+   * thread, with scratch buffers owned by the caller. Callers that run their
+   * own workers keep a scratch per worker.
+   * @param frames
+   * @param first_frame
+   * @param last_frame
+   * @param scratch Made for the fft size of the engine
+   * @param output Row i receives frame i
+   * @param row_stride Distance between two output rows, 0 means GetNumBins()
+   * @return maximum magnitude over the transformed frames
+   */
+  auto AnalyzeFrames(const FrameView &frames, const size_t &first_frame,
+                     const size_t &last_frame, Scratch *scratch,
+                     float *output, const size_t &row_stride = 0) const
+      -> float;
+
+  /**
+   * Transform a single frame with scratch buffers owned by the caller
+   * @param data
+   * @param length At most fft_size, the rest of the frame is zero padded
+   * @param scratch Made for the fft size of the engine
+   * @param magnitudes Receives GetNumBins() magnitudes
+   * @return maximum magnitude of the frame
+   */
+  auto TransformFrame(const float *data, const size_t &length,
+                      Scratch *scratch, float *magnitudes) const -> float;
+
+  /**
+   * Returns a view of one channel that matches the engine settings
+   * @param data
+   * @param num_samples
+   * @return view
+   */
+  auto MakeFrameView(const float *data, const size_t &num_samples) const
+      -> FrameView;
+
+ private:
+  StftSettings settings_;
+  std::vector<float> window_;
+  const FixedFftKernel *fixed_fft_ = nullptr;  // With FftBackend::kFixed
+
+  // Workers of AnalyzeFrames, absent for a single-threaded engine, and the
+  // scratch of each, made by the worker on its first frame
+  std::unique_ptr<WorkerPool> pool_;
+  mutable std::vector<std::unique_ptr<Scratch>> scratches_;
+
+  /**
+   * Transform frames [first_frame, last_frame) with the FixedFft, one batch
+   * of windowed frames at a time
+   * @param frames
+   * @param first_frame
+   * @param last_frame
+   * @param scratch
+   * @param output
+   * @param row_stride
+   * @return maximum magnitude in the range
+   */
+  auto AnalyzeBatches(const FrameView &frames, const size_t &first_frame,
+                      const size_t &last_frame, Scratch *scratch,
+                      float *output, const size_t &row_stride) const -> float;
+
+  /**
+   * Copy a frame multiplied by the window, zero padding the end of the
+   * channel
+   * @param data
+   * @param length
+   * @param windowed Receives fft_size samples
+   */
+  void WindowFrame(const float *data, const size_t &length,
+                   float *windowed) const;
+
+
+  /**
+   * Construct the coefficients of the window function
+   */
+  void ConstructWindow();
+};
+
+}  // namespace visualmusic
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+#include "audio_visualizer.h"
+#include "cinder/audio/audio.h"
+
+namespace visualmusic {
+
+using namespace ci;
+
+/**
+ * This class decodes an audio file in chunks on a background thread, filling
+ * a playback buffer and feeding the visualizer as the data arrives
+ */
+class StreamingLoader {
+ public:
+  // Number of frames decoded per chunk
+  static const size_t kDefaultChunkFrames = 1 << 16;
+
+  /**
+   * Initialize the loader
+   */
+  StreamingLoader();
+
+  /**
+   * Stop the loader and wait for the background thread
+   */
+  ~StreamingLoader();
+
+  StreamingLoader(const StreamingLoader &) = delete;
+  auto operator=(const StreamingLoader &) -> StreamingLoader & = delete;
+
+  /**
+   * Fill a playback buffer with the decoded track, which is on by default.
+   * Turned off when the player reads the sample file of the visualizer
+   * instead. Takes effect at the next Start.
+   * @param enabled
+   */
+  void SetKeepBuffer(const bool &enabled);
+
+  /**
+   * Start decoding a source file. The visualizer is prepared for the whole
+   * track before this returns, so it can be displayed right away.
+   * @param source_file
+   * @param visualizer Must outlive the loader or the next call to Cancel
+   * @param bounds
+   * @param sample_rate
+   * @param chunk_frames
+   */
+  void Start(const audio::SourceFileRef &source_file,
+             AudioVisualizer *visualizer, const Rectf &bounds,
+             const size_t &sample_rate,
+             const size_t &chunk_frames = kDefaultChunkFrames);
+
+  /**
+   * Stop decoding and wait for the background thread
+   */
+  void Cancel();
+
+  /**
+   * Returns whether the whole file has been decoded and analyzed
+   * @return true if finished
+   */
+  auto IsFinished() const -> bool;
+
+  /**
+   * Returns the fraction of the file decoded so far, in [0, 1]
+   * @return progress
+   */
+  auto GetProgress() const -> float;
+
+  /**
+   * Returns the decoded track, complete once IsFinished() is true
+   * @return buffer, nullptr unless the buffer is kept
+   */
+  auto GetBuffer() const -> audio::BufferRef;
+
+ private:
+  std::thread thread_;
+  std::atomic<bool> cancelled_;
+  std::atomic<bool> finished_;
+  std::atomic<size_t> decoded_frames_;
+  size_t total_frames_;
+  bool keep_buffer_ = true;
+  audio::BufferRef buffer_;
+
+  /**
+   * Decode the whole file, chunk by chunk (background thread)
+   * @param source_file
+   * @param visualizer
+   * @param chunk_frames
+   */
+  void Run(audio::SourceFileRef source_file, AudioVisualizer *visualizer,
+           size_t chunk_frames);
+};
+
+}  // namespace visualmusic
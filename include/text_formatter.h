@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdarg>
+#include <cstddef>
+#include <string>
+
+namespace visualmusic {
+
+/**
+ * This class formats the lines of the info boards into a string it keeps,
+ * so that drawing the boards allocates nothing once the string has grown
+ * to the longest line.
+ */
+class TextFormatter {
+ public:
+  /**
+   * Initialize the formatter with room for a line of the longest length
+   */
+  TextFormatter();
+
+  /**
+   * Format a line
+   * @param format printf format
+   * @return the line, valid until the next call
+   */
+  auto Format(const char *format, ...) -> const std::string &;
+
+  /**
+   * Format a line from a list of arguments
+   * @param format printf format
+   * @param args
+   * @return the line, valid until the next call
+   */
+  auto FormatList(const char *format, va_list args) -> const std::string &;
+
+  /**
+   * Returns the last line
+   * @return line
+   */
+  auto GetText() const -> const std::string &;
+
+ private:
+  static const size_t kMaxLength = 256;  // Longer lines are cut
+  char buffer_[kMaxLength];
+  std::string text_;
+};
+
+}  // namespace visualmusic
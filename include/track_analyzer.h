@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "analysis_cache.h"
+#include "cinder/audio/audio.h"
+#include "envelope_pyramid.h"
+#include "spectral_arena.h"
+
+namespace visualmusic {
+
+using namespace ci;
+
+/**
+ * This class runs the analysis of AudioVisualizer::Load without a display:
+ * the envelope pyramid, the magnitude spectra, their frequency bands and the
+ * maximum magnitudes of a decoded track. Its results can be written as a
+ * cache file that the visualizer maps instead of analyzing the track again.
+ */
+class TrackAnalyzer {
+ public:
+  // Rates and Fft size AudioVisualizer loads a track with by default
+  static const size_t kInstantDisplayRate = 20;
+  static const size_t kGeneralDisplayRate = 100;
+  static const size_t kThreeDimensionDisplayRate = 50;
+  static const size_t kFftSize = 1024;
+
+  /**
+   * Returns the parameters AudioVisualizer analyzes a track with
+   * @param sample_rate
+   * @param instant_display_rate
+   * @param general_display_rate
+   * @param three_dimension_display_rate
+   * @param fft_size
+   * @param bands Frequency bands of the spectra
+   * @param fft_backend
+   * @return parameters
+   */
+  static auto MakeDisplayParameters(
+      const size_t &sample_rate,
+      const size_t &instant_display_rate = kInstantDisplayRate,
+      const size_t &general_display_rate = kGeneralDisplayRate,
+      const size_t &three_dimension_display_rate = kThreeDimensionDisplayRate,
+      const size_t &fft_size = kFftSize,
+      const BandSettings &bands = BandSettings(),
+      const FftBackend &fft_backend = FftBackend::kCinder)
+      -> AnalysisParameters;
+
+  /**
+   * Returns the parameters AudioVisualizer analyzes a track with at its
+   * default rates and Fft size
+   * @param sample_rate
+   * @param bands Frequency bands of the spectra
+   * @param fft_backend
+   * @return parameters
+   */
+  static auto MakeDisplayParameters(
+      const size_t &sample_rate, const BandSettings &bands,
+      const FftBackend &fft_backend = FftBackend::kCinder)
+      -> AnalysisParameters;
+
+  /**
+   * Returns an upper bound of the memory used to decode and analyze a track
+   * @param num_frames
+   * @param num_channels
+   * @param parameters
+   * @return number of bytes
+   */
+  static auto EstimateBytes(const size_t &num_frames,
+                            const size_t &num_channels,
+                            const AnalysisParameters &parameters) -> size_t;
+
+  /**
+   * Initialize the analyzer
+   * @param parameters
+   * @param num_threads Workers per track, 0 means one per hardware thread
+   */
+  explicit TrackAnalyzer(const AnalysisParameters &parameters,
+                         const size_t &num_threads = 0);
+
+  TrackAnalyzer(const TrackAnalyzer &) = delete;
+  auto operator=(const TrackAnalyzer &) -> TrackAnalyzer & = delete;
+
+  /**
+   * Analyze a track, replacing the previous results. Memory is reused
+   * between tracks when it is large enough.
+   * @param buffer
+   */
+  void Analyze(const audio::Buffer &buffer);
+
+  /**
+   * Returns the results of the last analysis
+   * @return products, valid until the next Analyze
+   */
+  auto GetProducts() const -> AnalysisProducts;
+
+  /**
+   * Returns the cache key of the last analysis
+   * @return key
+   */
+  auto GetKey() const -> uint64_t;
+
+  /**
+   * Write the results as a cache file named after the key
+   * @param directory Existing directory
+   * @return path of the file, empty on failure
+   */
+  auto Write(const std::string &directory) const -> std::string;
+
+ private:
+  AnalysisParameters parameters_;
+  size_t num_threads_;
+
+  uint64_t key_ = 0;
+  EnvelopePyramid envelope_;
+  SpectralArena spectral_arena_;
+  BandMapper band_mapper_;
+  SpectralArena band_arena_;
+  float max_magnitude_general_ = 0.0f;
+  float max_magnitude_fft_ = 0.0f;
+  float max_magnitude_bands_ = 0.0f;
+};
+
+}  // namespace visualmusic
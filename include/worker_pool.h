@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace visualmusic {
+
+/**
+ * This class keeps a set of worker threads alive between parallel passes, so
+ * that a pass over a small chunk of a streamed track costs a wake-up instead
+ * of creating and joining threads. The calling thread takes part in each
+ * pass as worker 0.
+ */
+class WorkerPool {
+ public:
+  /**
+   * Start the workers
+   * @param num_workers Workers including the calling thread, 0 means one
+   * per hardware thread
+   */
+  explicit WorkerPool(const size_t &num_workers = 0);
+
+  /**
+   * Stop and join the workers
+   */
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool &) = delete;
+  auto operator=(const WorkerPool &) -> WorkerPool & = delete;
+
+  /**
+   * Returns the number of workers, the calling thread included
+   * @return number of workers
+   */
+  auto GetNumWorkers() const -> size_t;
+
+  /**
+   * Run tasks [0, num_tasks) and return once every task is done. Each worker
+   * takes the next task until none is left. Passes from several threads run
+   * one after the other; a task must not start a pass on the same pool.
+   * @param num_tasks
+   * @param task Called with the index of the task and of the worker running
+   * it, below GetNumWorkers(), so a worker can reuse its own buffers
+   */
+  void Run(const size_t &num_tasks,
+           const std::function<void(size_t, size_t)> &task);
+
+ private:
+  std::vector<std::thread> threads_;
+  std::mutex run_mutex_;  // Held for a whole pass
+
+  // State of the pass, written under mutex_ before the workers are woken
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  const std::function<void(size_t, size_t)> *task_ = nullptr;
+  size_t num_tasks_ = 0;
+  std::atomic<size_t> next_task_;
+  size_t busy_workers_ = 0;
+  uint64_t generation_ = 0;
+  bool stopping_ = false;
+
+  /**
+   * Take tasks of the current pass until none is left
+   * @param worker
+   */
+  void Work(const size_t &worker);
+
+  /**
+   * Wait for each pass and work on it (worker threads)
+   * @param worker
+   */
+  void Loop(size_t worker);
+};
+
+}  // namespace visualmusic
@@ -0,0 +1,308 @@
+#include "analysis_cache.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace visualmusic {
+
+namespace {
+
+const char kMagic[8] = {'V', 'M', 'C', 'A', 'C', 'H', 'E', '\0'};
+const uint64_t kHashSeed = 14695981039346656037ULL;
+const uint64_t kHashPrime = 1099511628211ULL;
+const uint64_t kAlignment = 64;
+
+// Every kChecksumStep-th spectral row, band row and envelope bucket is
+// covered by the checksum
+const size_t kChecksumStep = 64;
+
+/**
+ * Layout of the start of a cache file. Integers use the byte order of the
+ * machine, which the key does not cover, so a file moved to a machine of the
+ * other byte order is rejected by the magic and version checks at worst.
+ */
+struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t key;
+  uint64_t num_frames;
+  uint64_t num_envelope_buckets;
+  uint64_t num_spectral_frames;
+  uint64_t num_spectral_bins;
+  uint64_t spectral_row_stride;
+  uint64_t spectral_hop_size;
+  uint64_t num_bands;
+  uint64_t band_row_stride;
+  uint64_t envelope_offset;
+  uint64_t spectral_offset;
+  uint64_t band_offset;
+  uint64_t file_size;
+  float max_magnitude_general;
+  float max_magnitude_fft;
+  float max_magnitude_bands;
+  uint32_t reserved;
+  uint64_t checksum;         // Payload checksum
+  uint64_t header_checksum;  // Checksum of every field above
+};
+
+auto AlignOffset(const uint64_t& offset) -> uint64_t {
+  return (offset + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+}  // namespace
+
+const uint32_t AnalysisCache::kVersion;
+
+AnalysisCache::AnalysisCache() = default;
+
+auto AnalysisCache::Hash(const void* data, const size_t& size, uint64_t hash)
+    -> uint64_t {
+  const auto* bytes = static_cast<const unsigned char*>(data);
+  uint64_t lanes[4] = {hash, hash ^ 1, hash ^ 2, hash ^ 3};
+  size_t i = 0;
+
+  // FNV-1a over 32-bit words in four independent lanes, so hashing a long
+  // track is not bound by the latency of one multiplication chain
+  for (; i + 16 <= size; i += 16) {
+    for (size_t lane = 0; lane < 4; lane++) {
+      uint32_t word;
+      std::memcpy(&word, bytes + i + 4 * lane, sizeof(word));
+      lanes[lane] = (lanes[lane] ^ word) * kHashPrime;
+    }
+  }
+  for (; i < size; i++) {
+    lanes[0] = (lanes[0] ^ bytes[i]) * kHashPrime;
+  }
+
+  for (uint64_t lane : lanes) {
+    hash = (hash ^ lane) * kHashPrime;
+    hash ^= hash >> 29;
+  }
+  return hash;
+}
+
+auto AnalysisCache::ComputeKey(const audio::Buffer& buffer,
+                               const AnalysisParameters& parameters)
+    -> uint64_t {
+  std::vector<const float*> channels(buffer.getNumChannels());
+  for (size_t channel = 0; channel < channels.size(); channel++) {
+    channels[channel] = buffer.getChannel(channel);
+  }
+  return ComputeKey(channels.data(), channels.size(), buffer.getNumFrames(),
+                    parameters);
+}
+
+auto AnalysisCache::ComputeKey(const float* const* channels,
+                               const size_t& num_channels,
+                               const size_t& num_frames,
+                               const AnalysisParameters& parameters)
+    -> uint64_t {
+  const uint64_t fields[] = {
+      kVersion,
+      parameters.sample_rate,
+      parameters.instant_display_rate,
+      parameters.general_display_rate,
+      parameters.three_dimension_display_rate,
+      parameters.fft_size,
+      parameters.hop_size,
+      static_cast<uint64_t>(parameters.window),
+      static_cast<uint64_t>(parameters.fft_backend),
+      static_cast<uint64_t>(parameters.band_scale),
+      parameters.num_bands,
+      static_cast<uint64_t>(parameters.min_frequency * 1000.0f),
+      num_frames,
+      num_channels};
+
+  uint64_t hash = Hash(fields, sizeof(fields), kHashSeed);
+  for (size_t channel = 0; channel < num_channels; channel++) {
+    hash = Hash(channels[channel], num_frames * sizeof(float), hash);
+  }
+
+  return hash;
+}
+
+auto AnalysisCache::GetFileName(const uint64_t& key) -> std::string {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.vmcache",
+           static_cast<unsigned long long>(key));
+  return name;
+}
+
+auto AnalysisCache::ComputeChecksum(const AnalysisProducts& products)
+    -> uint64_t {
+  uint64_t hash = kHashSeed;
+
+  for (size_t bucket = 0; bucket < products.num_envelope_buckets;
+       bucket += kChecksumStep) {
+    hash = Hash(products.envelope + bucket, sizeof(EnvelopePyramid::Bucket),
+                hash);
+  }
+
+  for (size_t row = 0; row < products.num_spectral_frames;
+       row += kChecksumStep) {
+    hash = Hash(products.spectral_rows + row * products.spectral_row_stride,
+                products.num_spectral_bins * sizeof(float), hash);
+  }
+
+  if (products.num_bands > 0) {
+    for (size_t row = 0; row < products.num_spectral_frames;
+         row += kChecksumStep) {
+      hash = Hash(products.band_rows + row * products.band_row_stride,
+                  products.num_bands * sizeof(float), hash);
+    }
+  }
+
+  return hash;
+}
+
+auto AnalysisCache::Write(const std::string& path, const uint64_t& key,
+                          const AnalysisProducts& products) -> bool {
+  CacheHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.header_size = sizeof(CacheHeader);
+  header.key = key;
+  header.num_frames = products.num_frames;
+  header.num_envelope_buckets = products.num_envelope_buckets;
+  header.num_spectral_frames = products.num_spectral_frames;
+  header.num_spectral_bins = products.num_spectral_bins;
+  header.spectral_row_stride = products.spectral_row_stride;
+  header.spectral_hop_size = products.spectral_hop_size;
+  header.num_bands = products.num_bands;
+  header.band_row_stride = products.num_bands > 0 ? products.band_row_stride
+                                                  : 0;
+  header.envelope_offset = AlignOffset(sizeof(CacheHeader));
+  header.spectral_offset =
+      AlignOffset(header.envelope_offset + products.num_envelope_buckets *
+                                               sizeof(EnvelopePyramid::Bucket));
+  header.band_offset =
+      AlignOffset(header.spectral_offset + products.num_spectral_frames *
+                                               products.spectral_row_stride *
+                                               sizeof(float));
+  header.file_size = header.band_offset + products.num_spectral_frames *
+                                              header.band_row_stride *
+                                              sizeof(float);
+  header.max_magnitude_general = products.max_magnitude_general;
+  header.max_magnitude_fft = products.max_magnitude_fft;
+  header.max_magnitude_bands = products.max_magnitude_bands;
+  header.checksum = ComputeChecksum(products);
+  header.header_checksum =
+      Hash(&header, offsetof(CacheHeader, header_checksum), kHashSeed);
+
+  const std::string temporary_path = path + ".tmp";
+  {
+    std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      return false;
+    }
+
+    const char padding[kAlignment] = {};
+    const size_t envelope_size =
+        products.num_envelope_buckets * sizeof(EnvelopePyramid::Bucket);
+    const size_t spectral_size = products.num_spectral_frames *
+                                 products.spectral_row_stride * sizeof(float);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(padding, header.envelope_offset - sizeof(header));
+    file.write(reinterpret_cast<const char*>(products.envelope),
+               envelope_size);
+    file.write(padding,
+               header.spectral_offset - header.envelope_offset - envelope_size);
+    file.write(reinterpret_cast<const char*>(products.spectral_rows),
+               spectral_size);
+    file.write(padding,
+               header.band_offset - header.spectral_offset - spectral_size);
+    if (header.num_bands > 0) {
+      file.write(reinterpret_cast<const char*>(products.band_rows),
+                 header.file_size - header.band_offset);
+    }
+
+    if (!file) {
+      std::remove(temporary_path.c_str());
+      return false;
+    }
+  }
+
+  // Windows does not rename over an existing file
+  std::remove(path.c_str());
+  return std::rename(temporary_path.c_str(), path.c_str()) == 0;
+}
+
+auto AnalysisCache::Open(const std::string& path, const uint64_t& key)
+    -> bool {
+  Close();
+
+  if (!file_.Open(path)) {
+    return false;
+  }
+
+  // Reject anything that is not exactly the file we would have written
+  CacheHeader header;
+  if (file_.GetSize() < sizeof(header)) {
+    Close();
+    return false;
+  }
+  std::memcpy(&header, file_.GetData(), sizeof(header));
+
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion || header.header_size != sizeof(header) ||
+      header.key != key ||
+      header.header_checksum !=
+          Hash(&header, offsetof(CacheHeader, header_checksum), kHashSeed) ||
+      header.file_size != file_.GetSize() ||
+      header.num_envelope_buckets !=
+          EnvelopePyramid::CountBuckets(header.num_frames) ||
+      header.num_spectral_bins > header.spectral_row_stride ||
+      header.envelope_offset + header.num_envelope_buckets *
+                                   sizeof(EnvelopePyramid::Bucket) >
+          header.spectral_offset ||
+      header.spectral_offset + header.num_spectral_frames *
+                                   header.spectral_row_stride *
+                                   sizeof(float) >
+          header.band_offset ||
+      header.num_bands > header.band_row_stride ||
+      header.band_offset + header.num_spectral_frames *
+                               header.band_row_stride * sizeof(float) !=
+          header.file_size) {
+    Close();
+    return false;
+  }
+
+  products_.num_frames = header.num_frames;
+  products_.envelope = reinterpret_cast<const EnvelopePyramid::Bucket*>(
+      file_.GetData() + header.envelope_offset);
+  products_.num_envelope_buckets = header.num_envelope_buckets;
+  products_.spectral_rows = reinterpret_cast<const float*>(
+      file_.GetData() + header.spectral_offset);
+  products_.num_spectral_frames = header.num_spectral_frames;
+  products_.num_spectral_bins = header.num_spectral_bins;
+  products_.spectral_row_stride = header.spectral_row_stride;
+  products_.spectral_hop_size = header.spectral_hop_size;
+  if (header.num_bands > 0) {
+    products_.band_rows =
+        reinterpret_cast<const float*>(file_.GetData() + header.band_offset);
+    products_.num_bands = header.num_bands;
+    products_.band_row_stride = header.band_row_stride;
+  }
+  products_.max_magnitude_general = header.max_magnitude_general;
+  products_.max_magnitude_fft = header.max_magnitude_fft;
+  products_.max_magnitude_bands = header.max_magnitude_bands;
+
+  if (ComputeChecksum(products_) != header.checksum) {
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+void AnalysisCache::Close() {
+  file_.Close();
+  products_ = AnalysisProducts();
+}
+
+}  // namespace visualmusic
@@ -1,15 +1,611 @@
 #include "audio_visualizer.h"
 
+#include "frame_profiler.h"
+
 namespace visualmusic {
 
-AudioVisualizer::AudioVisualizer() = default;
+// Points are written by the kernels as interleaved x, y floats
+static_assert(sizeof(vec2) == 2 * sizeof(float), "vec2 must be two floats");
+
+const size_t AudioVisualizer::kAllChannels;
+const size_t AudioVisualizer::kNoRow;
+const size_t AudioVisualizer::kStagingRows;
+const size_t AudioVisualizer::kReadAheadSeconds;
+const size_t AudioVisualizer::kChannelViewChunk;
+
+AudioVisualizer::AudioVisualizer()
+    : channel_views_ready_(false),
+      channel_views_stopping_(false),
+      ready_frames_(0),
+      ready_spectral_frames_(0),
+      loaded_(false),
+      max_magnitude_general_(0.0f),
+      max_magnitude_fft_(0.0f),
+      max_magnitude_bands_(0.0f) {
+}
+
+AudioVisualizer::~AudioVisualizer() {
+  StopChannelViews();
+}
 
 void AudioVisualizer::Load(const audio::Buffer& buffer, const Rectf& bounds,
                            const size_t& sample_rate,
                            const size_t& instant_display_rate_time_domain,
                            const size_t& general_display_rate_time_domain,
                            const size_t& three_dimension_display_rate) {
+  StopChannelViews();
+  spectral_tiles_.Stop();
+  spectra_tiled_ = lazy_spectra_;
+  sample_file_.Close();
   buffer_ = buffer;
+  live_ = nullptr;
+  BindTrackSamples();
+  Configure(bounds, sample_rate, instant_display_rate_time_domain,
+            general_display_rate_time_domain, three_dimension_display_rate);
+  AnalyzeTrack();
+}
+
+auto AudioVisualizer::LoadSampleFile(
+    const std::string& path, const uint64_t& source_stamp, const Rectf& bounds,
+    const size_t& instant_display_rate_time_domain,
+    const size_t& general_display_rate_time_domain,
+    const size_t& three_dimension_display_rate) -> bool {
+  // The file is checked before the previous track is dropped, whose tiles
+  // may read its mapping until stopped
+  SampleFile file;
+  if (!file.Open(path, source_stamp)) {
+    return false;
+  }
+  file.Close();
+  StopChannelViews();
+  spectral_tiles_.Stop();
+  if (!sample_file_.Open(path, source_stamp)) {
+    BindTrackSamples();
+    return false;
+  }
+
+  spectra_tiled_ = lazy_spectra_;
+  buffer_ = audio::Buffer();
+  live_ = nullptr;
+  BindTrackSamples();
+  Configure(bounds, sample_file_.GetSampleRate(),
+            instant_display_rate_time_domain,
+            general_display_rate_time_domain, three_dimension_display_rate);
+
+  // Every product is built in one pass over the track, after which its pages
+  // are dropped and only faulted back in where the graphs and tiles read
+  sample_file_.Advise(MappedAccess::kSequential, 0, track_frames_);
+  AnalyzeTrack();
+  sample_file_.Advise(MappedAccess::kDontNeed, 0, track_frames_);
+  sample_file_.Advise(MappedAccess::kNormal, 0, track_frames_);
+  ResetReadAhead();
+  return true;
+}
+
+void AudioVisualizer::SetSampleFile(const std::string& path,
+                                    const uint64_t& source_stamp) {
+  sample_file_path_ = path;
+  sample_source_stamp_ = source_stamp;
+}
+
+auto AudioVisualizer::GetSampleFile() const -> const SampleFile& {
+  return sample_file_;
+}
+
+void AudioVisualizer::PrefetchSamples(const size_t& frame) const {
+  if (!sample_file_.IsOpen()) {
+    return;
+  }
+
+  // While the player moves forward inside the window, only its new end is
+  // requested. A seek requests the whole window at the new position.
+  const size_t last =
+      std::min(track_frames_, frame + kReadAheadSeconds * sample_rate_);
+  const size_t first =
+      frame >= prefetched_first_ && frame <= prefetched_last_
+          ? prefetched_last_
+          : frame;
+  sample_file_.Advise(MappedAccess::kWillNeed, first, last);
+  prefetched_first_ = frame;
+  prefetched_last_ = std::max(first, last);
+}
+
+void AudioVisualizer::ResetReadAhead() {
+  prefetched_first_ = 0;
+  prefetched_last_ = 0;
+  PrefetchSamples(0);
+}
+
+void AudioVisualizer::BindTrackSamples() {
+  if (sample_file_.IsOpen()) {
+    track_channels_.resize(sample_file_.GetNumChannels());
+    for (size_t channel = 0; channel < track_channels_.size(); channel++) {
+      track_channels_[channel] = sample_file_.GetChannel(channel);
+    }
+    track_frames_ = sample_file_.GetNumFrames();
+    return;
+  }
+
+  track_channels_.resize(buffer_.getNumChannels());
+  for (size_t channel = 0; channel < track_channels_.size(); channel++) {
+    track_channels_[channel] = buffer_.getChannel(channel);
+  }
+  track_frames_ = buffer_.getNumFrames();
+}
+
+void AudioVisualizer::AnalyzeTrack() {
+  written_frames_ = track_frames_;
+
+  cache_.Close();
+  const bool use_cache = !cache_directory_.empty();
+  const uint64_t cache_key = use_cache ? ComputeCacheKey() : 0;
+
+  if (!use_cache || !LoadFromCache(cache_key)) {
+    ConstructEnvelopePyramid();
+    float max_magnitude = 0.0f;
+    for (const float* channel : track_channels_) {
+      max_magnitude = std::fmaxf(max_magnitude,
+                                 FindMaximumMagnitude(channel, track_frames_));
+    }
+    max_magnitude_general_ = max_magnitude;
+
+    ConstructBufferSpectralArray(kFrequencyRange);
+    if (use_cache) {
+      StoreInCache(cache_key);
+    }
+  }
+  ResetChannelViews();
+  BuildChannelViews();
+  ResetGeneralGraph();
+
+  ready_frames_.store(written_frames_, std::memory_order_release);
+  loaded_.store(true, std::memory_order_release);
+}
+
+void AudioVisualizer::SetCacheDirectory(const std::string& directory) {
+  cache_directory_ = directory;
+}
+
+void AudioVisualizer::SetFrequencyBands(const BandSettings& settings) {
+  band_settings_ = settings;
+}
+
+void AudioVisualizer::SetFftBackend(const FftBackend& backend) {
+  fft_backend_ = backend;
+}
+
+void AudioVisualizer::SetSpectralStorage(const SpectralStorage& storage) {
+  spectral_storage_ = storage;
+}
+
+void AudioVisualizer::SetLazySpectra(const bool& enabled,
+                                     const TileSettings& settings) {
+  lazy_spectra_ = enabled;
+  tile_settings_ = settings;
+}
+
+void AudioVisualizer::SetChannelViews(const bool& enabled) {
+  channel_views_enabled_ = enabled;
+}
+
+auto AudioVisualizer::GetNumChannelViews() const -> size_t {
+  if (!channel_views_ready_.load(std::memory_order_acquire)) {
+    return 0;
+  }
+  return channel_analysis_.GetNumViews();
+}
+
+void AudioVisualizer::WaitChannelViews() {
+  if (channel_views_thread_.joinable()) {
+    channel_views_thread_.join();
+  }
+}
+
+auto AudioVisualizer::GetChannelViewName(const size_t& view) const
+    -> std::string {
+  if (view >= GetNumChannelViews()) {
+    return "all channels";
+  }
+  return ChannelAnalysis::GetViewName(channel_analysis_.GetView(view),
+                                      track_channels_.size());
+}
+
+void AudioVisualizer::SelectChannelView(const size_t& view) {
+  channel_view_ = view < GetNumChannelViews() ? view : kAllChannels;
+  ResetGeneralGraph();
+  Reset3DGraph();
+}
+
+auto AudioVisualizer::GetSelectedChannelView() const -> size_t {
+  return channel_view_;
+}
+
+auto AudioVisualizer::GetChannelAnalysis() const -> const ChannelAnalysis& {
+  return channel_analysis_;
+}
+
+void AudioVisualizer::ResetChannelViews() {
+  StopChannelViews();
+  channel_view_ = kAllChannels;
+  channel_views_ready_.store(false, std::memory_order_release);
+
+  // The views are float spectra and signals of the whole track, so they
+  // would undo a sample file, lazy spectra and a compact storage
+  if (!channel_views_enabled_ || live_ != nullptr || sample_file_.IsOpen() ||
+      spectra_tiled_ || spectra_quantized_) {
+    channel_analysis_.Release();
+    return;
+  }
+
+  // Framed like the spectra of the track, so a view shares its rows
+  StftSettings settings;
+  settings.fft_size = kFrequencyRange;
+  settings.hop_size = kFrequencyRange;
+  settings.backend = fft_backend_;
+  channel_band_mapper_.Configure(band_settings_, kFrequencyRange / 2,
+                                 sample_rate_);
+  channel_analysis_.Reset(
+      track_frames_, track_channels_.size(), settings,
+      channel_band_mapper_.IsEnabled() ? &channel_band_mapper_ : nullptr);
+
+  // A progressive load analyzes the views as the frames arrive
+  if (!IsLoadedFromCache()) {
+    channel_views_ready_.store(true, std::memory_order_release);
+  }
+}
+
+void AudioVisualizer::BuildChannelViews() {
+  if (!IsLoadedFromCache()) {
+    channel_analysis_.Append(track_channels_.data(), 0, track_frames_,
+                             spectral_num_rows_);
+    channel_analysis_.Finish();
+    return;
+  }
+  if (channel_analysis_.GetNumViews() == 0) {
+    return;
+  }
+
+  // The cached products are drawn at once, and the views a chunk at a time
+  // behind them, so that the next load need not wait for the whole track
+  const size_t num_frames = track_frames_;
+  const size_t num_rows = spectral_num_rows_;
+  const size_t fft_size = kFrequencyRange;
+  channel_views_thread_ = std::thread([this, num_frames, num_rows,
+                                       fft_size]() {
+    for (size_t first = 0; first < num_frames; first += kChannelViewChunk) {
+      if (channel_views_stopping_.load(std::memory_order_acquire)) {
+        return;
+      }
+
+      // Only rows that lie completely inside the analyzed frames, as in
+      // AppendFrames
+      const size_t last = std::min(num_frames, first + kChannelViewChunk);
+      const size_t last_row =
+          last >= fft_size
+              ? std::min(num_rows, (last - fft_size) / fft_size + 1)
+              : 0;
+      channel_analysis_.Append(track_channels_.data(), first, last, last_row);
+    }
+    channel_analysis_.Append(track_channels_.data(), num_frames, num_frames,
+                             num_rows);
+    channel_analysis_.Finish();
+    channel_views_ready_.store(true, std::memory_order_release);
+  });
+}
+
+void AudioVisualizer::StopChannelViews() {
+  if (channel_views_thread_.joinable()) {
+    channel_views_stopping_.store(true, std::memory_order_release);
+    channel_views_thread_.join();
+    channel_views_stopping_.store(false, std::memory_order_release);
+  }
+}
+
+auto AudioVisualizer::GetRhythm() const -> const RhythmTracker& {
+  return live_ != nullptr ? live_->GetRhythm() : rhythm_;
+}
+
+auto AudioVisualizer::GetRhythmAt(const size_t& frame,
+                                  RhythmFrame* rhythm) const -> bool {
+  const RhythmTracker& tracker = GetRhythm();
+  if (live_ != nullptr) {
+    const size_t num_frames = tracker.GetNumFrames();
+    return num_frames > 0 && tracker.GetFrame(num_frames - 1, rhythm);
+  }
+
+  return spectral_hop_size_ > 0 &&
+         tracker.GetFrame(frame / spectral_hop_size_, rhythm);
+}
+
+auto AudioVisualizer::GetSpectralTiles() const -> const SpectralTileCache& {
+  return spectral_tiles_;
+}
+
+auto AudioVisualizer::GetMemoryUsage() const -> MemoryUsage {
+  MemoryUsage usage;
+  usage.samples = buffer_.getSize() * sizeof(float);
+  usage.envelope = envelope_.GetNumBuckets() * sizeof(EnvelopePyramid::Bucket);
+  usage.spectra = spectral_arena_.GetCapacityBytes() +
+                  quantized_spectra_.GetCapacityBytes() +
+                  spectral_tiles_.GetCapacityBytes(false) +
+                  (decoded_spectrum_.capacity() + tile_row_.capacity()) *
+                      sizeof(float);
+  usage.bands = band_arena_.GetCapacityBytes() +
+                quantized_bands_.GetCapacityBytes() +
+                spectral_tiles_.GetCapacityBytes(true) +
+                decoded_bands_.capacity() * sizeof(float);
+  usage.graphs = (general_graph_points_.capacity() +
+                  three_dimension_rows_.capacity()) *
+                 sizeof(vec2);
+  usage.channel_views = channel_analysis_.GetCapacityBytes();
+  usage.rhythm = rhythm_.GetCapacityBytes();
+  usage.mapped = cache_.GetMappedBytes() + sample_file_.GetMappedBytes();
+  return usage;
+}
+
+auto AudioVisualizer::IsLoadedFromCache() const -> bool {
+  return cache_.IsOpen();
+}
+
+auto AudioVisualizer::ComputeCacheKey() const -> uint64_t {
+  // The batch analyzer writes files under the same key
+  const AnalysisParameters parameters = TrackAnalyzer::MakeDisplayParameters(
+      sample_rate_, instant_time_domain_display_rate_,
+      general_time_domain_display_rate_, three_dimension_display_rate_,
+      kFrequencyRange, band_settings_, fft_backend_);
+
+  return AnalysisCache::ComputeKey(track_channels_.data(),
+                                   track_channels_.size(), track_frames_,
+                                   parameters);
+}
+
+auto AudioVisualizer::GetCachePath(const uint64_t& key) const
+    -> std::string {
+  return cache_directory_ + "/" + AnalysisCache::GetFileName(key);
+}
+
+auto AudioVisualizer::LoadFromCache(const uint64_t& key) -> bool {
+  if (!cache_.Open(GetCachePath(key), key)) {
+    return false;
+  }
+
+  const AnalysisProducts& products = cache_.GetProducts();
+  envelope_.Assign(products.num_frames, products.envelope);
+
+  // Spectra are read straight from the mapping, whatever the storage
+  spectra_tiled_ = false;
+  spectra_quantized_ = false;
+  quantized_spectra_.Release();
+  quantized_bands_.Release();
+  spectral_rows_ = products.spectral_rows;
+  spectral_num_rows_ = products.num_spectral_frames;
+  spectral_num_bins_ = products.num_spectral_bins;
+  spectral_row_stride_ = products.spectral_row_stride;
+  spectral_hop_size_ = products.spectral_hop_size;
+  band_arena_.Release();
+  band_rows_ = products.band_rows;
+  band_num_bands_ = products.num_bands;
+  band_row_stride_ = products.band_row_stride;
+  written_spectral_frames_ = spectral_num_rows_;
+  ready_spectral_frames_.store(written_spectral_frames_,
+                               std::memory_order_release);
+  Reset3DGraph();
+
+  // The rhythm is cheap next to the spectra, so it is tracked again from
+  // the mapped rows instead of being cached
+  rhythm_.Reset(spectral_num_bins_, spectral_hop_size_, sample_rate_,
+                spectral_num_rows_);
+  rhythm_.AddFrames(spectral_rows_, spectral_row_stride_, spectral_num_rows_);
+  rhythm_.Finish();
+
+  max_magnitude_general_ = products.max_magnitude_general;
+  max_magnitude_fft_ = products.max_magnitude_fft;
+  max_magnitude_bands_ = products.max_magnitude_bands;
+  return true;
+}
+
+void AudioVisualizer::StoreInCache(const uint64_t& key) const {
+  // The cache holds every exact spectrum, which compact or lazy spectra
+  // cannot give back
+  if (spectra_quantized_ || spectra_tiled_) {
+    return;
+  }
+
+  AnalysisProducts products;
+  products.num_frames = envelope_.GetNumFrames();
+  products.envelope = envelope_.GetData();
+  products.num_envelope_buckets = envelope_.GetNumBuckets();
+  products.spectral_rows = spectral_rows_;
+  products.num_spectral_frames = spectral_num_rows_;
+  products.num_spectral_bins = spectral_num_bins_;
+  products.spectral_row_stride = spectral_row_stride_;
+  products.spectral_hop_size = spectral_hop_size_;
+  if (band_num_bands_ > 0 && spectral_num_rows_ > 0) {
+    products.band_rows = band_rows_;
+    products.num_bands = band_num_bands_;
+    products.band_row_stride = band_row_stride_;
+  }
+  products.max_magnitude_general = max_magnitude_general_;
+  products.max_magnitude_fft = max_magnitude_fft_;
+  products.max_magnitude_bands = max_magnitude_bands_;
+
+  AnalysisCache::Write(GetCachePath(key), key, products);
+}
+
+void AudioVisualizer::BeginStream(
+    const size_t& num_frames, const size_t& num_channels, const Rectf& bounds,
+    const size_t& sample_rate, const size_t& instant_display_rate_time_domain,
+    const size_t& general_display_rate_time_domain,
+    const size_t& three_dimension_display_rate) {
+  // Everything is allocated up front, so the display never reads memory that
+  // the loader reallocates
+  StopChannelViews();
+  spectral_tiles_.Stop();
+  spectra_tiled_ = false;
+  sample_file_.Close();
+  if (!sample_file_path_.empty() &&
+      sample_file_.Create(sample_file_path_, num_frames, num_channels,
+                          sample_rate, sample_source_stamp_)) {
+    buffer_ = audio::Buffer();
+  } else {
+    buffer_ = audio::Buffer(num_frames, num_channels);
+  }
+  live_ = nullptr;
+  BindTrackSamples();
+  Configure(bounds, sample_rate, instant_display_rate_time_domain,
+            general_display_rate_time_domain, three_dimension_display_rate);
+
+  written_frames_ = 0;
+  released_frames_ = 0;
+  max_magnitude_general_ = 0.0f;
+  envelope_.Reset(num_frames);
+  ResetGeneralGraph();
+  ResetBufferSpectralArray(kFrequencyRange, 0, WindowType::kRectangular);
+  ResetChannelViews();
+
+  ready_frames_.store(0, std::memory_order_release);
+  loaded_.store(false, std::memory_order_release);
+}
+
+void AudioVisualizer::AppendFrames(const audio::Buffer& chunk,
+                                   const size_t& num_frames) {
+  const size_t count = std::min(num_frames, track_frames_ - written_frames_);
+  const size_t first_frame = written_frames_;
+
+  if (sample_file_.IsOpen()) {
+    sample_file_.Write(chunk, first_frame, count);
+  } else {
+    buffer_.copyOffset(chunk, count, first_frame, 0);
+  }
+  written_frames_ += count;
+
+  float max_magnitude = max_magnitude_general_;
+  for (const float* channel : track_channels_) {
+    max_magnitude = std::fmaxf(
+        max_magnitude, FindMaximumMagnitude(channel + first_frame, count));
+  }
+  max_magnitude_general_ = max_magnitude;
+
+  envelope_.Append(track_channels_.data(), track_channels_.size(),
+                   first_frame, written_frames_);
+
+  // Only frames that lie completely inside the written data are transformed.
+  // The views are analyzed before the spectra publish the frames.
+  const size_t fft_size = stft_engine_->GetSettings().fft_size;
+  const size_t last_spectral_frame =
+      written_frames_ >= fft_size
+          ? (written_frames_ - fft_size) / spectral_hop_size_ + 1
+          : 0;
+  channel_analysis_.Append(track_channels_.data(), first_frame,
+                           written_frames_, last_spectral_frame);
+  AnalyzeSpectralFrames(last_spectral_frame);
+
+  // Frames before the first one a later spectrum reads are dropped from the
+  // mapping, so a mapped track stays resident a chunk at a time
+  const size_t analyzed_frames = last_spectral_frame * spectral_hop_size_;
+  if (sample_file_.IsOpen() && analyzed_frames > released_frames_) {
+    sample_file_.Advise(MappedAccess::kDontNeed, released_frames_,
+                        analyzed_frames);
+    released_frames_ = analyzed_frames;
+  }
+
+  ready_frames_.store(written_frames_, std::memory_order_release);
+}
+
+void AudioVisualizer::EndStream() {
+  envelope_.Finish();
+  channel_analysis_.Append(track_channels_.data(), written_frames_,
+                           written_frames_, spectral_num_rows_);
+  channel_analysis_.Finish();
+  AnalyzeSpectralFrames(spectral_num_rows_);
+
+  if (!cache_directory_.empty()) {
+    StoreInCache(ComputeCacheKey());
+  }
+
+  // Only a finished file is mapped again by LoadSampleFile
+  if (sample_file_.IsOpen()) {
+    sample_file_.Finish();
+    sample_file_.Advise(MappedAccess::kDontNeed, released_frames_,
+                        track_frames_);
+    released_frames_ = track_frames_;
+    ResetReadAhead();
+  }
+
+  ready_frames_.store(written_frames_, std::memory_order_release);
+  loaded_.store(true, std::memory_order_release);
+}
+
+void AudioVisualizer::BeginLive(LiveAnalyzer* analyzer, const Rectf& bounds) {
+  const LiveSettings& settings = analyzer->GetSettings();
+  StopChannelViews();
+  spectral_tiles_.Stop();
+  spectra_tiled_ = false;
+  sample_file_.Close();
+  buffer_ = audio::Buffer();
+  live_ = analyzer;
+  BindTrackSamples();
+  Configure(bounds, settings.sample_rate, settings.instant_display_rate,
+            settings.general_display_rate,
+            settings.three_dimension_display_rate);
+
+  cache_.Close();
+  envelope_.Reset(0);
+  ResetChannelViews();
+  ResetGeneralGraph();
+  spectral_arena_.Release();
+  spectra_quantized_ = false;
+  quantized_spectra_.Release();
+  quantized_bands_.Release();
+  spectral_rows_ = nullptr;
+  spectral_num_rows_ = 0;
+  spectral_num_bins_ = analyzer->GetNumBins();
+  spectral_hop_size_ = settings.fft_size;
+  band_arena_.Release();
+  band_rows_ = nullptr;
+  band_num_bands_ = 0;
+  rhythm_.Release();
+  Reset3DGraph();
+
+  max_magnitude_general_ = kMinLiveMagnitude;
+  max_magnitude_fft_ = kMinLiveMagnitude;
+
+  // The instant graph always reads the whole window of the analyzer
+  ready_frames_.store(analyzer->GetWindowFrames(), std::memory_order_release);
+  ready_spectral_frames_.store(0, std::memory_order_release);
+  loaded_.store(true, std::memory_order_release);
+}
+
+void AudioVisualizer::UpdateLive() {
+  if (live_ == nullptr) {
+    return;
+  }
+
+  live_->Update();
+  max_magnitude_general_ =
+      std::fmaxf(live_->GetMaxMagnitude(), kMinLiveMagnitude);
+  max_magnitude_fft_ =
+      std::fmaxf(live_->GetMaxSpectralMagnitude(), kMinLiveMagnitude);
+  ready_spectral_frames_.store(live_->GetNumSpectra(),
+                               std::memory_order_release);
+}
+
+auto AudioVisualizer::IsLive() const -> bool {
+  return live_ != nullptr;
+}
+
+auto AudioVisualizer::GetReadyFrames() const -> size_t {
+  return ready_frames_.load(std::memory_order_acquire);
+}
+
+auto AudioVisualizer::IsLoaded() const -> bool {
+  return loaded_.load(std::memory_order_acquire);
+}
+
+void AudioVisualizer::Configure(const Rectf& bounds, const size_t& sample_rate,
+                                const size_t& instant_display_rate_time_domain,
+                                const size_t& general_display_rate_time_domain,
+                                const size_t& three_dimension_display_rate) {
   bounds_ = bounds;
   sample_rate_ = sample_rate;
 
@@ -19,17 +615,12 @@ void AudioVisualizer::Load(const audio::Buffer& buffer, const Rectf& bounds,
   three_dimension_display_rate_ = three_dimension_display_rate;
 
   ConstructBoundaries();
-
-  ConstructCompressedBuffer();
-  max_magnitude_general_ = FindMaximumMagnitude(buffer_);
-  max_magnitude_compressed_ = FindMaximumMagnitude(compressed_buffer_);
-
-  ConstructBufferSpectralArray(kFrequencyRange);
 }
 
 void AudioVisualizer::Resize(Rectf bounds) {
   bounds_ = bounds;
   ConstructBoundaries();
+  ResetGeneralGraph();
 }
 
 void AudioVisualizer::ConstructBoundaries() {
@@ -46,13 +637,169 @@ void AudioVisualizer::ConstructBoundaries() {
 }
 
 void AudioVisualizer::Display(const size_t& frame) const {
-  DisplayInstantGraphInTimeDomain(frame);
-  DisplayGeneralGraphInTimeDomain(frame);
-  Display3DGraph(frame);
+  BuildGeometry(frame, &geometry_);
+  DisplayGeometry(geometry_);
+}
+
+void AudioVisualizer::BuildGeometry(const size_t& frame,
+                                    FrameGeometry* geometry) const {
+  VISUALMUSIC_PROFILE_STAGE(FrameStage::kBuildGeometry);
+  // The window of a live analyzer starts at frame 0, and its 3D graph starts
+  // at the newest spectrum
+  const size_t graph_frame =
+      live_ != nullptr
+          ? (std::max<size_t>(live_->GetNumSpectra(), 1) - 1) *
+                spectral_hop_size_
+          : frame;
+  const size_t instant_frame = live_ != nullptr ? 0 : frame;
+  geometry->frame = graph_frame;
+
+  // Every buffer is reused, so once the graphs are sized a frame allocates
+  // nothing
+  geometry->instant.resize(GetNumChannels());
+  for (size_t channel = 0; channel < geometry->instant.size(); channel++) {
+    CalculateInstantGraphInTimeDomain(GetChannelData(channel), instant_frame,
+                                      &geometry->instant[channel]);
+  }
+
+  // The columns of a track only grow until they are dropped, so a buffer
+  // copies the ones it has not seen. A live envelope is drawn as it comes.
+  if (live_ == nullptr) {
+    geometry->num_general_points = CalculateGeneralGraphInTimeDomain(frame);
+    if (geometry->general_generation != general_graph_generation_ ||
+        geometry->general.size() > general_graph_points_.size()) {
+      geometry->general.clear();
+      geometry->general.reserve(2 * general_num_columns_);
+      geometry->general_generation = general_graph_generation_;
+    }
+    geometry->general.insert(
+        geometry->general.end(),
+        general_graph_points_.begin() +
+            static_cast<std::ptrdiff_t>(geometry->general.size()),
+        general_graph_points_.end());
+  } else {
+    geometry->general.clear();
+    geometry->num_general_points = 0;
+  }
+
+  // Only the rows that entered the ring since this buffer was built are
+  // copied
+  Update3DGraph(graph_frame);
+  geometry->max_magnitude = GetDisplayMaxMagnitude();
+  if (geometry->rows_generation != three_dimension_generation_ ||
+      geometry->rows.size() != three_dimension_rows_.size() ||
+      geometry->row_indices.size() != three_dimension_row_indices_.size()) {
+    geometry->rows.assign(three_dimension_rows_.size(), vec2());
+    geometry->row_indices.assign(three_dimension_row_indices_.size(), kNoRow);
+    geometry->rows_generation = three_dimension_generation_;
+  }
+  const size_t num_slots = three_dimension_row_indices_.size();
+  const size_t num_bins =
+      num_slots == 0 ? 0 : three_dimension_rows_.size() / num_slots;
+  for (size_t slot = 0; slot < num_slots; slot++) {
+    if (geometry->row_indices[slot] != three_dimension_row_indices_[slot]) {
+      std::copy(three_dimension_rows_.begin() + slot * num_bins,
+                three_dimension_rows_.begin() + (slot + 1) * num_bins,
+                geometry->rows.begin() + slot * num_bins);
+      geometry->row_indices[slot] = three_dimension_row_indices_[slot];
+    }
+  }
+
+  geometry->complete = IsFrameComplete(graph_frame);
+}
+
+void AudioVisualizer::DisplayGeometry(const FrameGeometry& geometry) const {
+  VISUALMUSIC_PROFILE_STAGE(FrameStage::kDisplay);
+  DisplayInstantGraphInTimeDomain(geometry);
+  if (live_ != nullptr) {
+    DisplayLiveGeneralGraph();
+  } else {
+    DisplayGeneralGraphInTimeDomain(geometry);
+  }
+  Display3DGraph(geometry);
+
+  if (live_ != nullptr) {
+    live_->MarkGeometryReady();
+  } else {
+    RecordSeekFrame(geometry.frame, geometry.complete);
+  }
+}
+
+void AudioVisualizer::BeginSeek(const size_t& frame) {
+  // The tiles of the target go ahead of the ones at the old position. The
+  // playhead is followed by the thread that builds geometry, so the
+  // direction is taken from the previous seek.
+  if (spectral_tiles_.IsActive()) {
+    const int direction = frame >= seek_target_ ? 1 : -1;
+    spectral_tiles_.Prefetch(frame / spectral_hop_size_, direction,
+                             three_dimension_display_rate_);
+  }
+
+  seeking_ = true;
+  seek_target_ = frame;
+  seek_start_ = std::chrono::steady_clock::now();
+}
+
+auto AudioVisualizer::IsFrameComplete(const size_t& frame) const -> bool {
+  if (live_ != nullptr) {
+    return true;
+  }
+  if (frame >= GetReadyFrames() && !IsLoaded()) {
+    return false;
+  }
+
+  // Rows past the end of the track are never drawn
+  const size_t num_spectral_frames = GetNumSpectralFrames();
+  for (size_t i = 0; i < three_dimension_row_indices_.size(); i++) {
+    if (frame < i * spectral_hop_size_) {
+      break;
+    }
+
+    const size_t index = frame / spectral_hop_size_ - i;
+    const size_t slot = index % three_dimension_display_rate_;
+    if (index < num_spectral_frames &&
+        three_dimension_row_indices_[slot] != index) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void AudioVisualizer::MarkFrameDisplayed(const size_t& frame) const {
+  RecordSeekFrame(frame, IsFrameComplete(frame));
+}
+
+void AudioVisualizer::RecordSeekFrame(const size_t& frame,
+                                      const bool& complete) const {
+  if (!seeking_) {
+    return;
+  }
+
+  // The playhead moves on from the target while the frame is prepared
+  const double tolerance = kSeekTolerance * static_cast<double>(sample_rate_);
+  const double distance = std::fabs(static_cast<double>(frame) -
+                                    static_cast<double>(seek_target_));
+  if (distance > tolerance || !complete) {
+    return;
+  }
+
+  const double latency = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - seek_start_)
+                             .count();
+  seeking_ = false;
+  seek_latency_.last = latency;
+  seek_latency_.max = std::max(seek_latency_.max, latency);
+  seek_latency_.num_seeks++;
+}
+
+auto AudioVisualizer::GetSeekLatency() const -> SeekLatency {
+  return seek_latency_;
 }
 
 void AudioVisualizer::DisplayInstantGraphInTimeDomain(
-    const size_t& frame) const {
+    const FrameGeometry& geometry) const {
+  VISUALMUSIC_PROFILE_STAGE(FrameStage::kDisplayInstantGraph);
   // Color only has effect in this scope
   gl::ScopedGlslProg glslScope(getStockShader(gl::ShaderDef().color()));
 
@@ -62,55 +809,145 @@ void AudioVisualizer::DisplayInstantGraphInTimeDomain(
 
   // Display Graph
   gl::color(Color("red"));
-  for (size_t channel = 0; channel < buffer_.getNumChannels(); channel++) {
-    PolyLine2f waveform =
-        CalculateInstantGraphInTimeDomain(buffer_.getChannel(channel), frame);
-
-    if (!waveform.getPoints().empty()) {
-      gl::draw(waveform);
+  for (const std::vector<vec2>& points : geometry.instant) {
+    if (!points.empty()) {
+      instant_line_.getPoints().assign(points.begin(), points.end());
+      gl::draw(instant_line_);
     }
   }
 }
 
+auto AudioVisualizer::GetNumChannels() const -> size_t {
+  if (IsChannelViewSelected()) {
+    return 1;
+  }
+  return live_ != nullptr ? live_->GetNumChannels() : track_channels_.size();
+}
+
+auto AudioVisualizer::GetChannelData(const size_t& channel) const
+    -> const float* {
+  if (IsChannelViewSelected()) {
+    return channel_analysis_.GetSignal(channel_view_);
+  }
+  return live_ != nullptr ? live_->GetWindow(channel)
+                          : track_channels_[channel];
+}
+
+auto AudioVisualizer::IsChannelViewSelected() const -> bool {
+  return channel_view_ != kAllChannels;
+}
+
+auto AudioVisualizer::GetEnvelope() const -> const EnvelopePyramid& {
+  return IsChannelViewSelected() ? channel_analysis_.GetEnvelope(channel_view_)
+                                 : envelope_;
+}
+
+void AudioVisualizer::SetInstantGraphDecimation(const bool& enabled) {
+  decimate_instant_graph_ = enabled;
+}
+
 auto AudioVisualizer::CalculateInstantGraphInTimeDomain(
     const float* data, const size_t& frame) const -> PolyLine2f {
   PolyLine2f waveform = PolyLine2f();
+  CalculateInstantGraphInTimeDomain(data, frame, &waveform.getPoints());
+  return waveform;
+}
+
+void AudioVisualizer::CalculateInstantGraphInTimeDomain(
+    const float* data, const size_t& frame,
+    std::vector<vec2>* points_out) const {
+  VISUALMUSIC_PROFILE_STAGE(FrameStage::kInstantGraph);
+  const size_t window_frames =
+      sample_rate_ / static_cast<size_t>(instant_time_domain_display_rate_);
+  const size_t num_columns = static_cast<size_t>(
+      std::max(1.0f, instant_time_domain_graph_bounds_.getWidth()));
+
+  // More frames than pixels: one min/max pair per column is enough
+  if (decimate_instant_graph_ && window_frames > 2 * num_columns) {
+    CalculateDecimatedInstantGraph(data, frame, num_columns, points_out);
+    return;
+  }
+
+  std::vector<vec2>& points = *points_out;
+  points.resize(window_frames);
 
-  // Default wave height of this graph
-  const float wave_height = instant_time_domain_graph_bounds_.getHeight();
   const float x_scale = instant_time_domain_graph_bounds_.getWidth() /
                         (static_cast<float>(sample_rate_) /
                          static_cast<float>(instant_time_domain_display_rate_));
-
-  float x = instant_time_domain_graph_bounds_.x1;
+  const simd::ScreenMapping mapping = MakeScreenMapping(
+      instant_time_domain_graph_bounds_, x_scale, max_magnitude_general_);
 
   // Construct the graph out of the buffers
-  for (size_t f = frame;
-       f < frame + sample_rate_ /
-                       static_cast<size_t>(instant_time_domain_display_rate_);
-       f++) {
-    float y;
-
-    // Handle edge case: The final frames
-    if (f >= buffer_.getNumFrames()) {
-      y = instant_time_domain_graph_bounds_.y2 -
-          ConvertMagnitudeToDisplayableRatio(0.0f, max_magnitude_general_) *
-              wave_height;
-    } else {
-      y = instant_time_domain_graph_bounds_.y2 -
-          ConvertMagnitudeToDisplayableRatio(data[f], max_magnitude_general_) *
-              wave_height;
-    }
+  const size_t ready_frames = GetReadyFrames();
+  const size_t readable_frames =
+      ready_frames > frame ? std::min(window_frames, ready_frames - frame) : 0;
+  simd::MapToScreen(data + frame, readable_frames, mapping,
+                    reinterpret_cast<float*>(points.data()));
+
+  // Handle edge case: The final frames are drawn as silence
+  for (size_t i = readable_frames; i < window_frames; i++) {
+    points[i] = vec2(mapping.x_origin + static_cast<float>(i) * x_scale,
+                     mapping.y_origin);
+  }
+}
 
-    waveform.push_back(vec2(x, y));
-    x += x_scale;
+void AudioVisualizer::CalculateDecimatedInstantGraph(
+    const float* data, const size_t& frame, const size_t& num_columns,
+    std::vector<vec2>* points_out) const {
+  const size_t window_frames =
+      sample_rate_ / static_cast<size_t>(instant_time_domain_display_rate_);
+  const size_t ready_frames = GetReadyFrames();
+  std::vector<float>& mins = instant_mins_;
+  std::vector<float>& maxs = instant_maxs_;
+  mins.resize(num_columns);
+  maxs.resize(num_columns);
+
+  if (frame + window_frames <= ready_frames) {
+    // Every column in one kernel call
+    simd::MinMaxPerBucket(data + frame, window_frames, num_columns,
+                          mins.data(), maxs.data());
+  } else {
+    for (size_t column = 0; column < num_columns; column++) {
+      const size_t first = frame + column * window_frames / num_columns;
+      const size_t last = frame + (column + 1) * window_frames / num_columns;
+      const size_t readable_last = std::min(last, ready_frames);
+
+      // Frames that are not ready yet are drawn as silence
+      mins[column] = 0.0f;
+      maxs[column] = 0.0f;
+      if (first < readable_last) {
+        simd::MinMax(data + first, readable_last - first, &mins[column],
+                     &maxs[column]);
+        if (readable_last < last) {
+          mins[column] = std::fminf(mins[column], 0.0f);
+          maxs[column] = std::fmaxf(maxs[column], 0.0f);
+        }
+      }
+    }
   }
 
-  return waveform;
+  // A vertical stroke from max to min per column
+  const simd::ScreenMapping mapping = MakeScreenMapping(
+      instant_time_domain_graph_bounds_,
+      instant_time_domain_graph_bounds_.getWidth() /
+          static_cast<float>(num_columns),
+      max_magnitude_general_);
+  std::vector<vec2>& points = *points_out;
+  points.resize(2 * num_columns);
+
+  for (size_t column = 0; column < num_columns; column++) {
+    const float x =
+        mapping.x_origin + static_cast<float>(column) * mapping.x_step;
+    points[2 * column] =
+        vec2(x, mapping.y_origin + maxs[column] * mapping.y_scale);
+    points[2 * column + 1] =
+        vec2(x, mapping.y_origin + mins[column] * mapping.y_scale);
+  }
 }
 
 void AudioVisualizer::DisplayGeneralGraphInTimeDomain(
-    const size_t& frame) const {
+    const FrameGeometry& geometry) const {
+  VISUALMUSIC_PROFILE_STAGE(FrameStage::kDisplayGeneralGraph);
   // Color only has effect in this scope
   gl::ScopedGlslProg glslScope(getStockShader(gl::ShaderDef().color()));
   gl::color(Color("white"));
@@ -118,84 +955,200 @@ void AudioVisualizer::DisplayGeneralGraphInTimeDomain(
   // Display border
   gl::drawStrokedRect(general_time_domain_graph_bounds_);
 
-  // Init the graph
-  PolyLine2f waveform = CalculateGeneralGraphInTimeDomain(frame);
+  // Only the prefix before the playhead is drawn
+  const size_t num_points = geometry.num_general_points;
+  if (num_points == 0) {
+    return;
+  }
 
-  if (!waveform.getPoints().empty()) {
-    gl::draw(waveform);
+  // The mesh holds every column, and is refreshed only when points were added
+  if (!general_graph_mesh_ ||
+      general_graph_mesh_capacity_ != 2 * general_num_columns_) {
+    general_graph_mesh_capacity_ = 2 * general_num_columns_;
+    general_graph_mesh_ = gl::VboMesh::create(
+        static_cast<uint32_t>(general_graph_mesh_capacity_), GL_LINE_STRIP,
+        {gl::VboMesh::Layout().usage(GL_DYNAMIC_DRAW).attrib(geom::POSITION,
+                                                              2)});
+    general_graph_mesh_points_ = 0;
+  }
+  if (general_graph_mesh_generation_ != geometry.general_generation) {
+    general_graph_mesh_generation_ = geometry.general_generation;
+    general_graph_mesh_points_ = 0;
   }
+  if (general_graph_mesh_points_ != geometry.general.size()) {
+    general_graph_mesh_->bufferAttrib(geom::POSITION,
+                                      geometry.general.size() * sizeof(vec2),
+                                      geometry.general.data());
+    general_graph_mesh_points_ = geometry.general.size();
+  }
+  gl::draw(general_graph_mesh_, 0, static_cast<GLsizei>(num_points));
 
   // Display current playtime
-  if (waveform.size() != 0) {
-    gl::color(Color("red"));
-
-    // Get last buffer
-    auto last_iter = --waveform.end();
-    const float x_scale = general_time_domain_graph_bounds_.getWidth() /
-                          (static_cast<float>(compressed_buffer_.size()));
-    gl::drawStrokedRect(Rectf(
-        last_iter->x, general_time_domain_graph_bounds_.getY1(),
-        last_iter->x + x_scale, general_time_domain_graph_bounds_.getY2()));
-  }
+  gl::color(Color("red"));
+  const float x = geometry.general[num_points - 1].x;
+  const float x_scale = general_time_domain_graph_bounds_.getWidth() /
+                        static_cast<float>(general_num_columns_);
+  gl::drawStrokedRect(Rectf(x, general_time_domain_graph_bounds_.getY1(),
+                            x + x_scale,
+                            general_time_domain_graph_bounds_.getY2()));
 }
 
 auto AudioVisualizer::CalculateGeneralGraphInTimeDomain(
-    const size_t& frame) const -> PolyLine2f {
-  // Init the graph
-  PolyLine2f waveform = PolyLine2f();
+    const size_t& frame) const -> size_t {
+  VISUALMUSIC_PROFILE_STAGE(FrameStage::kGeneralGraph);
+  UpdateGeneralGraph();
+
+  const size_t last_column =
+      std::min(frame / general_frames_per_column_, general_graph_columns_);
+  return 2 * last_column;
+}
+
+auto AudioVisualizer::GetGeneralGraphPoints() const
+    -> const std::vector<vec2>& {
+  return general_graph_points_;
+}
+
+void AudioVisualizer::ResetGeneralGraph() {
+  const EnvelopePyramid& envelope = GetEnvelope();
+  const size_t num_frames = envelope.GetNumFrames();
+
+  // One column per pixel at most, summarized by the matching pyramid level
+  general_num_columns_ = GetNumGeneralColumns();
+  general_frames_per_column_ = std::max<size_t>(
+      1, (num_frames + general_num_columns_ - 1) / general_num_columns_);
+  general_level_ = envelope.SelectLevel(general_frames_per_column_);
+
+  general_graph_points_.clear();
+  general_graph_points_.reserve(2 * general_num_columns_);
+  general_graph_columns_ = 0;
+  general_graph_max_magnitude_ = 0.0f;
+  general_graph_generation_++;
+}
+
+void AudioVisualizer::UpdateGeneralGraph() const {
+  const EnvelopePyramid& envelope = GetEnvelope();
+  const size_t num_frames = envelope.GetNumFrames();
+  if (num_frames == 0) {
+    return;
+  }
+
+  const size_t readable_frames = envelope.GetReadableFrames(general_level_);
+  const size_t readable_columns =
+      readable_frames == num_frames
+          ? general_num_columns_
+          : std::min(general_num_columns_,
+                     readable_frames / general_frames_per_column_);
+
+  // A progressive load may raise the maximum, which rescales every column
+  const float max_magnitude = envelope.GetMaxMagnitude();
+  if (max_magnitude != general_graph_max_magnitude_) {
+    general_graph_points_.clear();
+    general_graph_columns_ = 0;
+    general_graph_max_magnitude_ = max_magnitude;
+    general_graph_generation_++;
+  }
+
   const float wave_height = general_time_domain_graph_bounds_.getHeight();
   const float x_scale = general_time_domain_graph_bounds_.getWidth() /
-                        (static_cast<float>(compressed_buffer_.size()));
-  float x = general_time_domain_graph_bounds_.x1;
+                        static_cast<float>(general_num_columns_);
+
+  // Construct the new columns, a vertical stroke from max to min per column
+  EnvelopePyramid::Bucket bucket;
+  for (size_t column = general_graph_columns_; column < readable_columns;
+       column++) {
+    if (!envelope.Query(general_level_, column * general_frames_per_column_,
+                         (column + 1) * general_frames_per_column_,
+                         &bucket)) {
+      break;
+    }
 
-  // Construct the graph
-  for (size_t f = 0;
-       f < (frame / (sample_rate_ / general_time_domain_display_rate_)); f++) {
-    float y;
+    const float x = general_time_domain_graph_bounds_.x1 +
+                    static_cast<float>(column) * x_scale;
+    general_graph_points_.push_back(vec2(
+        x, general_time_domain_graph_bounds_.y2 -
+               ConvertMagnitudeToDisplayableRatio(bucket.max, max_magnitude) *
+                   wave_height));
+    general_graph_points_.push_back(vec2(
+        x, general_time_domain_graph_bounds_.y2 -
+               ConvertMagnitudeToDisplayableRatio(bucket.min, max_magnitude) *
+                   wave_height));
+    general_graph_columns_ = column + 1;
+  }
+}
+
+void AudioVisualizer::DisplayLiveGeneralGraph() const {
+  VISUALMUSIC_PROFILE_STAGE(FrameStage::kDisplayGeneralGraph);
+  // Color only has effect in this scope
+  gl::ScopedGlslProg glslScope(getStockShader(gl::ShaderDef().color()));
+  gl::color(Color("white"));
 
-    y = general_time_domain_graph_bounds_.y2 -
-        ConvertMagnitudeToDisplayableRatio(compressed_buffer_[f],
-                                           max_magnitude_compressed_) *
-            wave_height;
+  // Display border
+  gl::drawStrokedRect(general_time_domain_graph_bounds_);
 
-    waveform.push_back(vec2(x, y));
-    x += x_scale;
+  CalculateLiveGeneralGraph(&live_general_line_.getPoints());
+  if (!live_general_line_.getPoints().empty()) {
+    gl::draw(live_general_line_);
   }
+}
 
-  return waveform;
+auto AudioVisualizer::CalculateLiveGeneralGraph() const -> PolyLine2f {
+  PolyLine2f envelope = PolyLine2f();
+  CalculateLiveGeneralGraph(&envelope.getPoints());
+  return envelope;
 }
 
-void AudioVisualizer::ConstructCompressedBuffer() {
-  float magnitude_per_range = 0;
+void AudioVisualizer::CalculateLiveGeneralGraph(
+    std::vector<vec2>* points_out) const {
+  VISUALMUSIC_PROFILE_STAGE(FrameStage::kLiveGeneralGraph);
+  std::vector<vec2>& points = *points_out;
+  if (live_ == nullptr) {
+    points.clear();
+    return;
+  }
 
-  for (size_t frame = 0; frame < buffer_.getNumFrames(); frame++) {
-    // Add value to range
-    for (size_t channel = 0; channel < buffer_.getNumChannels(); channel++) {
-      magnitude_per_range += buffer_.getChannel(channel)[frame];
-    }
+  const size_t num_buckets = live_->GetNumEnvelopeBuckets();
+  const float max_magnitude = max_magnitude_general_;
+  const float wave_height = general_time_domain_graph_bounds_.getHeight();
+  const float x_scale = general_time_domain_graph_bounds_.getWidth() /
+                        static_cast<float>(live_->GetEnvelopeCapacity());
+
+  // The envelope scrolls to the left as buckets are added. It is reserved
+  // whole, so it does not reallocate while the window fills.
+  points.reserve(2 * live_->GetEnvelopeCapacity());
+  points.resize(2 * num_buckets);
+  for (size_t i = 0; i < num_buckets; i++) {
+    const EnvelopePyramid::Bucket& bucket = live_->GetEnvelopeBucket(i);
+    const float x = general_time_domain_graph_bounds_.x2 -
+                    static_cast<float>(num_buckets - i) * x_scale;
+
+    points[2 * i] = vec2(
+        x, general_time_domain_graph_bounds_.y2 -
+               ConvertMagnitudeToDisplayableRatio(bucket.max, max_magnitude) *
+                   wave_height);
+    points[2 * i + 1] = vec2(
+        x, general_time_domain_graph_bounds_.y2 -
+               ConvertMagnitudeToDisplayableRatio(bucket.min, max_magnitude) *
+                   wave_height);
+  }
+}
 
-    // If end range, input data to compress_buffer, and reset variable
-    if ((frame + 1) % (sample_rate_ / general_time_domain_display_rate_) == 0) {
-      compressed_buffer_.push_back(
-          magnitude_per_range *
-          static_cast<float>(general_time_domain_display_rate_) *
-          static_cast<float>(sample_rate_ * buffer_.getNumChannels()));
-      magnitude_per_range = 0;
-    }
+auto AudioVisualizer::GetNumGeneralColumns() const -> size_t {
+  // No more columns than pixels, nor than the general display rate allows
+  const size_t pixel_columns = static_cast<size_t>(
+      std::max(1.0f, general_time_domain_graph_bounds_.getWidth()));
+  const size_t rate_columns = GetEnvelope().GetNumFrames() *
+                              general_time_domain_display_rate_ / sample_rate_;
 
-    // Else if ending frame
-    else if (frame == buffer_.getNumFrames() - 1) {
-      compressed_buffer_.push_back(
-          magnitude_per_range /
-          static_cast<float>(
-              (buffer_.getSize() %
-               (sample_rate_ / general_time_domain_display_rate_)) *
-              buffer_.getNumChannels()));
-    }
-  }
+  return std::max<size_t>(1, std::min(pixel_columns, rate_columns));
+}
+
+void AudioVisualizer::ConstructEnvelopePyramid() {
+  envelope_.Build(track_channels_.data(), track_channels_.size(),
+                  track_frames_);
 }
 
-void AudioVisualizer::Display3DGraph(const size_t& frame) const {
+void AudioVisualizer::Display3DGraph(const FrameGeometry& geometry) const {
+  VISUALMUSIC_PROFILE_STAGE(FrameStage::kDisplay3DGraph);
   // Color only has effect in this scope
   gl::ScopedGlslProg glslScope(getStockShader(gl::ShaderDef().color()));
   gl::color(Color("white"));
@@ -203,163 +1156,489 @@ void AudioVisualizer::Display3DGraph(const size_t& frame) const {
   // Display border
   gl::drawStrokedRect(three_dimension_graph_bounds_);
 
-  // Display multiple frequency domain graph
-  for (size_t i = 0; i < three_dimension_display_rate_; i++) {
-    // Avoid out of script
+  const size_t num_slots = geometry.row_indices.size();
+  if (num_slots == 0) {
+    return;
+  }
 
-    if (frame < i * kFrequencyRange) {
+  // A mesh per slot, uploaded when the slot receives a new row
+  const size_t num_bins = geometry.rows.size() / num_slots;
+  if (three_dimension_meshes_.size() != num_slots ||
+      three_dimension_mesh_bins_ != num_bins) {
+    three_dimension_meshes_.assign(num_slots, gl::VboMeshRef());
+    three_dimension_mesh_indices_.assign(num_slots, kNoRow);
+    three_dimension_mesh_bins_ = num_bins;
+  }
+  if (three_dimension_mesh_generation_ != geometry.rows_generation) {
+    three_dimension_mesh_indices_.assign(num_slots, kNoRow);
+    three_dimension_mesh_generation_ = geometry.rows_generation;
+  }
+
+  const size_t frame = geometry.frame;
+  const float num_rows = static_cast<float>(num_slots);
+
+  // Display multiple frequency domain graph, the newest in front
+  for (size_t i = 0; i < num_slots; i++) {
+    if (frame < i * spectral_hop_size_) {
       break;
     }
 
-    vec2 top_left_corner = vec2(
-        three_dimension_graph_bounds_.getX1() +
-            static_cast<float>(i) * three_dimension_graph_bounds_.getWidth() /
-                static_cast<float>(three_dimension_display_rate_),
-        three_dimension_graph_bounds_.getY2() -
-            three_dimension_graph_bounds_.getHeight() / 2 -
-            static_cast<float>(i) *
-                (three_dimension_graph_bounds_.getHeight() / 2) /
-                static_cast<float>(three_dimension_display_rate_));
-
-    vec2 bottom_right_corner =
-        vec2(three_dimension_graph_bounds_.getX2(),
-             three_dimension_graph_bounds_.getY2() -
-                 static_cast<float>(i) *
-                     (three_dimension_graph_bounds_.getHeight() / 2) /
-                     static_cast<float>(three_dimension_display_rate_));
-
-    Rectf graph_bounds = Rectf(top_left_corner, bottom_right_corner);
-
-    PolyLine2f waveform = CalculateInstantGraphInFrequencyDomain(
-        (frame - i * kFrequencyRange), graph_bounds);
-
-    if (!waveform.getPoints().empty()) {
-      float color_indicator =
-          1.0f - static_cast<float>(i) /
-                     static_cast<float>(three_dimension_display_rate_);
+    const size_t index = frame / spectral_hop_size_ - i;
+    const size_t slot = index % num_slots;
+    if (geometry.row_indices[slot] != index) {
+      continue;
+    }
+
+    if (three_dimension_mesh_indices_[slot] != index) {
+      if (!three_dimension_meshes_[slot]) {
+        three_dimension_meshes_[slot] = gl::VboMesh::create(
+            static_cast<uint32_t>(num_bins), GL_LINE_STRIP,
+            {gl::VboMesh::Layout().usage(GL_DYNAMIC_DRAW).attrib(
+                geom::POSITION, 2)});
+      }
+      three_dimension_meshes_[slot]->bufferAttrib(
+          geom::POSITION, num_bins * sizeof(vec2),
+          geometry.rows.data() + slot * num_bins);
+      three_dimension_mesh_indices_[slot] = index;
+    }
+
+    const simd::ScreenMapping mapping =
+        Get3DGraphRowMapping(i, geometry.max_magnitude);
+    gl::ScopedModelMatrix scoped_matrix;
+    gl::translate(vec2(mapping.x_origin, mapping.y_origin));
+    gl::scale(vec2(mapping.x_step, mapping.y_scale));
+
+    // Different state of white
+    const float color_indicator = 1.0f - static_cast<float>(i) / num_rows;
+    gl::color(Color(color_indicator, color_indicator, color_indicator));
+    gl::draw(three_dimension_meshes_[slot]);
+  }
+}
+
+auto AudioVisualizer::Update3DGraph(const size_t& frame) const -> size_t {
+  VISUALMUSIC_PROFILE_STAGE(FrameStage::k3DGraph);
+  const size_t num_bins = GetNumDisplayBins();
+  const size_t ready_spectral_frames =
+      ready_spectral_frames_.load(std::memory_order_acquire);
+  if (num_bins == 0 || three_dimension_row_indices_.empty()) {
+    return 0;
+  }
+
+  // Bins are spread over [0, 1), magnitudes are scaled when drawn
+  simd::ScreenMapping mapping;
+  mapping.x_step = 1.0f / static_cast<float>(num_bins);
+
+  // Lazy tiles follow the playhead, ahead of it in the direction it moves
+  if (spectral_tiles_.IsActive()) {
+    const size_t playhead_index = frame / spectral_hop_size_;
+    if (playhead_index != prefetch_index_) {
+      prefetch_direction_ = playhead_index > prefetch_index_ ? 1 : -1;
+      prefetch_index_ = playhead_index;
+    }
+    spectral_tiles_.Prefetch(playhead_index, prefetch_direction_,
+                             three_dimension_display_rate_);
+  }
+
+  size_t num_computed = 0;
+  for (size_t i = 0; i < three_dimension_display_rate_; i++) {
+    if (frame < i * spectral_hop_size_) {
+      break;
+    }
 
-      // Different state of white
-      gl::color(Color(color_indicator, color_indicator, color_indicator));
-      gl::draw(waveform);
+    // Rows that stay on screen keep their slot, only new ones are computed
+    const size_t index = frame / spectral_hop_size_ - i;
+    const size_t slot = index % three_dimension_display_rate_;
+    if (three_dimension_row_indices_[slot] == index ||
+        index >= ready_spectral_frames) {
+      continue;
     }
+
+    vec2* points = three_dimension_rows_.data() + slot * num_bins;
+    if (!MapDisplayRow(index, mapping, points)) {
+      continue;
+    }
+    three_dimension_row_indices_[slot] = index;
+    num_computed++;
+  }
+
+  return num_computed;
+}
+
+auto AudioVisualizer::Get3DGraphRow(const size_t& index) const
+    -> std::vector<vec2> {
+  if (three_dimension_row_indices_.empty()) {
+    return std::vector<vec2>();
+  }
+
+  const size_t slot = index % three_dimension_display_rate_;
+  if (three_dimension_row_indices_[slot] != index) {
+    return std::vector<vec2>();
   }
+
+  const size_t num_bins = GetNumDisplayBins();
+  const vec2* points = three_dimension_rows_.data() + slot * num_bins;
+  return std::vector<vec2>(points, points + num_bins);
+}
+
+auto AudioVisualizer::Get3DGraphRowBounds(const size_t& i) const -> Rectf {
+  const float step = static_cast<float>(i) /
+                     static_cast<float>(three_dimension_display_rate_);
+  const float half_height = three_dimension_graph_bounds_.getHeight() / 2;
+  const float y2 = three_dimension_graph_bounds_.getY2() - step * half_height;
+  return Rectf(vec2(three_dimension_graph_bounds_.getX1() +
+                        step * three_dimension_graph_bounds_.getWidth(),
+                    y2 - half_height),
+               vec2(three_dimension_graph_bounds_.getX2(), y2));
+}
+
+auto AudioVisualizer::Get3DGraphRowMapping(const size_t& i,
+                                           const float& max_magnitude) const
+    -> simd::ScreenMapping {
+  // Row points have x in [0, 1), so a unit step spans the whole row
+  const Rectf bounds = Get3DGraphRowBounds(i);
+  return MakeScreenMapping(bounds, bounds.getWidth(), max_magnitude);
+}
+
+void AudioVisualizer::Reset3DGraph() {
+  const size_t num_rows = three_dimension_display_rate_;
+
+  three_dimension_rows_.assign(num_rows * GetNumDisplayBins(), vec2());
+  three_dimension_row_indices_.assign(num_rows, kNoRow);
+  three_dimension_generation_++;
 }
 
 auto AudioVisualizer::CalculateInstantGraphInFrequencyDomain(
     const size_t& frame, const Rectf& bounds) const -> PolyLine2f {
+  VISUALMUSIC_PROFILE_STAGE(FrameStage::kFrequencyGraph);
   // Init the graph
   PolyLine2f waveform = PolyLine2f();
-  const float wave_height = bounds.getHeight();
-  const float x_scale = bounds.getWidth() / static_cast<float>(kFrequencyRange);
-  float x = bounds.x1;
-
-  float* buffer = buffer_spectral_arr_[frame / kFrequencyRange]->getData();
+  const size_t index = frame / spectral_hop_size_;
 
-  // Construct the graph
-  for (size_t f = 0; f < kFrequencyRange; f++) {
-    float y;
+  if (index >= ready_spectral_frames_.load(std::memory_order_acquire)) {
+    return waveform;
+  }
 
-    y = bounds.y2 - ConvertMagnitudeToDisplayableRatio(
-                        buffer[f], static_cast<float>(max_magnitude_fft_)) *
-                        wave_height;
+  const size_t num_bins = GetNumDisplayBins();
+  const float x_scale = bounds.getWidth() / static_cast<float>(num_bins);
+  const simd::ScreenMapping mapping =
+      MakeScreenMapping(bounds, x_scale, GetDisplayMaxMagnitude());
 
-    waveform.push_back(vec2(x, y));
-    x += x_scale;
+  // Construct the graph
+  std::vector<vec2>& points = waveform.getPoints();
+  points.resize(num_bins);
+  if (!MapDisplayRow(index, mapping, points.data())) {
+    points.clear();
   }
 
   return waveform;
 }
 
-void AudioVisualizer::ConstructBufferSpectralArray(const size_t& fft_size) {
-  if (!isPowerOf2(fft_size)) {
-    throw std::invalid_argument("Range must be a power of 2");
+void AudioVisualizer::ConstructBufferSpectralArray(const size_t& fft_size,
+                                                   const size_t& hop_size,
+                                                   const WindowType& window) {
+  ResetBufferSpectralArray(fft_size, hop_size, window);
+  AnalyzeSpectralFrames(spectral_num_rows_);
+}
+
+void AudioVisualizer::ResetBufferSpectralArray(const size_t& fft_size,
+                                               const size_t& hop_size,
+                                               const WindowType& window) {
+  StftSettings settings;
+  settings.fft_size = fft_size;
+  settings.hop_size = hop_size == 0 ? fft_size : hop_size;
+  settings.window = window;
+  settings.backend = fft_backend_;
+
+  stft_engine_.reset(new StftEngine(settings));
+
+  spectral_hop_size_ = settings.hop_size;
+  cache_.Close();
+  spectral_num_rows_ = stft_engine_->CountFrames(track_frames_);
+  spectral_num_bins_ = stft_engine_->GetNumBins();
+  band_mapper_.Configure(band_settings_, spectral_num_bins_, sample_rate_);
+  band_num_bands_ = band_mapper_.IsEnabled() ? band_mapper_.GetNumBands() : 0;
+
+  // A compact storage only needs a few float rows to quantize from
+  spectra_quantized_ =
+      !spectra_tiled_ && spectral_storage_ != SpectralStorage::kFloat32;
+  size_t num_arena_rows = spectral_num_rows_;
+  if (spectra_quantized_) {
+    num_arena_rows = std::min(spectral_num_rows_, kStagingRows);
+  } else if (spectra_tiled_) {
+    // Lazy spectra live in tiles only
+    num_arena_rows = 0;
+    tile_row_.assign(std::max(spectral_num_bins_, band_num_bands_), 0.0f);
+  }
+
+  // The magnitudes of samples in [-1, 1] are at most fft_size
+  const float reference = static_cast<float>(fft_size);
+  if (spectra_quantized_) {
+    quantized_spectra_.Reset(spectral_num_rows_, spectral_num_bins_,
+                             spectral_storage_, reference);
+  } else {
+    quantized_spectra_.Release();
+  }
+  if (spectra_quantized_ && band_num_bands_ > 0) {
+    quantized_bands_.Reset(spectral_num_rows_, band_num_bands_,
+                           spectral_storage_, reference);
+  } else {
+    quantized_bands_.Release();
+  }
+
+  const bool in_arena = !spectra_quantized_ && !spectra_tiled_;
+  spectral_arena_.Reset(num_arena_rows, spectral_num_bins_);
+  spectral_rows_ = in_arena ? spectral_arena_.Row(0) : nullptr;
+  spectral_row_stride_ = spectral_arena_.GetRowStride();
+
+  if (band_num_bands_ > 0) {
+    band_arena_.Reset(num_arena_rows, band_num_bands_);
+    band_rows_ = in_arena ? band_arena_.Row(0) : nullptr;
+    band_row_stride_ = band_arena_.GetRowStride();
+  } else {
+    band_arena_.Release();
+    band_rows_ = nullptr;
+    band_row_stride_ = 0;
   }
 
+  written_spectral_frames_ = 0;
   max_magnitude_fft_ = 0.0f;
+  max_magnitude_bands_ = 0.0f;
+
+  // The rhythm follows the frames in order, which lazy tiles are not
+  if (spectra_tiled_) {
+    rhythm_.Release();
+  } else {
+    rhythm_.Reset(spectral_num_bins_, spectral_hop_size_, sample_rate_,
+                  spectral_num_rows_);
+  }
 
-  std::vector<audio::Buffer*> buffer_arr = GenerateBufferPerRange(fft_size);
-  audio::dsp::Fft fft = audio::dsp::Fft(fft_size);
-  audio::BufferSpectral* temp;
+  // Every lazy frame counts as ready, the display asks for its tile
+  if (spectra_tiled_ && !track_channels_.empty()) {
+    spectral_tiles_.Start(stft_engine_.get(),
+                          band_num_bands_ > 0 ? &band_mapper_ : nullptr,
+                          track_channels_[0], track_frames_,
+                          tile_settings_);
+    written_spectral_frames_ = spectral_num_rows_;
+  }
+  ready_spectral_frames_.store(written_spectral_frames_,
+                               std::memory_order_release);
+  Reset3DGraph();
+}
 
-  for (auto& buffer : buffer_arr) {
-    temp = new audio::BufferSpectral(fft_size);
-    fft.forward(buffer, temp);
-    buffer_spectral_arr_.push_back(temp);
+void AudioVisualizer::AnalyzeSpectralFrames(const size_t& last_frame) {
+  if (last_frame <= written_spectral_frames_ || track_channels_.empty()) {
+    return;
+  }
 
-    float max_temp = FindMaximumMagnitude(temp);
-    if (max_magnitude_fft_ < max_temp) {
-      max_magnitude_fft_ = max_temp;
+  const float* channel = track_channels_[0];
+  const size_t num_samples = track_frames_;
+
+  // Compact spectra go through the staging rows a chunk at a time, float
+  // spectra are written in place in one go
+  const size_t chunk_rows =
+      spectra_quantized_ ? spectral_arena_.GetNumRows() : last_frame;
+  while (written_spectral_frames_ < last_frame) {
+    const size_t first = written_spectral_frames_;
+    const size_t count = std::min(chunk_rows, last_frame - first);
+    const size_t first_row = spectra_quantized_ ? 0 : first;
+
+    // Frame 0 of the view is spectral frame first
+    const size_t offset = first * spectral_hop_size_;
+    FrameView frames =
+        stft_engine_->MakeFrameView(channel + offset, num_samples - offset);
+    float max_magnitude = stft_engine_->AnalyzeFrames(
+        frames, 0, count, spectral_arena_.Row(first_row),
+        spectral_row_stride_);
+
+    max_magnitude_fft_ = std::fmaxf(max_magnitude_fft_, max_magnitude);
+    rhythm_.AddFrames(spectral_arena_.Row(first_row), spectral_row_stride_,
+                      count);
+
+    // Bands of the new frames, published with them
+    if (band_num_bands_ > 0) {
+      max_magnitude_bands_ = std::fmaxf(
+          max_magnitude_bands_,
+          band_mapper_.ApplyRows(spectral_arena_.Row(first_row),
+                                 spectral_row_stride_, 0, count,
+                                 band_arena_.Row(first_row),
+                                 band_row_stride_));
     }
+
+    if (spectra_quantized_) {
+      for (size_t i = 0; i < count; i++) {
+        quantized_spectra_.Encode(first + i, spectral_arena_.Row(i));
+        if (band_num_bands_ > 0) {
+          quantized_bands_.Encode(first + i, band_arena_.Row(i));
+        }
+      }
+    }
+
+    written_spectral_frames_ = first + count;
+    ready_spectral_frames_.store(written_spectral_frames_,
+                                 std::memory_order_release);
+  }
+
+  if (written_spectral_frames_ == spectral_num_rows_) {
+    rhythm_.Finish();
+  }
+
+  // The staging rows are not needed once every frame is quantized
+  if (spectra_quantized_ && written_spectral_frames_ == spectral_num_rows_) {
+    spectral_arena_.Release();
+    band_arena_.Release();
   }
 }
 
-auto AudioVisualizer::ConvertMagnitudeToDisplayableRatio(
-    const float& magnitude, const float& max_magnitude) const -> float {
-  return 0.5f * (1 - magnitude / max_magnitude);
+auto AudioVisualizer::GetSpectralFrame(const size_t& index) const
+    -> const float* {
+  if (live_ != nullptr) {
+    return live_->GetSpectrum(index);
+  }
+  if (spectra_tiled_) {
+    decoded_spectrum_.resize(spectral_num_bins_);
+    spectral_tiles_.ReadRow(index, false, decoded_spectrum_.data(), true);
+    return decoded_spectrum_.data();
+  }
+  if (spectra_quantized_) {
+    decoded_spectrum_.resize(spectral_num_bins_);
+    quantized_spectra_.Decode(index, decoded_spectrum_.data());
+    return decoded_spectrum_.data();
+  }
+
+  return spectral_rows_ + index * spectral_row_stride_;
 }
 
-auto AudioVisualizer::FindMaximumMagnitude(const audio::Buffer& buffer) const
-    -> float {
-  float max_magnitude = 0;
+auto AudioVisualizer::GetNumSpectralFrames() const -> size_t {
+  return spectral_num_rows_;
+}
 
-  for (size_t i = 0; i < buffer.getSize(); i++) {
-    max_magnitude = std::fmaxf(max_magnitude, abs(buffer.getData()[i]));
+auto AudioVisualizer::GetNumSpectralBins() const -> size_t {
+  return spectral_num_bins_;
+}
+
+auto AudioVisualizer::GetBandFrame(const size_t& index) const
+    -> const float* {
+  if (band_num_bands_ == 0) {
+    return nullptr;
+  }
+  if (spectra_tiled_) {
+    decoded_bands_.resize(band_num_bands_);
+    spectral_tiles_.ReadRow(index, true, decoded_bands_.data(), true);
+    return decoded_bands_.data();
+  }
+  if (spectra_quantized_) {
+    decoded_bands_.resize(band_num_bands_);
+    quantized_bands_.Decode(index, decoded_bands_.data());
+    return decoded_bands_.data();
   }
 
-  return max_magnitude;
+  return band_rows_ + index * band_row_stride_;
 }
 
-auto AudioVisualizer::FindMaximumMagnitude(
-    const std::vector<float>& buffer) const -> float {
-  float max_magnitude = 0;
+auto AudioVisualizer::GetNumBands() const -> size_t {
+  return band_num_bands_;
+}
+
+auto AudioVisualizer::MapDisplayRow(const size_t& index,
+                                    const simd::ScreenMapping& mapping,
+                                    vec2* points) const -> bool {
+  const size_t num_bins = GetNumDisplayBins();
+  const bool bands = band_num_bands_ > 0;
+  if (IsChannelViewSelected()) {
+    const SpectralArena& rows = channel_analysis_.GetRows(channel_view_);
+    simd::MapToScreen(rows.Row(index),
+                      std::min(num_bins, channel_analysis_.GetRowSize()),
+                      mapping, reinterpret_cast<float*>(points));
+    return true;
+  }
+  if (spectra_tiled_ && live_ == nullptr) {
+    if (!spectral_tiles_.ReadRow(index, bands, tile_row_.data(), false)) {
+      return false;
+    }
+    simd::MapToScreen(tile_row_.data(), num_bins, mapping,
+                      reinterpret_cast<float*>(points));
+    return true;
+  }
+  if (!spectra_quantized_ || live_ != nullptr) {
+    const float* row = bands ? band_rows_ + index * band_row_stride_
+                             : GetSpectralFrame(index);
+    simd::MapToScreen(row, num_bins, mapping,
+                      reinterpret_cast<float*>(points));
+    return true;
+  }
 
-  for (float i : buffer) {
-    max_magnitude = std::fmaxf(max_magnitude, abs(i));
+  // Decoded a block at a time, so drawing allocates nothing
+  const size_t kBlockSize = 256;
+  float block[kBlockSize];
+  const QuantizedSpectra& rows = bands ? quantized_bands_ : quantized_spectra_;
+  simd::ScreenMapping block_mapping = mapping;
+  for (size_t first = 0; first < num_bins; first += kBlockSize) {
+    const size_t count = std::min(kBlockSize, num_bins - first);
+    rows.DecodeRange(index, first, count, block);
+    block_mapping.x_origin =
+        mapping.x_origin + static_cast<float>(first) * mapping.x_step;
+    simd::MapToScreen(block, count, block_mapping,
+                      reinterpret_cast<float*>(points + first));
   }
 
-  return max_magnitude;
+  return true;
 }
 
-auto AudioVisualizer::FindMaximumMagnitude(
-    const audio::BufferSpectral* buffer) const -> float {
-  float max_magnitude = 0;
+auto AudioVisualizer::GetNumDisplayBins() const -> size_t {
+  return band_num_bands_ > 0 ? band_num_bands_ : spectral_num_bins_;
+}
 
-  for (size_t i = 0; i < buffer->getSize(); i++) {
-    max_magnitude = std::fmaxf(max_magnitude, abs(buffer->getData()[i]));
+auto AudioVisualizer::GetDisplayMaxMagnitude() const -> float {
+  if (IsChannelViewSelected()) {
+    return channel_analysis_.GetMaxMagnitude(channel_view_);
+  }
+  if (spectra_tiled_ && live_ == nullptr) {
+    return band_num_bands_ > 0 ? spectral_tiles_.GetMaxBandMagnitude()
+                               : spectral_tiles_.GetMaxMagnitude();
   }
 
-  return max_magnitude;
+  return band_num_bands_ > 0 ? max_magnitude_bands_ : max_magnitude_fft_;
 }
 
-void AudioVisualizer::SetMaxMagnitude(const float& magnitude) {
-  max_magnitude_general_ = magnitude;
+auto AudioVisualizer::GetSpectralArena() const -> const SpectralArena& {
+  return spectral_arena_;
 }
 
-auto AudioVisualizer::GenerateBufferPerRange(const size_t& range_size) const
-    -> std::vector<audio::Buffer*> {
-  std::vector<audio::Buffer*> buffer_vector;
+auto AudioVisualizer::MakeScreenMapping(const Rectf& bounds,
+                                        const float& x_step,
+                                        const float& max_magnitude) const
+    -> simd::ScreenMapping {
+  // y2 - ConvertMagnitudeToDisplayableRatio(m) * height, expanded
+  simd::ScreenMapping mapping;
+  mapping.x_origin = bounds.x1;
+  mapping.x_step = x_step;
+  mapping.y_origin = bounds.y2 - 0.5f * bounds.getHeight();
+  mapping.y_scale = 0.5f * bounds.getHeight() / max_magnitude;
+  return mapping;
+}
 
-  for (size_t frame = 0; frame + range_size < buffer_.getNumFrames();
-       frame += range_size) {
-    auto* temp = new audio::Buffer(range_size, buffer_.getNumChannels());
+auto AudioVisualizer::ConvertMagnitudeToDisplayableRatio(
+    const float& magnitude, const float& max_magnitude) const -> float {
+  return 0.5f * (1 - magnitude / max_magnitude);
+}
 
-    // Copy a portion from the original buffer
-    temp->copyOffset(buffer_, range_size, 0, frame);
-    buffer_vector.push_back(temp);
-  }
+auto AudioVisualizer::FindMaximumMagnitude(const audio::Buffer& buffer) const
+    -> float {
+  return simd::AbsMax(buffer.getData(), buffer.getSize());
+}
 
-  // Handle the last frames
-  if (buffer_.getNumFrames() % range_size != 0) {
-    auto* temp = new audio::Buffer(range_size, buffer_.getNumChannels());
-    size_t current_frame =
-        buffer_.getNumFrames() - 1 - (buffer_.getNumFrames() % range_size);
+auto AudioVisualizer::FindMaximumMagnitude(
+    const std::vector<float>& buffer) const -> float {
+  return simd::AbsMax(buffer.data(), buffer.size());
+}
 
-    temp->copyOffset(buffer_, (buffer_.getNumFrames() % range_size), 0,
-                     current_frame);
-    buffer_vector.push_back(temp);
-  }
+auto AudioVisualizer::FindMaximumMagnitude(const float* data,
+                                           const size_t& size) const -> float {
+  return simd::AbsMax(data, size);
+}
 
-  return buffer_vector;
+void AudioVisualizer::SetMaxMagnitude(const float& magnitude) {
+  max_magnitude_general_ = magnitude;
 }
 
 }  // namespace visualmusic
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include "band_mapper.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "simd_kernels.h"
+
+namespace visualmusic {
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+auto HertzToMel(const double& frequency) -> double {
+  return 2595.0 * std::log10(1.0 + frequency / 700.0);
+}
+
+auto MelToHertz(const double& mel) -> double {
+  return 700.0 * (std::pow(10.0, mel / 2595.0) - 1.0);
+}
+
+}  // namespace
+
+BandMapper::BandMapper() : weight_offsets_(1, 0) {
+}
+
+void BandMapper::Configure(const BandSettings& settings,
+                           const size_t& num_bins, const size_t& sample_rate) {
+  settings_ = settings;
+  num_bins_ = num_bins;
+  first_bins_.clear();
+  weight_offsets_.assign(1, 0);
+  weights_.clear();
+
+  if (!IsEnabled()) {
+    return;
+  }
+
+  const size_t num_bands = settings_.num_bands;
+  const double max_frequency = static_cast<double>(sample_rate) / 2.0;
+  const double bin_width = max_frequency / static_cast<double>(num_bins);
+  const double min_frequency =
+      std::min(std::max(1.0, static_cast<double>(settings_.min_frequency)),
+               max_frequency / 2.0);
+  const double ratio = max_frequency / min_frequency;
+
+  // Edges of the mel filters, two more than the bands
+  std::vector<double> mel_edges(num_bands + 2);
+  for (size_t i = 0; i < mel_edges.size(); i++) {
+    const double low = HertzToMel(min_frequency);
+    const double high = HertzToMel(max_frequency);
+    mel_edges[i] = MelToHertz(low + (high - low) * static_cast<double>(i) /
+                                        static_cast<double>(num_bands + 1));
+  }
+
+  // Quality factor of bands spread evenly over the octaves
+  const double bands_per_octave =
+      static_cast<double>(num_bands) / std::log2(ratio);
+  const double quality = 1.0 / (std::pow(2.0, 1.0 / bands_per_octave) - 1.0);
+
+  std::vector<float> bin_weights(num_bins);
+  for (size_t band = 0; band < num_bands; band++) {
+    const double position = static_cast<double>(band);
+    const double count = static_cast<double>(num_bands);
+    double center = 0.0;
+    std::fill(bin_weights.begin(), bin_weights.end(), 0.0f);
+
+    for (size_t bin = 0; bin < num_bins; bin++) {
+      const double frequency = static_cast<double>(bin) * bin_width;
+      double weight = 0.0;
+
+      switch (settings_.scale) {
+        case BandScale::kLog: {
+          const double low = min_frequency * std::pow(ratio, position / count);
+          const double high =
+              min_frequency * std::pow(ratio, (position + 1.0) / count);
+          center = std::sqrt(low * high);
+          weight = frequency >= low && frequency < high ? 1.0 : 0.0;
+          break;
+        }
+        case BandScale::kMel: {
+          const double low = mel_edges[band];
+          const double high = mel_edges[band + 2];
+          center = mel_edges[band + 1];
+          if (frequency > low && frequency < high) {
+            weight = frequency <= center ? (frequency - low) / (center - low)
+                                         : (high - frequency) / (high - center);
+          }
+          break;
+        }
+        case BandScale::kConstantQ: {
+          center = min_frequency * std::pow(ratio, (position + 0.5) / count);
+          const double half_width = center / quality;
+          const double distance = std::fabs(frequency - center);
+          if (distance < half_width) {
+            weight = 0.5 + 0.5 * std::cos(kPi * distance / half_width);
+          }
+          break;
+        }
+        case BandScale::kLinear:
+          break;
+      }
+
+      bin_weights[bin] = static_cast<float>(weight);
+    }
+
+    AddBand(bin_weights, center / bin_width);
+  }
+}
+
+void BandMapper::AddBand(const std::vector<float>& bin_weights,
+                         const double& center_bin) {
+  size_t first = 0;
+  while (first < bin_weights.size() && bin_weights[first] == 0.0f) {
+    first++;
+  }
+  size_t last = bin_weights.size();
+  while (last > first && bin_weights[last - 1] == 0.0f) {
+    last--;
+  }
+
+  if (first == last) {
+    // Narrower than a bin: read the nearest one
+    first_bins_.push_back(std::min(
+        static_cast<size_t>(std::lround(std::max(0.0, center_bin))),
+        bin_weights.size() - 1));
+    weights_.push_back(1.0f);
+  } else {
+    float sum = 0.0f;
+    for (size_t bin = first; bin < last; bin++) {
+      sum += bin_weights[bin];
+    }
+
+    first_bins_.push_back(first);
+    for (size_t bin = first; bin < last; bin++) {
+      weights_.push_back(bin_weights[bin] / sum);
+    }
+  }
+
+  weight_offsets_.push_back(weights_.size());
+}
+
+auto BandMapper::IsEnabled() const -> bool {
+  return settings_.scale != BandScale::kLinear && settings_.num_bands > 0 &&
+         num_bins_ > 0;
+}
+
+auto BandMapper::GetSettings() const -> const BandSettings& {
+  return settings_;
+}
+
+auto BandMapper::GetNumBands() const -> size_t {
+  return first_bins_.size();
+}
+
+void BandMapper::GetBandBins(const size_t& band, size_t* first_bin,
+                             size_t* num_bins) const {
+  *first_bin = first_bins_[band];
+  *num_bins = weight_offsets_[band + 1] - weight_offsets_[band];
+}
+
+auto BandMapper::GetBandWeights(const size_t& band) const -> const float* {
+  return weights_.data() + weight_offsets_[band];
+}
+
+auto BandMapper::Apply(const float* magnitudes, float* bands) const -> float {
+  float max_magnitude = 0.0f;
+
+  for (size_t band = 0; band < first_bins_.size(); band++) {
+    bands[band] = simd::DotProduct(weights_.data() + weight_offsets_[band],
+                                   magnitudes + first_bins_[band],
+                                   weight_offsets_[band + 1] -
+                                       weight_offsets_[band]);
+    max_magnitude = std::fmaxf(max_magnitude, bands[band]);
+  }
+
+  return max_magnitude;
+}
+
+auto BandMapper::ApplyRows(const float* rows, const size_t& row_stride,
+                           const size_t& first_row, const size_t& last_row,
+                           float* band_rows,
+                           const size_t& band_row_stride) const -> float {
+  float max_magnitude = 0.0f;
+
+  for (size_t row = first_row; row < last_row; row++) {
+    max_magnitude =
+        std::fmaxf(max_magnitude, Apply(rows + row * row_stride,
+                                        band_rows + row * band_row_stride));
+  }
+
+  return max_magnitude;
+}
+
+}  // namespace visualmusic
@@ -0,0 +1,121 @@
+#include "batch_analyzer.h"
+
+#include <atomic>
+#include <exception>
+#include <thread>
+
+namespace visualmusic {
+
+BatchAnalyzer::BatchAnalyzer(const BatchSettings& settings,
+                             ProbeFunction probe, DecodeFunction decode)
+    : settings_(settings),
+      probe_(std::move(probe)),
+      decode_(std::move(decode)) {
+}
+
+auto BatchAnalyzer::Run(const std::vector<std::string>& paths)
+    -> std::vector<TrackResult> {
+  std::vector<TrackResult> results(paths.size());
+  peak_reserved_bytes_ = 0;
+
+  size_t num_workers = settings_.num_workers;
+  if (num_workers == 0) {
+    num_workers = std::max<size_t>(1, std::thread::hardware_concurrency());
+  }
+  num_workers = std::max<size_t>(1, std::min(num_workers, paths.size()));
+
+  // Tracks differ in length, so workers pull the next track from a shared
+  // index instead of owning a fixed range
+  std::atomic<size_t> next_track(0);
+  auto work = [this, &paths, &results, &next_track]() {
+    for (size_t track = next_track++; track < paths.size();
+         track = next_track++) {
+      results[track] = AnalyzeTrack(paths[track]);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t worker = 1; worker < num_workers; worker++) {
+    workers.emplace_back(work);
+  }
+
+  // The calling thread is the first worker
+  work();
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  return results;
+}
+
+auto BatchAnalyzer::GetPeakReservedBytes() const -> size_t {
+  return peak_reserved_bytes_;
+}
+
+auto BatchAnalyzer::AnalyzeTrack(const std::string& path) -> TrackResult {
+  TrackResult result;
+  result.path = path;
+
+  TrackInfo info;
+  try {
+    if (!probe_(path, &info)) {
+      result.error = "cannot read the track";
+      return result;
+    }
+  } catch (const std::exception& exception) {
+    result.error = exception.what();
+    return result;
+  }
+
+  const size_t bytes =
+      std::min(settings_.memory_budget,
+               TrackAnalyzer::EstimateBytes(info.num_frames, info.num_channels,
+                                            settings_.parameters));
+  Reserve(bytes);
+
+  try {
+    audio::BufferRef buffer = decode_(path);
+
+    if (!buffer) {
+      result.error = "cannot decode the track";
+    } else {
+      // One thread per track: the pool already keeps every core busy
+      TrackAnalyzer analyzer(settings_.parameters, 1);
+      analyzer.Analyze(*buffer);
+      buffer.reset();
+
+      result.key = analyzer.GetKey();
+      result.output_path = analyzer.Write(settings_.output_directory);
+      result.analyzed = !result.output_path.empty();
+      if (!result.analyzed) {
+        result.error = "cannot write the feature file";
+      }
+    }
+  } catch (const std::exception& exception) {
+    result.error = exception.what();
+  }
+
+  Release(bytes);
+  return result;
+}
+
+void BatchAnalyzer::Reserve(const size_t& bytes) {
+  std::unique_lock<std::mutex> lock(budget_mutex_);
+  budget_released_.wait(lock, [this, &bytes]() {
+    return reserved_bytes_ + bytes <= settings_.memory_budget;
+  });
+
+  reserved_bytes_ += bytes;
+  peak_reserved_bytes_ = std::max(peak_reserved_bytes_, reserved_bytes_);
+}
+
+void BatchAnalyzer::Release(const size_t& bytes) {
+  {
+    std::lock_guard<std::mutex> lock(budget_mutex_);
+    reserved_bytes_ -= bytes;
+  }
+  budget_released_.notify_all();
+}
+
+}  // namespace visualmusic
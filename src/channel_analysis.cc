@@ -0,0 +1,335 @@
+#include "channel_analysis.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <thread>
+
+#include "simd_kernels.h"
+
+namespace visualmusic {
+
+namespace {
+
+// Spectral frames transformed by one task, enough to amortize its Fft
+const size_t kMinBlockFrames = 32;
+
+// Frames of the mix and side signals derived by one task
+const size_t kDeriveFrames = 1 << 16;
+
+}  // namespace
+
+auto ChannelAnalysis::MakeViews(const size_t& num_channels)
+    -> std::vector<ChannelView> {
+  std::vector<ChannelView> views;
+  if (num_channels == 0) {
+    return views;
+  }
+
+  // The only channel of a mono track is its mix
+  views.push_back(ChannelView());
+  for (size_t channel = 0; num_channels > 1 && channel < num_channels;
+       channel++) {
+    ChannelView view;
+    view.kind = ChannelViewKind::kChannel;
+    view.channel = channel;
+    views.push_back(view);
+  }
+  if (num_channels == 2) {
+    ChannelView side;
+    side.kind = ChannelViewKind::kSide;
+    views.push_back(side);
+  }
+
+  return views;
+}
+
+auto ChannelAnalysis::GetViewName(const ChannelView& view,
+                                  const size_t& num_channels) -> std::string {
+  const bool stereo = num_channels == 2;
+  switch (view.kind) {
+    case ChannelViewKind::kMix:
+      return stereo ? "mid" : "mix";
+    case ChannelViewKind::kChannel:
+      if (stereo) {
+        return view.channel == 0 ? "left" : "right";
+      }
+      return "channel " + std::to_string(view.channel + 1);
+    case ChannelViewKind::kSide:
+      return "side";
+  }
+
+  return "";
+}
+
+void ChannelAnalysis::Reset(const size_t& num_frames,
+                            const size_t& num_channels,
+                            const StftSettings& settings,
+                            const BandMapper* bands) {
+  Release();
+
+  // The workers of Append split the frames, so each transform runs on one
+  StftSettings single_threaded = settings;
+  single_threaded.num_threads = 1;
+  engine_.reset(new StftEngine(single_threaded));
+
+  // The workers outlive the track unless their number changes
+  size_t num_workers = settings.num_threads;
+  if (num_workers == 0) {
+    num_workers = std::max<size_t>(1, std::thread::hardware_concurrency());
+  }
+  if (GetNumWorkers() != num_workers) {
+    pool_.reset(num_workers > 1 ? new WorkerPool(num_workers) : nullptr);
+    scratches_.clear();
+  }
+  if (scratch_fft_size_ != settings.fft_size) {
+    scratches_.clear();
+    scratch_fft_size_ = settings.fft_size;
+  }
+  scratches_.resize(num_workers);
+
+  bands_ = bands;
+  num_frames_ = num_frames;
+  num_channels_ = num_channels;
+  num_spectral_frames_ = engine_->CountFrames(num_frames);
+  analyzed_frames_ = 0;
+
+  // Everything is allocated up front, so readers never see a reallocation
+  for (const ChannelView& view : MakeViews(num_channels)) {
+    std::unique_ptr<ViewData> data(new ViewData());
+    data->view = view;
+    if (view.kind != ChannelViewKind::kChannel) {
+      data->signal.assign(num_frames, 0.0f);
+      data->samples = data->signal.data();
+    }
+    data->envelope.Reset(num_frames);
+    data->rows.Reset(num_spectral_frames_, GetRowSize());
+    views_.push_back(std::move(data));
+  }
+}
+
+void ChannelAnalysis::Release() {
+  views_.clear();
+  engine_.reset();
+  bands_ = nullptr;
+  num_frames_ = 0;
+  num_channels_ = 0;
+  num_spectral_frames_ = 0;
+  analyzed_frames_ = 0;
+}
+
+void ChannelAnalysis::Append(const audio::Buffer& buffer,
+                             const size_t& first_frame,
+                             const size_t& last_frame,
+                             const size_t& last_spectral_frame) {
+  std::vector<const float*> channels(buffer.getNumChannels());
+  for (size_t channel = 0; channel < channels.size(); channel++) {
+    channels[channel] = buffer.getChannel(channel);
+  }
+  Append(channels.data(), first_frame, last_frame, last_spectral_frame);
+}
+
+void ChannelAnalysis::Append(const float* const* channels,
+                             const size_t& first_frame,
+                             const size_t& last_frame,
+                             const size_t& last_spectral_frame) {
+  if (views_.empty()) {
+    return;
+  }
+
+  for (const std::unique_ptr<ViewData>& view : views_) {
+    if (view->view.kind == ChannelViewKind::kChannel) {
+      view->samples = channels[view->view.channel];
+    }
+  }
+
+  // The spectra of the mix and side read the frames derived here
+  DeriveSignals(channels, first_frame, last_frame);
+
+  // An envelope task per view, then blocks of spectral frames of every view,
+  // sized so that each worker takes a few
+  const size_t num_views = views_.size();
+  const size_t first_spectral = analyzed_frames_;
+  const size_t last_spectral =
+      std::max(first_spectral,
+               std::min(last_spectral_frame, num_spectral_frames_));
+  const size_t num_new_frames = last_spectral - first_spectral;
+  const size_t block_frames = std::max(
+      kMinBlockFrames,
+      (num_new_frames * num_views + 4 * GetNumWorkers() - 1) /
+          (4 * GetNumWorkers()));
+  const size_t blocks_per_view =
+      (num_new_frames + block_frames - 1) / block_frames;
+
+  std::vector<float> block_max(num_views * blocks_per_view, 0.0f);
+  RunTasks(num_views * (1 + blocks_per_view),
+           [&](size_t task, size_t worker) {
+             if (task < num_views) {
+               ViewData* view = views_[task].get();
+               view->envelope.Append(&view->samples, 1, first_frame,
+                                     last_frame);
+               return;
+             }
+
+             const size_t block = task - num_views;
+             const size_t first =
+                 first_spectral + (block % blocks_per_view) * block_frames;
+             const size_t last = std::min(first + block_frames, last_spectral);
+             block_max[block] = AnalyzeBlock(
+                 views_[block / blocks_per_view].get(), first, last, worker);
+           });
+
+  // Only this thread raises the maximums
+  for (size_t view = 0; view < num_views; view++) {
+    float max_magnitude = GetMaxMagnitude(view);
+    for (size_t block = 0; block < blocks_per_view; block++) {
+      max_magnitude =
+          std::fmaxf(max_magnitude, block_max[view * blocks_per_view + block]);
+    }
+    views_[view]->max_magnitude.store(max_magnitude,
+                                      std::memory_order_relaxed);
+  }
+  analyzed_frames_ = last_spectral;
+}
+
+void ChannelAnalysis::Finish() {
+  for (const std::unique_ptr<ViewData>& view : views_) {
+    view->envelope.Finish();
+  }
+}
+
+auto ChannelAnalysis::GetNumViews() const -> size_t {
+  return views_.size();
+}
+
+auto ChannelAnalysis::GetView(const size_t& view) const
+    -> const ChannelView& {
+  return views_[view]->view;
+}
+
+auto ChannelAnalysis::GetSignal(const size_t& view) const -> const float* {
+  return views_[view]->samples;
+}
+
+auto ChannelAnalysis::GetEnvelope(const size_t& view) const
+    -> const EnvelopePyramid& {
+  return views_[view]->envelope;
+}
+
+auto ChannelAnalysis::GetRows(const size_t& view) const
+    -> const SpectralArena& {
+  return views_[view]->rows;
+}
+
+auto ChannelAnalysis::GetRowSize() const -> size_t {
+  if (bands_ != nullptr) {
+    return bands_->GetNumBands();
+  }
+  return engine_ ? engine_->GetNumBins() : 0;
+}
+
+auto ChannelAnalysis::GetMaxMagnitude(const size_t& view) const -> float {
+  return views_[view]->max_magnitude.load(std::memory_order_relaxed);
+}
+
+auto ChannelAnalysis::GetNumAnalyzedFrames() const -> size_t {
+  return analyzed_frames_;
+}
+
+auto ChannelAnalysis::GetCapacityBytes() const -> size_t {
+  size_t bytes = 0;
+  for (const std::unique_ptr<ViewData>& view : views_) {
+    bytes += view->signal.capacity() * sizeof(float) +
+             view->envelope.GetNumBuckets() *
+                 sizeof(EnvelopePyramid::Bucket) +
+             view->rows.GetCapacityBytes();
+  }
+
+  return bytes;
+}
+
+void ChannelAnalysis::DeriveSignals(const float* const* channels,
+                                    const size_t& first_frame,
+                                    const size_t& last_frame) {
+  if (last_frame <= first_frame) {
+    return;
+  }
+
+  const float channel_scale = 1.0f / static_cast<float>(num_channels_);
+
+  const size_t num_tasks =
+      (last_frame - first_frame + kDeriveFrames - 1) / kDeriveFrames;
+  RunTasks(num_tasks, [&](size_t task, size_t) {
+    const size_t first = first_frame + task * kDeriveFrames;
+    const size_t count = std::min(kDeriveFrames, last_frame - first);
+    std::vector<const float*> block_channels(num_channels_);
+    for (size_t channel = 0; channel < num_channels_; channel++) {
+      block_channels[channel] = channels[channel] + first;
+    }
+
+    for (const std::unique_ptr<ViewData>& view : views_) {
+      float* output = view->signal.data() + first;
+      if (view->view.kind == ChannelViewKind::kMix) {
+        simd::MixDown(block_channels.data(), num_channels_, count,
+                      channel_scale, output);
+      } else if (view->view.kind == ChannelViewKind::kSide) {
+        const float* left = block_channels[0];
+        const float* right = block_channels[1];
+        for (size_t i = 0; i < count; i++) {
+          output[i] = 0.5f * (left[i] - right[i]);
+        }
+      }
+    }
+  });
+}
+
+void ChannelAnalysis::RunTasks(
+    const size_t& num_tasks, const std::function<void(size_t, size_t)>& task) {
+  if (pool_ != nullptr) {
+    pool_->Run(num_tasks, task);
+    return;
+  }
+
+  for (size_t index = 0; index < num_tasks; index++) {
+    task(index, 0);
+  }
+}
+
+auto ChannelAnalysis::GetNumWorkers() const -> size_t {
+  return pool_ != nullptr ? pool_->GetNumWorkers() : 1;
+}
+
+auto ChannelAnalysis::AnalyzeBlock(ViewData* view, const size_t& first,
+                                   const size_t& last, const size_t& worker)
+    -> float {
+  if (last <= first) {
+    return 0.0f;
+  }
+
+  // Only this worker touches its scratch
+  std::unique_ptr<StftEngine::Scratch>& scratch = scratches_[worker];
+  if (scratch == nullptr) {
+    scratch.reset(new StftEngine::Scratch(scratch_fft_size_));
+  }
+
+  // Frame 0 of the view is spectral frame first
+  const size_t count = last - first;
+  const size_t offset = first * engine_->GetSettings().hop_size;
+  const FrameView frames =
+      engine_->MakeFrameView(view->samples + offset, num_frames_ - offset);
+  if (bands_ == nullptr) {
+    return engine_->AnalyzeFrames(frames, 0, count, scratch.get(),
+                                  view->rows.Row(first),
+                                  view->rows.GetRowStride());
+  }
+
+  // Only the bands of the block are kept
+  SpectralArena spectra;
+  spectra.Reset(count, engine_->GetNumBins());
+  engine_->AnalyzeFrames(frames, 0, count, scratch.get(), spectra.Row(0),
+                         spectra.GetRowStride());
+  return bands_->ApplyRows(spectra.Row(0), spectra.GetRowStride(), 0, count,
+                           view->rows.Row(first), view->rows.GetRowStride());
+}
+
+}  // namespace visualmusic
@@ -0,0 +1,288 @@
+#include "envelope_pyramid.h"
+
+#include <thread>
+
+#include "simd_kernels.h"
+
+namespace visualmusic {
+
+namespace {
+
+/**
+ * Merge a bucket into another
+ * @param source
+ * @param destination
+ */
+void MergeBucket(const EnvelopePyramid::Bucket& source,
+                 EnvelopePyramid::Bucket* destination) {
+  destination->min = std::fminf(destination->min, source.min);
+  destination->max = std::fmaxf(destination->max, source.max);
+  destination->sum_squares += source.sum_squares;
+}
+
+}  // namespace
+
+const size_t EnvelopePyramid::kBaseBucketFrames;
+
+EnvelopePyramid::EnvelopePyramid()
+    : num_frames_(0),
+      appended_frames_(0),
+      finished_(false),
+      max_magnitude_(0.0f) {
+}
+
+auto EnvelopePyramid::CountBuckets(const size_t& num_frames) -> size_t {
+  size_t level_size = (num_frames + kBaseBucketFrames - 1) / kBaseBucketFrames;
+  size_t num_buckets = 0;
+
+  while (level_size > 0) {
+    num_buckets += level_size;
+    if (level_size == 1) {
+      break;
+    }
+    level_size = (level_size + 1) / 2;
+  }
+
+  return num_buckets;
+}
+
+void EnvelopePyramid::Reset(const size_t& num_frames) {
+  num_frames_ = num_frames;
+  level_offsets_.clear();
+  level_sizes_.clear();
+
+  size_t level_size = (num_frames + kBaseBucketFrames - 1) / kBaseBucketFrames;
+  size_t offset = 0;
+  while (level_size > 0) {
+    level_offsets_.push_back(offset);
+    level_sizes_.push_back(level_size);
+    offset += level_size;
+
+    if (level_size == 1) {
+      break;
+    }
+    level_size = (level_size + 1) / 2;
+  }
+
+  buckets_.resize(offset);
+  appended_frames_.store(0, std::memory_order_release);
+  finished_.store(false, std::memory_order_release);
+  max_magnitude_ = 0.0f;
+}
+
+void EnvelopePyramid::Build(const audio::Buffer& buffer,
+                            const size_t& num_threads) {
+  std::vector<const float*> channels(buffer.getNumChannels());
+  for (size_t channel = 0; channel < channels.size(); channel++) {
+    channels[channel] = buffer.getChannel(channel);
+  }
+  Build(channels.data(), channels.size(), buffer.getNumFrames(), num_threads);
+}
+
+void EnvelopePyramid::Build(const float* const* channels,
+                            const size_t& num_channels,
+                            const size_t& num_frames,
+                            const size_t& num_threads) {
+  Reset(num_frames);
+  if (GetNumLevels() == 0) {
+    Finish();
+    return;
+  }
+
+  const size_t num_buckets = level_sizes_[0];
+
+  size_t num_workers = num_threads;
+  if (num_workers == 0) {
+    num_workers = std::max<size_t>(1, std::thread::hardware_concurrency());
+  }
+  num_workers = std::min(num_workers, num_buckets);
+
+  // Level 0 is split into contiguous runs of buckets, one per worker
+  std::vector<float> worker_max(num_workers, 0.0f);
+  std::vector<std::thread> workers;
+  for (size_t worker = 1; worker < num_workers; worker++) {
+    workers.emplace_back([this, channels, num_channels, &worker_max, worker,
+                          num_buckets, num_workers]() {
+      worker_max[worker] = SummarizeFrames(
+          channels, num_channels, num_buckets * worker / num_workers,
+          num_buckets * (worker + 1) / num_workers, num_frames_);
+    });
+  }
+  worker_max[0] = SummarizeFrames(channels, num_channels, 0,
+                                  num_buckets / num_workers, num_frames_);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  // The upper levels only read level 0, which is small next to the buffer
+  SummarizeLevels(0, num_buckets);
+
+  float max_magnitude = 0.0f;
+  for (float magnitude : worker_max) {
+    max_magnitude = std::fmaxf(max_magnitude, magnitude);
+  }
+  max_magnitude_ = max_magnitude;
+
+  appended_frames_.store(num_frames_, std::memory_order_release);
+  Finish();
+}
+
+void EnvelopePyramid::Append(const audio::Buffer& buffer,
+                             const size_t& first_frame,
+                             const size_t& last_frame) {
+  std::vector<const float*> channels(buffer.getNumChannels());
+  for (size_t channel = 0; channel < channels.size(); channel++) {
+    channels[channel] = buffer.getChannel(channel);
+  }
+  Append(channels.data(), channels.size(), first_frame, last_frame);
+}
+
+void EnvelopePyramid::Append(const float* const* channels,
+                             const size_t& num_channels,
+                             const size_t& first_frame,
+                             const size_t& last_frame) {
+  if (last_frame <= first_frame) {
+    return;
+  }
+
+  // The bucket holding first_frame may have been summarized partially before
+  const size_t first_bucket = first_frame / kBaseBucketFrames;
+  const size_t last_bucket =
+      (last_frame + kBaseBucketFrames - 1) / kBaseBucketFrames;
+
+  float max_magnitude = SummarizeFrames(channels, num_channels, first_bucket,
+                                        last_bucket, last_frame);
+  SummarizeLevels(first_bucket, last_bucket);
+
+  max_magnitude_ = std::fmaxf(max_magnitude_, max_magnitude);
+  appended_frames_.store(last_frame, std::memory_order_release);
+}
+
+void EnvelopePyramid::Finish() {
+  finished_.store(true, std::memory_order_release);
+}
+
+void EnvelopePyramid::Assign(const size_t& num_frames, const Bucket* buckets) {
+  Reset(num_frames);
+  std::copy(buckets, buckets + buckets_.size(), buckets_.begin());
+
+  if (GetNumLevels() > 0) {
+    const Bucket& top = buckets_.back();
+    max_magnitude_ = std::fmaxf(std::fabs(top.min), std::fabs(top.max));
+  }
+
+  appended_frames_.store(num_frames_, std::memory_order_release);
+  Finish();
+}
+
+auto EnvelopePyramid::SelectLevel(const size_t& frames_per_column) const
+    -> size_t {
+  size_t level = 0;
+  while (level + 1 < GetNumLevels() &&
+         GetBucketFrames(level + 1) <= frames_per_column) {
+    level++;
+  }
+  return level;
+}
+
+auto EnvelopePyramid::Query(const size_t& level, const size_t& first_frame,
+                            const size_t& last_frame, Bucket* result) const
+    -> bool {
+  if (level >= GetNumLevels()) {
+    return false;
+  }
+
+  const size_t bucket_frames = GetBucketFrames(level);
+  const size_t readable_frames = GetReadableFrames(level);
+  const size_t readable_buckets =
+      std::min(level_sizes_[level],
+               (readable_frames + bucket_frames - 1) / bucket_frames);
+
+  const size_t first_bucket = first_frame / bucket_frames;
+  if (first_bucket >= readable_buckets) {
+    return false;
+  }
+  const size_t last_bucket = std::min(
+      readable_buckets,
+      std::max(first_bucket + 1,
+               (last_frame + bucket_frames - 1) / bucket_frames));
+
+  const Bucket* buckets = GetLevel(level);
+  *result = buckets[first_bucket];
+  for (size_t bucket = first_bucket + 1; bucket < last_bucket; bucket++) {
+    MergeBucket(buckets[bucket], result);
+  }
+
+  return true;
+}
+
+auto EnvelopePyramid::GetReadableFrames(const size_t& level) const -> size_t {
+  if (finished_.load(std::memory_order_acquire)) {
+    return num_frames_;
+  }
+
+  // Only complete buckets are final
+  const size_t bucket_frames = GetBucketFrames(level);
+  return appended_frames_.load(std::memory_order_acquire) / bucket_frames *
+         bucket_frames;
+}
+
+auto EnvelopePyramid::GetMaxMagnitude() const -> float {
+  return max_magnitude_;
+}
+
+auto EnvelopePyramid::SummarizeFrames(const float* const* channels,
+                                      const size_t& num_channels,
+                                      const size_t& first_bucket,
+                                      const size_t& last_bucket,
+                                      const size_t& end_frame) -> float {
+  const float channel_scale = 1.0f / static_cast<float>(num_channels);
+  float max_magnitude = 0.0f;
+  float mix[kBaseBucketFrames];
+  std::vector<const float*> bucket_channels(num_channels);
+
+  for (size_t bucket = first_bucket; bucket < last_bucket; bucket++) {
+    const size_t first_frame = bucket * kBaseBucketFrames;
+    const size_t num_frames =
+        std::min(first_frame + kBaseBucketFrames, end_frame) - first_frame;
+
+    // Mix every channel down to one value per frame
+    for (size_t channel = 0; channel < num_channels; channel++) {
+      bucket_channels[channel] = channels[channel] + first_frame;
+    }
+    simd::MixDown(bucket_channels.data(), num_channels, num_frames,
+                  channel_scale, mix);
+
+    Bucket summary;
+    simd::MinMaxSumSquares(mix, num_frames, &summary.min, &summary.max,
+                           &summary.sum_squares);
+
+    buckets_[bucket] = summary;
+    max_magnitude =
+        std::fmaxf(max_magnitude,
+                   std::fmaxf(std::fabs(summary.min), std::fabs(summary.max)));
+  }
+
+  return max_magnitude;
+}
+
+void EnvelopePyramid::SummarizeLevels(size_t first_bucket,
+                                      size_t last_bucket) {
+  for (size_t level = 1; level < GetNumLevels(); level++) {
+    const Bucket* children = GetLevel(level - 1);
+    const size_t num_children = level_sizes_[level - 1];
+    Bucket* parents = buckets_.data() + level_offsets_[level];
+
+    first_bucket /= 2;
+    last_bucket = (last_bucket + 1) / 2;
+
+    for (size_t parent = first_bucket; parent < last_bucket; parent++) {
+      parents[parent] = children[2 * parent];
+      if (2 * parent + 1 < num_children) {
+        MergeBucket(children[2 * parent + 1], &parents[parent]);
+      }
+    }
+  }
+}
+
+}  // namespace visualmusic
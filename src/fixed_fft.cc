@@ -0,0 +1,241 @@
+#include "fixed_fft.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace visualmusic {
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+}  // namespace
+
+template <size_t N>
+FixedFft<N>::Tables::Tables()
+    : twiddle_real(N / 4),
+      twiddle_imag(N / 4),
+      split_real(N / 2),
+      split_imag(N / 2),
+      bit_reverse(N / 2) {
+  const size_t half = N / 2;
+
+  for (size_t k = 0; k < N / 4; k++) {
+    const double phase =
+        -2.0 * kPi * static_cast<double>(k) / static_cast<double>(half);
+    twiddle_real[k] = static_cast<float>(std::cos(phase));
+    twiddle_imag[k] = static_cast<float>(std::sin(phase));
+  }
+
+  for (size_t k = 0; k < half; k++) {
+    const double phase =
+        -2.0 * kPi * static_cast<double>(k) / static_cast<double>(N);
+    split_real[k] = static_cast<float>(std::cos(phase));
+    split_imag[k] = static_cast<float>(std::sin(phase));
+  }
+
+  size_t num_bits = 0;
+  while ((static_cast<size_t>(1) << num_bits) < half) {
+    num_bits++;
+  }
+  for (size_t i = 0; i < half; i++) {
+    size_t reversed = 0;
+    for (size_t bit = 0; bit < num_bits; bit++) {
+      reversed |= ((i >> bit) & 1) << (num_bits - 1 - bit);
+    }
+    bit_reverse[i] = reversed;
+  }
+}
+
+template <size_t N>
+auto FixedFft<N>::GetTables() -> const Tables& {
+  // Built on first use, as C++11 has no constexpr trigonometry. A local
+  // static is initialized once even when several workers get here together.
+  static const Tables tables;
+  return tables;
+}
+
+template <size_t N>
+void FixedFft<N>::TransformBatch(const float* frames,
+                                 const size_t& frame_stride,
+                                 const size_t& num_frames, float* real,
+                                 float* imag) {
+  const size_t half = N / 2;
+  const size_t lanes = kNumLanes;
+  const Tables& tables = GetTables();
+
+  // Even samples are the real parts and odd samples the imaginary parts,
+  // stored in bit-reversed order with the lanes of an index side by side
+  for (size_t i = 0; i < half; i++) {
+    const size_t source = 2 * tables.bit_reverse[i];
+    float* lane_real = real + i * lanes;
+    float* lane_imag = imag + i * lanes;
+
+    for (size_t lane = 0; lane < num_frames; lane++) {
+      lane_real[lane] = frames[lane * frame_stride + source];
+      lane_imag[lane] = frames[lane * frame_stride + source + 1];
+    }
+    for (size_t lane = num_frames; lane < lanes; lane++) {
+      lane_real[lane] = 0.0f;
+      lane_imag[lane] = 0.0f;
+    }
+  }
+
+  // Radix-2 butterflies, each over every lane at once
+  for (size_t size = 2; size <= half; size *= 2) {
+    const size_t span = size / 2;
+    const size_t step = half / size;
+
+    for (size_t start = 0; start < half; start += size) {
+      for (size_t k = 0; k < span; k++) {
+        const float twiddle_real = tables.twiddle_real[k * step];
+        const float twiddle_imag = tables.twiddle_imag[k * step];
+        float* top_real = real + (start + k) * lanes;
+        float* top_imag = imag + (start + k) * lanes;
+        float* bottom_real = top_real + span * lanes;
+        float* bottom_imag = top_imag + span * lanes;
+
+        for (size_t lane = 0; lane < lanes; lane++) {
+          const float product_real = bottom_real[lane] * twiddle_real -
+                                     bottom_imag[lane] * twiddle_imag;
+          const float product_imag = bottom_real[lane] * twiddle_imag +
+                                     bottom_imag[lane] * twiddle_real;
+          bottom_real[lane] = top_real[lane] - product_real;
+          bottom_imag[lane] = top_imag[lane] - product_imag;
+          top_real[lane] += product_real;
+          top_imag[lane] += product_imag;
+        }
+      }
+    }
+  }
+}
+
+template <size_t N>
+void FixedFft<N>::Forward(const float* input, float* real, float* imag) {
+  const size_t half = N / 2;
+  const size_t lanes = kNumLanes;
+  const Tables& tables = GetTables();
+  std::vector<float> workspace(kWorkspaceSize);
+  float* packed_real = workspace.data();
+  float* packed_imag = workspace.data() + half * lanes;
+
+  TransformBatch(input, N, 1, packed_real, packed_imag);
+
+  // Split the packed spectrum into the spectra of the even and odd samples,
+  // then combine them into the spectrum of the frame
+  real[0] = packed_real[0] + packed_imag[0];
+  imag[0] = packed_real[0] - packed_imag[0];
+  for (size_t k = 1; k < half; k++) {
+    const size_t mirror = (half - k) * lanes;
+    const float even_real = 0.5f * (packed_real[k * lanes] +
+                                    packed_real[mirror]);
+    const float even_imag = 0.5f * (packed_imag[k * lanes] -
+                                    packed_imag[mirror]);
+    const float odd_real = 0.5f * (packed_imag[k * lanes] +
+                                   packed_imag[mirror]);
+    const float odd_imag = -0.5f * (packed_real[k * lanes] -
+                                    packed_real[mirror]);
+
+    real[k] = even_real + tables.split_real[k] * odd_real -
+              tables.split_imag[k] * odd_imag;
+    imag[k] = even_imag + tables.split_real[k] * odd_imag +
+              tables.split_imag[k] * odd_real;
+  }
+}
+
+template <size_t N>
+auto FixedFft<N>::ForwardMagnitudes(const float* frames,
+                                    const size_t& frame_stride,
+                                    const size_t& num_frames,
+                                    float* magnitudes,
+                                    const size_t& row_stride,
+                                    float* workspace) -> float {
+  const size_t half = N / 2;
+  const size_t lanes = kNumLanes;
+  const Tables& tables = GetTables();
+  float* packed_real = workspace;
+  float* packed_imag = workspace + half * lanes;
+  float lane_max[kNumLanes] = {};
+  float lane_magnitudes[kNumLanes];
+
+  for (size_t first = 0; first < num_frames; first += lanes) {
+    const size_t count = std::min(lanes, num_frames - first);
+    float* rows = magnitudes + first * row_stride;
+    TransformBatch(frames + first * frame_stride, frame_stride, count,
+                   packed_real, packed_imag);
+
+    for (size_t lane = 0; lane < count; lane++) {
+      rows[lane * row_stride] = std::fabs(packed_real[lane] +
+                                          packed_imag[lane]);
+      lane_max[lane] = std::fmaxf(lane_max[lane], rows[lane * row_stride]);
+    }
+
+    for (size_t k = 1; k < half; k++) {
+      const float* top_real = packed_real + k * lanes;
+      const float* top_imag = packed_imag + k * lanes;
+      const float* mirror_real = packed_real + (half - k) * lanes;
+      const float* mirror_imag = packed_imag + (half - k) * lanes;
+      const float split_real = tables.split_real[k];
+      const float split_imag = tables.split_imag[k];
+
+      for (size_t lane = 0; lane < lanes; lane++) {
+        const float even_real = 0.5f * (top_real[lane] + mirror_real[lane]);
+        const float even_imag = 0.5f * (top_imag[lane] - mirror_imag[lane]);
+        const float odd_real = 0.5f * (top_imag[lane] + mirror_imag[lane]);
+        const float odd_imag = -0.5f * (top_real[lane] - mirror_real[lane]);
+        const float bin_real =
+            even_real + split_real * odd_real - split_imag * odd_imag;
+        const float bin_imag =
+            even_imag + split_real * odd_imag + split_imag * odd_real;
+
+        lane_magnitudes[lane] =
+            std::sqrt(bin_real * bin_real + bin_imag * bin_imag);
+        lane_max[lane] = std::fmaxf(lane_max[lane], lane_magnitudes[lane]);
+      }
+
+      for (size_t lane = 0; lane < count; lane++) {
+        rows[lane * row_stride + k] = lane_magnitudes[lane];
+      }
+    }
+  }
+
+  return *std::max_element(lane_max, lane_max + lanes);
+}
+
+template class FixedFft<256>;
+template class FixedFft<512>;
+template class FixedFft<1024>;
+template class FixedFft<2048>;
+template class FixedFft<4096>;
+template class FixedFft<8192>;
+
+namespace {
+
+template <size_t N>
+auto MakeKernel() -> FixedFftKernel {
+  FixedFftKernel kernel;
+  kernel.fft_size = N;
+  kernel.num_lanes = FixedFft<N>::kNumLanes;
+  kernel.workspace_size = FixedFft<N>::kWorkspaceSize;
+  kernel.forward_magnitudes = &FixedFft<N>::ForwardMagnitudes;
+  return kernel;
+}
+
+const FixedFftKernel kKernels[] = {
+    MakeKernel<256>(),  MakeKernel<512>(),  MakeKernel<1024>(),
+    MakeKernel<2048>(), MakeKernel<4096>(), MakeKernel<8192>(),
+};
+
+}  // namespace
+
+auto GetFixedFftKernel(const size_t& fft_size) -> const FixedFftKernel* {
+  for (const FixedFftKernel& kernel : kKernels) {
+    if (kernel.fft_size == fft_size) {
+      return &kernel;
+    }
+  }
+
+  return nullptr;
+}
+
+}  // namespace visualmusic
@@ -0,0 +1,213 @@
+#include "frame_profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+
+namespace visualmusic {
+
+namespace {
+
+// Names of the stages, in the order of FrameStage
+const char* const kStageNames[kNumFrameStages] = {
+    "update",
+    "draw",
+    "display",
+    "display_instant_graph",
+    "display_general_graph",
+    "display_3d_graph",
+    "build_geometry",
+    "instant_graph",
+    "general_graph",
+    "live_general_graph",
+    "frequency_graph",
+    "3d_graph",
+    "text",
+};
+
+/**
+ * Returns the position of the highest set bit of a non-zero value
+ * @param value
+ * @return exponent
+ */
+auto GetExponent(uint64_t value) -> size_t {
+  size_t exponent = 0;
+  for (size_t shift = 32; shift > 0; shift /= 2) {
+    if (value >> shift != 0) {
+      value >>= shift;
+      exponent += shift;
+    }
+  }
+
+  return exponent;
+}
+
+}  // namespace
+
+const size_t StageHistogram::kSubBuckets;
+const size_t StageHistogram::kMaxExponent;
+const size_t StageHistogram::kNumBuckets;
+
+StageHistogram::StageHistogram() : count_(0), sum_(0), max_(0) {
+  for (std::atomic<uint64_t>& bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+void StageHistogram::Record(const uint64_t& nanoseconds) {
+  buckets_[GetBucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+  uint64_t max = max_.load(std::memory_order_relaxed);
+  while (nanoseconds > max &&
+         !max_.compare_exchange_weak(max, nanoseconds,
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+void StageHistogram::Reset() {
+  for (std::atomic<uint64_t>& bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+  count_.store(0, std::memory_order_relaxed);
+  sum_.store(0, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+auto StageHistogram::GetCount() const -> uint64_t {
+  return count_.load(std::memory_order_relaxed);
+}
+
+auto StageHistogram::GetMax() const -> uint64_t {
+  return max_.load(std::memory_order_relaxed);
+}
+
+auto StageHistogram::GetPercentile(const double& percentile) const
+    -> double {
+  // Bucket counts are read one by one, so the total is counted again
+  // rather than taken from count_ while other threads record
+  uint64_t counts[kNumBuckets];
+  uint64_t total = 0;
+  for (size_t bucket = 0; bucket < kNumBuckets; bucket++) {
+    counts[bucket] = buckets_[bucket].load(std::memory_order_relaxed);
+    total += counts[bucket];
+  }
+  if (total == 0) {
+    return 0.0;
+  }
+
+  const uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(
+             std::ceil(percentile / 100.0 * static_cast<double>(total))));
+  uint64_t seen = 0;
+  size_t bucket = 0;
+  for (; bucket + 1 < kNumBuckets; bucket++) {
+    seen += counts[bucket];
+    if (seen >= rank) {
+      break;
+    }
+  }
+
+  // Buckets below kSubBuckets hold a single duration
+  const double start = static_cast<double>(GetBucketStart(bucket));
+  const double middle =
+      bucket < kSubBuckets
+          ? start
+          : (start + static_cast<double>(GetBucketStart(bucket + 1))) / 2.0;
+  return std::min(middle, static_cast<double>(GetMax()));
+}
+
+auto StageHistogram::GetStats() const -> StageStats {
+  StageStats stats;
+  stats.count = GetCount();
+  if (stats.count == 0) {
+    return stats;
+  }
+
+  stats.mean = static_cast<double>(sum_.load(std::memory_order_relaxed)) /
+               static_cast<double>(stats.count) * 1e-3;
+  stats.p50 = GetPercentile(50) * 1e-3;
+  stats.p95 = GetPercentile(95) * 1e-3;
+  stats.p99 = GetPercentile(99) * 1e-3;
+  stats.max = static_cast<double>(GetMax()) * 1e-3;
+  return stats;
+}
+
+auto StageHistogram::GetBucket(const uint64_t& nanoseconds) -> size_t {
+  if (nanoseconds < kSubBuckets) {
+    return static_cast<size_t>(nanoseconds);
+  }
+
+  // The 3 bits below the highest one pick the bucket within its power of two
+  const size_t exponent = GetExponent(nanoseconds);
+  const size_t sub_bucket =
+      static_cast<size_t>(nanoseconds >> (exponent - 3)) - kSubBuckets;
+  return std::min((exponent - 2) * kSubBuckets + sub_bucket,
+                  kNumBuckets - 1);
+}
+
+auto StageHistogram::GetBucketStart(const size_t& bucket) -> uint64_t {
+  if (bucket < kSubBuckets) {
+    return bucket;
+  }
+
+  const size_t exponent = bucket / kSubBuckets + 2;
+  return static_cast<uint64_t>(kSubBuckets + bucket % kSubBuckets)
+         << (exponent - 3);
+}
+
+void FrameProfiler::Record(const FrameStage& stage,
+                           const uint64_t& nanoseconds) {
+  histograms_[static_cast<size_t>(stage)].Record(nanoseconds);
+}
+
+void FrameProfiler::Reset() {
+  for (StageHistogram& histogram : histograms_) {
+    histogram.Reset();
+  }
+}
+
+auto FrameProfiler::GetHistogram(const FrameStage& stage) const
+    -> const StageHistogram& {
+  return histograms_[static_cast<size_t>(stage)];
+}
+
+auto FrameProfiler::WriteCsv(const std::string& path) const -> bool {
+  std::ofstream file(path, std::ios::trunc);
+  if (!file) {
+    return false;
+  }
+
+  file << "stage,count,mean_us,p50_us,p95_us,p99_us,max_us\n";
+  for (size_t stage = 0; stage < kNumFrameStages; stage++) {
+    const StageStats stats = histograms_[stage].GetStats();
+    if (stats.count == 0) {
+      continue;
+    }
+    file << kStageNames[stage] << "," << stats.count << "," << stats.mean
+         << "," << stats.p50 << "," << stats.p95 << "," << stats.p99 << ","
+         << stats.max << "\n";
+  }
+
+  return static_cast<bool>(file);
+}
+
+auto FrameProfiler::GetStageName(const FrameStage& stage) -> const char* {
+  return kStageNames[static_cast<size_t>(stage)];
+}
+
+auto FrameProfiler::GetTime() -> uint64_t {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+auto GetFrameProfiler() -> FrameProfiler& {
+  static FrameProfiler profiler;
+  return profiler;
+}
+
+}  // namespace visualmusic
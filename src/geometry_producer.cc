@@ -0,0 +1,117 @@
+#include "geometry_producer.h"
+
+namespace visualmusic {
+
+const int GeometryProducer::kFresh;
+const int GeometryProducer::kIndexMask;
+
+GeometryProducer::GeometryProducer() : middle_(2), num_built_(0) {
+}
+
+GeometryProducer::~GeometryProducer() {
+  Stop();
+}
+
+void GeometryProducer::Start(const AudioVisualizer* visualizer) {
+  Stop();
+
+  // A restart on the same visualizer, after a resize or a new view, keeps
+  // drawing the last picture until the next one is built, and its buffers
+  // are refreshed by generation. Buffers of another visualizer would only be
+  // partly refreshed.
+  if (visualizer != visualizer_) {
+    for (FrameGeometry& buffer : buffers_) {
+      buffer = FrameGeometry();
+    }
+    visualizer_ = visualizer;
+    back_ = 0;
+    front_ = 1;
+    middle_ = 2;
+    has_front_ = false;
+  }
+  pending_ = false;
+  busy_ = false;
+  stopping_ = false;
+  num_built_ = 0;
+
+  worker_ = std::thread(&GeometryProducer::Run, this);
+}
+
+void GeometryProducer::Stop() {
+  if (!worker_.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  requested_.notify_all();
+  built_.notify_all();
+  worker_.join();
+}
+
+auto GeometryProducer::IsActive() const -> bool {
+  return worker_.joinable();
+}
+
+auto GeometryProducer::GetVisualizer() const -> const AudioVisualizer* {
+  return visualizer_;
+}
+
+void GeometryProducer::Request(const size_t& frame) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    requested_frame_ = frame;
+    pending_ = true;
+  }
+  requested_.notify_one();
+}
+
+auto GeometryProducer::Acquire() -> const FrameGeometry* {
+  // The worker never writes the middle buffer, so taking it is one exchange
+  if ((middle_.load(std::memory_order_acquire) & kFresh) != 0) {
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndexMask;
+    has_front_ = true;
+  }
+
+  return has_front_ ? &buffers_[front_] : nullptr;
+}
+
+void GeometryProducer::WaitIdle() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  built_.wait(lock, [this]() {
+    return stopping_ || !IsActive() || (!pending_ && !busy_);
+  });
+}
+
+auto GeometryProducer::GetNumBuilt() const -> size_t {
+  return num_built_.load(std::memory_order_relaxed);
+}
+
+void GeometryProducer::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (true) {
+    requested_.wait(lock, [this]() { return stopping_ || pending_; });
+    if (stopping_) {
+      return;
+    }
+
+    const size_t frame = requested_frame_;
+    pending_ = false;
+    busy_ = true;
+
+    lock.unlock();
+    visualizer_->BuildGeometry(frame, &buffers_[back_]);
+    back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) &
+            kIndexMask;
+    num_built_.fetch_add(1, std::memory_order_relaxed);
+    lock.lock();
+
+    busy_ = false;
+    built_.notify_all();
+  }
+}
+
+}  // namespace visualmusic
@@ -0,0 +1,284 @@
+#include "live_analyzer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "simd_kernels.h"
+
+namespace visualmusic {
+
+/**
+ * Returns the settings of a single-threaded Fft with a hop of one frame
+ * @param settings
+ * @return Fft settings
+ */
+static auto MakeStftSettings(const LiveSettings& settings) -> StftSettings {
+  StftSettings stft_settings;
+  stft_settings.fft_size = settings.fft_size;
+  stft_settings.hop_size = settings.fft_size;
+  stft_settings.num_threads = 1;
+  stft_settings.backend = settings.fft_backend;
+  return stft_settings;
+}
+
+/**
+ * Returns the bucket of silence
+ * @return bucket
+ */
+static auto MakeEmptyBucket() -> EnvelopePyramid::Bucket {
+  EnvelopePyramid::Bucket bucket;
+  bucket.min = 0.0f;
+  bucket.max = 0.0f;
+  bucket.sum_squares = 0.0f;
+  return bucket;
+}
+
+const size_t LiveAnalyzer::kChunkFrames;
+
+LiveAnalyzer::LiveAnalyzer(SampleRing* ring, const LiveSettings& settings,
+                           Clock clock)
+    : ring_(ring),
+      settings_(settings),
+      clock_(std::move(clock)),
+      num_channels_(ring->GetNumChannels()),
+      window_frames_(std::max<size_t>(
+          1, settings.sample_rate /
+                 std::max<size_t>(1, settings.instant_display_rate))),
+      bucket_frames_(std::max<size_t>(
+          1, settings.sample_rate /
+                 std::max<size_t>(1, settings.general_display_rate))),
+      partial_bucket_(MakeEmptyBucket()),
+      stft_engine_(MakeStftSettings(settings)),
+      scratch_(settings.fft_size) {
+  size_t history_frames = 1;
+  while (history_frames < std::max(window_frames_, settings_.fft_size)) {
+    history_frames *= 2;
+  }
+  history_.assign(num_channels_ * history_frames, 0.0f);
+  history_mask_ = history_frames - 1;
+
+  chunk_.assign(num_channels_ * kChunkFrames, 0.0f);
+  chunk_channels_.assign(num_channels_, nullptr);
+  mix_.assign(kChunkFrames, 0.0f);
+  window_.assign(num_channels_ * window_frames_, 0.0f);
+
+  buckets_.assign(std::max<size_t>(1, settings_.general_display_rate *
+                                          settings_.general_seconds),
+                  MakeEmptyBucket());
+
+  fft_frame_.assign(settings_.fft_size, 0.0f);
+  spectra_.Reset(std::max<size_t>(1, settings_.three_dimension_display_rate),
+                 stft_engine_.GetNumBins());
+  spectrum_max_.assign(spectra_.GetNumRows(), 0.0f);
+  rhythm_.Reset(stft_engine_.GetNumBins(), settings_.fft_size,
+                settings_.sample_rate,
+                std::max<size_t>(1, settings_.rhythm_seconds *
+                                        settings_.sample_rate /
+                                        settings_.fft_size));
+}
+
+auto LiveAnalyzer::Update() -> size_t {
+  // The stamp is read first, so it is never newer than the drained frames
+  const int64_t arrival_time = ring_->GetLastWriteTime();
+
+  // Frames written during the update wait for the next one
+  size_t remaining = ring_->GetReadableFrames();
+  size_t drained = 0;
+
+  while (remaining > 0) {
+    const size_t count = ring_->Read(
+        chunk_.data(), kChunkFrames, std::min(remaining, kChunkFrames));
+    if (count == 0) {
+      break;
+    }
+
+    Consume(count);
+    remaining -= count;
+    drained += count;
+  }
+
+  if (drained == 0) {
+    return 0;
+  }
+
+  for (size_t channel = 0; channel < num_channels_; channel++) {
+    CopyNewest(channel, window_frames_,
+               window_.data() + channel * window_frames_);
+  }
+
+  pending_time_ = arrival_time;
+  has_pending_ = true;
+  return drained;
+}
+
+void LiveAnalyzer::Consume(const size_t& num_frames) {
+  const size_t hop_size = settings_.fft_size;
+  const float channel_scale = 1.0f / static_cast<float>(num_channels_);
+
+  for (size_t offset = 0; offset < num_frames;) {
+    // Stop at the end of the bucket and at the end of the hop
+    const size_t count = std::min(
+        std::min(num_frames - offset, bucket_frames_ - partial_frames_),
+        hop_size - num_frames_ % hop_size);
+
+    for (size_t channel = 0; channel < num_channels_; channel++) {
+      const float* source = chunk_.data() + channel * kChunkFrames + offset;
+      float* history = history_.data() + channel * (history_mask_ + 1);
+
+      for (size_t i = 0; i < count; i++) {
+        history[(num_frames_ + i) & history_mask_] = source[i];
+      }
+      chunk_channels_[channel] = source;
+    }
+
+    // Mix every channel down, as the envelope pyramid does
+    EnvelopePyramid::Bucket summary;
+    simd::MixDown(chunk_channels_.data(), num_channels_, count, channel_scale,
+                  mix_.data());
+    simd::MinMaxSumSquares(mix_.data(), count, &summary.min, &summary.max,
+                           &summary.sum_squares);
+
+    if (partial_frames_ == 0) {
+      partial_bucket_ = summary;
+    } else {
+      partial_bucket_.min = std::fminf(partial_bucket_.min, summary.min);
+      partial_bucket_.max = std::fmaxf(partial_bucket_.max, summary.max);
+      partial_bucket_.sum_squares += summary.sum_squares;
+    }
+    partial_frames_ += count;
+    num_frames_ += count;
+    offset += count;
+
+    if (partial_frames_ == bucket_frames_) {
+      PushBucket();
+    }
+    if (num_frames_ % hop_size == 0) {
+      TransformNewest();
+    }
+  }
+}
+
+void LiveAnalyzer::PushBucket() {
+  buckets_[num_buckets_ % buckets_.size()] = partial_bucket_;
+  num_buckets_++;
+  partial_bucket_ = MakeEmptyBucket();
+  partial_frames_ = 0;
+
+  // Buckets leave the envelope, so the maximum can fall
+  float max_magnitude = 0.0f;
+  for (size_t i = 0; i < GetNumEnvelopeBuckets(); i++) {
+    max_magnitude = std::fmaxf(
+        max_magnitude,
+        std::fmaxf(std::fabs(buckets_[i].min), std::fabs(buckets_[i].max)));
+  }
+  max_magnitude_ = max_magnitude;
+}
+
+void LiveAnalyzer::TransformNewest() {
+  const size_t slot = num_spectra_ % spectra_.GetNumRows();
+
+  CopyNewest(0, settings_.fft_size, fft_frame_.data());
+  spectrum_max_[slot] = stft_engine_.TransformFrame(
+      fft_frame_.data(), settings_.fft_size, &scratch_, spectra_.Row(slot));
+  rhythm_.AddFrame(spectra_.Row(slot));
+  num_spectra_++;
+
+  const size_t num_kept = std::min(num_spectra_, spectrum_max_.size());
+  max_spectral_magnitude_ = *std::max_element(
+      spectrum_max_.begin(), spectrum_max_.begin() + num_kept);
+}
+
+void LiveAnalyzer::CopyNewest(const size_t& channel, const size_t& num_frames,
+                              float* output) const {
+  const float* history = history_.data() + channel * (history_mask_ + 1);
+
+  // Frames before the start are silent
+  const size_t num_silent =
+      num_frames > num_frames_ ? num_frames - num_frames_ : 0;
+  std::fill(output, output + num_silent, 0.0f);
+
+  const size_t first_frame = num_frames_ + num_silent - num_frames;
+  for (size_t i = num_silent; i < num_frames; i++) {
+    output[i] = history[(first_frame + i - num_silent) & history_mask_];
+  }
+}
+
+void LiveAnalyzer::MarkGeometryReady() {
+  if (!has_pending_) {
+    return;
+  }
+  has_pending_ = false;
+
+  const double latency = static_cast<double>(clock_() - pending_time_) * 1e-9;
+  latency_sum_ += latency;
+  latency_.num_measurements++;
+  latency_.last = latency;
+  latency_.max = std::max(latency_.max, latency);
+  latency_.mean = latency_sum_ / static_cast<double>(latency_.num_measurements);
+}
+
+auto LiveAnalyzer::GetLatency() const -> LiveLatency {
+  return latency_;
+}
+
+auto LiveAnalyzer::GetSettings() const -> const LiveSettings& {
+  return settings_;
+}
+
+auto LiveAnalyzer::GetNumChannels() const -> size_t {
+  return num_channels_;
+}
+
+auto LiveAnalyzer::GetNumFrames() const -> size_t {
+  return num_frames_;
+}
+
+auto LiveAnalyzer::GetWindowFrames() const -> size_t {
+  return window_frames_;
+}
+
+auto LiveAnalyzer::GetWindow(const size_t& channel) const -> const float* {
+  return window_.data() + channel * window_frames_;
+}
+
+auto LiveAnalyzer::GetMaxMagnitude() const -> float {
+  return std::fmaxf(max_magnitude_,
+                    std::fmaxf(std::fabs(partial_bucket_.min),
+                               std::fabs(partial_bucket_.max)));
+}
+
+auto LiveAnalyzer::GetNumEnvelopeBuckets() const -> size_t {
+  return std::min(num_buckets_, buckets_.size());
+}
+
+auto LiveAnalyzer::GetEnvelopeCapacity() const -> size_t {
+  return buckets_.size();
+}
+
+auto LiveAnalyzer::GetEnvelopeBucket(const size_t& index) const
+    -> const EnvelopePyramid::Bucket& {
+  const size_t first = num_buckets_ - GetNumEnvelopeBuckets();
+  return buckets_[(first + index) % buckets_.size()];
+}
+
+auto LiveAnalyzer::GetNumSpectra() const -> size_t {
+  return num_spectra_;
+}
+
+auto LiveAnalyzer::GetNumBins() const -> size_t {
+  return spectra_.GetRowSize();
+}
+
+auto LiveAnalyzer::GetSpectrum(const size_t& index) const -> const float* {
+  return spectra_.Row(index % spectra_.GetNumRows());
+}
+
+auto LiveAnalyzer::GetMaxSpectralMagnitude() const -> float {
+  return max_spectral_magnitude_;
+}
+
+auto LiveAnalyzer::GetRhythm() const -> const RhythmTracker& {
+  return rhythm_;
+}
+
+}  // namespace visualmusic
@@ -0,0 +1,42 @@
+#include "live_input.h"
+
+namespace visualmusic {
+
+LiveInputNode::LiveInputNode(SampleRing* ring, const Format& format)
+    : NodeAutoPullable(format), ring_(ring) {
+}
+
+void LiveInputNode::process(audio::Buffer* buffer) {
+  ring_->Write(*buffer, SampleRing::GetTime());
+}
+
+FileDrivenInput::FileDrivenInput(const audio::Buffer& buffer, SampleRing* ring,
+                                 const size_t& frames_per_block)
+    : buffer_(buffer),
+      ring_(ring),
+      frames_per_block_(std::max<size_t>(1, frames_per_block)) {
+}
+
+auto FileDrivenInput::PushBlock(const int64_t& time) -> size_t {
+  const size_t count =
+      std::min(frames_per_block_, buffer_.getNumFrames() - position_);
+  if (count == 0 || buffer_.getNumChannels() == 0) {
+    return 0;
+  }
+
+  const size_t written =
+      ring_->Write(buffer_.getData() + position_, buffer_.getNumChannels(),
+                   buffer_.getNumFrames(), count, time);
+  position_ += count;
+  return written;
+}
+
+auto FileDrivenInput::GetPosition() const -> size_t {
+  return position_;
+}
+
+auto FileDrivenInput::IsFinished() const -> bool {
+  return position_ == buffer_.getNumFrames();
+}
+
+}  // namespace visualmusic
@@ -0,0 +1,253 @@
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace visualmusic {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+    : data_(nullptr),
+      size_(0),
+      writable_(false),
+      file_handle_(INVALID_HANDLE_VALUE),
+      mapping_handle_(nullptr) {
+}
+
+auto MappedFile::Open(const std::string& path) -> bool {
+  Close();
+
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+    CloseHandle(file);
+    return false;
+  }
+
+  HANDLE mapping =
+      CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping == nullptr) {
+    CloseHandle(file);
+    return false;
+  }
+
+  void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (data == nullptr) {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+
+  file_handle_ = file;
+  mapping_handle_ = mapping;
+  data_ = static_cast<const char*>(data);
+  size_ = static_cast<size_t>(size.QuadPart);
+  return true;
+}
+
+auto MappedFile::Create(const std::string& path, const size_t& size) -> bool {
+  Close();
+  if (size == 0) {
+    return false;
+  }
+
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                            FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  // The mapping extends the file to its size
+  const uint64_t size64 = size;
+  HANDLE mapping = CreateFileMappingA(
+      file, nullptr, PAGE_READWRITE, static_cast<DWORD>(size64 >> 32),
+      static_cast<DWORD>(size64 & 0xffffffffu), nullptr);
+  if (mapping == nullptr) {
+    CloseHandle(file);
+    return false;
+  }
+
+  void* data = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size);
+  if (data == nullptr) {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+
+  file_handle_ = file;
+  mapping_handle_ = mapping;
+  data_ = static_cast<const char*>(data);
+  size_ = size;
+  writable_ = true;
+  return true;
+}
+
+auto MappedFile::Flush(const size_t& offset, const size_t& length) -> bool {
+  if (!writable_ || offset >= size_) {
+    return false;
+  }
+
+  const size_t count = std::min(length, size_ - offset);
+  return FlushViewOfFile(data_ + offset, count) != 0 &&
+         FlushFileBuffers(file_handle_) != 0;
+}
+
+void MappedFile::Advise(const MappedAccess& /*access*/,
+                        const size_t& /*offset*/,
+                        const size_t& /*length*/) const {
+}
+
+void MappedFile::Close() {
+  if (data_ != nullptr) {
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_handle_);
+    CloseHandle(file_handle_);
+  }
+
+  data_ = nullptr;
+  size_ = 0;
+  writable_ = false;
+  file_handle_ = INVALID_HANDLE_VALUE;
+  mapping_handle_ = nullptr;
+}
+
+#else
+
+MappedFile::MappedFile() : data_(nullptr), size_(0), writable_(false) {
+}
+
+auto MappedFile::Open(const std::string& path) -> bool {
+  Close();
+
+  int file = open(path.c_str(), O_RDONLY);
+  if (file < 0) {
+    return false;
+  }
+
+  struct stat status;
+  if (fstat(file, &status) != 0 || status.st_size == 0) {
+    close(file);
+    return false;
+  }
+
+  // The mapping stays valid after the descriptor is closed
+  void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ,
+                    MAP_PRIVATE, file, 0);
+  close(file);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  data_ = static_cast<const char*>(data);
+  size_ = static_cast<size_t>(status.st_size);
+  return true;
+}
+
+auto MappedFile::Create(const std::string& path, const size_t& size) -> bool {
+  Close();
+  if (size == 0) {
+    return false;
+  }
+
+  int file = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (file < 0) {
+    return false;
+  }
+  if (ftruncate(file, static_cast<off_t>(size)) != 0) {
+    close(file);
+    return false;
+  }
+
+  // Pages are shared with the file, so they are written back to it
+  void* data =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+  close(file);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  data_ = static_cast<const char*>(data);
+  size_ = size;
+  writable_ = true;
+  return true;
+}
+
+auto MappedFile::Flush(const size_t& offset, const size_t& length) -> bool {
+  if (!writable_ || offset >= size_) {
+    return false;
+  }
+
+  const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  const size_t first = offset / page * page;
+  const size_t last = offset + std::min(length, size_ - offset);
+  return msync(const_cast<char*>(data_) + first, last - first, MS_SYNC) == 0;
+}
+
+void MappedFile::Advise(const MappedAccess& access, const size_t& offset,
+                        const size_t& length) const {
+  if (data_ == nullptr || offset >= size_ || length == 0) {
+    return;
+  }
+
+  int advice = MADV_NORMAL;
+  switch (access) {
+    case MappedAccess::kNormal:
+      advice = MADV_NORMAL;
+      break;
+    case MappedAccess::kSequential:
+      advice = MADV_SEQUENTIAL;
+      break;
+    case MappedAccess::kRandom:
+      advice = MADV_RANDOM;
+      break;
+    case MappedAccess::kWillNeed:
+      advice = MADV_WILLNEED;
+      break;
+    case MappedAccess::kDontNeed:
+      advice = MADV_DONTNEED;
+      break;
+  }
+
+  // madvise takes whole pages. Dropping a page of a shared mapping keeps
+  // its data in the file, and a read-only page is read again from it.
+  const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  const size_t first = offset / page * page;
+  const size_t last = offset + std::min(length, size_ - offset);
+  madvise(const_cast<char*>(data_) + first, last - first, advice);
+}
+
+void MappedFile::Close() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+
+  data_ = nullptr;
+  size_ = 0;
+  writable_ = false;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+  Close();
+}
+
+}  // namespace visualmusic
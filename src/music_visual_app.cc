@@ -1,131 +1,512 @@
 #include "music_visual_app.h"
 
+#include <algorithm>
+#include <cstdarg>
+
 namespace visualmusic {
 
 MusicVisualApp::MusicVisualApp() = default;
 
 void MusicVisualApp::setup() {
+  if (kLiveInput) {
+    SetupLiveInput();
+    return;
+  }
+
   auto ctx = audio::Context::master();
 
+  // Initialize the buffer player node. The output device renders a block
+  // ahead, which is the output latency of the playhead.
+  playhead_.SetSampleRate(ctx->getSampleRate());
+  playhead_.SetOutputLatency(
+      static_cast<double>(ctx->getOutput()->getDevice()->getFramesPerBlock()) /
+      static_cast<double>(ctx->getSampleRate()));
+  buffer_player_node_ = ctx->makeNode(new PlayheadPlayerNode(&playhead_));
+
+  // Connect nodes & context
+  buffer_player_node_ >> ctx->getOutput();
+  ctx->enable();
+
+  // Analysis results are cached next to the application
+  fs::path cache_directory = getAppPath() / kCacheDirectory;
+  fs::create_directories(cache_directory);
+  ConfigureVisualizer(&visualizer_);
+
+  if (!kPlaylist.empty()) {
+    // Each track is decoded and analyzed whole on the playlist's thread
+    const size_t sample_rate = ctx->getSampleRate();
+    playlist_.Start(
+        kPlaylist,
+        [sample_rate](const std::string &asset) {
+          return audio::load(app::loadAsset(asset), sample_rate)
+              ->loadBuffer();
+        },
+        [this](AudioVisualizer *visualizer) {
+          ConfigureVisualizer(visualizer);
+        },
+        GetVisualizerBounds(), sample_rate);
+    return;
+  }
+
+  // The track decoded by an earlier run is mapped instead of decoded again,
+  // unless the asset changed since. Otherwise the streaming load decodes it
+  // into the file, and neither the player nor the visualizer holds its
+  // samples.
+  if (kStreamingLoad && kSampleFile) {
+    const std::string sample_path =
+        (cache_directory /
+         SampleFile::GetFileName(kTrackAsset, ctx->getSampleRate()))
+            .string();
+    const uint64_t source_stamp =
+        SampleFile::GetSourceStamp(app::getAssetPath(kTrackAsset).string());
+    if (visualizer_.LoadSampleFile(sample_path, source_stamp,
+                                   GetVisualizerBounds())) {
+      buffer_player_node_->SetSamples(&visualizer_.GetSampleFile());
+      buffer_player_node_->enable();
+      return;
+    }
+    visualizer_.SetSampleFile(sample_path, source_stamp);
+    loader_.SetKeepBuffer(false);
+  }
+
   // Create a source file and set its output sample rate to match the context
-  // NOTE: Change the audio file name to your audio file!
+  // NOTE: Change kTrackAsset to your audio file!
   audio::SourceFileRef source_file =
-      audio::load(app::loadAsset("01 Ballade No. 1 in G Minor, Op. 23.m4a"),
+      audio::load(app::loadAsset(kTrackAsset), ctx->getSampleRate());
+
+  if (kStreamingLoad) {
+    // Decode in the background, playback starts once the track is complete
+    loader_.Start(source_file, &visualizer_, GetVisualizerBounds(),
                   ctx->getSampleRate());
+  } else {
+    buffer_player_node_->loadBuffer(source_file);
+    buffer_player_node_->enable();
 
-  // Initialize the buffer player node
-  buffer_player_node_ = ctx->makeNode(new audio::BufferPlayerNode());
-  buffer_player_node_->loadBuffer(source_file);
+    visualizer_.Load(*buffer_player_node_->getBuffer(), GetVisualizerBounds(),
+                     ctx->getSampleRate());
+  }
+}
 
-  // Connect nodes & context and enable them
-  buffer_player_node_ >> ctx->getOutput();
-  buffer_player_node_->enable();
-  ctx->enable();
+void MusicVisualApp::ConfigureVisualizer(AudioVisualizer *visualizer) const {
+  visualizer->SetCacheDirectory(
+      (getAppPath() / kCacheDirectory).string());
+
+  BandSettings bands;
+  bands.scale = kBandScale;
+  bands.num_bands = kNumBands;
+  visualizer->SetFrequencyBands(bands);
+  visualizer->SetFftBackend(kFftBackend);
+  visualizer->SetSpectralStorage(kSpectralStorage);
+  visualizer->SetLazySpectra(kLazySpectra);
+  visualizer->SetChannelViews(kChannelViews);
+}
+
+auto MusicVisualApp::GetVisualizer() -> AudioVisualizer & {
+  AudioVisualizer *current = playlist_.GetVisualizer();
+  return current != nullptr ? *current : visualizer_;
+}
+
+void MusicVisualApp::UpdatePlaylist() {
+  // The player stops at the end of a track, and has no track at first
+  if (buffer_player_node_->HasTrack() && !buffer_player_node_->isEof()) {
+    return;
+  }
 
-  visualizer_.Load(*buffer_player_node_->getBuffer(),
-                   Rectf(static_cast<float>(getWindowBounds().x1) +
-                             static_cast<float>(kMargin),
-                         static_cast<float>(getWindowBounds().y1) +
-                             static_cast<float>(kMargin),
-                         static_cast<float>(getWindowBounds().x2) -
-                             static_cast<float>(kMargin),
-                         static_cast<float>(getWindowBounds().y2) -
-                             static_cast<float>(kMargin)),
-                   ctx->getSampleRate());
+  // The old track is analyzed into the visualizer the producer reads
+  if (playlist_.IsStandbyReady()) {
+    producer_.Stop();
+  }
+  if (!playlist_.Advance()) {
+    return;
+  }
+
+  // Seeking here rather than through the playhead clears the end of the
+  // track before the next update
+  buffer_player_node_->setBuffer(playlist_.GetBuffer());
+  buffer_player_node_->seek(0);
+  buffer_player_node_->start();
+  last_saved_frame_ = 0;
+  last_presentation_time_ = 0;
+  displayed_frame_ = 0;
+}
+
+void MusicVisualApp::UpdateGeometry() {
+  if (!kGeometryThread ||
+      (!kPlaylist.empty() && playlist_.GetVisualizer() == nullptr)) {
+    return;
+  }
+
+  const AudioVisualizer *visualizer = &GetVisualizer();
+  if (!producer_.IsActive() || producer_.GetVisualizer() != visualizer) {
+    producer_.Start(visualizer);
+  }
+
+  // Built while this picture is drawn, drawn with the next one
+  size_t frame = last_saved_frame_;
+  if (buffer_player_node_->isEnabled() && playhead_.HasPublished()) {
+    frame = std::min(
+        playhead_.Predict(last_presentation_time_ +
+                          static_cast<int64_t>(1e9 / getFrameRate())),
+        buffer_player_node_->getNumFrames());
+  }
+  producer_.Request(frame);
+}
+
+void MusicVisualApp::SetupLiveInput() {
+  auto ctx = audio::Context::master();
+
+  input_device_node_ = ctx->createInputDeviceNode();
+  const size_t num_channels = input_device_node_->getNumChannels();
+
+  // Everything the audio thread touches is allocated before it starts
+  live_ring_.reset(new SampleRing(num_channels, kLiveRingFrames));
+  LiveSettings settings;
+  settings.sample_rate = ctx->getSampleRate();
+  live_analyzer_.reset(new LiveAnalyzer(live_ring_.get(), settings));
+  visualizer_.BeginLive(live_analyzer_.get(), GetVisualizerBounds());
+
+  live_input_node_ = ctx->makeNode(new LiveInputNode(
+      live_ring_.get(), audio::Node::Format().channels(num_channels)));
+  input_device_node_ >> live_input_node_;
+  input_device_node_->enable();
+  live_input_node_->enable();
+  ctx->enable();
 }
 
 void MusicVisualApp::draw() {
+  VISUALMUSIC_PROFILE_STAGE(FrameStage::kDraw);
   gl::clear();
   gl::enableAlphaBlending();
 
-  visualizer_.Display(last_saved_frame_);
+  // A playlist draws nothing until its first track is analyzed. The
+  // producer leaves only the submission to this thread.
+  if (!kLiveInput && kGeometryThread) {
+    const FrameGeometry *geometry = producer_.Acquire();
+    if (geometry != nullptr) {
+      GetVisualizer().DisplayGeometry(*geometry);
+      displayed_frame_ = geometry->frame;
+    }
+  } else if (kPlaylist.empty() || playlist_.GetVisualizer() != nullptr) {
+    GetVisualizer().Display(last_saved_frame_);
+    displayed_frame_ = last_saved_frame_;
+  }
 
-  DisplayInfoBoard();
-  DisplayGuidance();
+  // Text is slow to draw, so it is timed on its own
+  {
+    VISUALMUSIC_PROFILE_STAGE(FrameStage::kText);
+    DisplayInfoBoard();
+    DisplayGuidance();
+    DisplayFrameTimings();
+  }
 }
 
 void MusicVisualApp::update() {
+  VISUALMUSIC_PROFILE_STAGE(FrameStage::kUpdate);
+  if (kLiveInput) {
+    visualizer_.UpdateLive();
+    return;
+  }
+
+  // Hand the decoded track to the player once the streaming load is done
+  if (!kPlaylist.empty()) {
+    UpdatePlaylist();
+  } else if (kStreamingLoad && !buffer_player_node_->HasTrack() &&
+             loader_.IsFinished()) {
+    if (visualizer_.GetSampleFile().IsOpen()) {
+      buffer_player_node_->SetSamples(&visualizer_.GetSampleFile());
+    } else {
+      buffer_player_node_->setBuffer(loader_.GetBuffer());
+    }
+    buffer_player_node_->enable();
+  }
+
+  // A mapped track is paged in ahead of the player, off the audio thread
+  if (buffer_player_node_->HasTrack()) {
+    visualizer_.PrefetchSamples(buffer_player_node_->getReadPosition());
+  }
+
   if (buffer_player_node_->isEnabled()) {
-    last_saved_frame_ = buffer_player_node_->getReadPosition();
+    // Measure the last picture against the newest audio callback
+    if (last_presentation_time_ != 0) {
+      audio_visual_offset_ =
+          playhead_.MeasureOffset(displayed_frame_, last_presentation_time_);
+    }
+
+    // Draw the frame that is heard when the picture reaches the screen, one
+    // display frame from now
+    last_presentation_time_ =
+        Playhead::GetTime() + static_cast<int64_t>(1e9 / getFrameRate());
+    last_saved_frame_ =
+        playhead_.HasPublished()
+            ? std::min(playhead_.Predict(last_presentation_time_),
+                       buffer_player_node_->getNumFrames())
+            : buffer_player_node_->getReadPosition();
   }
+
+  UpdateGeometry();
 }
 
 void MusicVisualApp::keyDown(KeyEvent event) {
+  if (event.getCode() == KeyEvent::KEY_t) {
+    GetFrameProfiler().WriteCsv(kFrameTimingsPath);
+    return;
+  }
+
+  if (kLiveInput || !buffer_player_node_->HasTrack()) {
+    return;
+  }
+
+  if (event.getCode() == KeyEvent::KEY_c) {
+    // The graphs of the selected view are rebuilt, not while the producer
+    // reads them. It is restarted with the next update.
+    AudioVisualizer &visualizer = GetVisualizer();
+    if (visualizer.GetNumChannelViews() == 0) {
+      return;
+    }
+    const size_t view = visualizer.GetSelectedChannelView();
+    producer_.Stop();
+    visualizer.SelectChannelView(
+        view == AudioVisualizer::kAllChannels ? 0 : view + 1);
+    return;
+  }
+
   if (event.getCode() == KeyEvent::KEY_SPACE) {
     if (buffer_player_node_->isEnabled()) {
       buffer_player_node_->stop();
     } else {
+      playhead_.RequestSeek(last_saved_frame_);
       buffer_player_node_->start();
-      buffer_player_node_->seek(last_saved_frame_);
     }
   }
 }
 
 void MusicVisualApp::mouseDrag(MouseEvent event) {
-  if (!buffer_player_node_->isEnabled()) {
-    buffer_player_node_->start();
+  if (kLiveInput || !buffer_player_node_->HasTrack()) {
+    return;
   }
-  buffer_player_node_->seekToTime(
-      buffer_player_node_->getNumSeconds() *
+
+  // Drag events arrive faster than audio blocks, so only the latest target
+  // is applied by the audio thread
+  const double position =
       (static_cast<double>(event.getX()) - static_cast<double>(kMargin)) /
       (static_cast<double>(getWindowWidth()) -
-       2 * static_cast<double>(kMargin)));
+       2 * static_cast<double>(kMargin));
+  const size_t num_frames = buffer_player_node_->getNumFrames();
+  const size_t target = std::min(
+      static_cast<size_t>(std::fmax(0.0, position) *
+                          static_cast<double>(num_frames)),
+      num_frames - 1);
+  playhead_.RequestSeek(target);
+  GetVisualizer().BeginSeek(target);
+
+  // The next picture shows the target without waiting for the audio
+  last_saved_frame_ = target;
+  if (!buffer_player_node_->isEnabled()) {
+    buffer_player_node_->start();
+  }
 }
 
 void MusicVisualApp::DisplayInfoBoard() {
+  if (kLiveInput) {
+    DisplayLiveInfoBoard();
+    return;
+  }
+
   // Display time
-  std::string output =
-      "time: " +
-      std::to_string(static_cast<float>(last_saved_frame_) /
-                     static_cast<float>(buffer_player_node_->getSampleRate())) +
-      "/" + std::to_string(buffer_player_node_->getNumSeconds());
+  const float x = getWindowBounds().getX2() - 20;
+  const float y = getWindowBounds().getY2();
   gl::drawStringRight(
-      output,
-      vec2(getWindowBounds().getX2() - 20, getWindowBounds().getY2() - 40),
-      Color("white"));
+      FormatText("time: %f/%f",
+                 static_cast<float>(last_saved_frame_) /
+                     static_cast<float>(buffer_player_node_->getSampleRate()),
+                 buffer_player_node_->getNumSeconds()),
+      vec2(x, y - 40), Color("white"));
 
   // Sample rate
   gl::drawStringRight(
-      "sample_rate: " + std::to_string(buffer_player_node_->getSampleRate()) +
-          " fps",
-      vec2(getWindowBounds().getX2() - 20, getWindowBounds().getY2() - 60),
-      Color("white"));
+      FormatText("sample_rate: %zu fps",
+                 static_cast<size_t>(buffer_player_node_->getSampleRate())),
+      vec2(x, y - 60), Color("white"));
 
   // Display frame
-  output = "frame: " + std::to_string(buffer_player_node_->getReadPosition()) +
-           "/" + std::to_string(buffer_player_node_->getNumFrames());
   gl::drawStringRight(
-      output,
-      vec2(getWindowBounds().getX2() - 20, getWindowBounds().getY2() - 20),
-      Color("white"));
+      FormatText("frame: %zu/%zu",
+                 static_cast<size_t>(buffer_player_node_->getReadPosition()),
+                 static_cast<size_t>(buffer_player_node_->getNumFrames())),
+      vec2(x, y - 20), Color("white"));
+
+  // Offset of the picture from the audio
+  gl::drawStringRight(
+      FormatText("a/v offset: %f ms", audio_visual_offset_ * 1000.0),
+      vec2(x, y - 80), Color("white"));
+
+  // Time from the last seek to the first picture of its target
+  const SeekLatency seek_latency = GetVisualizer().GetSeekLatency();
+  gl::drawStringRight(FormatText("seek: %f ms (max %f ms)",
+                                 seek_latency.last * 1000.0,
+                                 seek_latency.max * 1000.0),
+                      vec2(x, y - 100), Color("white"));
+
+  // Signal the graphs draw
+  const AudioVisualizer &visualizer = GetVisualizer();
+  if (visualizer.GetNumChannelViews() > 0) {
+    const std::string view =
+        visualizer.GetChannelViewName(visualizer.GetSelectedChannelView());
+    gl::drawStringRight(FormatText("view: %s", view.c_str()),
+                        vec2(x, y - 120), Color("white"));
+  }
+
+  DisplayRhythm(y - 140);
 
   // Display state
-  std::string state = "playing";
-  if (!buffer_player_node_->isEnabled()) {
-    state = "paused";
+  if (!GetVisualizer().IsLoaded()) {
+    if (kPlaylist.empty()) {
+      FormatText("loading %d%%",
+                 static_cast<int>(loader_.GetProgress() * 100));
+    } else {
+      FormatText("analyzing");
+    }
+  } else if (!buffer_player_node_->isEnabled()) {
+    FormatText("paused");
+  } else if (!kPlaylist.empty()) {
+    FormatText(
+        "track %zu/%zu%s", playlist_.GetCurrentIndex() + 1,
+        playlist_.GetNumTracks(),
+        playlist_.IsStandbyReady() ? ", next ready" : ", analyzing next");
+  } else {
+    FormatText("playing");
   }
+  gl::drawStringRight(text_.GetText(),
+                      vec2(x, getWindowBounds().getY1() + 10),
+                      Color("white"));
+}
+
+void MusicVisualApp::DisplayLiveInfoBoard() {
+  const LiveLatency latency = live_analyzer_->GetLatency();
+  const float x = getWindowBounds().getX2() - 20;
+  const float y = getWindowBounds().getY2();
+
+  // Latency from the arrival of the samples to the geometry drawn from them
+  gl::drawStringRight(FormatText("latency: %f ms (max %f ms)",
+                                 latency.last * 1000.0, latency.max * 1000.0),
+                      vec2(x, y - 40), Color("white"));
+
+  gl::drawStringRight(
+      FormatText("dropped: %zu frames", live_ring_->GetDroppedFrames()),
+      vec2(x, y - 20), Color("white"));
+
+  DisplayRhythm(y - 60);
+
+  gl::drawStringRight(FormatText("live"),
+                      vec2(x, getWindowBounds().getY1() + 10),
+                      Color("white"));
+}
+
+void MusicVisualApp::DisplayRhythm(const float &y) {
+  // The beat indicator fades over the first half of each beat
+  RhythmFrame rhythm;
+  if (!GetVisualizer().GetRhythmAt(displayed_frame_, &rhythm) ||
+      rhythm.tempo == 0.0f) {
+    return;
+  }
+  const float flash = std::max(0.0f, 1.0f - 2.0f * rhythm.beat_phase);
   gl::drawStringRight(
-      state,
-      vec2(getWindowBounds().getX2() - 20, getWindowBounds().getY1() + 10),
-      Color("white"));
+      FormatText("tempo: %d bpm", static_cast<int>(rhythm.tempo + 0.5f)),
+      vec2(getWindowBounds().getX2() - 20, y), Color("white"));
+  gl::color(ColorA(1.0f, 1.0f, 1.0f, flash));
+  gl::drawSolidCircle(vec2(getWindowBounds().getX2() - 140, y + 5), 5.0f);
+  gl::color(Color("white"));
+}
+
+auto MusicVisualApp::FormatText(const char *format, ...)
+    -> const std::string & {
+  va_list args;
+  va_start(args, format);
+  const std::string& text = text_.FormatList(format, args);
+  va_end(args);
+  return text;
+}
+
+void MusicVisualApp::DisplayFrameTimings() {
+#if defined(VISUALMUSIC_PROFILING)
+  if (!kShowFrameTimings) {
+    return;
+  }
+
+  // One line per stage that ran, from the top left corner
+  const FrameProfiler &profiler = GetFrameProfiler();
+  float y = getWindowBounds().getY1() + 10;
+  for (size_t stage = 0; stage < kNumFrameStages; stage++) {
+    const FrameStage frame_stage = static_cast<FrameStage>(stage);
+    const StageStats stats = profiler.GetHistogram(frame_stage).GetStats();
+    if (stats.count == 0) {
+      continue;
+    }
+
+    gl::drawString(
+        FormatText("%-22s p50 %8.1f  p95 %8.1f  p99 %8.1f  max %8.1f us",
+                   FrameProfiler::GetStageName(frame_stage), stats.p50,
+                   stats.p95, stats.p99, stats.max),
+        vec2(getWindowBounds().getX1() + 20, y), Color("white"));
+    y += 15;
+  }
+#endif
 }
 
 void MusicVisualApp::DisplayGuidance() {
-  gl::drawStringCentered("Press 'Space' to pause the music",
-                         vec2(getWindowCenter().x, getWindowBounds().y2 - 40),
-                         Color("white"));
-  gl::drawStringCentered("Drag the audio box to seek to desired playtime",
-                         vec2(getWindowCenter().x, getWindowBounds().y2 - 20),
-                         Color("white"));
+  if (kLiveInput) {
+    return;
+  }
+
+  const float x = getWindowCenter().x;
+  const float y = getWindowBounds().y2;
+  // The views of a track loaded from the cache appear once built
+  const bool has_views = GetVisualizer().GetNumChannelViews() > 0;
+  gl::drawStringCentered(FormatText("Press 'Space' to pause the music"),
+                         vec2(x, y - (has_views ? 60 : 40)), Color("white"));
+  if (has_views) {
+    gl::drawStringCentered(
+        FormatText("Press 'C' to switch between the channels"),
+        vec2(x, y - 40), Color("white"));
+  }
+  gl::drawStringCentered(
+      FormatText("Drag the audio box to seek to desired playtime"),
+      vec2(x, y - 20), Color("white"));
 }
 
 void MusicVisualApp::resize() {
   AppBase::resize();
-  visualizer_.Resize(Rectf(
+
+  // Restarted with the next update
+  producer_.Stop();
+  visualizer_.Resize(GetVisualizerBounds());
+  playlist_.Resize(GetVisualizerBounds());
+}
+
+void MusicVisualApp::cleanup() {
+  // Each step waits for the block being rendered, so the audio thread
+  // touches none of the members once a node is disconnected
+  if (buffer_player_node_) {
+    buffer_player_node_->disable();
+    buffer_player_node_->SetSamples(nullptr);
+    buffer_player_node_->disconnectAll();
+    buffer_player_node_.reset();
+  }
+
+  if (live_input_node_) {
+    input_device_node_->disable();
+    live_input_node_->disable();
+    live_input_node_->disconnectAll();
+    live_input_node_.reset();
+  }
+}
+
+auto MusicVisualApp::GetVisualizerBounds() const -> Rectf {
+  return Rectf(
       static_cast<float>(getWindowBounds().x1) + static_cast<float>(kMargin),
       static_cast<float>(getWindowBounds().y1) + static_cast<float>(kMargin),
       static_cast<float>(getWindowBounds().x2) - static_cast<float>(kMargin),
-      static_cast<float>(getWindowBounds().y2) - static_cast<float>(kMargin)));
+      static_cast<float>(getWindowBounds().y2) - static_cast<float>(kMargin));
 }
 
 }  // namespace visualmusic
\ No newline at end of file
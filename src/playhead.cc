@@ -0,0 +1,218 @@
+#include "playhead.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <utility>
+
+namespace visualmusic {
+
+const size_t Playhead::kNoSeek;
+
+auto Playhead::GetTime() -> int64_t {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+Playhead::Playhead(const size_t& sample_rate)
+    : sample_rate_(sample_rate),
+      sequence_(0),
+      frame_(0),
+      time_(0),
+      seek_target_(kNoSeek),
+      num_requested_seeks_(0),
+      num_applied_seeks_(0) {
+}
+
+void Playhead::SetSampleRate(const size_t& sample_rate) {
+  sample_rate_ = sample_rate;
+}
+
+void Playhead::SetOutputLatency(const double& seconds) {
+  output_latency_ = seconds;
+}
+
+auto Playhead::GetOutputLatency() const -> double {
+  return output_latency_;
+}
+
+void Playhead::SetMaxExtrapolation(const double& seconds) {
+  max_extrapolation_ = seconds;
+}
+
+void Playhead::Publish(const size_t& frame, const int64_t& time) {
+  const uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+
+  sequence_.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  frame_.store(frame, std::memory_order_relaxed);
+  time_.store(time, std::memory_order_relaxed);
+  sequence_.store(sequence + 2, std::memory_order_release);
+}
+
+auto Playhead::Read(size_t* frame, int64_t* time) const -> bool {
+  for (;;) {
+    const uint64_t sequence = sequence_.load(std::memory_order_acquire);
+    if (sequence == 0) {
+      return false;
+    }
+    if (sequence % 2 == 1) {
+      continue;
+    }
+
+    *frame = frame_.load(std::memory_order_relaxed);
+    *time = time_.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    // A publish that overlapped the loads changed the sequence
+    if (sequence_.load(std::memory_order_relaxed) == sequence) {
+      return true;
+    }
+  }
+}
+
+auto Playhead::HasPublished() const -> bool {
+  return sequence_.load(std::memory_order_acquire) != 0;
+}
+
+auto Playhead::PredictExact(const int64_t& presentation_time) const
+    -> double {
+  size_t frame = 0;
+  if (GetPendingSeek(&frame)) {
+    return static_cast<double>(frame);
+  }
+
+  int64_t time = 0;
+  if (!Read(&frame, &time)) {
+    return 0.0;
+  }
+
+  // The published frame is heard output_latency_ after its callback
+  const double elapsed =
+      std::min(static_cast<double>(presentation_time - time) * 1e-9,
+               max_extrapolation_) -
+      output_latency_;
+
+  return std::fmax(0.0, static_cast<double>(frame) +
+                            elapsed * static_cast<double>(sample_rate_));
+}
+
+auto Playhead::Predict(const int64_t& presentation_time) const -> size_t {
+  return static_cast<size_t>(std::lround(PredictExact(presentation_time)));
+}
+
+auto Playhead::MeasureOffset(const size_t& displayed_frame,
+                             const int64_t& presentation_time) const
+    -> double {
+  return (static_cast<double>(displayed_frame) -
+          PredictExact(presentation_time)) /
+         static_cast<double>(sample_rate_);
+}
+
+void Playhead::RequestSeek(const size_t& frame) {
+  seek_target_.store(frame, std::memory_order_release);
+  num_requested_seeks_.fetch_add(1, std::memory_order_relaxed);
+}
+
+auto Playhead::TakeSeek(const int64_t& time, size_t* frame) -> bool {
+  const size_t target = seek_target_.load(std::memory_order_acquire);
+  if (target == kNoSeek) {
+    return false;
+  }
+
+  // A request made meanwhile stays pending for the next callback
+  Publish(target, time);
+  size_t expected = target;
+  seek_target_.compare_exchange_strong(expected, kNoSeek,
+                                       std::memory_order_acq_rel);
+  *frame = target;
+  num_applied_seeks_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+auto Playhead::GetPendingSeek(size_t* frame) const -> bool {
+  const size_t target = seek_target_.load(std::memory_order_acquire);
+  if (target == kNoSeek) {
+    return false;
+  }
+
+  *frame = target;
+  return true;
+}
+
+auto Playhead::GetNumRequestedSeeks() const -> size_t {
+  return num_requested_seeks_.load(std::memory_order_relaxed);
+}
+
+auto Playhead::GetNumAppliedSeeks() const -> size_t {
+  return num_applied_seeks_.load(std::memory_order_relaxed);
+}
+
+PlayheadPlayerNode::PlayheadPlayerNode(Playhead* playhead,
+                                       const Format& format)
+    : BufferPlayerNode(format), playhead_(playhead) {
+}
+
+void PlayheadPlayerNode::SetSamples(const SampleFile* samples) {
+  // The audio thread renders with the context mutex held
+  std::lock_guard<std::mutex> lock(audio::Context::master()->getMutex());
+  samples_ = samples;
+  mNumFrames = samples != nullptr
+                   ? samples->GetNumFrames()
+                   : (getBuffer() ? getBuffer()->getNumFrames() : 0);
+  mReadPos = 0;
+  mIsEof = false;
+}
+
+auto PlayheadPlayerNode::HasTrack() const -> bool {
+  return samples_ != nullptr || getBuffer() != nullptr;
+}
+
+void PlayheadPlayerNode::process(audio::Buffer* buffer) {
+  // At most one seek per block, to the latest target
+  const int64_t time = Playhead::GetTime();
+  size_t target = 0;
+  if (playhead_->TakeSeek(time, &target)) {
+    seek(target);
+  } else {
+    playhead_->Publish(getReadPosition(), time);
+  }
+
+  if (samples_ != nullptr) {
+    ProcessSamples(buffer);
+  } else {
+    BufferPlayerNode::process(buffer);
+  }
+}
+
+void PlayheadPlayerNode::ProcessSamples(audio::Buffer* buffer) {
+  const std::pair<size_t, size_t> range = getProcessFramesRange();
+  const size_t read_position = mReadPos;
+  const size_t num_frames = range.second - range.first;
+  const size_t read_count =
+      read_position < mNumFrames
+          ? std::min(mNumFrames - read_position, num_frames)
+          : 0;
+
+  const size_t num_file_channels = samples_->GetNumChannels();
+  for (size_t channel = 0; channel < buffer->getNumChannels(); channel++) {
+    const float* source =
+        samples_->GetChannel(std::min(channel, num_file_channels - 1));
+    std::copy(source + read_position, source + read_position + read_count,
+              buffer->getChannel(channel) + range.first);
+  }
+
+  // Like a buffer that is not looped, the end of the track stops the node
+  if (read_count < num_frames) {
+    buffer->zero(range.first + read_count, num_frames - read_count);
+    mIsEof = true;
+    mReadPos = 0;
+    disable();
+  } else {
+    mReadPos += read_count;
+  }
+}
+
+}  // namespace visualmusic
@@ -0,0 +1,139 @@
+#include "playlist.h"
+
+#include <exception>
+#include <utility>
+
+namespace visualmusic {
+
+Playlist::Playlist() : standby_state_(StandbyState::kEmpty) {
+}
+
+Playlist::~Playlist() {
+  WaitForStandby();
+}
+
+void Playlist::Start(const std::vector<std::string>& tracks,
+                     const Decoder& decoder, const Configurer& configure,
+                     const Rectf& bounds, const size_t& sample_rate) {
+  WaitForStandby();
+
+  tracks_ = tracks;
+  decoder_ = decoder;
+  sample_rate_ = sample_rate;
+  bounds_ = bounds;
+
+  // The only two visualizers, swapped from then on
+  current_.reset(new AudioVisualizer());
+  standby_.reset(new AudioVisualizer());
+  if (configure) {
+    configure(current_.get());
+    configure(standby_.get());
+  }
+  current_buffer_.reset();
+  current_index_ = 0;
+  has_current_ = false;
+  standby_state_ = StandbyState::kEmpty;
+
+  if (!tracks_.empty()) {
+    Prepare(0);
+  }
+}
+
+void Playlist::WaitForStandby() {
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+}
+
+auto Playlist::Advance() -> bool {
+  const StandbyState state = standby_state_.load(std::memory_order_acquire);
+  if (state == StandbyState::kFailed) {
+    WaitForStandby();
+    Prepare((standby_index_ + 1) % tracks_.size());
+    return false;
+  }
+
+  // A single track plays again from the same analysis
+  if (state == StandbyState::kEmpty) {
+    return has_current_;
+  }
+  if (state != StandbyState::kReady) {
+    return false;
+  }
+
+  // The thread has finished, so joining does not wait
+  WaitForStandby();
+  std::swap(current_, standby_);
+  std::swap(current_buffer_, standby_buffer_);
+  current_index_ = standby_index_;
+  has_current_ = true;
+  if (standby_resized_) {
+    current_->Resize(bounds_);
+  }
+
+  standby_state_ = StandbyState::kEmpty;
+  if (tracks_.size() > 1) {
+    Prepare((current_index_ + 1) % tracks_.size());
+  }
+
+  return true;
+}
+
+void Playlist::Resize(const Rectf& bounds) {
+  bounds_ = bounds;
+  standby_resized_ = true;
+  if (has_current_) {
+    current_->Resize(bounds_);
+  }
+}
+
+auto Playlist::GetVisualizer() const -> AudioVisualizer* {
+  return has_current_ ? current_.get() : nullptr;
+}
+
+auto Playlist::GetBuffer() const -> audio::BufferRef {
+  return current_buffer_;
+}
+
+auto Playlist::GetCurrentIndex() const -> size_t {
+  return current_index_;
+}
+
+auto Playlist::GetNumTracks() const -> size_t {
+  return tracks_.size();
+}
+
+auto Playlist::IsStandbyReady() const -> bool {
+  return standby_state_.load(std::memory_order_acquire) ==
+         StandbyState::kReady;
+}
+
+void Playlist::Prepare(const size_t& index) {
+  // The old track is freed before the next one is decoded
+  standby_buffer_.reset();
+  standby_index_ = index;
+  standby_bounds_ = bounds_;
+  standby_resized_ = false;
+  standby_state_ = StandbyState::kAnalyzing;
+  worker_ = std::thread(&Playlist::Analyze, this);
+}
+
+void Playlist::Analyze() {
+  StandbyState state = StandbyState::kFailed;
+
+  // Decoders report unreadable files by throwing or by returning nullptr
+  try {
+    audio::BufferRef buffer = decoder_(tracks_[standby_index_]);
+    if (buffer && buffer->getNumFrames() > 0) {
+      standby_->Load(*buffer, standby_bounds_, sample_rate_);
+      standby_buffer_ = buffer;
+      state = StandbyState::kReady;
+    }
+  } catch (const std::exception&) {
+    state = StandbyState::kFailed;
+  }
+
+  standby_state_.store(state, std::memory_order_release);
+}
+
+}  // namespace visualmusic
@@ -0,0 +1,192 @@
+#include "quantized_spectra.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace visualmusic {
+
+namespace {
+
+// Codes of SpectralStorage::kDecibel8 above silence
+const int kNumDecibelCodes = 255;
+
+// Largest finite half float, and the smallest normal one
+const float kMaxHalf = 65504.0f;
+const float kMinNormalHalf = 6.103515625e-5f;
+
+}  // namespace
+
+const float QuantizedSpectra::kDecibelRange = 96.0f;
+
+QuantizedSpectra::QuantizedSpectra()
+    : storage_(SpectralStorage::kDecibel8),
+      num_rows_(0),
+      row_size_(0),
+      reference_(1.0f),
+      decibels_per_code_(kDecibelRange / (kNumDecibelCodes - 1)) {
+}
+
+void QuantizedSpectra::Reset(const size_t& num_rows, const size_t& row_size,
+                             const SpectralStorage& storage,
+                             const float& reference) {
+  storage_ = storage;
+  num_rows_ = num_rows;
+  row_size_ = row_size;
+  reference_ = reference;
+
+  // Only the codes of the selected storage are kept
+  if (storage_ == SpectralStorage::kFloat16) {
+    std::vector<uint8_t>().swap(decibel_codes_);
+    half_codes_.resize(num_rows_ * row_size_);
+    return;
+  }
+  std::vector<uint16_t>().swap(half_codes_);
+  decibel_codes_.resize(num_rows_ * row_size_);
+
+  // Code 255 is the reference and code 1 is kDecibelRange below it
+  decibel_table_.assign(kNumDecibelCodes + 1, 0.0f);
+  for (int code = 1; code <= kNumDecibelCodes; code++) {
+    const float decibels =
+        static_cast<float>(code - kNumDecibelCodes) * decibels_per_code_;
+    decibel_table_[code] = reference_ * std::pow(10.0f, decibels / 20.0f);
+  }
+}
+
+void QuantizedSpectra::Release() {
+  std::vector<uint8_t>().swap(decibel_codes_);
+  std::vector<uint16_t>().swap(half_codes_);
+  num_rows_ = 0;
+  row_size_ = 0;
+}
+
+void QuantizedSpectra::Encode(const size_t& index, const float* magnitudes) {
+  if (storage_ == SpectralStorage::kFloat16) {
+    uint16_t* codes = half_codes_.data() + index * row_size_;
+    for (size_t i = 0; i < row_size_; i++) {
+      codes[i] = EncodeHalf(magnitudes[i]);
+    }
+    return;
+  }
+
+  uint8_t* codes = decibel_codes_.data() + index * row_size_;
+  for (size_t i = 0; i < row_size_; i++) {
+    codes[i] = EncodeDecibel(magnitudes[i]);
+  }
+}
+
+void QuantizedSpectra::Decode(const size_t& index, float* magnitudes) const {
+  DecodeRange(index, 0, row_size_, magnitudes);
+}
+
+void QuantizedSpectra::DecodeRange(const size_t& index, const size_t& first,
+                                   const size_t& count,
+                                   float* magnitudes) const {
+  const size_t offset = index * row_size_ + first;
+  if (storage_ == SpectralStorage::kFloat16) {
+    const uint16_t* codes = half_codes_.data() + offset;
+    for (size_t i = 0; i < count; i++) {
+      magnitudes[i] = DecodeHalf(codes[i]);
+    }
+    return;
+  }
+
+  // A table lookup per magnitude
+  const uint8_t* codes = decibel_codes_.data() + offset;
+  const float* table = decibel_table_.data();
+  for (size_t i = 0; i < count; i++) {
+    magnitudes[i] = table[codes[i]];
+  }
+}
+
+auto QuantizedSpectra::EncodeDecibel(const float& magnitude) const
+    -> uint8_t {
+  if (!(magnitude > 0.0f)) {
+    return 0;
+  }
+
+  const float decibels = 20.0f * std::log10(magnitude / reference_);
+  const int code = kNumDecibelCodes +
+                   static_cast<int>(std::lround(decibels / decibels_per_code_));
+  if (code < 1) {
+    return 0;
+  }
+
+  return static_cast<uint8_t>(std::min(code, kNumDecibelCodes));
+}
+
+auto QuantizedSpectra::GetMaxRelativeError() const -> float {
+  if (storage_ == SpectralStorage::kFloat16) {
+    return std::ldexp(1.0f, -11);
+  }
+
+  // Half a step either way
+  return std::pow(10.0f, decibels_per_code_ / 40.0f) - 1.0f;
+}
+
+auto QuantizedSpectra::GetFloor() const -> float {
+  if (storage_ == SpectralStorage::kFloat16) {
+    return kMinNormalHalf;
+  }
+
+  return reference_ * std::pow(10.0f, -kDecibelRange / 20.0f);
+}
+
+auto QuantizedSpectra::GetCapacityBytes() const -> size_t {
+  return decibel_codes_.capacity() * sizeof(uint8_t) +
+         half_codes_.capacity() * sizeof(uint16_t);
+}
+
+auto QuantizedSpectra::EncodeHalf(const float& value) -> uint16_t {
+  if (!(value > 0.0f)) {
+    return 0;
+  }
+  if (value >= kMaxHalf) {
+    return 0x7bff;
+  }
+
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const int exponent = static_cast<int>((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  // Normal half floats keep the top 10 bits of the mantissa, subnormal ones
+  // fewer. The dropped bits round to the nearest, ties to even.
+  uint32_t half;
+  int shift;
+  if (exponent >= 1) {
+    half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    shift = 13;
+  } else {
+    if (exponent < -10) {
+      return 0;
+    }
+    mantissa |= 0x800000;
+    shift = 14 - exponent;
+    half = mantissa >> shift;
+  }
+
+  const uint32_t remainder = mantissa & ((1u << shift) - 1);
+  const uint32_t halfway = 1u << (shift - 1);
+  if (remainder > halfway || (remainder == halfway && (half & 1) != 0)) {
+    // A carry out of the mantissa raises the exponent, which is still exact
+    half++;
+  }
+
+  return static_cast<uint16_t>(half);
+}
+
+auto QuantizedSpectra::DecodeHalf(const uint16_t& half) -> float {
+  const uint32_t exponent = (half >> 10) & 0x1f;
+  const uint32_t mantissa = half & 0x3ff;
+  if (exponent == 0) {
+    return std::ldexp(static_cast<float>(mantissa), -24);
+  }
+
+  const uint32_t bits = ((exponent - 15 + 127) << 23) | (mantissa << 13);
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+}  // namespace visualmusic
@@ -0,0 +1,368 @@
+#include "rhythm_tracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace visualmusic {
+
+namespace {
+
+// Half the width an onset must dominate, and the span of its local mean
+const float kPeakSeconds = 0.05f;
+const float kMeanSeconds = 0.3f;
+
+// An onset must exceed this multiple of its local mean
+const float kOnsetRatio = 1.5f;
+
+// Beats placed without any flux near them before the tracking stops
+const size_t kMaxMissedBeats = 4;
+
+/**
+ * Approximate log2 of a positive value within 0.01, cheap enough for every
+ * bin of every frame
+ * @param x
+ * @return log2(x)
+ */
+inline auto FastLog2(const float& x) -> float {
+  uint32_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  const float exponent =
+      static_cast<float>(static_cast<int32_t>(bits >> 23) - 128);
+
+  // 1 + log2 of the mantissa in [1, 2), fitted by a parabola
+  bits = (bits & 0x007FFFFFu) | 0x3F800000u;
+  float mantissa;
+  std::memcpy(&mantissa, &bits, sizeof(mantissa));
+  return exponent + (-0.34484843f * mantissa + 2.02466578f) * mantissa -
+         0.67487759f;
+}
+
+}  // namespace
+
+const size_t RhythmTracker::kNoBeat;
+
+RhythmTracker::RhythmTracker() : num_final_(0) {
+}
+
+void RhythmTracker::Reset(const size_t& num_bins, const size_t& hop_size,
+                          const size_t& sample_rate, const size_t& capacity,
+                          const RhythmSettings& settings) {
+  settings_ = settings;
+  num_bins_ = num_bins;
+  frame_seconds_ = static_cast<float>(hop_size) /
+                   static_cast<float>(std::max<size_t>(1, sample_rate));
+
+  // Every lag of the tempo range has two neighbors on each side, to smooth
+  // and interpolate its score
+  const float frames_per_minute = 60.0f / frame_seconds_;
+  min_lag_ = std::max<size_t>(
+      3, static_cast<size_t>(frames_per_minute / settings_.max_tempo));
+  max_lag_ = std::max(
+      min_lag_ + 1,
+      static_cast<size_t>(std::ceil(frames_per_minute / settings_.min_tempo)));
+  peak_radius_ = std::max<size_t>(
+      1, static_cast<size_t>(std::lround(kPeakSeconds / frame_seconds_)));
+  mean_frames_ = std::max<size_t>(
+      1, static_cast<size_t>(std::lround(kMeanSeconds / frame_seconds_)));
+
+  // A beat is placed up to twice its search radius, a quarter period, after
+  // its earliest frame
+  beat_lookahead_ = 2 * (max_lag_ / 4 + 1) + 2;
+
+  previous_.assign(num_bins_, 0.0f);
+
+  size_t history_frames = 1;
+  while (history_frames < max_lag_ + mean_frames_ + 2 * peak_radius_ +
+                              beat_lookahead_ + 3) {
+    history_frames *= 2;
+  }
+  flux_.assign(history_frames, 0.0f);
+  excess_.assign(history_frames, 0.0f);
+  history_mask_ = history_frames - 1;
+  flux_sum_ = 0.0;
+
+  const float prior_lag = frames_per_minute / settings_.prior_tempo;
+  autocorrelation_.assign(max_lag_ + 3, 0.0f);
+  tempo_prior_.resize(max_lag_ + 3);
+  for (size_t lag = 0; lag < tempo_prior_.size(); lag++) {
+    const float octaves =
+        std::log2(std::max(1.0f, static_cast<float>(lag)) / prior_lag);
+    tempo_prior_[lag] = std::exp(-0.5f * octaves * octaves);
+  }
+  decay_ = std::pow(0.5f, frame_seconds_ / settings_.tempo_half_life);
+  period_ = 0.0f;
+
+  tracking_ = false;
+  last_beat_ = kNoBeat;
+  next_beat_ = 0.0f;
+  num_missed_beats_ = 0;
+
+  // The frames not final yet have slots of their own
+  capacity_ = capacity;
+  frames_.assign(capacity_ + GetLookahead() + 1, RhythmFrame());
+  num_added_ = 0;
+  num_pushed_ = 0;
+  last_final_beat_ = kNoBeat;
+  num_final_.store(0, std::memory_order_release);
+}
+
+void RhythmTracker::Release() {
+  previous_ = std::vector<float>();
+  flux_ = std::vector<float>();
+  excess_ = std::vector<float>();
+  autocorrelation_ = std::vector<float>();
+  tempo_prior_ = std::vector<float>();
+  frames_ = std::vector<RhythmFrame>();
+  num_bins_ = 0;
+  capacity_ = 0;
+  num_added_ = 0;
+  num_pushed_ = 0;
+  num_final_.store(0, std::memory_order_release);
+}
+
+void RhythmTracker::AddFrame(const float* magnitudes) {
+  // Rises of the compressed magnitudes, so quiet partials count as well
+  float flux = 0.0f;
+  for (size_t bin = 0; bin < num_bins_; bin++) {
+    const float compressed = FastLog2(1.0f + magnitudes[bin]);
+    flux += std::fmax(0.0f, compressed - previous_[bin]);
+    previous_[bin] = compressed;
+  }
+
+  num_added_++;
+  PushFlux(flux / static_cast<float>(std::max<size_t>(1, num_bins_)));
+}
+
+void RhythmTracker::AddFrames(const float* rows, const size_t& row_stride,
+                              const size_t& num_rows) {
+  for (size_t row = 0; row < num_rows; row++) {
+    AddFrame(rows + row * row_stride);
+  }
+}
+
+void RhythmTracker::Finish() {
+  // Silent frames past the end close the windows of the last frames
+  const size_t end = num_added_ + GetLookahead();
+  while (num_pushed_ < end) {
+    PushFlux(0.0f);
+  }
+}
+
+auto RhythmTracker::GetNumFrames() const -> size_t {
+  return num_final_.load(std::memory_order_acquire);
+}
+
+auto RhythmTracker::GetFirstFrame() const -> size_t {
+  const size_t num_final = GetNumFrames();
+  return num_final > capacity_ ? num_final - capacity_ : 0;
+}
+
+auto RhythmTracker::GetFrame(const size_t& index, RhythmFrame* frame) const
+    -> bool {
+  const size_t num_final = num_final_.load(std::memory_order_acquire);
+  if (index >= num_final || index + capacity_ < num_final) {
+    return false;
+  }
+
+  *frame = frames_[index % frames_.size()];
+  return true;
+}
+
+auto RhythmTracker::GetLookahead() const -> size_t {
+  return peak_radius_ + beat_lookahead_;
+}
+
+auto RhythmTracker::GetFrameSeconds() const -> float {
+  return frame_seconds_;
+}
+
+auto RhythmTracker::GetCapacityBytes() const -> size_t {
+  return frames_.capacity() * sizeof(RhythmFrame) +
+         (previous_.capacity() + flux_.capacity() + excess_.capacity() +
+          autocorrelation_.capacity() + tempo_prior_.capacity()) *
+             sizeof(float);
+}
+
+void RhythmTracker::PushFlux(const float& flux) {
+  const size_t index = num_pushed_;
+  flux_[index & history_mask_] = flux;
+
+  // The local mean of a frame covers mean_frames_ before it and the frames
+  // it dominates after it
+  const size_t window = mean_frames_ + peak_radius_ + 1;
+  flux_sum_ += flux;
+  if (index >= window) {
+    flux_sum_ -= flux_[(index - window) & history_mask_];
+  }
+  num_pushed_++;
+
+  if (index >= peak_radius_) {
+    DecideFrame(index - peak_radius_);
+  }
+  if (index >= GetLookahead() && index - GetLookahead() < num_added_) {
+    FinalizeFrame(index - GetLookahead());
+  }
+}
+
+void RhythmTracker::DecideFrame(const size_t& index) {
+  const size_t window = mean_frames_ + peak_radius_ + 1;
+  const float mean = static_cast<float>(
+      std::max(0.0, flux_sum_) /
+      static_cast<double>(std::min(num_pushed_, window)));
+  const float flux = flux_[index & history_mask_];
+  const float excess = std::fmax(0.0f, flux - mean);
+  excess_[index & history_mask_] = excess;
+
+  // An onset peaks above its local mean, the first frame of a plateau
+  bool onset = flux > kOnsetRatio * mean + settings_.onset_threshold;
+  for (size_t offset = 1; onset && offset <= peak_radius_; offset++) {
+    onset = flux >= flux_[(index + offset) & history_mask_] &&
+            (offset > index || flux > flux_[(index - offset) & history_mask_]);
+  }
+
+  // Decaying autocorrelation of the excess, one term per lag
+  for (size_t lag = min_lag_ - 2; lag <= max_lag_ + 2 && lag <= index;
+       lag++) {
+    autocorrelation_[lag] = decay_ * autocorrelation_[lag] +
+                            excess * excess_[(index - lag) & history_mask_];
+  }
+  for (size_t lag = std::max(index + 1, min_lag_ - 2); lag <= max_lag_ + 2;
+       lag++) {
+    autocorrelation_[lag] *= decay_;
+  }
+  EstimatePeriod();
+
+  if (index < num_added_) {
+    RhythmFrame& frame = Slot(index);
+    frame = RhythmFrame();
+    frame.onset_strength = flux;
+    frame.onset = onset;
+    frame.tempo = period_ > 0.0f ? 60.0f / (period_ * frame_seconds_) : 0.0f;
+  }
+
+  if (period_ <= 0.0f) {
+    tracking_ = false;
+    return;
+  }
+  if (!tracking_) {
+    // The first onset with a tempo starts the beats
+    if (onset) {
+      tracking_ = true;
+      num_missed_beats_ = 0;
+      MarkBeat(index);
+    }
+    return;
+  }
+  TrackBeats(index);
+}
+
+void RhythmTracker::EstimatePeriod() {
+  // Two periods of the slowest tempo are needed to see one
+  if (num_pushed_ < 2 * max_lag_ + peak_radius_) {
+    period_ = 0.0f;
+    return;
+  }
+
+  // A period between two lags splits its peak over both, so each lag is
+  // scored with its neighbors
+  auto score_lag = [this](const size_t &lag) {
+    return 0.25f *
+           (autocorrelation_[lag - 1] + 2.0f * autocorrelation_[lag] +
+            autocorrelation_[lag + 1]) *
+           tempo_prior_[lag];
+  };
+
+  size_t best_lag = min_lag_;
+  float best_score = 0.0f;
+  for (size_t lag = min_lag_; lag <= max_lag_; lag++) {
+    const float score = score_lag(lag);
+    if (score > best_score) {
+      best_score = score;
+      best_lag = lag;
+    }
+  }
+  if (best_score <= 0.0f) {
+    period_ = 0.0f;
+    return;
+  }
+
+  // A beat rarely lasts a whole number of frames, so the peak is refined
+  // between its neighbors
+  const float before = score_lag(best_lag - 1);
+  const float after = score_lag(best_lag + 1);
+  const float curvature = before - 2.0f * best_score + after;
+  float offset = 0.0f;
+  if (curvature < 0.0f) {
+    offset = std::fmin(0.5f, std::fmax(-0.5f, 0.5f * (before - after) /
+                                                  curvature));
+  }
+  period_ = static_cast<float>(best_lag) + offset;
+}
+
+void RhythmTracker::TrackBeats(const size_t& index) {
+  const float radius = std::fmax(1.0f, std::round(period_ / 4.0f));
+  if (static_cast<float>(index) < next_beat_ + radius) {
+    return;
+  }
+
+  // The strongest flux near the predicted beat, after the last beat
+  const size_t first = std::max(
+      last_beat_ + 1,
+      static_cast<size_t>(std::fmax(0.0f, std::ceil(next_beat_ - radius))));
+  size_t best = kNoBeat;
+  float best_score = 0.0f;
+  for (size_t frame = first; frame <= index; frame++) {
+    const float distance =
+        (static_cast<float>(frame) - next_beat_) / radius;
+    const float score = excess_[frame & history_mask_] *
+                        std::exp(-0.5f * distance * distance);
+    if (score > best_score) {
+      best_score = score;
+      best = frame;
+    }
+  }
+
+  if (best == kNoBeat) {
+    // Silence keeps the beat for a few periods, then loses it
+    if (++num_missed_beats_ > kMaxMissedBeats) {
+      tracking_ = false;
+      return;
+    }
+    best = std::min(index, std::max(first, static_cast<size_t>(
+                                               std::lround(next_beat_))));
+  } else {
+    num_missed_beats_ = 0;
+  }
+  MarkBeat(best);
+}
+
+void RhythmTracker::MarkBeat(const size_t& index) {
+  last_beat_ = index;
+  next_beat_ = static_cast<float>(index) + period_;
+  if (index < num_added_) {
+    Slot(index).beat = true;
+  }
+}
+
+void RhythmTracker::FinalizeFrame(const size_t& index) {
+  RhythmFrame& frame = Slot(index);
+  if (frame.beat) {
+    last_final_beat_ = index;
+  }
+  frame.last_beat = last_final_beat_;
+  if (last_final_beat_ != kNoBeat && frame.tempo > 0.0f) {
+    const float period = 60.0f / (frame.tempo * frame_seconds_);
+    frame.beat_phase = std::fmod(
+        static_cast<float>(index - last_final_beat_) / period, 1.0f);
+  }
+
+  num_final_.store(index + 1, std::memory_order_release);
+}
+
+auto RhythmTracker::Slot(const size_t& index) -> RhythmFrame& {
+  return frames_[index % frames_.size()];
+}
+
+}  // namespace visualmusic
@@ -0,0 +1,207 @@
+#include "sample_file.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/stat.h>
+
+namespace visualmusic {
+
+namespace {
+
+const char kMagic[8] = {'V', 'M', 'S', 'A', 'M', 'P', 'L', '\0'};
+const uint64_t kHashSeed = 14695981039346656037ULL;
+const uint64_t kHashPrime = 1099511628211ULL;
+
+// Planes start on page boundaries, so a range of one channel is advised
+// without touching its neighbors
+const uint64_t kPageSize = 4096;
+
+/**
+ * Layout of the start of a sample file, in the byte order of the machine
+ */
+struct SampleHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t complete;  // Set by Finish once every sample is written
+  uint64_t num_frames;
+  uint64_t num_channels;
+  uint64_t sample_rate;
+  uint64_t data_offset;
+  uint64_t plane_stride;
+  uint64_t source_stamp;  // See GetSourceStamp
+};
+
+auto AlignToPage(const uint64_t& offset) -> uint64_t {
+  return (offset + kPageSize - 1) / kPageSize * kPageSize;
+}
+
+}  // namespace
+
+const uint32_t SampleFile::kVersion;
+
+SampleFile::SampleFile() = default;
+
+auto SampleFile::GetFileName(const std::string& source,
+                             const size_t& sample_rate) -> std::string {
+  // FNV-1a of the source, then of the rate it is decoded at
+  uint64_t hash = kHashSeed;
+  for (const char c : source) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * kHashPrime;
+  }
+  hash = (hash ^ sample_rate) * kHashPrime;
+
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.vmsamples",
+           static_cast<unsigned long long>(hash));
+  return name;
+}
+
+auto SampleFile::GetSourceStamp(const std::string& path) -> uint64_t {
+  struct stat status;
+  if (stat(path.c_str(), &status) != 0) {
+    return 0;
+  }
+
+  // FNV-1a of the size, then of the modification time
+  uint64_t hash = kHashSeed;
+  hash = (hash ^ static_cast<uint64_t>(status.st_size)) * kHashPrime;
+  hash = (hash ^ static_cast<uint64_t>(status.st_mtime)) * kHashPrime;
+  return hash;
+}
+
+auto SampleFile::Create(const std::string& path, const size_t& num_frames,
+                        const size_t& num_channels, const size_t& sample_rate,
+                        const uint64_t& source_stamp) -> bool {
+  Close();
+  if (num_channels == 0) {
+    return false;
+  }
+
+  const uint64_t data_offset = AlignToPage(sizeof(SampleHeader));
+  const uint64_t plane_stride =
+      AlignToPage(std::max<uint64_t>(num_frames, 1) * sizeof(float));
+  if (!file_.Create(path, data_offset + num_channels * plane_stride)) {
+    return false;
+  }
+
+  // Not complete until Finish, so a crash leaves a file Open rejects
+  SampleHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.num_frames = num_frames;
+  header.num_channels = num_channels;
+  header.sample_rate = sample_rate;
+  header.data_offset = data_offset;
+  header.plane_stride = plane_stride;
+  header.source_stamp = source_stamp;
+  std::memcpy(file_.GetMutableData(), &header, sizeof(header));
+
+  num_frames_ = num_frames;
+  num_channels_ = num_channels;
+  sample_rate_ = sample_rate;
+  data_offset_ = data_offset;
+  plane_stride_ = plane_stride;
+  return true;
+}
+
+void SampleFile::Write(const audio::Buffer& chunk, const size_t& first_frame,
+                       const size_t& num_frames) {
+  char* data = file_.GetMutableData();
+  if (data == nullptr || first_frame >= num_frames_) {
+    return;
+  }
+
+  const size_t count = std::min(num_frames, num_frames_ - first_frame);
+  const size_t num_channels =
+      std::min<size_t>(num_channels_, chunk.getNumChannels());
+  for (size_t channel = 0; channel < num_channels; channel++) {
+    std::memcpy(data + data_offset_ + channel * plane_stride_ +
+                    first_frame * sizeof(float),
+                chunk.getChannel(channel), count * sizeof(float));
+  }
+}
+
+auto SampleFile::Finish() -> bool {
+  char* data = file_.GetMutableData();
+  if (data == nullptr) {
+    return false;
+  }
+
+  // The samples reach the disk before the header says they are there
+  if (!file_.Flush(data_offset_, file_.GetSize() - data_offset_)) {
+    return false;
+  }
+  SampleHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  header.complete = 1;
+  std::memcpy(data, &header, sizeof(header));
+  return file_.Flush(0, sizeof(header));
+}
+
+auto SampleFile::Open(const std::string& path, const uint64_t& source_stamp)
+    -> bool {
+  Close();
+  if (!file_.Open(path)) {
+    return false;
+  }
+
+  SampleHeader header;
+  if (file_.GetSize() < sizeof(header)) {
+    file_.Close();
+    return false;
+  }
+  std::memcpy(&header, file_.GetData(), sizeof(header));
+
+  const bool valid =
+      std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+      header.version == kVersion && header.complete == 1 &&
+      header.source_stamp == source_stamp &&
+      header.num_channels > 0 && header.data_offset >= sizeof(header) &&
+      header.plane_stride >= header.num_frames * sizeof(float) &&
+      file_.GetSize() ==
+          header.data_offset + header.num_channels * header.plane_stride;
+  if (!valid) {
+    file_.Close();
+    return false;
+  }
+
+  num_frames_ = header.num_frames;
+  num_channels_ = header.num_channels;
+  sample_rate_ = header.sample_rate;
+  data_offset_ = header.data_offset;
+  plane_stride_ = header.plane_stride;
+  return true;
+}
+
+void SampleFile::Close() {
+  file_.Close();
+  num_frames_ = 0;
+  num_channels_ = 0;
+  sample_rate_ = 0;
+  data_offset_ = 0;
+  plane_stride_ = 0;
+}
+
+auto SampleFile::GetChannel(const size_t& channel) const -> const float* {
+  return reinterpret_cast<const float*>(file_.GetData() + data_offset_ +
+                                        channel * plane_stride_);
+}
+
+void SampleFile::Advise(const MappedAccess& access, const size_t& first_frame,
+                        const size_t& last_frame) const {
+  if (!IsOpen() || last_frame <= first_frame) {
+    return;
+  }
+
+  for (size_t channel = 0; channel < num_channels_; channel++) {
+    file_.Advise(access,
+                 data_offset_ + channel * plane_stride_ +
+                     first_frame * sizeof(float),
+                 (last_frame - first_frame) * sizeof(float));
+  }
+}
+
+}  // namespace visualmusic
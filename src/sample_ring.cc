@@ -0,0 +1,114 @@
+#include "sample_ring.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace visualmusic {
+
+auto SampleRing::GetTime() -> int64_t {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+SampleRing::SampleRing(const size_t& num_channels, const size_t& min_capacity)
+    : num_channels_(std::max<size_t>(1, num_channels)),
+      capacity_(1),
+      write_index_(0),
+      read_index_(0),
+      last_write_time_(0),
+      dropped_frames_(0) {
+  while (capacity_ < min_capacity) {
+    capacity_ *= 2;
+  }
+  mask_ = capacity_ - 1;
+  data_.reset(new float[num_channels_ * capacity_]());
+}
+
+auto SampleRing::Write(const float* data, const size_t& num_channels,
+                       const size_t& channel_stride, const size_t& num_frames,
+                       const int64_t& time) -> size_t {
+  const size_t write_index = write_index_.load(std::memory_order_relaxed);
+  const size_t read_index = read_index_.load(std::memory_order_acquire);
+  const size_t count =
+      std::min(num_frames, capacity_ - (write_index - read_index));
+
+  // The frames up to the end of the storage, then the wrapped part
+  const size_t offset = write_index & mask_;
+  const size_t first_part = std::min(count, capacity_ - offset);
+
+  for (size_t channel = 0; channel < num_channels_; channel++) {
+    const float* source =
+        data + std::min(channel, num_channels - 1) * channel_stride;
+    float* destination = data_.get() + channel * capacity_;
+
+    std::memcpy(destination + offset, source, first_part * sizeof(float));
+    std::memcpy(destination, source + first_part,
+                (count - first_part) * sizeof(float));
+  }
+
+  if (count < num_frames) {
+    dropped_frames_.fetch_add(num_frames - count, std::memory_order_relaxed);
+  }
+
+  write_index_.store(write_index + count, std::memory_order_release);
+  last_write_time_.store(time, std::memory_order_release);
+  return count;
+}
+
+auto SampleRing::Write(const audio::Buffer& buffer, const int64_t& time)
+    -> size_t {
+  if (buffer.getNumChannels() == 0) {
+    return 0;
+  }
+
+  return Write(buffer.getData(), buffer.getNumChannels(),
+               buffer.getNumFrames(), buffer.getNumFrames(), time);
+}
+
+auto SampleRing::Read(float* data, const size_t& channel_stride,
+                      const size_t& num_frames) -> size_t {
+  const size_t read_index = read_index_.load(std::memory_order_relaxed);
+  const size_t write_index = write_index_.load(std::memory_order_acquire);
+  const size_t count = std::min(num_frames, write_index - read_index);
+
+  const size_t offset = read_index & mask_;
+  const size_t first_part = std::min(count, capacity_ - offset);
+
+  for (size_t channel = 0; channel < num_channels_; channel++) {
+    const float* source = data_.get() + channel * capacity_;
+    float* destination = data + channel * channel_stride;
+
+    std::memcpy(destination, source + offset, first_part * sizeof(float));
+    std::memcpy(destination + first_part, source,
+                (count - first_part) * sizeof(float));
+  }
+
+  // The producer may reuse the storage once the index moves past it
+  read_index_.store(read_index + count, std::memory_order_release);
+  return count;
+}
+
+auto SampleRing::GetReadableFrames() const -> size_t {
+  return write_index_.load(std::memory_order_acquire) -
+         read_index_.load(std::memory_order_relaxed);
+}
+
+auto SampleRing::GetLastWriteTime() const -> int64_t {
+  return last_write_time_.load(std::memory_order_acquire);
+}
+
+auto SampleRing::GetDroppedFrames() const -> size_t {
+  return dropped_frames_.load(std::memory_order_relaxed);
+}
+
+auto SampleRing::GetCapacity() const -> size_t {
+  return capacity_;
+}
+
+auto SampleRing::GetNumChannels() const -> size_t {
+  return num_channels_;
+}
+
+}  // namespace visualmusic
@@ -0,0 +1,794 @@
+#include "simd_kernels.h"
+
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(_M_X64) || \
+    (defined(__i386__) && defined(__SSE2__)) ||  \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VISUALMUSIC_SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define VISUALMUSIC_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+// AVX2 kernels are compiled for that target alone, and only run after the
+// processor has been checked
+#if defined(__GNUC__) || defined(__clang__)
+#define VISUALMUSIC_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define VISUALMUSIC_TARGET_AVX2
+#endif
+
+namespace visualmusic {
+
+namespace simd {
+
+namespace {
+
+/**
+ * One implementation of every kernel
+ */
+struct KernelTable {
+  InstructionSet set;
+  float (*abs_max)(const float*, size_t);
+  void (*mix_down)(const float* const*, size_t, size_t, float, float*);
+  void (*min_max)(const float*, size_t, float*, float*);
+  void (*min_max_per_bucket)(const float*, size_t, size_t, float*, float*);
+  void (*min_max_sum_squares)(const float*, size_t, float*, float*, float*);
+  void (*map_to_screen)(const float*, size_t, const ScreenMapping&, float*);
+  float (*dot_product)(const float*, const float*, size_t);
+};
+
+// Scalar reference, also the fallback on every other processor
+
+float AbsMaxScalar(const float* data, size_t size) {
+  float max_magnitude = 0.0f;
+  for (size_t i = 0; i < size; i++) {
+    max_magnitude = std::fmaxf(max_magnitude, std::fabs(data[i]));
+  }
+  return max_magnitude;
+}
+
+void MixDownScalar(const float* const* channels, size_t num_channels,
+                   size_t size, float scale, float* output) {
+  for (size_t i = 0; i < size; i++) {
+    output[i] = channels[0][i];
+  }
+  for (size_t channel = 1; channel < num_channels; channel++) {
+    for (size_t i = 0; i < size; i++) {
+      output[i] += channels[channel][i];
+    }
+  }
+  for (size_t i = 0; i < size; i++) {
+    output[i] *= scale;
+  }
+}
+
+void MinMaxScalar(const float* data, size_t size, float* min, float* max) {
+  *min = data[0];
+  *max = data[0];
+  for (size_t i = 1; i < size; i++) {
+    *min = data[i] < *min ? data[i] : *min;
+    *max = data[i] > *max ? data[i] : *max;
+  }
+}
+
+void MinMaxPerBucketScalar(const float* data, size_t size,
+                           size_t num_buckets, float* mins, float* maxs) {
+  for (size_t bucket = 0; bucket < num_buckets; bucket++) {
+    const size_t first = bucket * size / num_buckets;
+    const size_t last = (bucket + 1) * size / num_buckets;
+    MinMaxScalar(data + first, last - first, mins + bucket, maxs + bucket);
+  }
+}
+
+void MinMaxSumSquaresScalar(const float* data, size_t size, float* min,
+                            float* max, float* sum_squares) {
+  MinMaxScalar(data, size, min, max);
+  *sum_squares = 0.0f;
+  for (size_t i = 0; i < size; i++) {
+    *sum_squares += data[i] * data[i];
+  }
+}
+
+void MapToScreenScalar(const float* data, size_t size,
+                       const ScreenMapping& mapping, float* points) {
+  for (size_t i = 0; i < size; i++) {
+    points[2 * i] =
+        mapping.x_origin + static_cast<float>(i) * mapping.x_step;
+    points[2 * i + 1] = mapping.y_origin + data[i] * mapping.y_scale;
+  }
+}
+
+float DotProductScalar(const float* a, const float* b, size_t size) {
+  float sum = 0.0f;
+  for (size_t i = 0; i < size; i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+/**
+ * Fold the lanes of the vector kernels into the scalar results
+ */
+void ReduceLanes(const float* lane_min, const float* lane_max, size_t lanes,
+                 float* min, float* max) {
+  for (size_t lane = 0; lane < lanes; lane++) {
+    *min = std::fminf(*min, lane_min[lane]);
+    *max = std::fmaxf(*max, lane_max[lane]);
+  }
+}
+
+#if defined(VISUALMUSIC_SIMD_X86)
+
+// SSE2, part of every x86-64 processor
+
+float AbsMaxSse2(const float* data, size_t size) {
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 max0 = _mm_setzero_ps();
+  __m128 max1 = _mm_setzero_ps();
+
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    max0 = _mm_max_ps(max0, _mm_and_ps(_mm_loadu_ps(data + i), abs_mask));
+    max1 = _mm_max_ps(max1, _mm_and_ps(_mm_loadu_ps(data + i + 4), abs_mask));
+  }
+
+  float lanes[4];
+  _mm_storeu_ps(lanes, _mm_max_ps(max0, max1));
+  float max_magnitude = AbsMaxScalar(data + i, size - i);
+  for (float lane : lanes) {
+    max_magnitude = std::fmaxf(max_magnitude, lane);
+  }
+  return max_magnitude;
+}
+
+void MixDownSse2(const float* const* channels, size_t num_channels,
+                 size_t size, float scale, float* output) {
+  const size_t vector_size = size / 4 * 4;
+  const __m128 scale_vector = _mm_set1_ps(scale);
+
+  for (size_t i = 0; i < vector_size; i += 4) {
+    __m128 sum = _mm_loadu_ps(channels[0] + i);
+    for (size_t channel = 1; channel < num_channels; channel++) {
+      sum = _mm_add_ps(sum, _mm_loadu_ps(channels[channel] + i));
+    }
+    _mm_storeu_ps(output + i, _mm_mul_ps(sum, scale_vector));
+  }
+
+  for (size_t i = vector_size; i < size; i++) {
+    float sum = channels[0][i];
+    for (size_t channel = 1; channel < num_channels; channel++) {
+      sum += channels[channel][i];
+    }
+    output[i] = sum * scale;
+  }
+}
+
+void MinMaxSse2(const float* data, size_t size, float* min, float* max) {
+  __m128 min_vector = _mm_set1_ps(data[0]);
+  __m128 max_vector = min_vector;
+
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    const __m128 values = _mm_loadu_ps(data + i);
+    min_vector = _mm_min_ps(min_vector, values);
+    max_vector = _mm_max_ps(max_vector, values);
+  }
+
+  float lane_min[4];
+  float lane_max[4];
+  _mm_storeu_ps(lane_min, min_vector);
+  _mm_storeu_ps(lane_max, max_vector);
+
+  *min = data[0];
+  *max = data[0];
+  for (; i < size; i++) {
+    *min = data[i] < *min ? data[i] : *min;
+    *max = data[i] > *max ? data[i] : *max;
+  }
+  ReduceLanes(lane_min, lane_max, 4, min, max);
+}
+
+void MinMaxPerBucketSse2(const float* data, size_t size,
+                         size_t num_buckets, float* mins, float* maxs) {
+  // Lanes only pay off once a bucket fills several vectors
+  if (size < 16 * num_buckets) {
+    MinMaxPerBucketScalar(data, size, num_buckets, mins, maxs);
+    return;
+  }
+
+  for (size_t bucket = 0; bucket < num_buckets; bucket++) {
+    const size_t first = bucket * size / num_buckets;
+    const size_t last = (bucket + 1) * size / num_buckets;
+    MinMaxSse2(data + first, last - first, mins + bucket, maxs + bucket);
+  }
+}
+
+void MinMaxSumSquaresSse2(const float* data, size_t size, float* min,
+                          float* max, float* sum_squares) {
+  __m128 min_vector = _mm_set1_ps(data[0]);
+  __m128 max_vector = min_vector;
+  __m128 sum_vector = _mm_setzero_ps();
+
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    const __m128 values = _mm_loadu_ps(data + i);
+    min_vector = _mm_min_ps(min_vector, values);
+    max_vector = _mm_max_ps(max_vector, values);
+    sum_vector = _mm_add_ps(sum_vector, _mm_mul_ps(values, values));
+  }
+
+  float lane_min[4];
+  float lane_max[4];
+  float lane_sum[4];
+  _mm_storeu_ps(lane_min, min_vector);
+  _mm_storeu_ps(lane_max, max_vector);
+  _mm_storeu_ps(lane_sum, sum_vector);
+
+  *min = data[0];
+  *max = data[0];
+  *sum_squares = 0.0f;
+  for (; i < size; i++) {
+    *min = data[i] < *min ? data[i] : *min;
+    *max = data[i] > *max ? data[i] : *max;
+    *sum_squares += data[i] * data[i];
+  }
+  ReduceLanes(lane_min, lane_max, 4, min, max);
+  *sum_squares += (lane_sum[0] + lane_sum[1]) + (lane_sum[2] + lane_sum[3]);
+}
+
+void MapToScreenSse2(const float* data, size_t size,
+                     const ScreenMapping& mapping, float* points) {
+  const __m128 x_origin = _mm_set1_ps(mapping.x_origin);
+  const __m128 x_step = _mm_set1_ps(mapping.x_step);
+  const __m128 y_origin = _mm_set1_ps(mapping.y_origin);
+  const __m128 y_scale = _mm_set1_ps(mapping.y_scale);
+  const __m128i lanes = _mm_set_epi32(3, 2, 1, 0);
+
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    const __m128 index = _mm_cvtepi32_ps(
+        _mm_add_epi32(_mm_set1_epi32(static_cast<int>(i)), lanes));
+    const __m128 x = _mm_add_ps(x_origin, _mm_mul_ps(index, x_step));
+    const __m128 y =
+        _mm_add_ps(y_origin, _mm_mul_ps(_mm_loadu_ps(data + i), y_scale));
+    _mm_storeu_ps(points + 2 * i, _mm_unpacklo_ps(x, y));
+    _mm_storeu_ps(points + 2 * i + 4, _mm_unpackhi_ps(x, y));
+  }
+
+  for (; i < size; i++) {
+    points[2 * i] =
+        mapping.x_origin + static_cast<float>(i) * mapping.x_step;
+    points[2 * i + 1] = mapping.y_origin + data[i] * mapping.y_scale;
+  }
+}
+
+float DotProductSse2(const float* a, const float* b, size_t size) {
+  __m128 sum0 = _mm_setzero_ps();
+  __m128 sum1 = _mm_setzero_ps();
+
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    sum0 = _mm_add_ps(sum0,
+                      _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    sum1 = _mm_add_ps(
+        sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+  }
+
+  float lanes[4];
+  _mm_storeu_ps(lanes, _mm_add_ps(sum0, sum1));
+  return DotProductScalar(a + i, b + i, size - i) + lanes[0] + lanes[1] +
+         lanes[2] + lanes[3];
+}
+
+// AVX2, eight lanes
+
+VISUALMUSIC_TARGET_AVX2
+float AbsMaxAvx2(const float* data, size_t size) {
+  const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  __m256 max0 = _mm256_setzero_ps();
+  __m256 max1 = _mm256_setzero_ps();
+
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    max0 = _mm256_max_ps(max0,
+                         _mm256_and_ps(_mm256_loadu_ps(data + i), abs_mask));
+    max1 = _mm256_max_ps(
+        max1, _mm256_and_ps(_mm256_loadu_ps(data + i + 8), abs_mask));
+  }
+
+  float lanes[8];
+  _mm256_storeu_ps(lanes, _mm256_max_ps(max0, max1));
+  float max_magnitude = AbsMaxScalar(data + i, size - i);
+  for (float lane : lanes) {
+    max_magnitude = std::fmaxf(max_magnitude, lane);
+  }
+  return max_magnitude;
+}
+
+VISUALMUSIC_TARGET_AVX2
+void MixDownAvx2(const float* const* channels, size_t num_channels,
+                 size_t size, float scale, float* output) {
+  const size_t vector_size = size / 8 * 8;
+  const __m256 scale_vector = _mm256_set1_ps(scale);
+
+  for (size_t i = 0; i < vector_size; i += 8) {
+    __m256 sum = _mm256_loadu_ps(channels[0] + i);
+    for (size_t channel = 1; channel < num_channels; channel++) {
+      sum = _mm256_add_ps(sum, _mm256_loadu_ps(channels[channel] + i));
+    }
+    _mm256_storeu_ps(output + i, _mm256_mul_ps(sum, scale_vector));
+  }
+
+  for (size_t i = vector_size; i < size; i++) {
+    float sum = channels[0][i];
+    for (size_t channel = 1; channel < num_channels; channel++) {
+      sum += channels[channel][i];
+    }
+    output[i] = sum * scale;
+  }
+}
+
+VISUALMUSIC_TARGET_AVX2
+void MinMaxAvx2(const float* data, size_t size, float* min, float* max) {
+  __m256 min_vector = _mm256_set1_ps(data[0]);
+  __m256 max_vector = min_vector;
+
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const __m256 values = _mm256_loadu_ps(data + i);
+    min_vector = _mm256_min_ps(min_vector, values);
+    max_vector = _mm256_max_ps(max_vector, values);
+  }
+
+  float lane_min[8];
+  float lane_max[8];
+  _mm256_storeu_ps(lane_min, min_vector);
+  _mm256_storeu_ps(lane_max, max_vector);
+
+  *min = data[0];
+  *max = data[0];
+  for (; i < size; i++) {
+    *min = data[i] < *min ? data[i] : *min;
+    *max = data[i] > *max ? data[i] : *max;
+  }
+  ReduceLanes(lane_min, lane_max, 8, min, max);
+}
+
+VISUALMUSIC_TARGET_AVX2
+void MinMaxPerBucketAvx2(const float* data, size_t size,
+                         size_t num_buckets, float* mins, float* maxs) {
+  // Lanes only pay off once a bucket fills several vectors
+  if (size < 32 * num_buckets) {
+    MinMaxPerBucketScalar(data, size, num_buckets, mins, maxs);
+    return;
+  }
+
+  for (size_t bucket = 0; bucket < num_buckets; bucket++) {
+    const size_t first = bucket * size / num_buckets;
+    const size_t last = (bucket + 1) * size / num_buckets;
+    MinMaxAvx2(data + first, last - first, mins + bucket, maxs + bucket);
+  }
+}
+
+VISUALMUSIC_TARGET_AVX2
+void MinMaxSumSquaresAvx2(const float* data, size_t size, float* min,
+                          float* max, float* sum_squares) {
+  __m256 min_vector = _mm256_set1_ps(data[0]);
+  __m256 max_vector = min_vector;
+  __m256 sum_vector = _mm256_setzero_ps();
+
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const __m256 values = _mm256_loadu_ps(data + i);
+    min_vector = _mm256_min_ps(min_vector, values);
+    max_vector = _mm256_max_ps(max_vector, values);
+    sum_vector = _mm256_add_ps(sum_vector, _mm256_mul_ps(values, values));
+  }
+
+  float lane_min[8];
+  float lane_max[8];
+  float lane_sum[8];
+  _mm256_storeu_ps(lane_min, min_vector);
+  _mm256_storeu_ps(lane_max, max_vector);
+  _mm256_storeu_ps(lane_sum, sum_vector);
+
+  *min = data[0];
+  *max = data[0];
+  *sum_squares = 0.0f;
+  for (; i < size; i++) {
+    *min = data[i] < *min ? data[i] : *min;
+    *max = data[i] > *max ? data[i] : *max;
+    *sum_squares += data[i] * data[i];
+  }
+  ReduceLanes(lane_min, lane_max, 8, min, max);
+  for (float lane : lane_sum) {
+    *sum_squares += lane;
+  }
+}
+
+VISUALMUSIC_TARGET_AVX2
+void MapToScreenAvx2(const float* data, size_t size,
+                     const ScreenMapping& mapping, float* points) {
+  const __m256 x_origin = _mm256_set1_ps(mapping.x_origin);
+  const __m256 x_step = _mm256_set1_ps(mapping.x_step);
+  const __m256 y_origin = _mm256_set1_ps(mapping.y_origin);
+  const __m256 y_scale = _mm256_set1_ps(mapping.y_scale);
+  const __m256i lanes = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const __m256 index = _mm256_cvtepi32_ps(
+        _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(i)), lanes));
+    const __m256 x = _mm256_add_ps(x_origin, _mm256_mul_ps(index, x_step));
+    const __m256 y = _mm256_add_ps(
+        y_origin, _mm256_mul_ps(_mm256_loadu_ps(data + i), y_scale));
+
+    // Unpacking works inside each 128-bit half, so the halves are swapped
+    // back into order
+    const __m256 low = _mm256_unpacklo_ps(x, y);
+    const __m256 high = _mm256_unpackhi_ps(x, y);
+    _mm256_storeu_ps(points + 2 * i, _mm256_permute2f128_ps(low, high, 0x20));
+    _mm256_storeu_ps(points + 2 * i + 8,
+                     _mm256_permute2f128_ps(low, high, 0x31));
+  }
+
+  for (; i < size; i++) {
+    points[2 * i] =
+        mapping.x_origin + static_cast<float>(i) * mapping.x_step;
+    points[2 * i + 1] = mapping.y_origin + data[i] * mapping.y_scale;
+  }
+}
+
+VISUALMUSIC_TARGET_AVX2
+float DotProductAvx2(const float* a, const float* b, size_t size) {
+  // Short bands are common, and a half-empty register only adds a reduction
+  if (size < 16) {
+    return DotProductSse2(a, b, size);
+  }
+
+  __m256 sum0 = _mm256_setzero_ps();
+  __m256 sum1 = _mm256_setzero_ps();
+
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    sum0 = _mm256_add_ps(
+        sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8),
+                                             _mm256_loadu_ps(b + i + 8)));
+  }
+
+  float lanes[8];
+  _mm256_storeu_ps(lanes, _mm256_add_ps(sum0, sum1));
+  float sum = DotProductScalar(a + i, b + i, size - i);
+  for (float lane : lanes) {
+    sum += lane;
+  }
+  return sum;
+}
+
+#endif  // VISUALMUSIC_SIMD_X86
+
+#if defined(VISUALMUSIC_SIMD_NEON)
+
+// NEON, part of every 64-bit ARM processor
+
+float AbsMaxNeon(const float* data, size_t size) {
+  float32x4_t max0 = vdupq_n_f32(0.0f);
+  float32x4_t max1 = vdupq_n_f32(0.0f);
+
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    max0 = vmaxq_f32(max0, vabsq_f32(vld1q_f32(data + i)));
+    max1 = vmaxq_f32(max1, vabsq_f32(vld1q_f32(data + i + 4)));
+  }
+
+  float lanes[4];
+  vst1q_f32(lanes, vmaxq_f32(max0, max1));
+  float max_magnitude = AbsMaxScalar(data + i, size - i);
+  for (float lane : lanes) {
+    max_magnitude = std::fmaxf(max_magnitude, lane);
+  }
+  return max_magnitude;
+}
+
+void MixDownNeon(const float* const* channels, size_t num_channels,
+                 size_t size, float scale, float* output) {
+  const size_t vector_size = size / 4 * 4;
+
+  for (size_t i = 0; i < vector_size; i += 4) {
+    float32x4_t sum = vld1q_f32(channels[0] + i);
+    for (size_t channel = 1; channel < num_channels; channel++) {
+      sum = vaddq_f32(sum, vld1q_f32(channels[channel] + i));
+    }
+    vst1q_f32(output + i, vmulq_n_f32(sum, scale));
+  }
+
+  for (size_t i = vector_size; i < size; i++) {
+    float sum = channels[0][i];
+    for (size_t channel = 1; channel < num_channels; channel++) {
+      sum += channels[channel][i];
+    }
+    output[i] = sum * scale;
+  }
+}
+
+void MinMaxNeon(const float* data, size_t size, float* min, float* max) {
+  float32x4_t min_vector = vdupq_n_f32(data[0]);
+  float32x4_t max_vector = min_vector;
+
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    const float32x4_t values = vld1q_f32(data + i);
+    min_vector = vminq_f32(min_vector, values);
+    max_vector = vmaxq_f32(max_vector, values);
+  }
+
+  float lane_min[4];
+  float lane_max[4];
+  vst1q_f32(lane_min, min_vector);
+  vst1q_f32(lane_max, max_vector);
+
+  *min = data[0];
+  *max = data[0];
+  for (; i < size; i++) {
+    *min = data[i] < *min ? data[i] : *min;
+    *max = data[i] > *max ? data[i] : *max;
+  }
+  ReduceLanes(lane_min, lane_max, 4, min, max);
+}
+
+void MinMaxPerBucketNeon(const float* data, size_t size,
+                         size_t num_buckets, float* mins, float* maxs) {
+  // Lanes only pay off once a bucket fills several vectors
+  if (size < 16 * num_buckets) {
+    MinMaxPerBucketScalar(data, size, num_buckets, mins, maxs);
+    return;
+  }
+
+  for (size_t bucket = 0; bucket < num_buckets; bucket++) {
+    const size_t first = bucket * size / num_buckets;
+    const size_t last = (bucket + 1) * size / num_buckets;
+    MinMaxNeon(data + first, last - first, mins + bucket, maxs + bucket);
+  }
+}
+
+void MinMaxSumSquaresNeon(const float* data, size_t size, float* min,
+                          float* max, float* sum_squares) {
+  float32x4_t min_vector = vdupq_n_f32(data[0]);
+  float32x4_t max_vector = min_vector;
+  float32x4_t sum_vector = vdupq_n_f32(0.0f);
+
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    const float32x4_t values = vld1q_f32(data + i);
+    min_vector = vminq_f32(min_vector, values);
+    max_vector = vmaxq_f32(max_vector, values);
+    sum_vector = vaddq_f32(sum_vector, vmulq_f32(values, values));
+  }
+
+  float lane_min[4];
+  float lane_max[4];
+  float lane_sum[4];
+  vst1q_f32(lane_min, min_vector);
+  vst1q_f32(lane_max, max_vector);
+  vst1q_f32(lane_sum, sum_vector);
+
+  *min = data[0];
+  *max = data[0];
+  *sum_squares = 0.0f;
+  for (; i < size; i++) {
+    *min = data[i] < *min ? data[i] : *min;
+    *max = data[i] > *max ? data[i] : *max;
+    *sum_squares += data[i] * data[i];
+  }
+  ReduceLanes(lane_min, lane_max, 4, min, max);
+  *sum_squares += (lane_sum[0] + lane_sum[1]) + (lane_sum[2] + lane_sum[3]);
+}
+
+void MapToScreenNeon(const float* data, size_t size,
+                     const ScreenMapping& mapping, float* points) {
+  const int32_t kLanes[4] = {0, 1, 2, 3};
+  const int32x4_t lanes = vld1q_s32(kLanes);
+
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    const float32x4_t index = vcvtq_f32_s32(
+        vaddq_s32(vdupq_n_s32(static_cast<int32_t>(i)), lanes));
+    float32x4x2_t point;
+    point.val[0] = vaddq_f32(vdupq_n_f32(mapping.x_origin),
+                             vmulq_n_f32(index, mapping.x_step));
+    point.val[1] = vaddq_f32(vdupq_n_f32(mapping.y_origin),
+                             vmulq_n_f32(vld1q_f32(data + i), mapping.y_scale));
+    vst2q_f32(points + 2 * i, point);
+  }
+
+  for (; i < size; i++) {
+    points[2 * i] =
+        mapping.x_origin + static_cast<float>(i) * mapping.x_step;
+    points[2 * i + 1] = mapping.y_origin + data[i] * mapping.y_scale;
+  }
+}
+
+float DotProductNeon(const float* a, const float* b, size_t size) {
+  float32x4_t sum0 = vdupq_n_f32(0.0f);
+  float32x4_t sum1 = vdupq_n_f32(0.0f);
+
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    sum0 = vmlaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+    sum1 = vmlaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+  }
+
+  float lanes[4];
+  vst1q_f32(lanes, vaddq_f32(sum0, sum1));
+  return DotProductScalar(a + i, b + i, size - i) + lanes[0] + lanes[1] +
+         lanes[2] + lanes[3];
+}
+
+#endif  // VISUALMUSIC_SIMD_NEON
+
+const KernelTable kScalarTable = {
+    InstructionSet::kScalar, AbsMaxScalar, MixDownScalar, MinMaxScalar,
+    MinMaxPerBucketScalar, MinMaxSumSquaresScalar, MapToScreenScalar,
+    DotProductScalar};
+
+#if defined(VISUALMUSIC_SIMD_X86)
+const KernelTable kSse2Table = {
+    InstructionSet::kSse2, AbsMaxSse2, MixDownSse2, MinMaxSse2,
+    MinMaxPerBucketSse2, MinMaxSumSquaresSse2, MapToScreenSse2,
+    DotProductSse2};
+
+const KernelTable kAvx2Table = {
+    InstructionSet::kAvx2, AbsMaxAvx2, MixDownAvx2, MinMaxAvx2,
+    MinMaxPerBucketAvx2, MinMaxSumSquaresAvx2, MapToScreenAvx2,
+    DotProductAvx2};
+#endif
+
+#if defined(VISUALMUSIC_SIMD_NEON)
+const KernelTable kNeonTable = {
+    InstructionSet::kNeon, AbsMaxNeon, MixDownNeon, MinMaxNeon,
+    MinMaxPerBucketNeon, MinMaxSumSquaresNeon, MapToScreenNeon,
+    DotProductNeon};
+#endif
+
+/**
+ * Returns whether the processor runs AVX2 and the system saves its registers
+ */
+auto DetectAvx2() -> bool {
+#if defined(VISUALMUSIC_SIMD_X86) && defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 1);
+  const bool saves_registers =
+      (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+  __cpuidex(info, 7, 0);
+  return saves_registers && (info[1] & (1 << 5)) != 0;
+#elif defined(VISUALMUSIC_SIMD_X86)
+  return __builtin_cpu_supports("avx2") != 0;
+#else
+  return false;
+#endif
+}
+
+/**
+ * Returns the kernels of an instruction set
+ * @param set
+ * @return kernels, nullptr if the set is not supported
+ */
+auto FindTable(const InstructionSet& set) -> const KernelTable* {
+  switch (set) {
+    case InstructionSet::kScalar:
+      return &kScalarTable;
+#if defined(VISUALMUSIC_SIMD_X86)
+    case InstructionSet::kSse2:
+      return &kSse2Table;
+    case InstructionSet::kAvx2:
+      return DetectAvx2() ? &kAvx2Table : nullptr;
+#endif
+#if defined(VISUALMUSIC_SIMD_NEON)
+    case InstructionSet::kNeon:
+      return &kNeonTable;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+/**
+ * Returns the kernels in use, the widest supported ones at first
+ * @return kernels
+ */
+auto ActiveTable() -> std::atomic<const KernelTable*>& {
+  static std::atomic<const KernelTable*> table([]() -> const KernelTable* {
+    const InstructionSet kPreferred[] = {InstructionSet::kAvx2,
+                                         InstructionSet::kNeon,
+                                         InstructionSet::kSse2};
+    for (InstructionSet set : kPreferred) {
+      if (FindTable(set) != nullptr) {
+        return FindTable(set);
+      }
+    }
+    return &kScalarTable;
+  }());
+
+  return table;
+}
+
+auto Kernels() -> const KernelTable& {
+  return *ActiveTable().load(std::memory_order_relaxed);
+}
+
+}  // namespace
+
+auto IsSupported(const InstructionSet& set) -> bool {
+  return FindTable(set) != nullptr;
+}
+
+auto GetSupportedInstructionSets() -> std::vector<InstructionSet> {
+  std::vector<InstructionSet> sets;
+  for (InstructionSet set :
+       {InstructionSet::kScalar, InstructionSet::kSse2, InstructionSet::kAvx2,
+        InstructionSet::kNeon}) {
+    if (IsSupported(set)) {
+      sets.push_back(set);
+    }
+  }
+  return sets;
+}
+
+auto GetInstructionSet() -> InstructionSet {
+  return Kernels().set;
+}
+
+void SetInstructionSet(const InstructionSet& set) {
+  const KernelTable* table = FindTable(set);
+  if (table == nullptr) {
+    throw std::invalid_argument("Instruction set is not supported");
+  }
+  ActiveTable().store(table, std::memory_order_relaxed);
+}
+
+auto AbsMax(const float* data, const size_t& size) -> float {
+  return Kernels().abs_max(data, size);
+}
+
+void MixDown(const float* const* channels, const size_t& num_channels,
+             const size_t& size, const float& scale, float* output) {
+  Kernels().mix_down(channels, num_channels, size, scale, output);
+}
+
+void MinMax(const float* data, const size_t& size, float* min, float* max) {
+  Kernels().min_max(data, size, min, max);
+}
+
+void MinMaxPerBucket(const float* data, const size_t& size,
+                     const size_t& num_buckets, float* mins, float* maxs) {
+  Kernels().min_max_per_bucket(data, size, num_buckets, mins, maxs);
+}
+
+void MinMaxSumSquares(const float* data, const size_t& size, float* min,
+                      float* max, float* sum_squares) {
+  Kernels().min_max_sum_squares(data, size, min, max, sum_squares);
+}
+
+void MapToScreen(const float* data, const size_t& size,
+                 const ScreenMapping& mapping, float* points) {
+  Kernels().map_to_screen(data, size, mapping, points);
+}
+
+auto DotProduct(const float* a, const float* b, const size_t& size) -> float {
+  return Kernels().dot_product(a, b, size);
+}
+
+}  // namespace simd
+
+}  // namespace visualmusic
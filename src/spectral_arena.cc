@@ -0,0 +1,47 @@
+#include "spectral_arena.h"
+
+#include <cstdint>
+
+namespace visualmusic {
+
+const size_t SpectralArena::kAlignment;
+
+SpectralArena::SpectralArena()
+    : data_(nullptr),
+      capacity_(0),
+      num_rows_(0),
+      row_size_(0),
+      row_stride_(0) {
+}
+
+void SpectralArena::Reset(const size_t& num_rows, const size_t& row_size) {
+  const size_t floats_per_line = kAlignment / sizeof(float);
+  const size_t row_stride =
+      (row_size + floats_per_line - 1) / floats_per_line * floats_per_line;
+  const size_t required = num_rows * row_stride;
+
+  if (required > capacity_) {
+    storage_.reset(new char[required * sizeof(float) + kAlignment]);
+
+    // Move the start forward to the next cache line
+    auto address = reinterpret_cast<std::uintptr_t>(storage_.get());
+    address = (address + kAlignment - 1) / kAlignment * kAlignment;
+    data_ = reinterpret_cast<float*>(address);
+    capacity_ = required;
+  }
+
+  num_rows_ = num_rows;
+  row_size_ = row_size;
+  row_stride_ = row_stride;
+}
+
+void SpectralArena::Release() {
+  storage_.reset();
+  data_ = nullptr;
+  capacity_ = 0;
+  num_rows_ = 0;
+  row_size_ = 0;
+  row_stride_ = 0;
+}
+
+}  // namespace visualmusic
@@ -0,0 +1,337 @@
+#include "spectral_tile_cache.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace visualmusic {
+
+const size_t SpectralTileCache::kNoSlot;
+
+SpectralTileCache::SpectralTileCache()
+    : max_magnitude_(0.0f), max_band_magnitude_(0.0f) {
+}
+
+SpectralTileCache::~SpectralTileCache() {
+  Stop();
+}
+
+void SpectralTileCache::Start(const StftEngine* engine,
+                              const BandMapper* bands, const float* channel,
+                              const size_t& num_samples,
+                              const TileSettings& settings) {
+  Stop();
+
+  engine_ = engine;
+  bands_ = bands;
+  channel_ = channel;
+  num_samples_ = num_samples;
+  settings_ = settings;
+  settings_.frames_per_tile = std::max<size_t>(1, settings_.frames_per_tile);
+  settings_.max_tiles = std::max<size_t>(1, settings_.max_tiles);
+  num_frames_ = engine_->CountFrames(num_samples_);
+  num_tiles_ = (num_frames_ + settings_.frames_per_tile - 1) /
+               settings_.frames_per_tile;
+
+  // Prefetch asks for max_tiles at most, so the display allocates nothing
+  // once started
+  slot_of_tile_.assign(num_tiles_, kNoSlot);
+  requests_.clear();
+  requests_.reserve(settings_.max_tiles);
+  waiting_.clear();
+  order_.clear();
+  order_.reserve(settings_.max_tiles);
+  use_clock_ = 0;
+  num_computed_tiles_ = 0;
+  busy_ = false;
+  stopping_ = false;
+  max_magnitude_ = 0.0f;
+  max_band_magnitude_ = 0.0f;
+
+  worker_ = std::thread(&SpectralTileCache::Run, this);
+}
+
+void SpectralTileCache::Stop() {
+  if (!worker_.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  requested_.notify_all();
+  computed_.notify_all();
+  worker_.join();
+
+  slots_.clear();
+  slot_of_tile_.clear();
+  requests_.clear();
+  engine_ = nullptr;
+  bands_ = nullptr;
+  channel_ = nullptr;
+}
+
+auto SpectralTileCache::IsActive() const -> bool {
+  return worker_.joinable();
+}
+
+void SpectralTileCache::Prefetch(const size_t& index, const int& direction,
+                                 const size_t& history) {
+  if (!IsActive() || num_tiles_ == 0) {
+    return;
+  }
+
+  // The tile at the playhead, then the history drawn behind it, nearest
+  // first, then the tiles the playhead moves into. More tiles than fit
+  // would evict each other.
+  const size_t frames_per_tile = settings_.frames_per_tile;
+  const size_t tile = std::min(index, num_frames_ - 1) / frames_per_tile;
+  const size_t first_history_tile =
+      (index > history ? index - history : 0) / frames_per_tile;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    order_.assign(1, tile);
+    for (size_t t = tile;
+         t > first_history_tile && order_.size() < settings_.max_tiles; t--) {
+      order_.push_back(t - 1);
+    }
+    for (size_t k = 1; k <= settings_.prefetch_tiles &&
+                       order_.size() < settings_.max_tiles;
+         k++) {
+      if (direction >= 0 && tile + k < num_tiles_) {
+        order_.push_back(tile + k);
+      } else if (direction < 0 && tile >= k &&
+                 std::find(order_.begin(), order_.end(), tile - k) ==
+                     order_.end()) {
+        order_.push_back(tile - k);
+      }
+    }
+
+    requests_.clear();
+    for (size_t i = 0; i < order_.size(); i++) {
+      const size_t slot = slot_of_tile_[order_[i]];
+      if (slot == kNoSlot) {
+        requests_.push_back(order_[i]);
+      } else {
+        // Resident tiles are kept, the most urgent one the longest
+        slots_[slot]->last_use = use_clock_ + order_.size() - i;
+      }
+    }
+    use_clock_ += order_.size();
+  }
+  requested_.notify_one();
+}
+
+auto SpectralTileCache::ReadRow(const size_t& index, const bool& bands,
+                                float* magnitudes, const bool& wait) -> bool {
+  if (!IsActive() || index >= num_frames_ || (bands && bands_ == nullptr)) {
+    return false;
+  }
+
+  const size_t tile = index / settings_.frames_per_tile;
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (slot_of_tile_[tile] == kNoSlot) {
+    if (!wait) {
+      return false;
+    }
+
+    // The tile stays wanted until it is read, whatever Prefetch requests
+    // meanwhile, and is computed again if it is evicted before this reader
+    // wakes
+    waiting_.push_back(tile);
+    requested_.notify_one();
+    computed_.wait(lock, [this, tile]() {
+      return stopping_ || slot_of_tile_[tile] != kNoSlot;
+    });
+    waiting_.erase(std::find(waiting_.begin(), waiting_.end(), tile));
+    requested_.notify_one();
+    if (stopping_) {
+      return false;
+    }
+  }
+
+  // Copied under the lock, so the worker cannot reuse the slot meanwhile
+  Tile* slot = slots_[slot_of_tile_[tile]].get();
+  slot->last_use = ++use_clock_;
+  const SpectralArena& rows = bands ? slot->bands : slot->spectra;
+  std::memcpy(magnitudes, rows.Row(index % settings_.frames_per_tile),
+              rows.GetRowSize() * sizeof(float));
+  return true;
+}
+
+void SpectralTileCache::WaitIdle() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  size_t tile = 0;
+  computed_.wait(lock, [this, &tile]() {
+    return stopping_ || !IsActive() ||
+           (requests_.empty() && !busy_ && !FindWaitedTile(&tile));
+  });
+}
+
+auto SpectralTileCache::IsResident(const size_t& index) const -> bool {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const size_t tile = index / settings_.frames_per_tile;
+  return tile < slot_of_tile_.size() && slot_of_tile_[tile] != kNoSlot;
+}
+
+auto SpectralTileCache::GetNumResidentTiles() const -> size_t {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return static_cast<size_t>(
+      slot_of_tile_.size() -
+      std::count(slot_of_tile_.begin(), slot_of_tile_.end(), kNoSlot));
+}
+
+auto SpectralTileCache::GetNumComputedTiles() const -> size_t {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_computed_tiles_;
+}
+
+auto SpectralTileCache::GetMaxMagnitude() const -> float {
+  return max_magnitude_.load(std::memory_order_relaxed);
+}
+
+auto SpectralTileCache::GetMaxBandMagnitude() const -> float {
+  return max_band_magnitude_.load(std::memory_order_relaxed);
+}
+
+auto SpectralTileCache::GetCapacityBytes(const bool& bands) const -> size_t {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t bytes = 0;
+  for (const std::unique_ptr<Tile>& slot : slots_) {
+    bytes += bands ? slot->bands.GetCapacityBytes()
+                   : slot->spectra.GetCapacityBytes();
+  }
+
+  return bytes;
+}
+
+void SpectralTileCache::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (true) {
+    size_t tile = 0;
+    requested_.wait(
+        lock, [this, &tile]() { return stopping_ || TakeRequest(&tile); });
+    if (stopping_) {
+      return;
+    }
+
+    if (slot_of_tile_[tile] == kNoSlot) {
+      // The slot holds no tile while it is computed, so readers skip it
+      const size_t slot = TakeSlot();
+      Tile* target = slots_[slot].get();
+      busy_ = true;
+
+      lock.unlock();
+      ComputeTile(tile, target);
+      lock.lock();
+
+      busy_ = false;
+      target->tile = tile;
+      target->last_use = ++use_clock_;
+      slot_of_tile_[tile] = slot;
+      num_computed_tiles_++;
+    }
+
+    computed_.notify_all();
+  }
+}
+
+auto SpectralTileCache::FindWaitedTile(size_t* tile) const -> bool {
+  for (size_t waited : waiting_) {
+    if (slot_of_tile_[waited] == kNoSlot) {
+      *tile = waited;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+auto SpectralTileCache::HasFreeSlot() const -> bool {
+  if (slots_.size() < settings_.max_tiles) {
+    return true;
+  }
+
+  for (const std::unique_ptr<Tile>& slot : slots_) {
+    if (std::find(waiting_.begin(), waiting_.end(), slot->tile) ==
+        waiting_.end()) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+auto SpectralTileCache::TakeRequest(size_t* tile) -> bool {
+  if (FindWaitedTile(tile)) {
+    return true;
+  }
+
+  // A prefetched tile must not evict a tile that a reader is about to read
+  if (requests_.empty() || !HasFreeSlot()) {
+    return false;
+  }
+
+  *tile = requests_.front();
+  requests_.erase(requests_.begin());
+  return true;
+}
+
+auto SpectralTileCache::TakeSlot() -> size_t {
+  if (slots_.size() < settings_.max_tiles) {
+    slots_.emplace_back(new Tile());
+    return slots_.size() - 1;
+  }
+
+  // The least recently used tile that no reader waits for, or the least
+  // recently used one if readers wait for every tile
+  size_t oldest = kNoSlot;
+  for (int pass = 0; pass < 2 && oldest == kNoSlot; pass++) {
+    for (size_t slot = 0; slot < slots_.size(); slot++) {
+      const bool waited =
+          std::find(waiting_.begin(), waiting_.end(), slots_[slot]->tile) !=
+          waiting_.end();
+      if ((pass == 1 || !waited) &&
+          (oldest == kNoSlot ||
+           slots_[slot]->last_use < slots_[oldest]->last_use)) {
+        oldest = slot;
+      }
+    }
+  }
+
+  if (slots_[oldest]->tile != kNoSlot) {
+    slot_of_tile_[slots_[oldest]->tile] = kNoSlot;
+  }
+  slots_[oldest]->tile = kNoSlot;
+  return oldest;
+}
+
+void SpectralTileCache::ComputeTile(const size_t& tile, Tile* slot) {
+  const size_t frames_per_tile = settings_.frames_per_tile;
+  const size_t first = tile * frames_per_tile;
+  const size_t count = std::min(frames_per_tile, num_frames_ - first);
+
+  // Frame 0 of the view is the first frame of the tile
+  const size_t offset = first * engine_->GetSettings().hop_size;
+  const FrameView frames =
+      engine_->MakeFrameView(channel_ + offset, num_samples_ - offset);
+  slot->spectra.Reset(frames_per_tile, engine_->GetNumBins());
+  const float max_magnitude = engine_->AnalyzeFrames(
+      frames, 0, count, slot->spectra.Row(0), slot->spectra.GetRowStride());
+
+  // Only the worker raises the maximums
+  max_magnitude_.store(std::fmaxf(GetMaxMagnitude(), max_magnitude),
+                       std::memory_order_relaxed);
+
+  if (bands_ != nullptr) {
+    slot->bands.Reset(frames_per_tile, bands_->GetNumBands());
+    const float max_band = bands_->ApplyRows(
+        slot->spectra.Row(0), slot->spectra.GetRowStride(), 0, count,
+        slot->bands.Row(0), slot->bands.GetRowStride());
+    max_band_magnitude_.store(std::fmaxf(GetMaxBandMagnitude(), max_band),
+                              std::memory_order_relaxed);
+  }
+}
+
+}  // namespace visualmusic
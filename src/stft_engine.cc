@@ -0,0 +1,230 @@
+#include "stft_engine.h"
+
+#include <algorithm>
+
+#include "simd_kernels.h"
+
+namespace visualmusic {
+
+StftEngine::Scratch::Scratch(const size_t& fft_size)
+    : fft(fft_size), frame(fft_size), spectral(fft_size) {
+}
+
+StftEngine::StftEngine(const StftSettings& settings) : settings_(settings) {
+  if (!isPowerOf2(settings_.fft_size)) {
+    throw std::invalid_argument("Range must be a power of 2");
+  }
+  if (settings_.hop_size == 0) {
+    throw std::invalid_argument("Hop size must be positive");
+  }
+  if (settings_.backend == FftBackend::kFixed) {
+    fixed_fft_ = GetFixedFftKernel(settings_.fft_size);
+    if (fixed_fft_ == nullptr) {
+      throw std::invalid_argument("Fixed Fft sizes range from 256 to 8192");
+    }
+  }
+
+  ConstructWindow();
+
+  // A single worker is the calling thread, which needs no pool
+  if (settings_.num_threads != 1) {
+    pool_.reset(new WorkerPool(settings_.num_threads));
+    if (pool_->GetNumWorkers() == 1) {
+      pool_.reset();
+    } else {
+      scratches_.resize(pool_->GetNumWorkers());
+    }
+  }
+}
+
+void StftEngine::ConstructWindow() {
+  const double kPi = 3.14159265358979323846;
+  const double size = static_cast<double>(settings_.fft_size);
+  window_.assign(settings_.fft_size, 1.0f);
+
+  for (size_t i = 0; i < settings_.fft_size; i++) {
+    const double phase = 2.0 * kPi * static_cast<double>(i) / size;
+
+    switch (settings_.window) {
+      case WindowType::kHann:
+        window_[i] = static_cast<float>(0.5 - 0.5 * cos(phase));
+        break;
+      case WindowType::kHamming:
+        window_[i] = static_cast<float>(0.54 - 0.46 * cos(phase));
+        break;
+      case WindowType::kBlackman:
+        window_[i] = static_cast<float>(0.42 - 0.5 * cos(phase) +
+                                        0.08 * cos(2.0 * phase));
+        break;
+      case WindowType::kRectangular:
+        break;
+    }
+  }
+}
+
+auto StftEngine::CountFrames(const size_t& num_samples) const -> size_t {
+  return (num_samples + settings_.hop_size - 1) / settings_.hop_size;
+}
+
+auto StftEngine::GetNumBins() const -> size_t {
+  return settings_.fft_size / 2;
+}
+
+auto StftEngine::GetSettings() const -> const StftSettings& {
+  return settings_;
+}
+
+auto StftEngine::MakeFrameView(const float* data,
+                               const size_t& num_samples) const -> FrameView {
+  return FrameView(data, num_samples, settings_.fft_size, settings_.hop_size);
+}
+
+auto StftEngine::Analyze(const audio::Buffer& buffer, float* output,
+                         const size_t& row_stride) const -> float {
+  if (buffer.getNumChannels() == 0) {
+    return 0.0f;
+  }
+
+  return Analyze(MakeFrameView(buffer.getChannel(0), buffer.getNumFrames()),
+                 output, row_stride);
+}
+
+auto StftEngine::Analyze(const FrameView& frames, float* output,
+                         const size_t& row_stride) const -> float {
+  return AnalyzeFrames(frames, 0, frames.GetNumFrames(), output, row_stride);
+}
+
+auto StftEngine::AnalyzeFrames(const FrameView& frames,
+                               const size_t& first_frame,
+                               const size_t& last_frame, float* output,
+                               const size_t& row_stride) const -> float {
+  const size_t stride = row_stride == 0 ? GetNumBins() : row_stride;
+  if (last_frame <= first_frame) {
+    return 0.0f;
+  }
+  const size_t num_frames = last_frame - first_frame;
+
+  // A single-threaded engine may be shared by the workers of its caller, so
+  // each call has its own scratch
+  if (pool_ == nullptr) {
+    Scratch scratch(settings_.fft_size);
+    return AnalyzeFrames(frames, first_frame, last_frame, &scratch, output,
+                         stride);
+  }
+
+  // Static partition: each task owns a contiguous run of frames, so it
+  // writes a contiguous part of the slab and keeps its own maximum
+  const size_t num_tasks = std::min(pool_->GetNumWorkers(), num_frames);
+  std::vector<size_t> range_starts(num_tasks + 1, first_frame);
+  for (size_t task = 0; task < num_tasks; task++) {
+    range_starts[task + 1] = range_starts[task] + num_frames / num_tasks +
+                             (task < num_frames % num_tasks ? 1 : 0);
+  }
+
+  std::vector<float> task_max(num_tasks, 0.0f);
+  pool_->Run(num_tasks, [&](size_t task, size_t worker) {
+    std::unique_ptr<Scratch>& scratch = scratches_[worker];
+    if (scratch == nullptr) {
+      scratch.reset(new Scratch(settings_.fft_size));
+    }
+    task_max[task] =
+        AnalyzeFrames(frames, range_starts[task], range_starts[task + 1],
+                      scratch.get(), output, stride);
+  });
+
+  float max_magnitude = 0.0f;
+  for (float magnitude : task_max) {
+    max_magnitude = std::fmaxf(max_magnitude, magnitude);
+  }
+
+  return max_magnitude;
+}
+
+auto StftEngine::AnalyzeFrames(const FrameView& frames,
+                               const size_t& first_frame,
+                               const size_t& last_frame, Scratch* scratch,
+                               float* output, const size_t& row_stride) const
+    -> float {
+  const size_t stride = row_stride == 0 ? GetNumBins() : row_stride;
+  if (fixed_fft_ != nullptr) {
+    return AnalyzeBatches(frames, first_frame, last_frame, scratch, output,
+                          stride);
+  }
+
+  float max_magnitude = 0.0f;
+  for (size_t frame = first_frame; frame < last_frame; frame++) {
+    max_magnitude = std::fmaxf(
+        max_magnitude,
+        TransformFrame(frames.GetFrame(frame), frames.GetFrameLength(frame),
+                       scratch, output + frame * stride));
+  }
+
+  return max_magnitude;
+}
+
+auto StftEngine::AnalyzeBatches(const FrameView& frames,
+                                const size_t& first_frame,
+                                const size_t& last_frame, Scratch* scratch,
+                                float* output, const size_t& row_stride) const
+    -> float {
+  const size_t fft_size = settings_.fft_size;
+  const size_t num_lanes = fixed_fft_->num_lanes;
+  scratch->batch.resize(num_lanes * fft_size);
+  scratch->workspace.resize(fixed_fft_->workspace_size);
+  float max_magnitude = 0.0f;
+
+  for (size_t first = first_frame; first < last_frame; first += num_lanes) {
+    const size_t count = std::min(num_lanes, last_frame - first);
+    for (size_t lane = 0; lane < count; lane++) {
+      WindowFrame(frames.GetFrame(first + lane),
+                  frames.GetFrameLength(first + lane),
+                  scratch->batch.data() + lane * fft_size);
+    }
+
+    max_magnitude = std::fmaxf(
+        max_magnitude,
+        fixed_fft_->forward_magnitudes(
+            scratch->batch.data(), fft_size, count, output + first * row_stride,
+            row_stride, scratch->workspace.data()));
+  }
+
+  return max_magnitude;
+}
+
+void StftEngine::WindowFrame(const float* data, const size_t& length,
+                             float* windowed) const {
+  for (size_t i = 0; i < length; i++) {
+    windowed[i] = data[i] * window_[i];
+  }
+  std::fill(windowed + length, windowed + settings_.fft_size, 0.0f);
+}
+
+auto StftEngine::TransformFrame(const float* data, const size_t& length,
+                                Scratch* scratch, float* magnitudes) const
+    -> float {
+  const size_t num_bins = GetNumBins();
+  if (fixed_fft_ != nullptr) {
+    scratch->batch.resize(settings_.fft_size);
+    scratch->workspace.resize(fixed_fft_->workspace_size);
+    WindowFrame(data, length, scratch->batch.data());
+    return fixed_fft_->forward_magnitudes(scratch->batch.data(),
+                                          settings_.fft_size, 1, magnitudes,
+                                          num_bins, scratch->workspace.data());
+  }
+
+  WindowFrame(data, length, scratch->frame.getData());
+  scratch->fft.forward(&scratch->frame, &scratch->spectral);
+
+  // The imaginary part of bin 0 holds the Nyquist component
+  const float* real = scratch->spectral.getReal();
+  const float* imag = scratch->spectral.getImag();
+
+  magnitudes[0] = std::fabs(real[0]);
+  for (size_t bin = 1; bin < num_bins; bin++) {
+    magnitudes[bin] = std::sqrt(real[bin] * real[bin] + imag[bin] * imag[bin]);
+  }
+
+  return simd::AbsMax(magnitudes, num_bins);
+}
+
+}  // namespace visualmusic
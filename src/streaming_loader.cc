@@ -0,0 +1,94 @@
+#include "streaming_loader.h"
+
+namespace visualmusic {
+
+const size_t StreamingLoader::kDefaultChunkFrames;
+
+StreamingLoader::StreamingLoader()
+    : cancelled_(false),
+      finished_(false),
+      decoded_frames_(0),
+      total_frames_(0) {
+}
+
+StreamingLoader::~StreamingLoader() {
+  Cancel();
+}
+
+void StreamingLoader::SetKeepBuffer(const bool& enabled) {
+  keep_buffer_ = enabled;
+}
+
+void StreamingLoader::Start(const audio::SourceFileRef& source_file,
+                            AudioVisualizer* visualizer, const Rectf& bounds,
+                            const size_t& sample_rate,
+                            const size_t& chunk_frames) {
+  Cancel();
+
+  total_frames_ = source_file->getNumFrames();
+  buffer_ = keep_buffer_ ? std::make_shared<audio::Buffer>(
+                             total_frames_, source_file->getNumChannels())
+                       : nullptr;
+  cancelled_ = false;
+  finished_ = false;
+  decoded_frames_ = 0;
+
+  visualizer->BeginStream(total_frames_, source_file->getNumChannels(), bounds,
+                          sample_rate);
+
+  thread_ = std::thread(&StreamingLoader::Run, this, source_file, visualizer,
+                        chunk_frames);
+}
+
+void StreamingLoader::Cancel() {
+  cancelled_ = true;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+auto StreamingLoader::IsFinished() const -> bool {
+  return finished_;
+}
+
+auto StreamingLoader::GetProgress() const -> float {
+  if (total_frames_ == 0) {
+    return 1.0f;
+  }
+  return static_cast<float>(decoded_frames_) /
+         static_cast<float>(total_frames_);
+}
+
+auto StreamingLoader::GetBuffer() const -> audio::BufferRef {
+  return buffer_;
+}
+
+void StreamingLoader::Run(audio::SourceFileRef source_file,
+                          AudioVisualizer* visualizer, size_t chunk_frames) {
+  audio::Buffer chunk(chunk_frames, source_file->getNumChannels());
+  size_t frame = 0;
+
+  source_file->seek(0);
+  while (frame < total_frames_ && !cancelled_) {
+    size_t num_frames = source_file->read(&chunk);
+    if (num_frames == 0) {
+      break;
+    }
+    num_frames = std::min(num_frames, total_frames_ - frame);
+
+    if (buffer_) {
+      buffer_->copyOffset(chunk, num_frames, frame, 0);
+    }
+    visualizer->AppendFrames(chunk, num_frames);
+
+    frame += num_frames;
+    decoded_frames_ = frame;
+  }
+
+  if (!cancelled_) {
+    visualizer->EndStream();
+    finished_ = true;
+  }
+}
+
+}  // namespace visualmusic
@@ -0,0 +1,35 @@
+#include "text_formatter.h"
+
+#include <cstdio>
+
+namespace visualmusic {
+
+const size_t TextFormatter::kMaxLength;
+
+TextFormatter::TextFormatter() {
+  buffer_[0] = '\0';
+  text_.reserve(kMaxLength);
+}
+
+auto TextFormatter::Format(const char* format, ...) -> const std::string& {
+  va_list args;
+  va_start(args, format);
+  FormatList(format, args);
+  va_end(args);
+  return text_;
+}
+
+auto TextFormatter::FormatList(const char* format, va_list args)
+    -> const std::string& {
+  std::vsnprintf(buffer_, sizeof(buffer_), format, args);
+
+  // Assigning within the capacity of the string does not allocate
+  text_.assign(buffer_);
+  return text_;
+}
+
+auto TextFormatter::GetText() const -> const std::string& {
+  return text_;
+}
+
+}  // namespace visualmusic
@@ -0,0 +1,148 @@
+#include "track_analyzer.h"
+
+#include "simd_kernels.h"
+#include "stft_engine.h"
+
+namespace visualmusic {
+
+const size_t TrackAnalyzer::kInstantDisplayRate;
+const size_t TrackAnalyzer::kGeneralDisplayRate;
+const size_t TrackAnalyzer::kThreeDimensionDisplayRate;
+const size_t TrackAnalyzer::kFftSize;
+
+auto TrackAnalyzer::MakeDisplayParameters(
+    const size_t& sample_rate, const size_t& instant_display_rate,
+    const size_t& general_display_rate,
+    const size_t& three_dimension_display_rate, const size_t& fft_size,
+    const BandSettings& bands, const FftBackend& fft_backend)
+    -> AnalysisParameters {
+  AnalysisParameters parameters;
+  parameters.sample_rate = sample_rate;
+  parameters.instant_display_rate = instant_display_rate;
+  parameters.general_display_rate = general_display_rate;
+  parameters.three_dimension_display_rate = three_dimension_display_rate;
+  parameters.fft_size = fft_size;
+  parameters.hop_size = fft_size;
+  parameters.window = WindowType::kRectangular;
+  parameters.fft_backend = fft_backend;
+
+  // Settings that do not change the bands do not change the key either
+  if (bands.scale != BandScale::kLinear && bands.num_bands > 0) {
+    parameters.band_scale = bands.scale;
+    parameters.num_bands = bands.num_bands;
+    parameters.min_frequency = bands.min_frequency;
+  }
+  return parameters;
+}
+
+auto TrackAnalyzer::MakeDisplayParameters(const size_t& sample_rate,
+                                          const BandSettings& bands,
+                                          const FftBackend& fft_backend)
+    -> AnalysisParameters {
+  return MakeDisplayParameters(sample_rate, kInstantDisplayRate,
+                               kGeneralDisplayRate, kThreeDimensionDisplayRate,
+                               kFftSize, bands, fft_backend);
+}
+
+auto TrackAnalyzer::EstimateBytes(const size_t& num_frames,
+                                  const size_t& num_channels,
+                                  const AnalysisParameters& parameters)
+    -> size_t {
+  const size_t hop_size =
+      parameters.hop_size == 0 ? parameters.fft_size : parameters.hop_size;
+  const size_t num_spectral_frames = (num_frames + hop_size - 1) / hop_size;
+
+  // Rows are padded to a multiple of 16 floats, plus one cache line
+  const size_t row_stride = (parameters.fft_size / 2 + 15) / 16 * 16;
+  const size_t band_stride = (parameters.num_bands + 15) / 16 * 16;
+  const size_t spectral_bytes =
+      num_spectral_frames * (row_stride + band_stride) * sizeof(float) +
+      2 * SpectralArena::kAlignment;
+
+  return num_frames * num_channels * sizeof(float) +
+         EnvelopePyramid::CountBuckets(num_frames) *
+             sizeof(EnvelopePyramid::Bucket) +
+         spectral_bytes;
+}
+
+TrackAnalyzer::TrackAnalyzer(const AnalysisParameters& parameters,
+                             const size_t& num_threads)
+    : parameters_(parameters), num_threads_(num_threads) {
+}
+
+void TrackAnalyzer::Analyze(const audio::Buffer& buffer) {
+  key_ = AnalysisCache::ComputeKey(buffer, parameters_);
+
+  envelope_.Build(buffer, num_threads_);
+  max_magnitude_general_ = simd::AbsMax(buffer.getData(), buffer.getSize());
+
+  StftSettings settings;
+  settings.fft_size = parameters_.fft_size;
+  settings.hop_size = parameters_.hop_size;
+  settings.window = parameters_.window;
+  settings.backend = parameters_.fft_backend;
+  settings.num_threads = num_threads_;
+  StftEngine engine(settings);
+
+  spectral_arena_.Reset(engine.CountFrames(buffer.getNumFrames()),
+                        engine.GetNumBins());
+  max_magnitude_fft_ =
+      spectral_arena_.GetNumRows() == 0
+          ? 0.0f
+          : engine.Analyze(buffer, spectral_arena_.Row(0),
+                           spectral_arena_.GetRowStride());
+
+  BandSettings bands;
+  bands.scale = parameters_.band_scale;
+  bands.num_bands = parameters_.num_bands;
+  bands.min_frequency = parameters_.min_frequency;
+  band_mapper_.Configure(bands, engine.GetNumBins(), parameters_.sample_rate);
+
+  max_magnitude_bands_ = 0.0f;
+  if (band_mapper_.IsEnabled()) {
+    band_arena_.Reset(spectral_arena_.GetNumRows(),
+                      band_mapper_.GetNumBands());
+    if (band_arena_.GetNumRows() > 0) {
+      max_magnitude_bands_ = band_mapper_.ApplyRows(
+          spectral_arena_.Row(0), spectral_arena_.GetRowStride(), 0,
+          spectral_arena_.GetNumRows(), band_arena_.Row(0),
+          band_arena_.GetRowStride());
+    }
+  } else {
+    band_arena_.Release();
+  }
+}
+
+auto TrackAnalyzer::GetProducts() const -> AnalysisProducts {
+  AnalysisProducts products;
+  products.num_frames = envelope_.GetNumFrames();
+  products.envelope = envelope_.GetData();
+  products.num_envelope_buckets = envelope_.GetNumBuckets();
+  products.spectral_rows =
+      spectral_arena_.GetNumRows() == 0 ? nullptr : spectral_arena_.Row(0);
+  products.num_spectral_frames = spectral_arena_.GetNumRows();
+  products.num_spectral_bins = spectral_arena_.GetRowSize();
+  products.spectral_row_stride = spectral_arena_.GetRowStride();
+  products.spectral_hop_size = parameters_.hop_size;
+  if (band_mapper_.IsEnabled() && band_arena_.GetNumRows() > 0) {
+    products.band_rows = band_arena_.Row(0);
+    products.num_bands = band_arena_.GetRowSize();
+    products.band_row_stride = band_arena_.GetRowStride();
+  }
+  products.max_magnitude_general = max_magnitude_general_;
+  products.max_magnitude_fft = max_magnitude_fft_;
+  products.max_magnitude_bands = max_magnitude_bands_;
+  return products;
+}
+
+auto TrackAnalyzer::GetKey() const -> uint64_t {
+  return key_;
+}
+
+auto TrackAnalyzer::Write(const std::string& directory) const
+    -> std::string {
+  const std::string path = directory + "/" + AnalysisCache::GetFileName(key_);
+  return AnalysisCache::Write(path, key_, GetProducts()) ? path : "";
+}
+
+}  // namespace visualmusic
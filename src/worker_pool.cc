@@ -0,0 +1,96 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+
+namespace visualmusic {
+
+WorkerPool::WorkerPool(const size_t& num_workers) : next_task_(0) {
+  size_t count = num_workers;
+  if (count == 0) {
+    count = std::max<size_t>(1, std::thread::hardware_concurrency());
+  }
+
+  for (size_t worker = 1; worker < count; worker++) {
+    threads_.emplace_back(&WorkerPool::Loop, this, worker);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+auto WorkerPool::GetNumWorkers() const -> size_t {
+  return threads_.size() + 1;
+}
+
+void WorkerPool::Run(const size_t& num_tasks,
+                     const std::function<void(size_t, size_t)>& task) {
+  if (num_tasks == 0) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> run_lock(run_mutex_);
+
+  // A single task is not worth a wake-up
+  if (threads_.empty() || num_tasks == 1) {
+    for (size_t index = 0; index < num_tasks; index++) {
+      task(index, 0);
+    }
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    num_tasks_ = num_tasks;
+    next_task_ = 0;
+    busy_workers_ = threads_.size();
+    generation_++;
+  }
+  wake_.notify_all();
+
+  Work(0);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this]() { return busy_workers_ == 0; });
+  task_ = nullptr;
+}
+
+void WorkerPool::Work(const size_t& worker) {
+  for (size_t index = next_task_++; index < num_tasks_;
+       index = next_task_++) {
+    (*task_)(index, worker);
+  }
+}
+
+void WorkerPool::Loop(size_t worker) {
+  uint64_t generation = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this, generation]() {
+        return stopping_ || generation_ != generation;
+      });
+      if (stopping_) {
+        return;
+      }
+      generation = generation_;
+    }
+
+    Work(worker);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--busy_workers_ == 0) {
+      done_.notify_one();
+    }
+  }
+}
+
+}  // namespace visualmusic
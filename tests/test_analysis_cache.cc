@@ -0,0 +1,240 @@
+#include <catch2/catch.hpp>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "analysis_cache.h"
+#include "audio_visualizer.h"
+
+using namespace ci;
+
+namespace {
+
+const char *kCachePath = "test_analysis_cache.vmcache";
+
+auto MakeProducts(visualmusic::EnvelopePyramid &envelope,
+                  std::vector<float> &rows, std::vector<float> &band_rows)
+    -> visualmusic::AnalysisProducts {
+  audio::Buffer buffer(3000, 1);
+  for (size_t i = 0; i < buffer.getNumFrames(); i++) {
+    buffer.getData()[i] = static_cast<float>(i % 100) * 0.01f;
+  }
+  envelope.Build(buffer);
+
+  rows.resize(200 * 16);
+  for (size_t i = 0; i < rows.size(); i++) {
+    rows[i] = static_cast<float>(i % 7);
+  }
+  band_rows.resize(200 * 8);
+  for (size_t i = 0; i < band_rows.size(); i++) {
+    band_rows[i] = static_cast<float>(i % 5);
+  }
+
+  visualmusic::AnalysisProducts products;
+  products.num_frames = envelope.GetNumFrames();
+  products.envelope = envelope.GetData();
+  products.num_envelope_buckets = envelope.GetNumBuckets();
+  products.spectral_rows = rows.data();
+  products.num_spectral_frames = 200;
+  products.num_spectral_bins = 12;
+  products.spectral_row_stride = 16;
+  products.spectral_hop_size = 1024;
+  products.band_rows = band_rows.data();
+  products.num_bands = 6;
+  products.band_row_stride = 8;
+  products.max_magnitude_general = 1.0f;
+  products.max_magnitude_fft = 6.0f;
+  products.max_magnitude_bands = 4.0f;
+  return products;
+}
+
+// Overwrite one byte of the cache file
+void CorruptByte(const size_t &offset) {
+  std::fstream file(kCachePath,
+                    std::ios::binary | std::ios::in | std::ios::out);
+  file.seekp(static_cast<std::streamoff>(offset));
+  file.put('\x7f');
+}
+
+}  // namespace
+
+TEST_CASE("Test AnalysisCache") {
+  visualmusic::EnvelopePyramid envelope;
+  std::vector<float> rows;
+  std::vector<float> band_rows;
+  visualmusic::AnalysisProducts products =
+      MakeProducts(envelope, rows, band_rows);
+  REQUIRE(visualmusic::AnalysisCache::Write(kCachePath, 42, products));
+
+  visualmusic::AnalysisCache cache;
+
+  SECTION("Round trip") {
+    REQUIRE(cache.Open(kCachePath, 42));
+    const visualmusic::AnalysisProducts &mapped = cache.GetProducts();
+
+    REQUIRE(mapped.num_frames == 3000);
+    REQUIRE(mapped.num_envelope_buckets == envelope.GetNumBuckets());
+    REQUIRE(std::memcmp(mapped.envelope, envelope.GetData(),
+                        envelope.GetNumBuckets() *
+                            sizeof(visualmusic::EnvelopePyramid::Bucket)) ==
+            0);
+    REQUIRE(mapped.num_spectral_frames == 200);
+    REQUIRE(mapped.spectral_row_stride == 16);
+    REQUIRE(std::memcmp(mapped.spectral_rows, rows.data(),
+                        rows.size() * sizeof(float)) == 0);
+    REQUIRE(mapped.max_magnitude_fft == 6.0f);
+    REQUIRE(mapped.num_bands == 6);
+    REQUIRE(mapped.band_row_stride == 8);
+    REQUIRE(std::memcmp(mapped.band_rows, band_rows.data(),
+                        band_rows.size() * sizeof(float)) == 0);
+    REQUIRE(mapped.max_magnitude_bands == 4.0f);
+  }
+
+  SECTION("Stale key is rejected") {
+    REQUIRE_FALSE(cache.Open(kCachePath, 43));
+  }
+
+  SECTION("Corrupt header is rejected") {
+    CorruptByte(20);
+    REQUIRE_FALSE(cache.Open(kCachePath, 42));
+  }
+
+  SECTION("Corrupt payload is rejected") {
+    // First bucket of the envelope, right after the header
+    CorruptByte(128);
+    REQUIRE_FALSE(cache.Open(kCachePath, 42));
+  }
+
+  SECTION("Truncated file is rejected") {
+    std::ifstream input(kCachePath, std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(input)),
+                         std::istreambuf_iterator<char>());
+    input.close();
+
+    std::ofstream output(kCachePath, std::ios::binary | std::ios::trunc);
+    output.write(contents.data(),
+                 static_cast<std::streamsize>(contents.size() - 64));
+    output.close();
+
+    REQUIRE_FALSE(cache.Open(kCachePath, 42));
+  }
+
+  cache.Close();
+  std::remove(kCachePath);
+}
+
+TEST_CASE("Test loading through the cache") {
+  audio::Buffer buffer(10000, 2);
+  for (size_t i = 0; i < buffer.getNumFrames(); i++) {
+    buffer.getChannel(0)[i] = std::sin(0.02f * static_cast<float>(i));
+    buffer.getChannel(1)[i] = std::sin(0.03f * static_cast<float>(i));
+  }
+  Rectf bounds(vec2(0, 0), vec2(400, 300));
+
+  visualmusic::AudioVisualizer uncached;
+  uncached.Load(buffer, bounds, 44100);
+
+  visualmusic::AudioVisualizer visualizer;
+  visualizer.SetCacheDirectory(".");
+  visualizer.Load(buffer, bounds, 44100);
+  REQUIRE_FALSE(visualizer.IsLoadedFromCache());
+
+  visualizer.Load(buffer, bounds, 44100);
+  REQUIRE(visualizer.IsLoadedFromCache());
+  REQUIRE(visualizer.GetNumSpectralFrames() ==
+          uncached.GetNumSpectralFrames());
+  for (size_t i = 0; i < uncached.GetNumSpectralFrames(); i++) {
+    REQUIRE(std::memcmp(visualizer.GetSpectralFrame(i),
+                        uncached.GetSpectralFrame(i),
+                        uncached.GetNumSpectralBins() * sizeof(float)) == 0);
+  }
+
+  REQUIRE(visualizer.CalculateGeneralGraphInTimeDomain(10000) ==
+          uncached.CalculateGeneralGraphInTimeDomain(10000));
+  const std::vector<vec2> &cached_graph = visualizer.GetGeneralGraphPoints();
+  const std::vector<vec2> &uncached_graph = uncached.GetGeneralGraphPoints();
+  REQUIRE(cached_graph.size() == uncached_graph.size());
+  for (size_t i = 0; i < cached_graph.size(); i++) {
+    REQUIRE(cached_graph[i].y == uncached_graph[i].y);
+  }
+
+  // The rhythm is tracked again from the mapped spectra
+  const visualmusic::RhythmTracker &rhythm = visualizer.GetRhythm();
+  REQUIRE(rhythm.GetNumFrames() == uncached.GetNumSpectralFrames());
+  for (size_t i = 0; i < rhythm.GetNumFrames(); i++) {
+    visualmusic::RhythmFrame cached_frame;
+    visualmusic::RhythmFrame uncached_frame;
+    REQUIRE(rhythm.GetFrame(i, &cached_frame));
+    REQUIRE(uncached.GetRhythm().GetFrame(i, &uncached_frame));
+    REQUIRE(cached_frame.onset_strength == uncached_frame.onset_strength);
+    REQUIRE(cached_frame.tempo == uncached_frame.tempo);
+    REQUIRE(cached_frame.beat == uncached_frame.beat);
+  }
+
+  // A different track misses the cache
+  buffer.getChannel(0)[0] = 0.5f;
+  visualizer.Load(buffer, bounds, 44100);
+  REQUIRE_FALSE(visualizer.IsLoadedFromCache());
+
+  // Remove the two files written by the test
+  visualmusic::AnalysisParameters parameters;
+  parameters.sample_rate = 44100;
+  parameters.instant_display_rate = 20;
+  parameters.general_display_rate = 100;
+  parameters.three_dimension_display_rate = 50;
+  parameters.fft_size = 1024;
+  parameters.hop_size = 1024;
+  std::remove(visualmusic::AnalysisCache::GetFileName(
+                  visualmusic::AnalysisCache::ComputeKey(buffer, parameters))
+                  .c_str());
+  buffer.getChannel(0)[0] = 0.0f;
+  std::remove(visualmusic::AnalysisCache::GetFileName(
+                  visualmusic::AnalysisCache::ComputeKey(buffer, parameters))
+                  .c_str());
+}
+
+TEST_CASE("Test frequency bands through the cache") {
+  audio::Buffer buffer(20000, 1);
+  for (size_t i = 0; i < buffer.getNumFrames(); i++) {
+    buffer.getData()[i] = std::sin(0.05f * static_cast<float>(i));
+  }
+  Rectf bounds(vec2(0, 0), vec2(400, 300));
+  visualmusic::BandSettings bands;
+  bands.scale = visualmusic::BandScale::kMel;
+  bands.num_bands = 64;
+
+  visualmusic::AudioVisualizer uncached;
+  uncached.SetFrequencyBands(bands);
+  uncached.Load(buffer, bounds, 44100);
+  REQUIRE(uncached.GetNumBands() == 64);
+
+  visualmusic::AudioVisualizer visualizer;
+  visualizer.SetCacheDirectory(".");
+  visualizer.SetFrequencyBands(bands);
+  visualizer.Load(buffer, bounds, 44100);
+  visualizer.Load(buffer, bounds, 44100);
+  REQUIRE(visualizer.IsLoadedFromCache());
+  REQUIRE(visualizer.GetNumBands() == 64);
+  for (size_t i = 0; i < uncached.GetNumSpectralFrames(); i++) {
+    REQUIRE(std::memcmp(visualizer.GetBandFrame(i), uncached.GetBandFrame(i),
+                        64 * sizeof(float)) == 0);
+  }
+
+  // Other bands are another key
+  visualizer.SetFrequencyBands(visualmusic::BandSettings());
+  visualizer.Load(buffer, bounds, 44100);
+  REQUIRE_FALSE(visualizer.IsLoadedFromCache());
+  REQUIRE(visualizer.GetNumBands() == 0);
+
+  std::remove(visualmusic::AnalysisCache::GetFileName(
+                  visualmusic::AnalysisCache::ComputeKey(
+                      buffer, visualmusic::TrackAnalyzer::MakeDisplayParameters(
+                                  44100, bands)))
+                  .c_str());
+  std::remove(visualmusic::AnalysisCache::GetFileName(
+                  visualmusic::AnalysisCache::ComputeKey(
+                      buffer, visualmusic::TrackAnalyzer::MakeDisplayParameters(
+                                  44100)))
+                  .c_str());
+}
@@ -1,4 +1,6 @@
 #include <catch2/catch.hpp>
+#include <cstdio>
+#include <cstring>
 
 #include "audio_visualizer.h"
 
@@ -35,4 +37,405 @@ TEST_CASE("Test CalculateInstantGraphInTimeDomain") {
   }
 
   delete[] arr_ptr;
-}
\ No newline at end of file
+}
+
+TEST_CASE("Test reloading the same buffer") {
+  // Bands and channel views, so every product is reloaded
+  visualmusic::AudioVisualizer visualizer;
+  visualmusic::BandSettings bands;
+  bands.scale = visualmusic::BandScale::kLog;
+  visualizer.SetFrequencyBands(bands);
+  visualizer.SetChannelViews(true);
+  audio::Buffer buffer(44100, 2);
+  for (size_t i = 0; i < buffer.getNumFrames(); i++) {
+    buffer.getChannel(0)[i] = std::sin(0.05f * static_cast<float>(i));
+    buffer.getChannel(1)[i] = std::cos(0.05f * static_cast<float>(i));
+  }
+
+  Rectf bounds(vec2(0, 0), vec2(400, 300));
+  visualizer.Load(buffer, bounds, 44100);
+
+  const visualmusic::SpectralArena &arena = visualizer.GetSpectralArena();
+  const float *first_row = arena.Row(0);
+  const size_t capacity = arena.GetCapacityBytes();
+  const size_t num_frames = visualizer.GetNumSpectralFrames();
+  visualizer.CalculateGeneralGraphInTimeDomain(buffer.getNumFrames());
+  const visualmusic::MemoryUsage usage = visualizer.GetMemoryUsage();
+
+  SECTION("Spectral rows are cache aligned") {
+    REQUIRE(reinterpret_cast<std::uintptr_t>(first_row) %
+                visualmusic::SpectralArena::kAlignment ==
+            0);
+    REQUIRE(arena.GetRowStride() * sizeof(float) %
+                visualmusic::SpectralArena::kAlignment ==
+            0);
+  }
+
+  SECTION("Memory stays flat across reloads") {
+    for (size_t i = 0; i < 100; i++) {
+      visualizer.Load(buffer, bounds, 44100);
+      visualizer.CalculateGeneralGraphInTimeDomain(buffer.getNumFrames());
+    }
+
+    REQUIRE(visualizer.GetNumSpectralFrames() == num_frames);
+    REQUIRE(arena.GetCapacityBytes() == capacity);
+    REQUIRE(arena.Row(0) == first_row);
+
+    // Every product the visualizer holds, not only the spectral arena
+    const visualmusic::MemoryUsage reloaded = visualizer.GetMemoryUsage();
+    REQUIRE(reloaded.samples == usage.samples);
+    REQUIRE(reloaded.envelope == usage.envelope);
+    REQUIRE(reloaded.spectra == usage.spectra);
+    REQUIRE(reloaded.bands == usage.bands);
+    REQUIRE(reloaded.graphs == usage.graphs);
+    REQUIRE(reloaded.channel_views == usage.channel_views);
+    REQUIRE(reloaded.rhythm == usage.rhythm);
+    REQUIRE(reloaded.mapped == usage.mapped);
+    REQUIRE(reloaded.GetTotal() == usage.GetTotal());
+    REQUIRE(usage.bands > 0);
+    REQUIRE(usage.channel_views > 0);
+  }
+
+  SECTION("Memory stays flat across reloads from the cache") {
+    visualizer.SetCacheDirectory(".");
+    visualizer.Load(buffer, bounds, 44100);
+    visualizer.Load(buffer, bounds, 44100);
+    REQUIRE(visualizer.IsLoadedFromCache());
+    const visualmusic::MemoryUsage cached = visualizer.GetMemoryUsage();
+
+    for (size_t i = 0; i < 100; i++) {
+      visualizer.Load(buffer, bounds, 44100);
+    }
+
+    // One mapping at a time, whatever the number of reloads
+    const visualmusic::MemoryUsage reloaded = visualizer.GetMemoryUsage();
+    REQUIRE(visualizer.IsLoadedFromCache());
+    REQUIRE(cached.mapped > 0);
+    REQUIRE(reloaded.mapped == cached.mapped);
+    REQUIRE(reloaded.GetTotal() == cached.GetTotal());
+    const visualmusic::AnalysisParameters parameters =
+        visualmusic::TrackAnalyzer::MakeDisplayParameters(44100, bands);
+    std::remove(visualmusic::AnalysisCache::GetFileName(
+                    visualmusic::AnalysisCache::ComputeKey(buffer, parameters))
+                    .c_str());
+  }
+}
+
+TEST_CASE("Test progressive load") {
+  const size_t kNumFrames = 20000;
+  audio::Buffer buffer(kNumFrames, 2);
+  for (size_t i = 0; i < kNumFrames; i++) {
+    buffer.getChannel(0)[i] = std::sin(0.01f * static_cast<float>(i));
+    buffer.getChannel(1)[i] = 0.25f;
+  }
+  Rectf bounds(vec2(0, 0), vec2(400, 300));
+
+  visualmusic::AudioVisualizer loaded;
+  loaded.Load(buffer, bounds, 1000);
+
+  visualmusic::AudioVisualizer streamed;
+  streamed.BeginStream(kNumFrames, 2, bounds, 1000);
+
+  SECTION("Only the received frames are displayed") {
+    audio::Buffer chunk(3000, 2);
+    chunk.copyOffset(buffer, 3000, 0, 0);
+    streamed.AppendFrames(chunk, 3000);
+
+    REQUIRE(streamed.GetReadyFrames() == 3000);
+    REQUIRE_FALSE(streamed.IsLoaded());
+    // 400 columns of 50 frames, two points per column, over the complete
+    // envelope buckets only
+    size_t complete_frames = 3000 / 256 * 256;
+    REQUIRE(streamed.CalculateGeneralGraphInTimeDomain(kNumFrames) ==
+            2 * (complete_frames / 50));
+    REQUIRE(streamed.CalculateInstantGraphInFrequencyDomain(1024, bounds)
+                .size() == streamed.GetNumSpectralBins());
+    REQUIRE(streamed.CalculateInstantGraphInFrequencyDomain(2048, bounds)
+                .size() == 0);
+  }
+
+  SECTION("Result matches a full load") {
+    // Uneven chunks, so ranges and Fft frames straddle chunk borders
+    audio::Buffer chunk(777, 2);
+    for (size_t frame = 0; frame < kNumFrames; frame += 777) {
+      size_t count = std::min<size_t>(777, kNumFrames - frame);
+      chunk.copyOffset(buffer, count, 0, frame);
+      streamed.AppendFrames(chunk, count);
+    }
+    streamed.EndStream();
+
+    REQUIRE(streamed.IsLoaded());
+    REQUIRE(streamed.GetNumSpectralFrames() == loaded.GetNumSpectralFrames());
+    for (size_t i = 0; i < loaded.GetNumSpectralFrames(); i++) {
+      REQUIRE(std::memcmp(streamed.GetSpectralFrame(i),
+                          loaded.GetSpectralFrame(i),
+                          loaded.GetNumSpectralBins() * sizeof(float)) == 0);
+    }
+
+    REQUIRE(streamed.CalculateGeneralGraphInTimeDomain(kNumFrames) ==
+            loaded.CalculateGeneralGraphInTimeDomain(kNumFrames));
+    const std::vector<vec2> &streamed_graph = streamed.GetGeneralGraphPoints();
+    const std::vector<vec2> &loaded_graph = loaded.GetGeneralGraphPoints();
+    REQUIRE(streamed_graph.size() == loaded_graph.size());
+    for (size_t i = 0; i < loaded_graph.size(); i++) {
+      REQUIRE(Approx(streamed_graph[i].y) == loaded_graph[i].y);
+    }
+  }
+}
+
+TEST_CASE("Test general graph cost does not grow with the playhead") {
+  // Ten minutes of a mono sweep
+  const size_t kSampleRate = 44100;
+  const size_t kNumFrames = 10 * 60 * kSampleRate;
+  audio::Buffer buffer(kNumFrames, 1);
+  float *data = buffer.getChannel(0);
+  for (size_t i = 0; i < kNumFrames; i++) {
+    const float t = static_cast<float>(i) / static_cast<float>(kNumFrames);
+    data[i] = std::sin(static_cast<float>(i) * (0.01f + 0.2f * t));
+  }
+
+  visualmusic::AudioVisualizer visualizer;
+  visualizer.Load(buffer, Rectf(vec2(0, 0), vec2(800, 600)), kSampleRate);
+
+  // The points are computed once, then only the prefix length changes
+  const size_t num_points = visualizer.CalculateGeneralGraphInTimeDomain(0);
+  const std::vector<vec2> &points = visualizer.GetGeneralGraphPoints();
+  const vec2 *first_point = points.data();
+  const std::vector<vec2> computed = points;
+  REQUIRE(num_points == 0);
+  REQUIRE(points.size() == 2 * 800);
+
+  // Whatever the playhead, the points are neither dropped, moved nor
+  // recomputed, and the geometry of a frame keeps their generation
+  visualmusic::FrameGeometry geometry;
+  visualizer.BuildGeometry(0, &geometry);
+  const uint64_t generation = geometry.general_generation;
+  size_t last_points = 0;
+  for (size_t frame = 0; frame <= kNumFrames; frame += kNumFrames / 97) {
+    const size_t drawn = visualizer.CalculateGeneralGraphInTimeDomain(frame);
+    REQUIRE(drawn >= last_points);
+    REQUIRE(drawn == 2 * (frame * 800 / kNumFrames));
+    last_points = drawn;
+
+    visualizer.BuildGeometry(frame, &geometry);
+    REQUIRE(geometry.general_generation == generation);
+    REQUIRE(geometry.num_general_points == drawn);
+  }
+  REQUIRE(visualizer.CalculateGeneralGraphInTimeDomain(kNumFrames) ==
+          points.size());
+  REQUIRE(points.data() == first_point);
+  REQUIRE(points.size() == computed.size());
+  REQUIRE(std::memcmp(points.data(), computed.data(),
+                      points.size() * sizeof(vec2)) == 0);
+}
+
+TEST_CASE("Test decimated instant graph") {
+  Rectf bounds(vec2(0, 0), vec2(400, 300));
+
+  // One second of eight quiet channels at 192 kHz, with a one-sample spike
+  audio::Buffer buffer(192000, 8);
+  for (size_t channel = 0; channel < 8; channel++) {
+    for (size_t i = 0; i < buffer.getNumFrames(); i++) {
+      buffer.getChannel(channel)[i] =
+          0.1f * std::sin(0.01f * static_cast<float>(i + channel));
+    }
+  }
+  buffer.getChannel(3)[5001] = -1.0f;
+
+  visualmusic::AudioVisualizer visualizer;
+  visualizer.Load(buffer, bounds, 192000);
+
+  SECTION("At most two points per pixel column") {
+    for (size_t channel = 0; channel < 8; channel++) {
+      REQUIRE(visualizer
+                  .CalculateInstantGraphInTimeDomain(
+                      buffer.getChannel(channel), 0)
+                  .size() == 2 * 400);
+    }
+
+    audio::Buffer stereo(44100, 2);
+    visualmusic::AudioVisualizer reference;
+    reference.Load(stereo, bounds, 44100);
+    REQUIRE(
+        reference.CalculateInstantGraphInTimeDomain(stereo.getChannel(0), 0)
+            .size() == 2 * 400);
+  }
+
+  SECTION("Transients stay visible") {
+    PolyLine2f graph =
+        visualizer.CalculateInstantGraphInTimeDomain(buffer.getChannel(3), 0);
+
+    float top = bounds.getY2();
+    for (const vec2 &point : graph.getPoints()) {
+      top = std::fminf(top, point.y);
+    }
+
+    // The spike reaches the full magnitude, the edge of the graph
+    REQUIRE(Approx(top) == bounds.getY1() + bounds.getHeight() * 8.2f / 10);
+  }
+
+  SECTION("Decimation can be disabled") {
+    visualizer.SetInstantGraphDecimation(false);
+    REQUIRE(
+        visualizer.CalculateInstantGraphInTimeDomain(buffer.getChannel(0), 0)
+            .size() == 192000 / 20);
+  }
+}
+
+TEST_CASE("Test 3D graph computes only new rows") {
+  audio::Buffer buffer(44100 * 10, 1);
+  for (size_t i = 0; i < buffer.getNumFrames(); i++) {
+    buffer.getChannel(0)[i] =
+        std::sin(0.002f * static_cast<float>(i * i % 9973));
+  }
+
+  Rectf bounds(vec2(0, 0), vec2(800, 600));
+  visualmusic::AudioVisualizer visualizer;
+  visualizer.Load(buffer, bounds, 44100);
+
+  const size_t frame = 100 * 1024 + 17;
+  REQUIRE(visualizer.Update3DGraph(frame) == 50);
+
+  SECTION("Advancing by a hop computes one row") {
+    REQUIRE(visualizer.Update3DGraph(frame) == 0);
+    REQUIRE(visualizer.Update3DGraph(frame + 500) == 0);
+    REQUIRE(visualizer.Update3DGraph(frame + 1024) == 1);
+    REQUIRE(visualizer.Update3DGraph(frame + 3 * 1024) == 2);
+
+    // A seek past the history computes every row again
+    REQUIRE(visualizer.Update3DGraph(frame + 200 * 1024) == 50);
+  }
+
+  SECTION("Rows hold the spectra") {
+    const size_t num_bins = visualizer.GetNumSpectralBins();
+    for (size_t index = 51; index <= 100; index++) {
+      const std::vector<vec2> row = visualizer.Get3DGraphRow(index);
+      const float* spectrum = visualizer.GetSpectralFrame(index);
+
+      REQUIRE(row.size() == num_bins);
+      for (size_t bin = 0; bin < num_bins; bin++) {
+        REQUIRE(row[bin].x ==
+                Approx(static_cast<float>(bin) / static_cast<float>(num_bins)));
+        REQUIRE(row[bin].y == spectrum[bin]);
+      }
+    }
+    REQUIRE(visualizer.Get3DGraphRow(50).empty());
+  }
+
+  SECTION("Rows are drawn like the frequency graph in their bounds") {
+    visualmusic::FrameGeometry geometry;
+    visualizer.BuildGeometry(frame, &geometry);
+
+    // Each row is as high as the newest, and i 50ths of it above
+    const Rectf newest = visualizer.Get3DGraphRowBounds(0);
+    for (size_t i = 0; i < 50; i += 7) {
+      const Rectf row_bounds = visualizer.Get3DGraphRowBounds(i);
+      REQUIRE(row_bounds.getHeight() == Approx(newest.getHeight()));
+      REQUIRE(row_bounds.getY2() ==
+              Approx(newest.getY2() -
+                     static_cast<float>(i) * newest.getHeight() / 50));
+
+      const visualmusic::simd::ScreenMapping mapping =
+          visualizer.Get3DGraphRowMapping(i, geometry.max_magnitude);
+      const std::vector<vec2> row =
+          visualizer.Get3DGraphRow(frame / 1024 - i);
+      const std::vector<vec2> expected =
+          visualizer
+              .CalculateInstantGraphInFrequencyDomain(frame - i * 1024,
+                                                      row_bounds)
+              .getPoints();
+
+      REQUIRE(row.size() == expected.size());
+      for (size_t bin = 0; bin < row.size(); bin++) {
+        REQUIRE(mapping.x_origin + row[bin].x * mapping.x_step ==
+                Approx(expected[bin].x).margin(1e-3));
+        REQUIRE(mapping.y_origin + row[bin].y * mapping.y_scale ==
+                Approx(expected[bin].y).margin(1e-3));
+      }
+    }
+  }
+
+  SECTION("Rows hold the bands when the spectra are reduced") {
+    visualmusic::BandSettings bands;
+    bands.scale = visualmusic::BandScale::kLog;
+    bands.num_bands = 128;
+    visualizer.SetFrequencyBands(bands);
+    visualizer.Load(buffer, bounds, 44100);
+    REQUIRE(visualizer.Update3DGraph(frame) == 50);
+
+    const std::vector<vec2> row = visualizer.Get3DGraphRow(100);
+    const float* band_frame = visualizer.GetBandFrame(100);
+    REQUIRE(row.size() == 128);
+    for (size_t band = 0; band < 128; band++) {
+      REQUIRE(row[band].y == band_frame[band]);
+    }
+    REQUIRE(visualizer.CalculateInstantGraphInFrequencyDomain(frame, bounds)
+                .getPoints()
+                .size() == 128);
+  }
+}
+
+TEST_CASE("Test seek latency") {
+  audio::Buffer buffer(44100 * 10, 1);
+  for (size_t i = 0; i < buffer.getNumFrames(); i++) {
+    buffer.getChannel(0)[i] =
+        std::sin(0.002f * static_cast<float>(i * i % 9973));
+  }
+
+  Rectf bounds(vec2(0, 0), vec2(800, 600));
+  visualmusic::AudioVisualizer visualizer;
+  visualizer.Load(buffer, bounds, 44100);
+  const size_t target = 300 * 1024;
+
+  SECTION("A seek ends at the first complete frame of its target") {
+    visualizer.Update3DGraph(100 * 1024);
+    visualizer.BeginSeek(target);
+    REQUIRE_FALSE(visualizer.IsFrameComplete(target));
+
+    // The old position does not end the seek
+    visualizer.MarkFrameDisplayed(100 * 1024);
+    REQUIRE(visualizer.GetSeekLatency().num_seeks == 0);
+
+    // The analysis is in memory, so one frame draws the target
+    visualizer.Update3DGraph(target + 1000);
+    REQUIRE(visualizer.IsFrameComplete(target + 1000));
+    visualizer.MarkFrameDisplayed(target + 1000);
+
+    const visualmusic::SeekLatency latency = visualizer.GetSeekLatency();
+    REQUIRE(latency.num_seeks == 1);
+    REQUIRE(latency.last > 0.0);
+    REQUIRE(latency.last < 0.1);
+    REQUIRE(latency.max == latency.last);
+
+    // Later frames measure nothing until the next seek
+    visualizer.MarkFrameDisplayed(target + 2000);
+    REQUIRE(visualizer.GetSeekLatency().num_seeks == 1);
+  }
+
+  SECTION("A new target replaces the seek in flight") {
+    visualizer.BeginSeek(target);
+    visualizer.BeginSeek(2 * target);
+    visualizer.Update3DGraph(target);
+    visualizer.MarkFrameDisplayed(target);
+    REQUIRE(visualizer.GetSeekLatency().num_seeks == 0);
+
+    visualizer.Update3DGraph(2 * target);
+    visualizer.MarkFrameDisplayed(2 * target);
+    REQUIRE(visualizer.GetSeekLatency().num_seeks == 1);
+  }
+
+  SECTION("Frames past the analysis are incomplete") {
+    visualmusic::AudioVisualizer streamed;
+    streamed.BeginStream(buffer.getNumFrames(), 1, bounds, 44100);
+    audio::Buffer chunk(44100, 1);
+    chunk.copyOffset(buffer, 44100, 0, 0);
+    streamed.AppendFrames(chunk, 44100);
+
+    streamed.BeginSeek(target);
+    streamed.Update3DGraph(target);
+    REQUIRE_FALSE(streamed.IsFrameComplete(target));
+    streamed.MarkFrameDisplayed(target);
+    REQUIRE(streamed.GetSeekLatency().num_seeks == 0);
+    streamed.EndStream();
+  }
+}
@@ -0,0 +1,141 @@
+#include <catch2/catch.hpp>
+#include <algorithm>
+#include <cmath>
+
+#include "band_mapper.h"
+
+using visualmusic::BandMapper;
+using visualmusic::BandScale;
+using visualmusic::BandSettings;
+
+namespace {
+
+const size_t kNumBins = 512;
+const size_t kSampleRate = 44100;
+
+auto MakeMapper(const BandScale &scale, const size_t &num_bands)
+    -> BandMapper {
+  BandSettings settings;
+  settings.scale = scale;
+  settings.num_bands = num_bands;
+
+  BandMapper mapper;
+  mapper.Configure(settings, kNumBins, kSampleRate);
+  return mapper;
+}
+
+}  // namespace
+
+TEST_CASE("Test BandMapper") {
+  SECTION("Linear scale has no bands") {
+    BandMapper mapper = MakeMapper(BandScale::kLinear, 128);
+    REQUIRE_FALSE(mapper.IsEnabled());
+    REQUIRE(mapper.GetNumBands() == 0);
+  }
+
+  const BandScale scales[] = {BandScale::kLog, BandScale::kMel,
+                              BandScale::kConstantQ};
+  for (const BandScale &scale : scales) {
+    for (size_t num_bands : {64, 128, 256}) {
+      BandMapper mapper = MakeMapper(scale, num_bands);
+      REQUIRE(mapper.IsEnabled());
+      REQUIRE(mapper.GetNumBands() == num_bands);
+
+      // Every band is a weighted mean of bins inside the spectrum
+      for (size_t band = 0; band < num_bands; band++) {
+        size_t first_bin = 0;
+        size_t num_bins = 0;
+        mapper.GetBandBins(band, &first_bin, &num_bins);
+        REQUIRE(num_bins > 0);
+        REQUIRE(first_bin + num_bins <= kNumBins);
+
+        float sum = 0.0f;
+        for (size_t i = 0; i < num_bins; i++) {
+          sum += mapper.GetBandWeights(band)[i];
+        }
+        REQUIRE(sum == Approx(1.0f).margin(1e-5));
+      }
+    }
+  }
+
+  SECTION("A tone lands in the band around its frequency") {
+    // Bin 100 is about 4307 Hz
+    std::vector<float> spectrum(kNumBins, 0.0f);
+    spectrum[100] = 1.0f;
+
+    for (const BandScale &scale : scales) {
+      BandMapper mapper = MakeMapper(scale, 128);
+      std::vector<float> bands(128);
+      const float max_band = mapper.Apply(spectrum.data(), bands.data());
+
+      const size_t loudest = static_cast<size_t>(
+          std::max_element(bands.begin(), bands.end()) - bands.begin());
+      REQUIRE(bands[loudest] == max_band);
+
+      size_t first_bin = 0;
+      size_t num_bins = 0;
+      mapper.GetBandBins(loudest, &first_bin, &num_bins);
+      REQUIRE(first_bin <= 100);
+      REQUIRE(first_bin + num_bins > 100);
+    }
+
+    // Log bands of equal width in octaves
+    BandMapper mapper = MakeMapper(BandScale::kLog, 128);
+    std::vector<float> bands(128);
+    mapper.Apply(spectrum.data(), bands.data());
+    const double frequency = 100.0 * 22050.0 / kNumBins;
+    const size_t expected = static_cast<size_t>(
+        128.0 * std::log(frequency / 20.0) / std::log(22050.0 / 20.0));
+    REQUIRE(bands[expected] > 0.0f);
+  }
+
+  SECTION("Apply is one dot product per band") {
+    std::vector<float> spectrum(kNumBins);
+    for (size_t i = 0; i < kNumBins; i++) {
+      spectrum[i] = std::fabs(std::sin(0.37f * static_cast<float>(i)));
+    }
+
+    BandMapper mapper = MakeMapper(BandScale::kConstantQ, 96);
+    std::vector<float> bands(96);
+    mapper.Apply(spectrum.data(), bands.data());
+
+    for (size_t band = 0; band < 96; band++) {
+      size_t first_bin = 0;
+      size_t num_bins = 0;
+      mapper.GetBandBins(band, &first_bin, &num_bins);
+
+      float expected = 0.0f;
+      for (size_t i = 0; i < num_bins; i++) {
+        expected += mapper.GetBandWeights(band)[i] * spectrum[first_bin + i];
+      }
+      REQUIRE(bands[band] == Approx(expected).margin(1e-5));
+    }
+  }
+
+  SECTION("Rows of an arena are reduced in place") {
+    const size_t num_rows = 5;
+    const size_t row_stride = kNumBins + 16;
+    std::vector<float> rows(num_rows * row_stride);
+    for (size_t i = 0; i < rows.size(); i++) {
+      rows[i] = static_cast<float>(i % 13);
+    }
+
+    BandMapper mapper = MakeMapper(BandScale::kMel, 64);
+    std::vector<float> band_rows(num_rows * 80, -1.0f);
+    const float max_band = mapper.ApplyRows(rows.data(), row_stride, 1, 4,
+                                            band_rows.data(), 80);
+
+    REQUIRE(band_rows[0] == -1.0f);
+    REQUIRE(band_rows[4 * 80] == -1.0f);
+    float expected_max = 0.0f;
+    std::vector<float> bands(64);
+    for (size_t row = 1; row < 4; row++) {
+      expected_max = std::fmaxf(
+          expected_max,
+          mapper.Apply(rows.data() + row * row_stride, bands.data()));
+      REQUIRE(std::equal(bands.begin(), bands.end(),
+                         band_rows.begin() + row * 80));
+    }
+    REQUIRE(max_band == expected_max);
+  }
+}
@@ -0,0 +1,150 @@
+#include <catch2/catch.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+#include "batch_analyzer.h"
+
+using namespace ci;
+using visualmusic::BatchAnalyzer;
+
+namespace {
+
+// Synthetic tracks named after their length in frames, "missing" fails
+auto ProbeSynthetic(const std::string &path, visualmusic::TrackInfo *info)
+    -> bool {
+  if (path == "missing") {
+    return false;
+  }
+  info->num_frames = std::stoul(path);
+  info->num_channels = 2;
+  return true;
+}
+
+auto DecodeSynthetic(const std::string &path) -> audio::BufferRef {
+  const size_t num_frames = std::stoul(path);
+  audio::BufferRef buffer(new audio::Buffer(num_frames, 2));
+  for (size_t i = 0; i < num_frames; i++) {
+    buffer->getChannel(0)[i] = std::sin(0.01f * static_cast<float>(i));
+    buffer->getChannel(1)[i] = std::sin(0.02f * static_cast<float>(i));
+  }
+  return buffer;
+}
+
+// Decodes synthetic tracks whose buffers count themselves while they are
+// alive, so a test sees how many tracks were in flight at once
+struct CountingDecoder {
+  auto Decode(const std::string &path) -> audio::BufferRef {
+    const audio::BufferRef decoded = DecodeSynthetic(path);
+    const size_t frames = decoded->getNumFrames();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (num_alive > 0 && (frames == largest_frames || largest_alive)) {
+        largest_shared = true;
+      }
+      largest_alive = largest_alive || frames == largest_frames;
+      max_alive = std::max(max_alive, ++num_alive);
+    }
+
+    return audio::BufferRef(new audio::Buffer(std::move(*decoded)),
+                            [this, frames](audio::Buffer *buffer) {
+                              std::lock_guard<std::mutex> lock(mutex);
+                              num_alive--;
+                              if (frames == largest_frames) {
+                                largest_alive = false;
+                              }
+                              delete buffer;
+                            });
+  }
+
+  // Tracks of this length should never share the budget
+  size_t largest_frames = 0;
+
+  std::mutex mutex;
+  size_t num_alive = 0;
+  size_t max_alive = 0;
+  bool largest_alive = false;
+  bool largest_shared = false;
+};
+
+}  // namespace
+
+TEST_CASE("Test BatchAnalyzer") {
+  visualmusic::BatchSettings settings;
+  settings.num_workers = 4;
+  settings.output_directory = ".";
+  settings.parameters =
+      visualmusic::TrackAnalyzer::MakeDisplayParameters(44100);
+
+  std::vector<std::string> paths = {"20000", "50000", "missing", "30000",
+                                    "80000", "10000", "60000"};
+  const size_t largest = visualmusic::TrackAnalyzer::EstimateBytes(
+      80000, 2, settings.parameters);
+
+  SECTION("Every track gets a feature file") {
+    BatchAnalyzer analyzer(settings, ProbeSynthetic, DecodeSynthetic);
+    std::vector<visualmusic::TrackResult> results = analyzer.Run(paths);
+
+    REQUIRE(results.size() == paths.size());
+    for (size_t i = 0; i < results.size(); i++) {
+      REQUIRE(results[i].path == paths[i]);
+      REQUIRE(results[i].analyzed == (paths[i] != "missing"));
+    }
+
+    visualmusic::AnalysisCache cache;
+    REQUIRE(cache.Open(results[0].output_path, results[0].key));
+    REQUIRE(cache.GetProducts().num_frames == 20000);
+    cache.Close();
+
+    for (const visualmusic::TrackResult &result : results) {
+      std::remove(result.output_path.c_str());
+    }
+  }
+
+  SECTION("The budget limits the tracks in flight") {
+    // Room for two of these tracks at once, with a worker to spare
+    paths.clear();
+    for (size_t i = 0; i < 8; i++) {
+      paths.push_back(std::to_string(80000 - i));
+    }
+    settings.memory_budget = 2 * largest + largest / 2;
+    CountingDecoder decoder;
+
+    BatchAnalyzer analyzer(settings, ProbeSynthetic,
+                           [&decoder](const std::string &path) {
+                             return decoder.Decode(path);
+                           });
+    std::vector<visualmusic::TrackResult> results = analyzer.Run(paths);
+
+    for (const visualmusic::TrackResult &result : results) {
+      REQUIRE(result.analyzed);
+    }
+    REQUIRE(decoder.num_alive == 0);
+    REQUIRE(decoder.max_alive <= 2);
+    REQUIRE(analyzer.GetPeakReservedBytes() <= 2 * largest);
+    for (const visualmusic::TrackResult &result : results) {
+      std::remove(result.output_path.c_str());
+    }
+  }
+
+  SECTION("A track larger than the budget runs alone") {
+    settings.memory_budget = largest / 4;
+    CountingDecoder decoder;
+    decoder.largest_frames = 80000;
+
+    BatchAnalyzer analyzer(settings, ProbeSynthetic,
+                           [&decoder](const std::string &path) {
+                             return decoder.Decode(path);
+                           });
+    std::vector<visualmusic::TrackResult> results = analyzer.Run(paths);
+
+    REQUIRE(results[4].analyzed);
+    REQUIRE(decoder.num_alive == 0);
+    REQUIRE_FALSE(decoder.largest_shared);
+    for (const visualmusic::TrackResult &result : results) {
+      std::remove(result.output_path.c_str());
+    }
+  }
+}
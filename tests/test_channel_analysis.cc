@@ -0,0 +1,314 @@
+#include <catch2/catch.hpp>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "audio_visualizer.h"
+#include "channel_analysis.h"
+#include "track_analyzer.h"
+
+using namespace ci;
+
+namespace {
+
+const size_t kNumFrames = 44100 * 3 + 777;
+
+// Different tones on the two channels, so every view differs
+auto MakeStereoTrack() -> audio::Buffer {
+  audio::Buffer buffer(kNumFrames, 2);
+  for (size_t i = 0; i < kNumFrames; i++) {
+    const float t = static_cast<float>(i) / 44100.0f;
+    buffer.getChannel(0)[i] = 0.8f * std::sin(2000.0f * t);
+    buffer.getChannel(1)[i] = 0.3f * std::sin(9000.0f * t + 0.5f * t * t);
+  }
+
+  return buffer;
+}
+
+// Spectra of one signal by a lone engine
+auto AnalyzeSignal(const std::vector<float> &signal,
+                   const visualmusic::StftSettings &settings)
+    -> std::vector<float> {
+  visualmusic::StftEngine engine(settings);
+  std::vector<float> rows(engine.CountFrames(signal.size()) *
+                          engine.GetNumBins());
+  engine.Analyze(engine.MakeFrameView(signal.data(), signal.size()),
+                 rows.data());
+  return rows;
+}
+
+// Whether the rows of a view hold the expected spectra
+auto SameRows(const visualmusic::ChannelAnalysis &analysis,
+              const size_t &view, const std::vector<float> &expected)
+    -> bool {
+  const visualmusic::SpectralArena &rows = analysis.GetRows(view);
+  const size_t row_size = analysis.GetRowSize();
+  for (size_t row = 0; row < rows.GetNumRows(); row++) {
+    if (std::memcmp(rows.Row(row), expected.data() + row * row_size,
+                    row_size * sizeof(float)) != 0) {
+      return false;
+    }
+  }
+
+  return rows.GetNumRows() * row_size == expected.size();
+}
+
+// Whether two analyses hold identical rows and envelopes
+auto SameAnalysis(const visualmusic::ChannelAnalysis &a,
+                  const visualmusic::ChannelAnalysis &b) -> bool {
+  if (a.GetNumViews() != b.GetNumViews()) {
+    return false;
+  }
+  for (size_t view = 0; view < a.GetNumViews(); view++) {
+    const visualmusic::SpectralArena &rows = b.GetRows(view);
+    std::vector<float> expected(rows.GetNumRows() * b.GetRowSize());
+    for (size_t row = 0; row < rows.GetNumRows(); row++) {
+      std::copy(rows.Row(row), rows.Row(row) + b.GetRowSize(),
+                expected.begin() + row * b.GetRowSize());
+    }
+    if (!SameRows(a, view, expected) ||
+        a.GetMaxMagnitude(view) != b.GetMaxMagnitude(view) ||
+        std::memcmp(a.GetEnvelope(view).GetData(),
+                    b.GetEnvelope(view).GetData(),
+                    a.GetEnvelope(view).GetNumBuckets() *
+                        sizeof(visualmusic::EnvelopePyramid::Bucket)) != 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+}  // namespace
+
+TEST_CASE("Test ChannelAnalysis views") {
+  using visualmusic::ChannelAnalysis;
+  using visualmusic::ChannelViewKind;
+
+  REQUIRE(ChannelAnalysis::MakeViews(0).empty());
+  REQUIRE(ChannelAnalysis::MakeViews(1).size() == 1);
+
+  const std::vector<visualmusic::ChannelView> stereo =
+      ChannelAnalysis::MakeViews(2);
+  REQUIRE(stereo.size() == 4);
+  REQUIRE(ChannelAnalysis::GetViewName(stereo[0], 2) == "mid");
+  REQUIRE(ChannelAnalysis::GetViewName(stereo[1], 2) == "left");
+  REQUIRE(ChannelAnalysis::GetViewName(stereo[2], 2) == "right");
+  REQUIRE(stereo[3].kind == ChannelViewKind::kSide);
+
+  // Only a stereo track has a side signal
+  const std::vector<visualmusic::ChannelView> surround =
+      ChannelAnalysis::MakeViews(6);
+  REQUIRE(surround.size() == 7);
+  REQUIRE(ChannelAnalysis::GetViewName(surround[0], 6) == "mix");
+  REQUIRE(ChannelAnalysis::GetViewName(surround[6], 6) == "channel 6");
+}
+
+TEST_CASE("Test ChannelAnalysis") {
+  const audio::Buffer track = MakeStereoTrack();
+  visualmusic::StftSettings settings;
+  settings.backend = visualmusic::FftBackend::kFixed;
+  settings.num_threads = 4;
+
+  visualmusic::ChannelAnalysis analysis;
+  analysis.Reset(kNumFrames, 2, settings, nullptr);
+  analysis.Append(track, 0, kNumFrames, kNumFrames);
+  analysis.Finish();
+
+  SECTION("Each view matches the analysis of its own signal") {
+    std::vector<float> left(track.getChannel(0),
+                            track.getChannel(0) + kNumFrames);
+    std::vector<float> right(track.getChannel(1),
+                             track.getChannel(1) + kNumFrames);
+    std::vector<float> mid(kNumFrames);
+    std::vector<float> side(kNumFrames);
+    for (size_t i = 0; i < kNumFrames; i++) {
+      mid[i] = 0.5f * (left[i] + right[i]);
+      side[i] = 0.5f * (left[i] - right[i]);
+    }
+
+    REQUIRE(analysis.GetNumViews() == 4);
+    REQUIRE(analysis.GetNumAnalyzedFrames() ==
+            visualmusic::StftEngine(settings).CountFrames(kNumFrames));
+    REQUIRE(analysis.GetSignal(1) == track.getChannel(0));
+    REQUIRE(SameRows(analysis, 1, AnalyzeSignal(left, settings)));
+    REQUIRE(SameRows(analysis, 2, AnalyzeSignal(right, settings)));
+    REQUIRE(SameRows(analysis, 3, AnalyzeSignal(side, settings)));
+
+    // The mix is scaled by the kernel, within a rounding of the average
+    for (size_t i = 0; i < kNumFrames; i++) {
+      REQUIRE(analysis.GetSignal(0)[i] == Approx(mid[i]).margin(1e-6));
+      REQUIRE(analysis.GetSignal(3)[i] == Approx(side[i]).margin(1e-6));
+    }
+
+    // The envelope of a channel summarizes that channel alone
+    visualmusic::EnvelopePyramid envelope;
+    audio::Buffer right_only(kNumFrames, 1);
+    std::copy(right.begin(), right.end(), right_only.getChannel(0));
+    envelope.Build(right_only, 1);
+    REQUIRE(std::memcmp(analysis.GetEnvelope(2).GetData(), envelope.GetData(),
+                        envelope.GetNumBuckets() *
+                            sizeof(visualmusic::EnvelopePyramid::Bucket)) ==
+            0);
+    REQUIRE(analysis.GetMaxMagnitude(1) > analysis.GetMaxMagnitude(2));
+  }
+
+  SECTION("Threads and chunks do not change the results") {
+    visualmusic::StftSettings single = settings;
+    single.num_threads = 1;
+    visualmusic::ChannelAnalysis serial;
+    serial.Reset(kNumFrames, 2, single, nullptr);
+    serial.Append(track, 0, kNumFrames, kNumFrames);
+    serial.Finish();
+    REQUIRE(SameAnalysis(analysis, serial));
+
+    // Streamed in uneven chunks, each up to the frames it completes
+    visualmusic::ChannelAnalysis streamed;
+    streamed.Reset(kNumFrames, 2, settings, nullptr);
+    const size_t fft_size = settings.fft_size;
+    for (size_t first = 0; first < kNumFrames; first += 10007) {
+      const size_t last = std::min(first + 10007, kNumFrames);
+      streamed.Append(track, first, last,
+                      last >= fft_size ? (last - fft_size) / fft_size + 1 : 0);
+      REQUIRE(streamed.GetNumAnalyzedFrames() * fft_size <= last);
+    }
+    streamed.Append(track, kNumFrames, kNumFrames, kNumFrames);
+    streamed.Finish();
+    REQUIRE(SameAnalysis(analysis, streamed));
+  }
+
+  SECTION("Rows are reduced to bands") {
+    visualmusic::BandSettings band_settings;
+    band_settings.scale = visualmusic::BandScale::kLog;
+    band_settings.num_bands = 64;
+    visualmusic::BandMapper bands;
+    bands.Configure(band_settings, settings.fft_size / 2, 44100);
+
+    visualmusic::ChannelAnalysis banded;
+    banded.Reset(kNumFrames, 2, settings, &bands);
+    banded.Append(track, 0, kNumFrames, kNumFrames);
+    REQUIRE(banded.GetRowSize() == 64);
+
+    const visualmusic::SpectralArena &spectra = analysis.GetRows(2);
+    std::vector<float> expected(spectra.GetNumRows() * 64);
+    bands.ApplyRows(spectra.Row(0), spectra.GetRowStride(), 0,
+                    spectra.GetNumRows(), expected.data(), 64);
+    REQUIRE(SameRows(banded, 2, expected));
+  }
+}
+
+TEST_CASE("Test AudioVisualizer channel views") {
+  const audio::Buffer track = MakeStereoTrack();
+  const Rectf bounds(vec2(0, 0), vec2(800, 600));
+  visualmusic::AudioVisualizer visualizer;
+  visualizer.SetFftBackend(visualmusic::FftBackend::kFixed);
+
+  SECTION("Views are off by default") {
+    visualizer.Load(track, bounds, 44100);
+    REQUIRE(visualizer.GetNumChannelViews() == 0);
+    visualizer.SelectChannelView(0);
+    REQUIRE(visualizer.GetSelectedChannelView() ==
+            visualmusic::AudioVisualizer::kAllChannels);
+  }
+
+  visualizer.SetChannelViews(true);
+  visualizer.Load(track, bounds, 44100);
+  REQUIRE(visualizer.GetNumChannelViews() == 4);
+  REQUIRE(visualizer.GetMemoryUsage().channel_views ==
+          visualizer.GetChannelAnalysis().GetCapacityBytes());
+
+  SECTION("The graphs draw the selected view") {
+    const size_t frame = 50000;
+    visualmusic::FrameGeometry all;
+    visualizer.BuildGeometry(frame, &all);
+    REQUIRE(all.instant.size() == 2);
+
+    // The left channel is the one the spectra of the track are taken from
+    visualizer.SelectChannelView(1);
+    REQUIRE(visualizer.GetChannelViewName(1) == "left");
+    visualmusic::FrameGeometry left;
+    visualizer.BuildGeometry(frame, &left);
+    REQUIRE(left.instant.size() == 1);
+    REQUIRE(std::memcmp(left.instant[0].data(), all.instant[0].data(),
+                        left.instant[0].size() * sizeof(vec2)) == 0);
+    REQUIRE(left.rows.size() == all.rows.size());
+    REQUIRE(std::memcmp(left.rows.data(), all.rows.data(),
+                        left.rows.size() * sizeof(vec2)) == 0);
+
+    // The side view draws something else
+    visualizer.SelectChannelView(3);
+    visualmusic::FrameGeometry side;
+    visualizer.BuildGeometry(frame, &side);
+    REQUIRE(side.rows.size() == all.rows.size());
+    REQUIRE(std::memcmp(side.rows.data(), all.rows.data(),
+                        side.rows.size() * sizeof(vec2)) != 0);
+    REQUIRE(side.general_generation != all.general_generation);
+
+    // Past the last view, every channel is drawn again
+    visualizer.SelectChannelView(4);
+    REQUIRE(visualizer.GetSelectedChannelView() ==
+            visualmusic::AudioVisualizer::kAllChannels);
+    visualmusic::FrameGeometry again;
+    visualizer.BuildGeometry(frame, &again);
+    REQUIRE(again.instant.size() == 2);
+  }
+
+  SECTION("A streamed track has the same views") {
+    visualmusic::AudioVisualizer streamed;
+    streamed.SetFftBackend(visualmusic::FftBackend::kFixed);
+    streamed.SetChannelViews(true);
+    streamed.BeginStream(kNumFrames, 2, bounds, 44100);
+    for (size_t first = 0; first < kNumFrames; first += 4096) {
+      const size_t count = std::min<size_t>(4096, kNumFrames - first);
+      audio::Buffer chunk(count, 2);
+      chunk.copyOffset(track, count, 0, first);
+      streamed.AppendFrames(chunk, count);
+    }
+    streamed.EndStream();
+
+    REQUIRE(SameAnalysis(streamed.GetChannelAnalysis(),
+                         visualizer.GetChannelAnalysis()));
+  }
+
+  SECTION("A track loaded from the cache builds its views behind it") {
+    // A cache hit maps the products without a transform, and the views
+    // are readable once built
+    visualmusic::AudioVisualizer cached;
+    cached.SetFftBackend(visualmusic::FftBackend::kFixed);
+    cached.SetChannelViews(true);
+    cached.SetCacheDirectory(".");
+    cached.Load(track, bounds, 44100);
+    cached.Load(track, bounds, 44100);
+    REQUIRE(cached.IsLoadedFromCache());
+    cached.WaitChannelViews();
+    REQUIRE(cached.GetNumChannelViews() == 4);
+    REQUIRE(SameAnalysis(cached.GetChannelAnalysis(),
+                         visualizer.GetChannelAnalysis()));
+
+    // A load stops the build of the previous track
+    cached.Load(track, bounds, 44100);
+    cached.SetCacheDirectory("");
+    cached.Load(audio::Buffer(1000, 2), bounds, 44100);
+    REQUIRE(cached.GetNumChannelViews() == 4);
+
+    const visualmusic::AnalysisParameters parameters =
+        visualmusic::TrackAnalyzer::MakeDisplayParameters(
+            44100, visualmusic::BandSettings(),
+            visualmusic::FftBackend::kFixed);
+    std::remove(visualmusic::AnalysisCache::GetFileName(
+                    visualmusic::AnalysisCache::ComputeKey(track, parameters))
+                    .c_str());
+  }
+
+  SECTION("Views are skipped where they would undo a cheaper load") {
+    visualizer.SetSpectralStorage(visualmusic::SpectralStorage::kDecibel8);
+    visualizer.Load(track, bounds, 44100);
+    REQUIRE(visualizer.GetNumChannelViews() == 0);
+
+    visualizer.SetSpectralStorage(visualmusic::SpectralStorage::kFloat32);
+    visualizer.SetLazySpectra(true);
+    visualizer.Load(track, bounds, 44100);
+    REQUIRE(visualizer.GetNumChannelViews() == 0);
+  }
+}
@@ -0,0 +1,94 @@
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <cstring>
+
+#include "envelope_pyramid.h"
+
+using namespace ci;
+
+namespace {
+
+// Quiet noise with a few single-sample spikes
+auto MakeSpikyBuffer(const size_t &num_frames, const size_t &num_channels)
+    -> audio::Buffer {
+  audio::Buffer buffer(num_frames, num_channels);
+
+  for (size_t channel = 0; channel < num_channels; channel++) {
+    for (size_t i = 0; i < num_frames; i++) {
+      buffer.getChannel(channel)[i] =
+          0.01f * static_cast<float>((i * 7919 + channel) % 13) - 0.06f;
+    }
+    buffer.getChannel(channel)[num_frames / 3] = 1.0f;
+    buffer.getChannel(channel)[num_frames / 2] = -0.8f;
+  }
+
+  return buffer;
+}
+
+}  // namespace
+
+TEST_CASE("Test EnvelopePyramid") {
+  const size_t kNumFrames = 100000;
+  audio::Buffer buffer = MakeSpikyBuffer(kNumFrames, 2);
+
+  visualmusic::EnvelopePyramid pyramid;
+  pyramid.Build(buffer, 3);
+
+  SECTION("Levels halve down to one bucket") {
+    REQUIRE(pyramid.GetLevelSize(0) == (kNumFrames + 255) / 256);
+    REQUIRE(pyramid.GetLevelSize(pyramid.GetNumLevels() - 1) == 1);
+    REQUIRE(pyramid.GetNumBuckets() ==
+            visualmusic::EnvelopePyramid::CountBuckets(kNumFrames));
+  }
+
+  SECTION("Peaks survive at every level") {
+    for (size_t level = 0; level < pyramid.GetNumLevels(); level++) {
+      visualmusic::EnvelopePyramid::Bucket bucket;
+      REQUIRE(pyramid.Query(level, 0, kNumFrames, &bucket));
+      REQUIRE(bucket.max == 1.0f);
+      REQUIRE(bucket.min == -0.8f);
+    }
+    REQUIRE(pyramid.GetMaxMagnitude() == 1.0f);
+  }
+
+  SECTION("Level matches the column width") {
+    REQUIRE(pyramid.SelectLevel(100) == 0);
+    REQUIRE(pyramid.SelectLevel(256) == 0);
+    REQUIRE(pyramid.SelectLevel(1024) == 2);
+    REQUIRE(pyramid.SelectLevel(1500) == 2);
+  }
+
+  SECTION("Appending in chunks gives the same pyramid") {
+    visualmusic::EnvelopePyramid appended;
+    appended.Reset(kNumFrames);
+
+    for (size_t frame = 0; frame < kNumFrames; frame += 1000) {
+      appended.Append(buffer, frame, std::min(frame + 1000, kNumFrames));
+
+      // Only complete buckets are readable before the end
+      REQUIRE(appended.GetReadableFrames(1) % 512 == 0);
+    }
+    appended.Finish();
+
+    REQUIRE(appended.GetReadableFrames(0) == kNumFrames);
+    REQUIRE(std::memcmp(appended.GetData(), pyramid.GetData(),
+                        pyramid.GetNumBuckets() *
+                            sizeof(visualmusic::EnvelopePyramid::Bucket)) ==
+            0);
+  }
+}
+
+TEST_CASE("Test EnvelopePyramid on a 3-hour stereo track", "[.][perf]") {
+  // 3 hours at 44.1 kHz, run with "[perf]" on an optimized build
+  const size_t kNumFrames = 3 * 3600 * 44100;
+  audio::Buffer buffer = MakeSpikyBuffer(kNumFrames, 2);
+
+  visualmusic::EnvelopePyramid pyramid;
+  auto start = std::chrono::steady_clock::now();
+  pyramid.Build(buffer);
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  REQUIRE(elapsed.count() < 1.0);
+  REQUIRE(pyramid.GetMaxMagnitude() == 1.0f);
+}
@@ -0,0 +1,134 @@
+#include <catch2/catch.hpp>
+#include <cmath>
+
+#include "fixed_fft.h"
+#include "stft_engine.h"
+#include "test_signals.h"
+
+using namespace ci;
+
+namespace {
+
+// Compare one size against audio::dsp::Fft, which may use the other sign
+// for the imaginary parts
+template <size_t N>
+void CheckAgainstCinder() {
+  const std::vector<float> input = MakeNoise(N, static_cast<uint32_t>(N));
+  const float margin = 1e-5f * static_cast<float>(N);
+
+  audio::dsp::Fft fft(N);
+  audio::Buffer frame(N);
+  audio::BufferSpectral expected(N);
+  std::copy(input.begin(), input.end(), frame.getData());
+  fft.forward(&frame, &expected);
+
+  std::vector<float> real(N / 2);
+  std::vector<float> imag(N / 2);
+  visualmusic::FixedFft<N>::Forward(input.data(), real.data(), imag.data());
+
+  for (size_t k = 0; k < N / 2; k++) {
+    REQUIRE(real[k] == Approx(expected.getReal()[k]).margin(margin));
+    REQUIRE(std::fabs(imag[k]) ==
+            Approx(std::fabs(expected.getImag()[k])).margin(margin));
+  }
+
+  // Frames overlap by half, rows are padded, and the last batch is partial
+  const size_t num_frames = 2 * visualmusic::FixedFft<N>::kNumLanes + 3;
+  const size_t frame_stride = N / 2;
+  const size_t row_stride = N / 2 + 16;
+  const std::vector<float> signal =
+      MakeNoise(num_frames * frame_stride + N, 7);
+  std::vector<float> magnitudes(num_frames * row_stride, -1.0f);
+  std::vector<float> workspace(visualmusic::FixedFft<N>::kWorkspaceSize);
+  const float max_magnitude = visualmusic::FixedFft<N>::ForwardMagnitudes(
+      signal.data(), frame_stride, num_frames, magnitudes.data(), row_stride,
+      workspace.data());
+
+  float expected_max = 0.0f;
+  for (size_t i = 0; i < num_frames; i++) {
+    visualmusic::FixedFft<N>::Forward(signal.data() + i * frame_stride,
+                                      real.data(), imag.data());
+    const float *row = magnitudes.data() + i * row_stride;
+
+    REQUIRE(row[0] == Approx(std::fabs(real[0])).margin(margin));
+    for (size_t k = 1; k < N / 2; k++) {
+      const float magnitude = std::sqrt(real[k] * real[k] + imag[k] * imag[k]);
+      REQUIRE(row[k] == Approx(magnitude).margin(margin));
+      expected_max = std::fmaxf(expected_max, row[k]);
+    }
+    expected_max = std::fmaxf(expected_max, row[0]);
+    REQUIRE(row[N / 2] == -1.0f);
+  }
+  REQUIRE(max_magnitude == expected_max);
+}
+
+}  // namespace
+
+TEST_CASE("Test FixedFft") {
+  SECTION("Every size matches the Cinder Fft") {
+    CheckAgainstCinder<256>();
+    CheckAgainstCinder<512>();
+    CheckAgainstCinder<1024>();
+    CheckAgainstCinder<2048>();
+    CheckAgainstCinder<4096>();
+    CheckAgainstCinder<8192>();
+  }
+
+  SECTION("Sizes are chosen at run time") {
+    for (size_t size = 256; size <= 8192; size *= 2) {
+      const visualmusic::FixedFftKernel *kernel =
+          visualmusic::GetFixedFftKernel(size);
+      REQUIRE(kernel != nullptr);
+      REQUIRE(kernel->fft_size == size);
+    }
+    REQUIRE(visualmusic::GetFixedFftKernel(128) == nullptr);
+    REQUIRE(visualmusic::GetFixedFftKernel(16384) == nullptr);
+    REQUIRE(visualmusic::GetFixedFftKernel(1000) == nullptr);
+  }
+
+  SECTION("StftEngine runs on either backend") {
+    const std::vector<float> signal = MakeNoise(50000, 3);
+
+    visualmusic::StftSettings settings;
+    settings.fft_size = 2048;
+    settings.hop_size = 700;
+    settings.window = visualmusic::WindowType::kHann;
+    settings.num_threads = 3;
+    visualmusic::StftEngine cinder(settings);
+    settings.backend = visualmusic::FftBackend::kFixed;
+    visualmusic::StftEngine fixed(settings);
+
+    const visualmusic::FrameView frames =
+        cinder.MakeFrameView(signal.data(), 50000);
+    const size_t num_frames = cinder.CountFrames(50000);
+    std::vector<float> expected(num_frames * 1024);
+    std::vector<float> actual(num_frames * 1024);
+    const float expected_max = cinder.Analyze(frames, expected.data());
+    const float actual_max = fixed.Analyze(frames, actual.data());
+
+    REQUIRE(actual_max == Approx(expected_max).margin(1e-2));
+    for (size_t i = 0; i < expected.size(); i++) {
+      REQUIRE(actual[i] == Approx(expected[i]).margin(1e-2));
+    }
+
+    // One frame at a time, as the live analyzer transforms
+    visualmusic::StftEngine::Scratch scratch(2048);
+    std::vector<float> single(1024);
+    fixed.TransformFrame(frames.GetFrame(num_frames - 1),
+                         frames.GetFrameLength(num_frames - 1), &scratch,
+                         single.data());
+    for (size_t k = 0; k < 1024; k++) {
+      REQUIRE(single[k] ==
+              Approx(actual[(num_frames - 1) * 1024 + k]).margin(1e-6));
+    }
+  }
+
+  SECTION("Sizes without a FixedFft are rejected") {
+    visualmusic::StftSettings settings;
+    settings.fft_size = 128;
+    settings.hop_size = 128;
+    settings.backend = visualmusic::FftBackend::kFixed;
+    REQUIRE_THROWS_AS(visualmusic::StftEngine(settings),
+                      std::invalid_argument);
+  }
+}
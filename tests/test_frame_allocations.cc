@@ -0,0 +1,171 @@
+#include <catch2/catch.hpp>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include "audio_visualizer.h"
+#include "live_analyzer.h"
+#include "live_input.h"
+#include "text_formatter.h"
+
+using namespace ci;
+
+namespace {
+
+// Allocations made by the thread under test. The workers of the visualizer
+// allocate on their own threads, which are not counted.
+thread_local bool counting_allocations = false;
+thread_local size_t num_allocations = 0;
+
+const size_t kSampleRate = 44100;
+const size_t kFramesPerPicture = kSampleRate / 60;
+
+auto MakeTrack(const size_t &num_frames, const size_t &num_channels)
+    -> audio::Buffer {
+  audio::Buffer buffer(num_frames, num_channels);
+  for (size_t channel = 0; channel < num_channels; channel++) {
+    float *data = buffer.getChannel(channel);
+    for (size_t i = 0; i < num_frames; i++) {
+      const float t = static_cast<float>(i) / static_cast<float>(kSampleRate);
+      data[i] = 0.5f * std::sin((1000.0f + 500.0f * channel) * t * (1.0f + t));
+    }
+  }
+
+  return buffer;
+}
+
+// Allocations made building the pictures of a stretch of playback into
+// one geometry buffer, as the app does. The drawing itself needs a GL
+// context, which the tests do not have.
+auto CountGeometryAllocations(const visualmusic::AudioVisualizer &visualizer,
+                              visualmusic::FrameGeometry *geometry,
+                              const size_t &first_frame,
+                              const size_t &num_pictures) -> size_t {
+  num_allocations = 0;
+  counting_allocations = true;
+  for (size_t picture = 0; picture < num_pictures; picture++) {
+    visualizer.BuildGeometry(first_frame + picture * kFramesPerPicture,
+                             geometry);
+  }
+  counting_allocations = false;
+
+  return num_allocations;
+}
+
+}  // namespace
+
+// Counting replacements of the global allocation functions
+auto operator new(std::size_t size) -> void * {
+  if (counting_allocations) {
+    num_allocations++;
+  }
+  void *pointer = std::malloc(size == 0 ? 1 : size);
+  if (pointer == nullptr) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+auto operator new[](std::size_t size) -> void * {
+  return operator new(size);
+}
+
+void operator delete(void *pointer) noexcept {
+  std::free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept {
+  std::free(pointer);
+}
+
+TEST_CASE("Test building a picture allocates nothing after warm-up") {
+  const audio::Buffer track = MakeTrack(kSampleRate * 8, 2);
+  const Rectf bounds(vec2(0, 0), vec2(800, 600));
+  visualmusic::AudioVisualizer visualizer;
+  visualizer.SetFftBackend(visualmusic::FftBackend::kFixed);
+  visualmusic::FrameGeometry geometry;
+
+  // The first seconds fill every row of the 3D graph and size each buffer
+  const size_t warm_up = 2 * kSampleRate / kFramesPerPicture;
+  const size_t played = warm_up * kFramesPerPicture;
+
+  SECTION("A loaded track") {
+    visualizer.Load(track, bounds, kSampleRate);
+    REQUIRE(CountGeometryAllocations(visualizer, &geometry, 0, warm_up) > 0);
+    REQUIRE(CountGeometryAllocations(visualizer, &geometry, played, 240) ==
+            0);
+
+    // Every frame of the window is drawn without decimation
+    visualizer.SetInstantGraphDecimation(false);
+    CountGeometryAllocations(visualizer, &geometry, played, 1);
+    REQUIRE(CountGeometryAllocations(visualizer, &geometry, played, 120) ==
+            0);
+  }
+
+  SECTION("Bands and compact spectra") {
+    visualmusic::BandSettings settings;
+    settings.scale = visualmusic::BandScale::kLog;
+    visualizer.SetFrequencyBands(settings);
+    visualizer.SetSpectralStorage(visualmusic::SpectralStorage::kDecibel8);
+    visualizer.Load(track, bounds, kSampleRate);
+    CountGeometryAllocations(visualizer, &geometry, 0, warm_up);
+    REQUIRE(CountGeometryAllocations(visualizer, &geometry, played, 240) ==
+            0);
+  }
+
+  SECTION("Lazy spectra") {
+    visualizer.SetLazySpectra(true);
+    visualizer.Load(track, bounds, kSampleRate);
+    // A picture never waits for a tile, so the warm-up is built again once
+    // its tiles are in memory
+    CountGeometryAllocations(visualizer, &geometry, 0, warm_up);
+    visualizer.GetSpectralTiles().WaitIdle();
+    CountGeometryAllocations(visualizer, &geometry, 0, warm_up);
+    REQUIRE(CountGeometryAllocations(visualizer, &geometry, played, 240) ==
+            0);
+  }
+
+  SECTION("A live input") {
+    visualmusic::SampleRing ring(2, 8192);
+    visualmusic::FileDrivenInput input(track, &ring, 512);
+    visualmusic::LiveSettings settings;
+    settings.sample_rate = kSampleRate;
+    visualmusic::LiveAnalyzer analyzer(&ring, settings);
+    visualizer.BeginLive(&analyzer, bounds);
+
+    // Each picture follows the blocks that arrived since the previous one
+    size_t num_live_allocations = 0;
+    for (size_t picture = 0; picture < 300 && !input.IsFinished();
+         picture++) {
+      input.PushBlock(0);
+      input.PushBlock(0);
+      visualizer.UpdateLive();
+      const size_t allocations =
+          CountGeometryAllocations(visualizer, &geometry, 0, 1);
+      if (picture >= warm_up) {
+        num_live_allocations += allocations;
+      }
+    }
+    REQUIRE(num_live_allocations == 0);
+  }
+}
+
+TEST_CASE("Test formatting a line allocates nothing") {
+  visualmusic::TextFormatter text;
+
+  num_allocations = 0;
+  counting_allocations = true;
+  for (size_t frame = 0; frame < 1000; frame++) {
+    text.Format("frame: %zu/%zu", frame, static_cast<size_t>(352800));
+    text.Format("a/v offset: %f ms", 0.001 * static_cast<double>(frame));
+  }
+  counting_allocations = false;
+
+  REQUIRE(num_allocations == 0);
+  REQUIRE(text.GetText() == "a/v offset: 0.999000 ms");
+
+  // Lines longer than the reserved room are cut, not grown
+  const std::string long_line(1000, 'x');
+  REQUIRE(text.Format("%s", long_line.c_str()).size() < 256);
+}
@@ -0,0 +1,109 @@
+#include <catch2/catch.hpp>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame_profiler.h"
+
+TEST_CASE("Test StageHistogram") {
+  visualmusic::StageHistogram histogram;
+
+  SECTION("Buckets cover every duration in order") {
+    using visualmusic::StageHistogram;
+    for (uint64_t nanoseconds = 0; nanoseconds < 100000; nanoseconds++) {
+      const size_t bucket = StageHistogram::GetBucket(nanoseconds);
+      REQUIRE(StageHistogram::GetBucketStart(bucket) <= nanoseconds);
+      REQUIRE(StageHistogram::GetBucketStart(bucket + 1) > nanoseconds);
+    }
+    REQUIRE(StageHistogram::GetBucket(static_cast<uint64_t>(-1)) ==
+            StageHistogram::kNumBuckets - 1);
+  }
+
+  SECTION("Percentiles are within the width of a bucket") {
+    REQUIRE(histogram.GetPercentile(50) == 0.0);
+
+    // 1 to 10000 microseconds, once each
+    for (uint64_t i = 1; i <= 10000; i++) {
+      histogram.Record(i * 1000);
+    }
+
+    const visualmusic::StageStats stats = histogram.GetStats();
+    REQUIRE(stats.count == 10000);
+    REQUIRE(stats.mean == Approx(5000.5));
+    REQUIRE(stats.p50 == Approx(5000).epsilon(0.0625));
+    REQUIRE(stats.p95 == Approx(9500).epsilon(0.0625));
+    REQUIRE(stats.p99 == Approx(9900).epsilon(0.0625));
+    REQUIRE(stats.max == 10000);
+
+    histogram.Reset();
+    REQUIRE(histogram.GetCount() == 0);
+    REQUIRE(histogram.GetMax() == 0);
+  }
+
+  SECTION("Threads record at once without losing durations") {
+    const size_t kNumThreads = 4;
+    const uint64_t kPerThread = 100000;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < kNumThreads; t++) {
+      threads.emplace_back([&histogram, t, kPerThread]() {
+        for (uint64_t i = 0; i < kPerThread; i++) {
+          histogram.Record(100 + t * 1000 + i % 7);
+        }
+      });
+    }
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+
+    REQUIRE(histogram.GetCount() == kNumThreads * kPerThread);
+    REQUIRE(histogram.GetMax() == 100 + (kNumThreads - 1) * 1000 + 6);
+    REQUIRE(histogram.GetPercentile(100) ==
+            static_cast<double>(histogram.GetMax()));
+  }
+}
+
+TEST_CASE("Test FrameProfiler") {
+  visualmusic::FrameProfiler profiler;
+  const char *kPath = "test_frame_timings.csv";
+
+  {
+    visualmusic::ScopedStageTimer timer(&profiler,
+                                        visualmusic::FrameStage::k3DGraph);
+  }
+  profiler.Record(visualmusic::FrameStage::kUpdate, 2000);
+  profiler.Record(visualmusic::FrameStage::kUpdate, 4000);
+
+  SECTION("Scoped timers record into their stage") {
+    REQUIRE(profiler.GetHistogram(visualmusic::FrameStage::k3DGraph)
+                .GetCount() == 1);
+    REQUIRE(profiler.GetHistogram(visualmusic::FrameStage::kDraw)
+                .GetCount() == 0);
+  }
+
+  SECTION("The CSV has a row per stage that ran") {
+    REQUIRE(profiler.WriteCsv(kPath));
+
+    std::ifstream file(kPath);
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(file, line)) {
+      lines.push_back(line);
+    }
+    std::remove(kPath);
+
+    REQUIRE(lines.size() == 3);
+    REQUIRE(lines[0] == "stage,count,mean_us,p50_us,p95_us,p99_us,max_us");
+    // Count and mean are exact, the percentiles are bucket middles
+    REQUIRE(lines[1].find("update,2,3,") == 0);
+    REQUIRE(lines[1].substr(lines[1].rfind(',')) == ",4");
+    REQUIRE(lines[2].find("3d_graph,1,") == 0);
+  }
+
+  SECTION("Reset forgets every stage") {
+    profiler.Reset();
+    REQUIRE(profiler.GetHistogram(visualmusic::FrameStage::kUpdate)
+                .GetCount() == 0);
+  }
+}
@@ -0,0 +1,193 @@
+#include <catch2/catch.hpp>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "geometry_producer.h"
+
+using namespace ci;
+
+namespace {
+
+// A few seconds of a chirp, so every frame draws different points
+auto MakeTrack() -> audio::Buffer {
+  audio::Buffer buffer(44100 * 6, 2);
+  for (size_t i = 0; i < buffer.getNumFrames(); i++) {
+    const float t = static_cast<float>(i) / 44100.0f;
+    buffer.getChannel(0)[i] = std::sin(300.0f * t * t);
+    buffer.getChannel(1)[i] = 0.5f * std::cos(40.0f * t);
+  }
+
+  return buffer;
+}
+
+// Whether two runs of points are identical
+auto SamePoints(const vec2 *a, const vec2 *b, const size_t &num_points)
+    -> bool {
+  return num_points == 0 ||
+         std::memcmp(a, b, num_points * sizeof(vec2)) == 0;
+}
+
+// Whether two geometries draw the same picture
+auto DrawSame(const visualmusic::FrameGeometry &a,
+              const visualmusic::FrameGeometry &b) -> bool {
+  if (a.frame != b.frame || a.complete != b.complete ||
+      a.instant.size() != b.instant.size() ||
+      a.row_indices != b.row_indices || a.rows.size() != b.rows.size() ||
+      a.max_magnitude != b.max_magnitude ||
+      a.num_general_points != b.num_general_points) {
+    return false;
+  }
+  for (size_t channel = 0; channel < a.instant.size(); channel++) {
+    if (a.instant[channel].size() != b.instant[channel].size() ||
+        !SamePoints(a.instant[channel].data(), b.instant[channel].data(),
+                    a.instant[channel].size())) {
+      return false;
+    }
+  }
+
+  // Only the drawn prefix of the general graph, and the rows in the ring
+  if (!SamePoints(a.general.data(), b.general.data(),
+                  a.num_general_points)) {
+    return false;
+  }
+  const size_t num_bins =
+      a.row_indices.empty() ? 0 : a.rows.size() / a.row_indices.size();
+  for (size_t slot = 0; slot < a.row_indices.size(); slot++) {
+    if (a.row_indices[slot] != static_cast<size_t>(-1) &&
+        !SamePoints(a.rows.data() + slot * num_bins,
+                    b.rows.data() + slot * num_bins, num_bins)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+}  // namespace
+
+TEST_CASE("Test GeometryProducer") {
+  const audio::Buffer track = MakeTrack();
+  const Rectf bounds(vec2(0, 0), vec2(800, 600));
+  visualmusic::AudioVisualizer visualizer;
+  visualizer.Load(track, bounds, 44100);
+  visualmusic::AudioVisualizer reference;
+  reference.Load(track, bounds, 44100);
+
+  SECTION("A reused buffer matches a fresh build") {
+    visualmusic::FrameGeometry reused;
+    for (size_t frame = 0; frame < track.getNumFrames(); frame += 30011) {
+      visualizer.BuildGeometry(frame, &reused);
+      visualmusic::FrameGeometry fresh;
+      reference.BuildGeometry(frame, &fresh);
+      REQUIRE(DrawSame(reused, fresh));
+    }
+
+    // A resize drops the general graph the buffer holds
+    visualizer.Resize(Rectf(vec2(0, 0), vec2(400, 300)));
+    reference.Resize(Rectf(vec2(0, 0), vec2(400, 300)));
+    visualizer.BuildGeometry(100000, &reused);
+    visualmusic::FrameGeometry fresh;
+    reference.BuildGeometry(100000, &fresh);
+    REQUIRE(reused.general.size() == fresh.general.size());
+    REQUIRE(DrawSame(reused, fresh));
+  }
+
+  visualmusic::GeometryProducer producer;
+  REQUIRE(producer.Acquire() == nullptr);
+  producer.Start(&visualizer);
+  REQUIRE(producer.IsActive());
+
+  SECTION("The producer builds what Display would draw") {
+    producer.Request(150000);
+    producer.WaitIdle();
+    const visualmusic::FrameGeometry *geometry = producer.Acquire();
+    REQUIRE(geometry != nullptr);
+
+    visualmusic::FrameGeometry expected;
+    reference.BuildGeometry(150000, &expected);
+    REQUIRE(geometry->complete);
+    REQUIRE(DrawSame(*geometry, expected));
+  }
+
+  SECTION("Acquire returns the newest geometry") {
+    producer.Request(50000);
+    producer.WaitIdle();
+    producer.Request(60000);
+    producer.WaitIdle();
+    REQUIRE(producer.GetNumBuilt() == 2);
+
+    const visualmusic::FrameGeometry *geometry = producer.Acquire();
+    REQUIRE(geometry->frame == 60000);
+
+    // Without a new build the display keeps drawing the same buffer
+    REQUIRE(producer.Acquire() == geometry);
+    REQUIRE(geometry->frame == 60000);
+  }
+
+  SECTION("A restart keeps the last picture until the next is built") {
+    producer.Request(50000);
+    producer.WaitIdle();
+    const visualmusic::FrameGeometry *geometry = producer.Acquire();
+    REQUIRE(geometry->frame == 50000);
+
+    // The app restarts the producer on a resize and on a new view
+    producer.Stop();
+    visualizer.Resize(Rectf(vec2(0, 0), vec2(400, 300)));
+    reference.Resize(Rectf(vec2(0, 0), vec2(400, 300)));
+    producer.Start(&visualizer);
+    REQUIRE(producer.Acquire() == geometry);
+    REQUIRE(geometry->frame == 50000);
+
+    // Every buffer is refreshed for the new bounds
+    for (size_t frame = 60000; frame < 100000; frame += 10000) {
+      producer.Request(frame);
+      producer.WaitIdle();
+      visualmusic::FrameGeometry expected;
+      reference.BuildGeometry(frame, &expected);
+      REQUIRE(DrawSame(*producer.Acquire(), expected));
+    }
+
+    // Pictures of another visualizer are not drawn
+    producer.Start(&reference);
+    REQUIRE(producer.Acquire() == nullptr);
+  }
+
+  SECTION("The display never sees a buffer being built") {
+    const size_t step = 4096;
+    const size_t num_frames = 60;
+    std::vector<visualmusic::FrameGeometry> expected(num_frames);
+    for (size_t k = 0; k < num_frames; k++) {
+      reference.BuildGeometry(k * step, &expected[k]);
+    }
+
+    // The display acquires as fast as it can while the worker builds
+    size_t last_frame = 0;
+    size_t num_acquired = 0;
+    for (size_t k = 0; k < num_frames; k++) {
+      producer.Request(k * step);
+      if (k % 10 == 9) {
+        producer.WaitIdle();
+      }
+      for (size_t i = 0; i < 50; i++) {
+        const visualmusic::FrameGeometry *geometry = producer.Acquire();
+        if (geometry == nullptr) {
+          continue;
+        }
+
+        REQUIRE(geometry->frame % step == 0);
+        REQUIRE(geometry->frame >= last_frame);
+        REQUIRE(DrawSame(*geometry, expected[geometry->frame / step]));
+        last_frame = geometry->frame;
+        num_acquired++;
+      }
+    }
+
+    producer.WaitIdle();
+    REQUIRE(producer.Acquire()->frame == (num_frames - 1) * step);
+    REQUIRE(num_acquired > 0);
+  }
+
+  producer.Stop();
+  REQUIRE_FALSE(producer.IsActive());
+}
@@ -0,0 +1,218 @@
+#include <catch2/catch.hpp>
+#include <cstring>
+#include <thread>
+
+#include "audio_visualizer.h"
+#include "live_analyzer.h"
+#include "live_input.h"
+#include "sample_ring.h"
+
+using namespace ci;
+
+TEST_CASE("Test SampleRing") {
+  visualmusic::SampleRing ring(2, 1000);
+  REQUIRE(ring.GetCapacity() == 1024);
+
+  SECTION("Frames come out in order across the wrap") {
+    std::vector<float> input(2 * 300);
+    std::vector<float> output(2 * 300);
+    size_t written = 0;
+    size_t read = 0;
+
+    for (size_t round = 0; round < 20; round++) {
+      for (size_t i = 0; i < 300; i++) {
+        input[i] = static_cast<float>(written + i);
+        input[300 + i] = -static_cast<float>(written + i);
+      }
+      REQUIRE(ring.Write(input.data(), 2, 300, 300, 0) == 300);
+      written += 300;
+
+      const size_t count = ring.Read(output.data(), 300, 300);
+      REQUIRE(count == 300);
+      for (size_t i = 0; i < count; i++) {
+        REQUIRE(output[i] == static_cast<float>(read + i));
+        REQUIRE(output[300 + i] == -static_cast<float>(read + i));
+      }
+      read += count;
+    }
+    REQUIRE(ring.GetDroppedFrames() == 0);
+  }
+
+  SECTION("A full ring drops the newest frames") {
+    std::vector<float> input(2 * 1000, 1.0f);
+    REQUIRE(ring.Write(input.data(), 2, 1000, 1000, 0) == 1000);
+    REQUIRE(ring.Write(input.data(), 2, 1000, 1000, 0) == 24);
+    REQUIRE(ring.GetDroppedFrames() == 976);
+    REQUIRE(ring.GetReadableFrames() == 1024);
+  }
+
+  SECTION("A mono source fills every channel") {
+    std::vector<float> input = {0.25f, 0.5f};
+    std::vector<float> output(4);
+    ring.Write(input.data(), 1, 2, 2, 7);
+    REQUIRE(ring.GetLastWriteTime() == 7);
+    REQUIRE(ring.Read(output.data(), 2, 2) == 2);
+    REQUIRE(output == std::vector<float>({0.25f, 0.5f, 0.25f, 0.5f}));
+  }
+
+  SECTION("A producer thread and a consumer share the ring") {
+    const size_t num_frames = 200000;
+    std::thread producer([&ring]() {
+      std::vector<float> block(2 * 64);
+      size_t frame = 0;
+      while (frame < num_frames) {
+        const size_t count = std::min<size_t>(64, num_frames - frame);
+        for (size_t i = 0; i < count; i++) {
+          block[i] = static_cast<float>(frame + i);
+          block[64 + i] = static_cast<float>(frame + i);
+        }
+
+        // The test producer waits instead of dropping, to check every frame
+        size_t written = 0;
+        while (written < count) {
+          written += ring.Write(block.data() + written, 2, 64,
+                                count - written, 0);
+        }
+        frame += count;
+      }
+    });
+
+    std::vector<float> output(2 * 100);
+    size_t frame = 0;
+    bool ordered = true;
+    while (frame < num_frames) {
+      const size_t count = ring.Read(output.data(), 100, 100);
+      for (size_t i = 0; i < count; i++) {
+        ordered = ordered && output[i] == static_cast<float>(frame + i) &&
+                  output[100 + i] == static_cast<float>(frame + i);
+      }
+      frame += count;
+    }
+    producer.join();
+
+    REQUIRE(ordered);
+  }
+}
+
+TEST_CASE("Test LiveAnalyzer") {
+  // A stereo file, fed to the ring like an audio callback of 512 frames
+  const size_t sample_rate = 44100;
+  audio::Buffer file(sample_rate * 3, 2);
+  for (size_t i = 0; i < file.getNumFrames(); i++) {
+    file.getChannel(0)[i] = 0.8f * std::sin(0.05f * static_cast<float>(i));
+    file.getChannel(1)[i] = 0.4f * std::cos(0.01f * static_cast<float>(i));
+  }
+
+  visualmusic::SampleRing ring(2, 8192);
+  visualmusic::FileDrivenInput input(file, &ring, 512);
+
+  int64_t now = 0;
+  visualmusic::LiveSettings settings;
+  settings.sample_rate = sample_rate;
+  settings.general_seconds = 1;
+  visualmusic::LiveAnalyzer analyzer(&ring, settings,
+                                     [&now]() { return now; });
+
+  // Blocks arrive every 512 / 44100 s, the display runs at 60 fps
+  const int64_t block_time = 512 * 1000000000LL / sample_rate;
+  const int64_t display_time = 1000000000LL / 60;
+  int64_t next_block = 0;
+
+  visualmusic::FrameGeometry geometry;
+  auto play = [&](const size_t &num_display_frames,
+                  visualmusic::AudioVisualizer *visualizer) {
+    for (size_t frame = 0; frame < num_display_frames; frame++) {
+      now += display_time;
+      while (next_block <= now && !input.IsFinished()) {
+        input.PushBlock(next_block);
+        next_block += block_time;
+      }
+
+      // Pictures are built as the display would draw them, which needs no
+      // GL context
+      if (visualizer != nullptr) {
+        visualizer->UpdateLive();
+        visualizer->BuildGeometry(0, &geometry);
+        analyzer.MarkGeometryReady();
+      } else {
+        analyzer.Update();
+        analyzer.MarkGeometryReady();
+      }
+    }
+  };
+
+  SECTION("Rolling results match the file") {
+    play(120, nullptr);
+    const size_t num_frames = analyzer.GetNumFrames();
+    REQUIRE(num_frames == input.GetPosition());
+
+    // The window holds the newest frames
+    const size_t window_frames = analyzer.GetWindowFrames();
+    REQUIRE(window_frames == sample_rate / 20);
+    REQUIRE(std::memcmp(analyzer.GetWindow(1),
+                        file.getChannel(1) + num_frames - window_frames,
+                        window_frames * sizeof(float)) == 0);
+
+    // The spectra match an offline transform of the same frames
+    visualmusic::StftEngine engine(visualmusic::StftSettings{});
+    std::vector<float> expected(engine.GetNumBins() *
+                                engine.CountFrames(num_frames));
+    engine.Analyze(engine.MakeFrameView(file.getChannel(0), num_frames),
+                   expected.data());
+    const size_t newest = analyzer.GetNumSpectra() - 1;
+    REQUIRE(analyzer.GetNumSpectra() == num_frames / 1024);
+    for (size_t bin = 0; bin < engine.GetNumBins(); bin++) {
+      REQUIRE(analyzer.GetSpectrum(newest)[bin] ==
+              Approx(expected[newest * engine.GetNumBins() + bin])
+                  .margin(1e-4));
+    }
+
+    // The envelope keeps the last second, one bucket per 441 frames
+    REQUIRE(analyzer.GetNumEnvelopeBuckets() == 100);
+    const size_t first_bucket = num_frames / 441 - 100;
+    for (size_t bucket = 0; bucket < 100; bucket++) {
+      float min = 1.0f;
+      float max = -1.0f;
+      for (size_t i = 0; i < 441; i++) {
+        const size_t frame = (first_bucket + bucket) * 441 + i;
+        const float mix =
+            (file.getChannel(0)[frame] + file.getChannel(1)[frame]) * 0.5f;
+        min = std::fminf(min, mix);
+        max = std::fmaxf(max, mix);
+      }
+      REQUIRE(analyzer.GetEnvelopeBucket(bucket).min == Approx(min));
+      REQUIRE(analyzer.GetEnvelopeBucket(bucket).max == Approx(max));
+    }
+  }
+
+  SECTION("Latency is bounded by the block period") {
+    play(150, nullptr);
+
+    const visualmusic::LiveLatency latency = analyzer.GetLatency();
+    REQUIRE(latency.num_measurements >= 140);
+    REQUIRE(latency.max <= static_cast<double>(block_time) * 1e-9);
+    REQUIRE(latency.mean <= latency.max);
+    REQUIRE(ring.GetDroppedFrames() == 0);
+  }
+
+  SECTION("The visualizer draws the live input") {
+    visualmusic::AudioVisualizer visualizer;
+    visualizer.BeginLive(&analyzer, Rectf(vec2(0, 0), vec2(800, 600)));
+    REQUIRE(visualizer.IsLive());
+    play(90, &visualizer);
+
+    REQUIRE(analyzer.GetLatency().num_measurements == 90);
+    REQUIRE(visualizer.GetNumSpectralBins() == 512);
+    REQUIRE(visualizer.CalculateLiveGeneralGraph().getPoints().size() ==
+            2 * analyzer.GetNumEnvelopeBuckets());
+
+    // The instant graph reads the window of the analyzer
+    PolyLine2f waveform =
+        visualizer.CalculateInstantGraphInTimeDomain(analyzer.GetWindow(0), 0);
+    REQUIRE(waveform.getPoints().size() == 2 * 800);
+
+    // Loading a track leaves the live mode
+    visualizer.Load(file, Rectf(vec2(0, 0), vec2(800, 600)), sample_rate);
+    REQUIRE_FALSE(visualizer.IsLive());
+  }
+}
@@ -0,0 +1,189 @@
+#include <catch2/catch.hpp>
+#include <atomic>
+#include <random>
+#include <thread>
+
+#include "playhead.h"
+
+TEST_CASE("Test Playhead") {
+  const size_t sample_rate = 48000;
+  const size_t block_frames = 480;
+  const double output_latency = 0.02;
+  const int64_t kMillisecond = 1000000;
+
+  visualmusic::Playhead playhead(sample_rate);
+  playhead.SetOutputLatency(output_latency);
+
+  SECTION("Nothing is predicted before the first callback") {
+    REQUIRE_FALSE(playhead.HasPublished());
+    REQUIRE(playhead.Predict(123456789) == 0);
+  }
+
+  SECTION("The picture follows the audio within a few milliseconds") {
+    // Fake clock: frame f is heard at f / rate + latency. Callbacks run
+    // early by up to 2 ms, and the display updates with 4 ms of jitter.
+    std::mt19937 generator(11);
+    std::uniform_int_distribution<int64_t> callback_jitter(0,
+                                                           2 * kMillisecond);
+    std::uniform_int_distribution<int64_t> display_jitter(-4 * kMillisecond,
+                                                          4 * kMillisecond);
+    auto heard_frame = [&](const int64_t &time) {
+      return (static_cast<double>(time) * 1e-9 - output_latency) *
+             static_cast<double>(sample_rate);
+    };
+
+    const int64_t block_time = 10 * kMillisecond;
+    const int64_t display_time = 1000000000LL / 60;
+    int64_t next_callback = 0;
+    size_t next_block = 0;
+
+    double max_offset = 0.0;
+    double max_measure_error = 0.0;
+    double max_polling_offset = 0.0;
+    size_t last_frame = 0;
+    int64_t last_presentation_time = 0;
+
+    for (size_t frame = 1; frame <= 600; frame++) {
+      const int64_t now =
+          static_cast<int64_t>(frame) * display_time +
+          display_jitter(generator);
+
+      // Audio callbacks that ran since the last update
+      while (next_callback <= now) {
+        playhead.Publish(next_block * block_frames,
+                         next_callback - callback_jitter(generator));
+        next_block++;
+        next_callback = static_cast<int64_t>(next_block) * block_time;
+      }
+
+      // The previous picture, measured against the newest callback
+      if (last_presentation_time != 0) {
+        const double measured =
+            playhead.MeasureOffset(last_frame, last_presentation_time);
+        const double actual = (static_cast<double>(last_frame) -
+                               heard_frame(last_presentation_time)) /
+                              static_cast<double>(sample_rate);
+        max_measure_error =
+            std::max(max_measure_error, std::fabs(measured - actual));
+      }
+
+      // The picture drawn now reaches the screen one display frame later
+      const int64_t presentation_time = now + display_time;
+      last_frame = playhead.Predict(presentation_time);
+      last_presentation_time = presentation_time;
+
+      const double offset = (static_cast<double>(last_frame) -
+                             heard_frame(presentation_time)) /
+                            static_cast<double>(sample_rate);
+      max_offset = std::max(max_offset, std::fabs(offset));
+
+      // Polling shows the last published frame instead
+      const double polling_offset =
+          (static_cast<double>((next_block - 1) * block_frames) -
+           heard_frame(presentation_time)) /
+          static_cast<double>(sample_rate);
+      max_polling_offset =
+          std::max(max_polling_offset, std::fabs(polling_offset));
+    }
+
+    REQUIRE(max_offset < 0.003);
+    REQUIRE(max_measure_error < 0.003);
+    REQUIRE(max_polling_offset > 2 * max_offset);
+  }
+
+  SECTION("The prediction stops with the callbacks") {
+    playhead.SetMaxExtrapolation(0.05);
+    playhead.Publish(48000, 0);
+
+    const size_t stopped = playhead.Predict(10 * 1000 * kMillisecond);
+    REQUIRE(stopped ==
+            48000 + static_cast<size_t>((0.05 - output_latency) * 48000));
+  }
+
+  SECTION("Readers never see half of a publish") {
+    // Every publish lies on one line of 48 frames per millisecond, so any
+    // consistent pair predicts the same frame and a torn pair does not
+    playhead.SetMaxExtrapolation(1e9);
+    std::thread audio([&playhead, &kMillisecond]() {
+      for (size_t i = 1; i <= 200000; i++) {
+        playhead.Publish(i * 48, static_cast<int64_t>(i) * kMillisecond);
+      }
+    });
+
+    const int64_t presentation_time = 300 * 1000 * kMillisecond;
+    const size_t expected =
+        300 * sample_rate - static_cast<size_t>(output_latency * 48000);
+    bool consistent = true;
+    for (size_t i = 0; i < 200000; i++) {
+      if (playhead.HasPublished()) {
+        consistent =
+            consistent && playhead.Predict(presentation_time) == expected;
+      }
+    }
+    audio.join();
+
+    REQUIRE(consistent);
+    REQUIRE(playhead.Predict(presentation_time) == expected);
+  }
+
+  SECTION("Seeks between two callbacks collapse to the latest") {
+    playhead.Publish(48000, 0);
+    for (size_t i = 1; i <= 100; i++) {
+      playhead.RequestSeek(i * 1000);
+    }
+
+    // The picture jumps to the target before the audio gets there
+    size_t target = 0;
+    REQUIRE(playhead.GetPendingSeek(&target));
+    REQUIRE(target == 100000);
+    REQUIRE(playhead.Predict(5 * kMillisecond) == 100000);
+
+    REQUIRE(playhead.TakeSeek(10 * kMillisecond, &target));
+    REQUIRE(target == 100000);
+    REQUIRE_FALSE(playhead.GetPendingSeek(&target));
+    REQUIRE_FALSE(playhead.TakeSeek(20 * kMillisecond, &target));
+    REQUIRE(playhead.GetNumRequestedSeeks() == 100);
+    REQUIRE(playhead.GetNumAppliedSeeks() == 1);
+
+    // The target is published as the position of the callback
+    REQUIRE(playhead.Predict(10 * kMillisecond +
+                             static_cast<int64_t>(output_latency * 1e9)) ==
+            100000);
+  }
+
+  SECTION("A drag seeks at most once per callback") {
+    const size_t num_requests = 100000;
+    std::atomic<bool> dragging(true);
+    size_t num_callbacks = 0;
+    size_t last_target = 0;
+
+    std::thread audio([&]() {
+      int64_t time = 0;
+      size_t target = 0;
+      while (dragging.load()) {
+        if (playhead.TakeSeek(time, &target)) {
+          last_target = target;
+        }
+        num_callbacks++;
+        time += 10 * kMillisecond;
+        std::this_thread::yield();
+      }
+
+      // The callback after the drag applies its last target
+      if (playhead.TakeSeek(time, &target)) {
+        last_target = target;
+      }
+      num_callbacks++;
+    });
+
+    for (size_t i = 1; i <= num_requests; i++) {
+      playhead.RequestSeek(i);
+    }
+    dragging.store(false);
+    audio.join();
+
+    REQUIRE(playhead.GetNumRequestedSeeks() == num_requests);
+    REQUIRE(playhead.GetNumAppliedSeeks() <= num_callbacks);
+    REQUIRE(last_target == num_requests);
+  }
+}
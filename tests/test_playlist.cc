@@ -0,0 +1,163 @@
+#include <catch2/catch.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "playlist.h"
+
+using namespace ci;
+
+namespace {
+
+// Tracks of a few seconds, each at its own pitch
+auto DecodeTrack(const std::string &name) -> audio::BufferRef {
+  if (name == "missing") {
+    return nullptr;
+  }
+
+  const size_t num_frames = 3 * 44100 + 1000 * name.size();
+  audio::BufferRef buffer = std::make_shared<audio::Buffer>(num_frames, 1);
+  const float step = 0.01f * static_cast<float>(name.size());
+  for (size_t i = 0; i < num_frames; i++) {
+    buffer->getChannel(0)[i] = std::sin(step * static_cast<float>(i));
+  }
+
+  return buffer;
+}
+
+}  // namespace
+
+TEST_CASE("Test Playlist") {
+  const Rectf bounds(vec2(0, 0), vec2(800, 600));
+  std::atomic<size_t> num_decoded(0);
+  const visualmusic::Playlist::Decoder decoder =
+      [&num_decoded](const std::string &name) {
+        num_decoded++;
+        return DecodeTrack(name);
+      };
+  const visualmusic::Playlist::Configurer configure =
+      [](visualmusic::AudioVisualizer *visualizer) {
+        visualizer->SetFftBackend(visualmusic::FftBackend::kFixed);
+      };
+
+  visualmusic::Playlist playlist;
+
+  SECTION("The next track is analyzed while the current one plays") {
+    playlist.Start({"a", "bb", "ccc"}, decoder, configure, bounds, 44100);
+    REQUIRE(playlist.GetVisualizer() == nullptr);
+
+    playlist.WaitForStandby();
+    REQUIRE(playlist.Advance());
+    REQUIRE(playlist.GetCurrentIndex() == 0);
+    REQUIRE(playlist.GetVisualizer()->IsLoaded());
+    REQUIRE(playlist.GetBuffer()->getNumFrames() == 3 * 44100 + 1000);
+
+    // At most one track is decoded ahead
+    playlist.WaitForStandby();
+    REQUIRE(playlist.IsStandbyReady());
+    REQUIRE(num_decoded == 2);
+
+    // The swap is ready to draw at once: the track is analyzed, and the
+    // first picture only maps the rows on screen
+    REQUIRE(playlist.Advance());
+    visualmusic::AudioVisualizer *visualizer = playlist.GetVisualizer();
+    REQUIRE(playlist.GetCurrentIndex() == 1);
+    REQUIRE(visualizer->IsLoaded());
+    REQUIRE(visualizer->GetReadyFrames() == 3 * 44100 + 2000);
+    REQUIRE(visualizer->Update3DGraph(0) <= 1);
+    REQUIRE(visualizer->IsFrameComplete(0));
+    REQUIRE(visualizer->Update3DGraph(0) == 0);
+  }
+
+  SECTION("Two visualizers take turns") {
+    // Buffers count themselves while they are alive
+    std::atomic<size_t> num_alive(0);
+    std::atomic<size_t> max_alive(0);
+    const visualmusic::Playlist::Decoder counting_decoder =
+        [&](const std::string &name) {
+          num_decoded++;
+          const audio::BufferRef track = DecodeTrack(name);
+          max_alive = std::max<size_t>(max_alive, ++num_alive);
+          return audio::BufferRef(new audio::Buffer(track->getNumFrames(), 1),
+                                  [&num_alive](audio::Buffer *buffer) {
+                                    num_alive--;
+                                    delete buffer;
+                                  });
+        };
+    playlist.Start({"a", "bb", "ccc"}, counting_decoder, configure, bounds,
+                   44100);
+    std::vector<visualmusic::AudioVisualizer *> visualizers;
+    std::vector<size_t> indices;
+    for (size_t i = 0; i < 5; i++) {
+      playlist.WaitForStandby();
+      REQUIRE(playlist.Advance());
+      visualizers.push_back(playlist.GetVisualizer());
+      indices.push_back(playlist.GetCurrentIndex());
+    }
+
+    REQUIRE(indices == std::vector<size_t>({0, 1, 2, 0, 1}));
+    REQUIRE(visualizers[0] != visualizers[1]);
+    for (size_t i = 2; i < visualizers.size(); i++) {
+      REQUIRE(visualizers[i] == visualizers[i - 2]);
+    }
+
+    // The old track is freed before the next one is decoded
+    playlist.WaitForStandby();
+    REQUIRE(num_decoded == 6);
+    REQUIRE(num_alive == 2);
+    REQUIRE(max_alive == 2);
+  }
+
+  SECTION("The current track stays until the next is analyzed") {
+    std::atomic<bool> decodable(false);
+    const visualmusic::Playlist::Decoder slow_decoder =
+        [&decodable](const std::string &name) {
+          while (name == "slow" && !decodable) {
+            std::this_thread::yield();
+          }
+          return DecodeTrack(name);
+        };
+    playlist.Start({"a", "slow"}, slow_decoder, configure, bounds, 44100);
+    playlist.WaitForStandby();
+    REQUIRE(playlist.Advance());
+    visualmusic::AudioVisualizer *first = playlist.GetVisualizer();
+
+    REQUIRE_FALSE(playlist.Advance());
+    REQUIRE(playlist.GetVisualizer() == first);
+    REQUIRE(playlist.GetCurrentIndex() == 0);
+
+    decodable = true;
+    playlist.WaitForStandby();
+    REQUIRE(playlist.Advance());
+    REQUIRE(playlist.GetCurrentIndex() == 1);
+    REQUIRE(playlist.GetVisualizer() != first);
+  }
+
+  SECTION("Tracks that cannot be decoded are skipped") {
+    playlist.Start({"a", "missing", "ccc"}, decoder, configure, bounds,
+                   44100);
+    playlist.WaitForStandby();
+    REQUIRE(playlist.Advance());
+
+    playlist.WaitForStandby();
+    REQUIRE_FALSE(playlist.Advance());
+    playlist.WaitForStandby();
+    REQUIRE(playlist.Advance());
+    REQUIRE(playlist.GetCurrentIndex() == 2);
+  }
+
+  SECTION("A single track plays again") {
+    playlist.Start({"a"}, decoder, configure, bounds, 44100);
+    playlist.WaitForStandby();
+    REQUIRE(playlist.Advance());
+    visualmusic::AudioVisualizer *visualizer = playlist.GetVisualizer();
+
+    REQUIRE(playlist.Advance());
+    REQUIRE(playlist.GetVisualizer() == visualizer);
+    REQUIRE(num_decoded == 1);
+  }
+}
@@ -0,0 +1,239 @@
+#include <catch2/catch.hpp>
+#include <algorithm>
+#include <cmath>
+
+#include "audio_visualizer.h"
+#include "quantized_spectra.h"
+#include "test_signals.h"
+
+using namespace ci;
+
+namespace {
+
+// A sweep over background noise, so every level of the scale is used
+auto MakeTrack(const size_t &num_frames) -> audio::Buffer {
+  audio::Buffer buffer(num_frames, 1);
+  const std::vector<float> noise = MakeNoise(num_frames, 1);
+
+  for (size_t i = 0; i < num_frames; i++) {
+    const float t = static_cast<float>(i) / 44100.0f;
+    buffer.getChannel(0)[i] =
+        0.6f * std::sin(2.0f * 3.14159265f * (200.0f + 400.0f * t) * t) +
+        0.01f * noise[i];
+  }
+
+  return buffer;
+}
+
+// Largest error a decoded magnitude may have
+auto GetBound(const visualmusic::QuantizedSpectra &spectra,
+              const float &magnitude) -> float {
+  return std::fmaxf(spectra.GetMaxRelativeError() * magnitude,
+                    spectra.GetFloor()) *
+         1.0001f;
+}
+
+}  // namespace
+
+TEST_CASE("Test QuantizedSpectra") {
+  const size_t kRowSize = 1000;
+  const float kReference = 1024.0f;
+
+  // Magnitudes from far below the floor up to the reference
+  std::vector<float> magnitudes(kRowSize);
+  for (size_t i = 0; i < kRowSize; i++) {
+    magnitudes[i] = kReference *
+                    std::pow(10.0f, -7.0f * static_cast<float>(i) / kRowSize);
+  }
+  magnitudes[kRowSize - 1] = 0.0f;
+  std::vector<float> decoded(kRowSize);
+
+  SECTION("Decibel codes are within the bound") {
+    visualmusic::QuantizedSpectra spectra;
+    spectra.Reset(3, kRowSize, visualmusic::SpectralStorage::kDecibel8,
+                  kReference);
+    REQUIRE(spectra.GetCapacityBytes() == 3 * kRowSize);
+    REQUIRE(spectra.GetMaxRelativeError() < 0.025f);
+
+    spectra.Encode(2, magnitudes.data());
+    spectra.Decode(2, decoded.data());
+    for (size_t i = 0; i < kRowSize; i++) {
+      REQUIRE(std::fabs(decoded[i] - magnitudes[i]) <=
+              GetBound(spectra, magnitudes[i]));
+    }
+    REQUIRE(decoded[0] == Approx(kReference));
+    REQUIRE(decoded[kRowSize - 1] == 0.0f);
+
+    // Magnitudes above the reference are clamped to it
+    std::vector<float> loud(kRowSize, 4.0f * kReference);
+    spectra.Encode(0, loud.data());
+    spectra.DecodeRange(0, 10, 5, decoded.data());
+    REQUIRE(decoded[0] == Approx(kReference));
+  }
+
+  SECTION("Half floats are within the bound") {
+    visualmusic::QuantizedSpectra spectra;
+    spectra.Reset(3, kRowSize, visualmusic::SpectralStorage::kFloat16,
+                  kReference);
+    REQUIRE(spectra.GetCapacityBytes() == 3 * kRowSize * sizeof(uint16_t));
+
+    spectra.Encode(1, magnitudes.data());
+    spectra.Decode(1, decoded.data());
+    for (size_t i = 0; i < kRowSize; i++) {
+      REQUIRE(std::fabs(decoded[i] - magnitudes[i]) <=
+              GetBound(spectra, magnitudes[i]));
+    }
+
+    // Exact values, ties to even, subnormals and clamping
+    using visualmusic::QuantizedSpectra;
+    REQUIRE(QuantizedSpectra::DecodeHalf(QuantizedSpectra::EncodeHalf(1.0f)) ==
+            1.0f);
+    REQUIRE(QuantizedSpectra::EncodeHalf(1.0f) == 0x3c00);
+    REQUIRE(QuantizedSpectra::EncodeHalf(1.0f + std::ldexp(1.0f, -11)) ==
+            0x3c00);
+    REQUIRE(QuantizedSpectra::EncodeHalf(1.0f + 3 * std::ldexp(1.0f, -11)) ==
+            0x3c02);
+    REQUIRE(QuantizedSpectra::EncodeHalf(std::ldexp(1.0f, -24)) == 1);
+    REQUIRE(QuantizedSpectra::DecodeHalf(0x0200) == std::ldexp(1.0f, -15));
+    REQUIRE(QuantizedSpectra::EncodeHalf(1e6f) == 0x7bff);
+    REQUIRE(QuantizedSpectra::EncodeHalf(-1.0f) == 0);
+  }
+}
+
+TEST_CASE("Test compact spectral storage") {
+  const audio::Buffer buffer = MakeTrack(20 * 44100);
+  const Rectf bounds(vec2(0, 0), vec2(800, 600));
+
+  visualmusic::AudioVisualizer exact;
+  exact.SetFftBackend(visualmusic::FftBackend::kFixed);
+  exact.Load(buffer, bounds, 44100);
+  const visualmusic::MemoryUsage exact_usage = exact.GetMemoryUsage();
+
+  SECTION("Decibel codes take a quarter of the memory") {
+    visualmusic::AudioVisualizer compact;
+    compact.SetFftBackend(visualmusic::FftBackend::kFixed);
+    compact.SetSpectralStorage(visualmusic::SpectralStorage::kDecibel8);
+    compact.Load(buffer, bounds, 44100);
+    const visualmusic::MemoryUsage usage = compact.GetMemoryUsage();
+
+    REQUIRE(usage.spectra * 4 <= exact_usage.spectra);
+    REQUIRE(usage.samples == exact_usage.samples);
+    REQUIRE(usage.envelope == exact_usage.envelope);
+    REQUIRE(usage.mapped == 0);
+    REQUIRE(usage.GetTotal() < exact_usage.GetTotal());
+
+    // The frequency graph moves by at most the error of the magnitudes
+    visualmusic::QuantizedSpectra scale;
+    scale.Reset(0, 0, visualmusic::SpectralStorage::kDecibel8, 1024.0f);
+    const size_t num_bins = exact.GetNumSpectralBins();
+    std::vector<float> spectrum(num_bins);
+
+    for (size_t frame = 0; frame < buffer.getNumFrames(); frame += 77777) {
+      const std::vector<vec2> expected =
+          exact.CalculateInstantGraphInFrequencyDomain(frame, bounds)
+              .getPoints();
+      const std::vector<vec2> actual =
+          compact.CalculateInstantGraphInFrequencyDomain(frame, bounds)
+              .getPoints();
+      const float *row = exact.GetSpectralFrame(frame / 1024);
+      std::copy(row, row + num_bins, spectrum.begin());
+
+      // Pixels per magnitude, the same in both graphs as the maximum
+      // magnitude comes from the exact spectra
+      const size_t loudest = static_cast<size_t>(
+          std::max_element(spectrum.begin(), spectrum.end()) -
+          spectrum.begin());
+      const float y_scale =
+          std::fabs(expected[loudest].y - 300.0f) / spectrum[loudest];
+      REQUIRE(actual.size() == expected.size());
+      for (size_t bin = 0; bin < num_bins; bin++) {
+        REQUIRE(actual[bin].x == expected[bin].x);
+        REQUIRE(std::fabs(actual[bin].y - expected[bin].y) <=
+                GetBound(scale, spectrum[bin]) * y_scale + 1e-3f);
+      }
+    }
+  }
+
+  SECTION("Half floats take half of the memory") {
+    visualmusic::AudioVisualizer compact;
+    compact.SetFftBackend(visualmusic::FftBackend::kFixed);
+    compact.SetSpectralStorage(visualmusic::SpectralStorage::kFloat16);
+    compact.Load(buffer, bounds, 44100);
+
+    REQUIRE(compact.GetMemoryUsage().spectra * 2 <= exact_usage.spectra);
+    for (size_t index = 0; index < exact.GetNumSpectralFrames(); index += 50) {
+      std::vector<float> expected(exact.GetSpectralFrame(index),
+                                  exact.GetSpectralFrame(index) +
+                                      exact.GetNumSpectralBins());
+      const float *actual = compact.GetSpectralFrame(index);
+      for (size_t bin = 0; bin < expected.size(); bin++) {
+        REQUIRE(actual[bin] ==
+                Approx(expected[bin]).epsilon(1e-3).margin(1e-4));
+      }
+    }
+  }
+
+  SECTION("Bands are kept in the same storage") {
+    visualmusic::BandSettings bands;
+    bands.scale = visualmusic::BandScale::kLog;
+    bands.num_bands = 128;
+    exact.SetFrequencyBands(bands);
+    exact.Load(buffer, bounds, 44100);
+
+    visualmusic::AudioVisualizer compact;
+    compact.SetFftBackend(visualmusic::FftBackend::kFixed);
+    compact.SetFrequencyBands(bands);
+    compact.SetSpectralStorage(visualmusic::SpectralStorage::kDecibel8);
+    compact.Load(buffer, bounds, 44100);
+
+    REQUIRE(compact.GetMemoryUsage().bands * 4 <=
+            exact.GetMemoryUsage().bands);
+    REQUIRE(compact.Update3DGraph(300 * 1024) == 50);
+    exact.Update3DGraph(300 * 1024);
+
+    visualmusic::QuantizedSpectra scale;
+    scale.Reset(0, 0, visualmusic::SpectralStorage::kDecibel8, 1024.0f);
+    const std::vector<vec2> expected = exact.Get3DGraphRow(300);
+    const std::vector<vec2> actual = compact.Get3DGraphRow(300);
+    REQUIRE(actual.size() == 128);
+    for (size_t band = 0; band < 128; band++) {
+      REQUIRE(std::fabs(actual[band].y - expected[band].y) <=
+              GetBound(scale, expected[band].y));
+    }
+  }
+
+  SECTION("Progressive loads quantize as they go") {
+    visualmusic::AudioVisualizer loaded;
+    loaded.SetSpectralStorage(visualmusic::SpectralStorage::kDecibel8);
+    loaded.SetFftBackend(visualmusic::FftBackend::kFixed);
+    loaded.Load(buffer, bounds, 44100);
+
+    visualmusic::AudioVisualizer streamed;
+    streamed.SetSpectralStorage(visualmusic::SpectralStorage::kDecibel8);
+    streamed.SetFftBackend(visualmusic::FftBackend::kFixed);
+    streamed.BeginStream(buffer.getNumFrames(), 1, bounds, 44100);
+    audio::Buffer chunk(10000, 1);
+    for (size_t frame = 0; frame < buffer.getNumFrames(); frame += 10000) {
+      const size_t count =
+          std::min<size_t>(10000, buffer.getNumFrames() - frame);
+      chunk.copyOffset(buffer, count, 0, frame);
+      streamed.AppendFrames(chunk, count);
+    }
+
+    // The staging rows are released once the last frame is quantized
+    const size_t staging_bytes = streamed.GetMemoryUsage().spectra;
+    streamed.EndStream();
+    REQUIRE(streamed.GetMemoryUsage().spectra < staging_bytes);
+    REQUIRE(streamed.GetMemoryUsage().spectra ==
+            loaded.GetMemoryUsage().spectra);
+
+    const size_t num_bins = loaded.GetNumSpectralBins();
+    std::vector<float> expected(num_bins);
+    for (size_t i = 0; i < loaded.GetNumSpectralFrames(); i++) {
+      const float *row = loaded.GetSpectralFrame(i);
+      std::copy(row, row + num_bins, expected.begin());
+      REQUIRE(std::equal(expected.begin(), expected.end(),
+                         streamed.GetSpectralFrame(i)));
+    }
+  }
+}
@@ -0,0 +1,252 @@
+#include <catch2/catch.hpp>
+#include <cmath>
+#include <vector>
+
+#include "audio_visualizer.h"
+#include "live_analyzer.h"
+#include "live_input.h"
+#include "rhythm_tracker.h"
+
+using namespace ci;
+
+namespace {
+
+const size_t kSampleRate = 44100;
+const size_t kHopSize = 1024;
+const size_t kClickFrames = kSampleRate / 2;  // 120 beats per minute
+
+// A quiet tone with a short noise burst every beat, starting off the grid,
+// cut to whole spectral frames
+auto MakeClickTrack(const size_t &seconds) -> audio::Buffer {
+  audio::Buffer buffer(seconds * kSampleRate / kHopSize * kHopSize, 1);
+  float *data = buffer.getChannel(0);
+  uint32_t state = 1;
+  for (size_t i = 0; i < buffer.getNumFrames(); i++) {
+    data[i] = 0.05f * std::sin(0.03f * static_cast<float>(i));
+  }
+  for (size_t click = 3000; click < buffer.getNumFrames();
+       click += kClickFrames) {
+    for (size_t i = click; i < std::min(click + 400, buffer.getNumFrames());
+         i++) {
+      state = state * 1664525u + 1013904223u;
+      const float noise =
+          static_cast<float>(state >> 8) / static_cast<float>(1 << 23) - 1.0f;
+      data[i] += 0.8f * noise *
+                 std::exp(-static_cast<float>(i - click) / 100.0f);
+    }
+  }
+
+  return buffer;
+}
+
+// Spectra of the track, as the visualizer frames them
+auto AnalyzeTrack(const audio::Buffer &buffer) -> std::vector<float> {
+  visualmusic::StftSettings settings;
+  settings.backend = visualmusic::FftBackend::kFixed;
+  visualmusic::StftEngine engine(settings);
+  std::vector<float> spectra(engine.CountFrames(buffer.getNumFrames()) *
+                             engine.GetNumBins());
+  engine.Analyze(buffer, spectra.data());
+  return spectra;
+}
+
+// Whether two frames hold the same rhythm
+auto SameRhythm(const visualmusic::RhythmFrame &a,
+                const visualmusic::RhythmFrame &b) -> bool {
+  return a.onset_strength == b.onset_strength && a.tempo == b.tempo &&
+         a.beat_phase == b.beat_phase && a.last_beat == b.last_beat &&
+         a.onset == b.onset && a.beat == b.beat;
+}
+
+}  // namespace
+
+TEST_CASE("Test RhythmTracker") {
+  const audio::Buffer track = MakeClickTrack(20);
+  const std::vector<float> spectra = AnalyzeTrack(track);
+  const size_t num_bins = kHopSize / 2;
+  const size_t num_frames = spectra.size() / num_bins;
+
+  visualmusic::RhythmTracker tracker;
+  tracker.Reset(num_bins, kHopSize, kSampleRate, num_frames);
+  tracker.AddFrames(spectra.data(), num_bins, num_frames);
+  REQUIRE(tracker.GetNumFrames() + tracker.GetLookahead() >= num_frames);
+  tracker.Finish();
+  REQUIRE(tracker.GetNumFrames() == num_frames);
+
+  // Spectral frames holding the start of each click
+  std::vector<size_t> clicks;
+  for (size_t click = 3000; click < track.getNumFrames();
+       click += kClickFrames) {
+    clicks.push_back(click / kHopSize);
+  }
+  auto near_click = [&clicks](const size_t &frame) {
+    for (size_t click : clicks) {
+      if (frame + 1 >= click && frame <= click + 1) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  SECTION("Every click is an onset, and nothing else") {
+    size_t num_onsets = 0;
+    for (size_t frame = 0; frame < num_frames; frame++) {
+      visualmusic::RhythmFrame rhythm;
+      REQUIRE(tracker.GetFrame(frame, &rhythm));
+      if (rhythm.onset) {
+        REQUIRE(near_click(frame));
+        num_onsets++;
+      }
+    }
+    REQUIRE(num_onsets == clicks.size());
+  }
+
+  SECTION("The tempo and the beats lock to the clicks") {
+    visualmusic::RhythmFrame last;
+    REQUIRE(tracker.GetFrame(num_frames - 1, &last));
+    REQUIRE(last.tempo == Approx(120.0f).margin(2.0f));
+
+    // Once the tempo is known, each beat falls on a click. The beat after
+    // the last click may fall anywhere near the end.
+    size_t num_beats = 0;
+    const size_t first_frame = 5 * kSampleRate / kHopSize;
+    for (size_t frame = first_frame; frame <= clicks.back() + 1; frame++) {
+      visualmusic::RhythmFrame rhythm;
+      REQUIRE(tracker.GetFrame(frame, &rhythm));
+      REQUIRE(rhythm.last_beat <= frame);
+      REQUIRE(rhythm.beat_phase >= 0.0f);
+      REQUIRE(rhythm.beat_phase < 1.0f);
+      if (rhythm.beat) {
+        REQUIRE(rhythm.last_beat == frame);
+        REQUIRE(near_click(frame));
+        num_beats++;
+      }
+    }
+    REQUIRE(num_beats >= 29);
+    REQUIRE(num_beats <= 30);
+  }
+
+  SECTION("Frames become final within the lookahead") {
+    visualmusic::RhythmTracker streamed;
+    streamed.Reset(num_bins, kHopSize, kSampleRate, num_frames);
+    for (size_t frame = 0; frame < num_frames; frame++) {
+      streamed.AddFrame(spectra.data() + frame * num_bins);
+      REQUIRE(streamed.GetNumFrames() + streamed.GetLookahead() >= frame + 1);
+    }
+    streamed.Finish();
+
+    for (size_t frame = 0; frame < num_frames; frame++) {
+      visualmusic::RhythmFrame expected;
+      visualmusic::RhythmFrame rhythm;
+      tracker.GetFrame(frame, &expected);
+      REQUIRE(streamed.GetFrame(frame, &rhythm));
+      REQUIRE(SameRhythm(rhythm, expected));
+    }
+  }
+
+  SECTION("A rolling tracker keeps the newest frames") {
+    visualmusic::RhythmTracker rolling;
+    rolling.Reset(num_bins, kHopSize, kSampleRate, 100);
+    rolling.AddFrames(spectra.data(), num_bins, num_frames);
+    rolling.Finish();
+
+    visualmusic::RhythmFrame rhythm;
+    REQUIRE(rolling.GetFirstFrame() == num_frames - 100);
+    REQUIRE_FALSE(rolling.GetFrame(num_frames - 101, &rhythm));
+    for (size_t frame = num_frames - 100; frame < num_frames; frame++) {
+      visualmusic::RhythmFrame expected;
+      tracker.GetFrame(frame, &expected);
+      REQUIRE(rolling.GetFrame(frame, &rhythm));
+      REQUIRE(SameRhythm(rhythm, expected));
+    }
+  }
+
+  SECTION("Silence has no onsets and no tempo") {
+    const std::vector<float> silence(num_bins * 500, 0.0f);
+    visualmusic::RhythmTracker quiet;
+    quiet.Reset(num_bins, kHopSize, kSampleRate, 500);
+    quiet.AddFrames(silence.data(), num_bins, 500);
+    quiet.Finish();
+    for (size_t frame = 0; frame < 500; frame++) {
+      visualmusic::RhythmFrame rhythm;
+      REQUIRE(quiet.GetFrame(frame, &rhythm));
+      REQUIRE_FALSE(rhythm.onset);
+      REQUIRE_FALSE(rhythm.beat);
+      REQUIRE(rhythm.tempo == 0.0f);
+    }
+  }
+}
+
+TEST_CASE("Test AudioVisualizer rhythm") {
+  const audio::Buffer track = MakeClickTrack(12);
+  const Rectf bounds(vec2(0, 0), vec2(800, 600));
+  visualmusic::AudioVisualizer visualizer;
+  visualizer.SetFftBackend(visualmusic::FftBackend::kFixed);
+  visualizer.Load(track, bounds, kSampleRate);
+
+  const size_t num_frames = track.getNumFrames() / kHopSize;
+  REQUIRE(visualizer.GetRhythm().GetNumFrames() == num_frames);
+  visualmusic::RhythmFrame rhythm;
+  REQUIRE(visualizer.GetRhythmAt(track.getNumFrames() - 1, &rhythm));
+  REQUIRE(rhythm.tempo == Approx(120.0f).margin(2.0f));
+
+  SECTION("A streamed track has the same rhythm") {
+    visualmusic::AudioVisualizer streamed;
+    streamed.SetFftBackend(visualmusic::FftBackend::kFixed);
+    streamed.BeginStream(track.getNumFrames(), 1, bounds, kSampleRate);
+    for (size_t first = 0; first < track.getNumFrames(); first += 5000) {
+      const size_t count =
+          std::min<size_t>(5000, track.getNumFrames() - first);
+      audio::Buffer chunk(count, 1);
+      chunk.copyOffset(track, count, 0, first);
+      streamed.AppendFrames(chunk, count);
+
+      // Only the lookahead trails the written frames
+      REQUIRE(streamed.GetRhythm().GetNumFrames() +
+                  streamed.GetRhythm().GetLookahead() >=
+              (first + count) / kHopSize);
+    }
+    streamed.EndStream();
+
+    REQUIRE(streamed.GetRhythm().GetNumFrames() == num_frames);
+    for (size_t frame = 0; frame < track.getNumFrames(); frame += kHopSize) {
+      visualmusic::RhythmFrame expected;
+      REQUIRE(visualizer.GetRhythmAt(frame, &expected));
+      REQUIRE(streamed.GetRhythmAt(frame, &rhythm));
+      REQUIRE(SameRhythm(rhythm, expected));
+    }
+  }
+
+  SECTION("Lazy spectra have no rhythm") {
+    visualmusic::AudioVisualizer lazy;
+    lazy.SetLazySpectra(true);
+    lazy.Load(track, bounds, kSampleRate);
+    REQUIRE(lazy.GetRhythm().GetNumFrames() == 0);
+    REQUIRE_FALSE(lazy.GetRhythmAt(0, &rhythm));
+  }
+
+  SECTION("A live input tracks the newest rhythm") {
+    visualmusic::SampleRing ring(1, 8192);
+    visualmusic::FileDrivenInput input(track, &ring, 512);
+    visualmusic::LiveSettings settings;
+    settings.sample_rate = kSampleRate;
+    settings.fft_size = kHopSize;
+    visualmusic::LiveAnalyzer analyzer(&ring, settings);
+    while (!input.IsFinished()) {
+      input.PushBlock(0);
+      analyzer.Update();
+    }
+
+    visualmusic::AudioVisualizer live;
+    live.BeginLive(&analyzer, bounds);
+    REQUIRE(live.GetRhythmAt(0, &rhythm));
+    REQUIRE(rhythm.tempo == Approx(120.0f).margin(2.0f));
+
+    // Only the last rhythm_seconds are kept
+    const visualmusic::RhythmTracker &tracker = live.GetRhythm();
+    REQUIRE(tracker.GetNumFrames() + tracker.GetLookahead() ==
+            analyzer.GetNumSpectra());
+    REQUIRE(tracker.GetFirstFrame() ==
+            tracker.GetNumFrames() - 10 * kSampleRate / kHopSize);
+  }
+}
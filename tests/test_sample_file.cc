@@ -0,0 +1,280 @@
+#include <catch2/catch.hpp>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "audio_visualizer.h"
+#include "playhead.h"
+#include "sample_file.h"
+
+using namespace ci;
+
+namespace {
+
+const char *kSamplePath = "test_sample_file.vmsamples";
+const size_t kSampleRate = 1000;
+
+auto MakeTrack(const size_t &num_frames) -> audio::Buffer {
+  audio::Buffer buffer(num_frames, 2);
+  for (size_t i = 0; i < num_frames; i++) {
+    buffer.getChannel(0)[i] = std::sin(0.01f * static_cast<float>(i));
+    buffer.getChannel(1)[i] = 0.5f * std::cos(0.003f * static_cast<float>(i));
+  }
+  return buffer;
+}
+
+// Write a track into a sample file a chunk at a time
+void WriteTrack(const audio::Buffer &track, visualmusic::SampleFile *file) {
+  audio::Buffer chunk(777, track.getNumChannels());
+  for (size_t frame = 0; frame < track.getNumFrames(); frame += 777) {
+    const size_t count = std::min<size_t>(777, track.getNumFrames() - frame);
+    chunk.copyOffset(track, count, 0, frame);
+    file->Write(chunk, frame, count);
+  }
+}
+
+// Stream a track into a visualizer in uneven chunks
+void StreamTrack(const audio::Buffer &track,
+                 visualmusic::AudioVisualizer *visualizer) {
+  visualizer->BeginStream(track.getNumFrames(), track.getNumChannels(),
+                          Rectf(vec2(0, 0), vec2(400, 300)), kSampleRate);
+  audio::Buffer chunk(777, track.getNumChannels());
+  for (size_t frame = 0; frame < track.getNumFrames(); frame += 777) {
+    const size_t count = std::min<size_t>(777, track.getNumFrames() - frame);
+    chunk.copyOffset(track, count, 0, frame);
+    visualizer->AppendFrames(chunk, count);
+  }
+  visualizer->EndStream();
+}
+
+// Whether two visualizers computed the same spectra and envelope
+void RequireSameAnalysis(const visualmusic::AudioVisualizer &actual,
+                         const visualmusic::AudioVisualizer &expected,
+                         const size_t &num_frames) {
+  REQUIRE(actual.IsLoaded());
+  REQUIRE(actual.GetNumSpectralFrames() == expected.GetNumSpectralFrames());
+  for (size_t i = 0; i < expected.GetNumSpectralFrames(); i++) {
+    REQUIRE(std::memcmp(actual.GetSpectralFrame(i),
+                        expected.GetSpectralFrame(i),
+                        expected.GetNumSpectralBins() * sizeof(float)) == 0);
+  }
+
+  REQUIRE(actual.CalculateGeneralGraphInTimeDomain(num_frames) ==
+          expected.CalculateGeneralGraphInTimeDomain(num_frames));
+  const std::vector<vec2> &actual_graph = actual.GetGeneralGraphPoints();
+  const std::vector<vec2> &expected_graph = expected.GetGeneralGraphPoints();
+  REQUIRE(actual_graph.size() == expected_graph.size());
+  for (size_t i = 0; i < expected_graph.size(); i++) {
+    REQUIRE(actual_graph[i].y == expected_graph[i].y);
+  }
+}
+
+// Exposes the block rendering of the player
+class TestPlayerNode : public visualmusic::PlayheadPlayerNode {
+ public:
+  explicit TestPlayerNode(visualmusic::Playhead *playhead)
+      : PlayheadPlayerNode(playhead) {
+  }
+
+  using PlayheadPlayerNode::process;
+};
+
+}  // namespace
+
+TEST_CASE("Test SampleFile") {
+  const audio::Buffer track = MakeTrack(10000);
+  visualmusic::SampleFile written;
+  REQUIRE(written.Create(kSamplePath, 10000, 2, kSampleRate));
+  WriteTrack(track, &written);
+
+  visualmusic::SampleFile file;
+
+  SECTION("Round trip") {
+    REQUIRE(written.Finish());
+    written.Close();
+    REQUIRE(file.Open(kSamplePath));
+    REQUIRE(file.GetNumFrames() == 10000);
+    REQUIRE(file.GetNumChannels() == 2);
+    REQUIRE(file.GetSampleRate() == kSampleRate);
+    for (size_t channel = 0; channel < 2; channel++) {
+      REQUIRE(std::memcmp(file.GetChannel(channel), track.getChannel(channel),
+                          10000 * sizeof(float)) == 0);
+    }
+
+    // Each plane starts on its own page
+    REQUIRE(reinterpret_cast<uintptr_t>(file.GetChannel(1)) % 4096 == 0);
+  }
+
+  SECTION("Unfinished file is rejected") {
+    REQUIRE_FALSE(file.Open(kSamplePath));
+  }
+
+  SECTION("Truncated file is rejected") {
+    REQUIRE(written.Finish());
+    written.Close();
+
+    std::ifstream input(kSamplePath, std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(input)),
+                         std::istreambuf_iterator<char>());
+    input.close();
+
+    std::ofstream output(kSamplePath, std::ios::binary | std::ios::trunc);
+    output.write(contents.data(),
+                 static_cast<std::streamsize>(contents.size() - 64));
+    output.close();
+
+    REQUIRE_FALSE(file.Open(kSamplePath));
+  }
+
+  SECTION("A file of another version of the source is rejected") {
+    REQUIRE(written.Create(kSamplePath, 10000, 2, kSampleRate, 7));
+    WriteTrack(track, &written);
+    REQUIRE(written.Finish());
+    written.Close();
+    REQUIRE(file.Open(kSamplePath, 7));
+    REQUIRE_FALSE(file.Open(kSamplePath, 8));
+    REQUIRE_FALSE(file.Open(kSamplePath));
+  }
+
+  SECTION("The stamp of a source follows its contents") {
+    const char *kSourcePath = "test_sample_file.source";
+    REQUIRE(visualmusic::SampleFile::GetSourceStamp(kSourcePath) == 0);
+    std::ofstream(kSourcePath) << "track";
+    const uint64_t stamp =
+        visualmusic::SampleFile::GetSourceStamp(kSourcePath);
+    REQUIRE(stamp != 0);
+    REQUIRE(visualmusic::SampleFile::GetSourceStamp(kSourcePath) == stamp);
+
+    std::ofstream(kSourcePath) << "a longer track";
+    REQUIRE(visualmusic::SampleFile::GetSourceStamp(kSourcePath) != stamp);
+    std::remove(kSourcePath);
+  }
+
+  SECTION("Each source and rate has its own file") {
+    const std::string name =
+        visualmusic::SampleFile::GetFileName("track.m4a", 44100);
+    REQUIRE(name == visualmusic::SampleFile::GetFileName("track.m4a", 44100));
+    REQUIRE(name != visualmusic::SampleFile::GetFileName("track.m4a", 48000));
+    REQUIRE(name != visualmusic::SampleFile::GetFileName("other.m4a", 44100));
+  }
+
+  written.Close();
+  file.Close();
+  std::remove(kSamplePath);
+}
+
+TEST_CASE("Test reading a track through a sample file") {
+  const size_t kNumFrames = 20000;
+  const audio::Buffer track = MakeTrack(kNumFrames);
+  const Rectf bounds(vec2(0, 0), vec2(400, 300));
+
+  visualmusic::AudioVisualizer loaded;
+  loaded.Load(track, bounds, kSampleRate);
+
+  visualmusic::AudioVisualizer streamed;
+  streamed.SetSampleFile(kSamplePath);
+  StreamTrack(track, &streamed);
+
+  SECTION("A streamed track is decoded into the file") {
+    const visualmusic::SampleFile &file = streamed.GetSampleFile();
+    REQUIRE(file.IsOpen());
+    REQUIRE(std::memcmp(file.GetChannel(1), track.getChannel(1),
+                        kNumFrames * sizeof(float)) == 0);
+    RequireSameAnalysis(streamed, loaded, kNumFrames);
+
+    // The samples are paged in by the system, not held by the visualizer
+    const visualmusic::MemoryUsage usage = streamed.GetMemoryUsage();
+    REQUIRE(usage.samples == 0);
+    REQUIRE(usage.mapped >= kNumFrames * 2 * sizeof(float));
+    REQUIRE(loaded.GetMemoryUsage().samples == kNumFrames * 2 * sizeof(float));
+  }
+
+  SECTION("A finished file is analyzed like the buffer") {
+    visualmusic::AudioVisualizer mapped;
+    REQUIRE(mapped.LoadSampleFile(kSamplePath, 0, bounds));
+    REQUIRE(mapped.GetSampleFile().GetSampleRate() == kSampleRate);
+    RequireSameAnalysis(mapped, loaded, kNumFrames);
+    REQUIRE(mapped.GetMemoryUsage().samples == 0);
+
+    // Loading a buffer drops the mapping
+    mapped.Load(track, bounds, kSampleRate);
+    REQUIRE_FALSE(mapped.GetSampleFile().IsOpen());
+    RequireSameAnalysis(mapped, loaded, kNumFrames);
+  }
+
+  SECTION("A mapped track has no channel views") {
+    // The views would hold full mix and side signals in memory
+    visualmusic::AudioVisualizer mapped;
+    mapped.SetChannelViews(true);
+    REQUIRE(mapped.LoadSampleFile(kSamplePath, 0, bounds));
+    REQUIRE(mapped.GetNumChannelViews() == 0);
+    REQUIRE(mapped.GetMemoryUsage().channel_views == 0);
+
+    // The read-ahead window follows the player, seeks included
+    mapped.PrefetchSamples(5000);
+    mapped.PrefetchSamples(6000);
+    mapped.PrefetchSamples(100);
+    RequireSameAnalysis(mapped, loaded, kNumFrames);
+
+    mapped.Load(track, bounds, kSampleRate);
+    REQUIRE(mapped.GetNumChannelViews() == 4);
+  }
+
+  SECTION("A file decoded from an older source is not mapped") {
+    visualmusic::AudioVisualizer mapped;
+    REQUIRE_FALSE(mapped.LoadSampleFile(kSamplePath, 1, bounds));
+    REQUIRE_FALSE(mapped.GetSampleFile().IsOpen());
+    REQUIRE_FALSE(mapped.IsLoaded());
+  }
+
+  SECTION("A missing file keeps the loaded track") {
+    REQUIRE_FALSE(loaded.LoadSampleFile("missing.vmsamples", 0, bounds));
+    REQUIRE(loaded.IsLoaded());
+    REQUIRE(loaded.GetReadyFrames() == kNumFrames);
+  }
+
+  SECTION("Without a path the samples stay in memory") {
+    visualmusic::AudioVisualizer in_memory;
+    StreamTrack(track, &in_memory);
+    REQUIRE_FALSE(in_memory.GetSampleFile().IsOpen());
+    RequireSameAnalysis(in_memory, loaded, kNumFrames);
+  }
+
+  SECTION("The player reads the mapping") {
+    visualmusic::Playhead playhead(kSampleRate);
+    TestPlayerNode player(&playhead);
+    player.SetSamples(&streamed.GetSampleFile());
+    REQUIRE(player.HasTrack());
+    REQUIRE(player.getNumFrames() == kNumFrames);
+    player.start();
+
+    audio::Buffer block(512, 2);
+    player.process(&block);
+    REQUIRE(player.getReadPosition() == 512);
+    for (size_t channel = 0; channel < 2; channel++) {
+      REQUIRE(std::memcmp(block.getChannel(channel), track.getChannel(channel),
+                          512 * sizeof(float)) == 0);
+    }
+
+    // The last block is padded with silence and ends the playback
+    playhead.RequestSeek(kNumFrames - 100);
+    player.process(&block);
+    REQUIRE(std::memcmp(block.getChannel(0),
+                        track.getChannel(0) + kNumFrames - 100,
+                        100 * sizeof(float)) == 0);
+    REQUIRE(block.getChannel(1)[100] == 0.0f);
+    REQUIRE(player.isEof());
+    REQUIRE_FALSE(player.isEnabled());
+
+    player.SetSamples(nullptr);
+    REQUIRE_FALSE(player.HasTrack());
+  }
+
+  // A stream into memory drops the mapping before the file is removed
+  streamed.SetSampleFile("");
+  streamed.BeginStream(1000, 1, bounds, kSampleRate);
+  std::remove(kSamplePath);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Returns deterministic noise in [-1, 1], the same for a seed on every
+ * platform, so that tests and benchmarks compare the same input across runs
+ * @param size Number of samples
+ * @param seed State of the generator before the first sample
+ * @return samples
+ */
+inline auto MakeNoise(const size_t &size, const uint32_t &seed)
+    -> std::vector<float> {
+  std::vector<float> data(size);
+  uint32_t state = seed;
+
+  for (float &value : data) {
+    state = state * 1664525u + 1013904223u;
+    value = static_cast<float>(state >> 8) / static_cast<float>(1 << 23) - 1.0f;
+  }
+
+  return data;
+}
@@ -0,0 +1,139 @@
+#include <catch2/catch.hpp>
+#include <chrono>
+
+#include "simd_kernels.h"
+#include "test_signals.h"
+
+using visualmusic::simd::InstructionSet;
+
+namespace {
+
+// Restores the default dispatch when a test ends
+struct ScopedInstructionSet {
+  InstructionSet previous = visualmusic::simd::GetInstructionSet();
+  explicit ScopedInstructionSet(const InstructionSet &set) {
+    visualmusic::simd::SetInstructionSet(set);
+  }
+  ~ScopedInstructionSet() {
+    visualmusic::simd::SetInstructionSet(previous);
+  }
+};
+
+}  // namespace
+
+TEST_CASE("Test SIMD kernels against the scalar reference") {
+  namespace simd = visualmusic::simd;
+  REQUIRE(simd::IsSupported(InstructionSet::kScalar));
+  REQUIRE(simd::GetSupportedInstructionSets().front() ==
+          InstructionSet::kScalar);
+
+  // Sizes around every vector width, and one long enough for every loop
+  const size_t kSizes[] = {1, 3, 4, 7, 8, 9, 15, 16, 17, 31, 33, 1000, 4099};
+  std::vector<float> left = MakeNoise(4099, 1);
+  std::vector<float> right = MakeNoise(4099, 2);
+  left[777] = -1.5f;
+
+  for (InstructionSet set : simd::GetSupportedInstructionSets()) {
+    for (size_t size : kSizes) {
+      const float *channels[] = {left.data(), right.data()};
+      float expected_min, expected_max, expected_squares;
+      std::vector<float> expected_mix(size);
+      std::vector<float> expected_points(2 * size);
+      simd::ScreenMapping mapping;
+      mapping.x_origin = 10.0f;
+      mapping.x_step = 0.25f;
+      mapping.y_origin = 50.0f;
+      mapping.y_scale = -20.0f;
+
+      const size_t num_buckets = (size + 2) / 3;
+      std::vector<float> expected_mins(num_buckets);
+      std::vector<float> expected_maxs(num_buckets);
+
+      float expected_abs_max, expected_dot;
+      {
+        ScopedInstructionSet scalar(InstructionSet::kScalar);
+        expected_abs_max = simd::AbsMax(left.data(), size);
+        simd::MixDown(channels, 2, size, 0.5f, expected_mix.data());
+        simd::MinMaxSumSquares(left.data(), size, &expected_min,
+                               &expected_max, &expected_squares);
+        simd::MapToScreen(left.data(), size, mapping, expected_points.data());
+        simd::MinMaxPerBucket(left.data(), size, num_buckets,
+                              expected_mins.data(), expected_maxs.data());
+        expected_dot = simd::DotProduct(left.data(), right.data(), size);
+      }
+
+      ScopedInstructionSet vector(set);
+      REQUIRE(simd::GetInstructionSet() == set);
+      REQUIRE(simd::AbsMax(left.data(), size) == expected_abs_max);
+
+      std::vector<float> mix(size);
+      simd::MixDown(channels, 2, size, 0.5f, mix.data());
+      REQUIRE(mix == expected_mix);
+
+      float min, max, squares;
+      simd::MinMax(left.data(), size, &min, &max);
+      REQUIRE(min == expected_min);
+      REQUIRE(max == expected_max);
+      std::vector<float> mins(num_buckets);
+      std::vector<float> maxs(num_buckets);
+      simd::MinMaxPerBucket(left.data(), size, num_buckets, mins.data(),
+                            maxs.data());
+      REQUIRE(mins == expected_mins);
+      REQUIRE(maxs == expected_maxs);
+      simd::MinMaxSumSquares(left.data(), size, &min, &max, &squares);
+      REQUIRE(min == expected_min);
+      REQUIRE(max == expected_max);
+      REQUIRE(Approx(squares).epsilon(1e-5) == expected_squares);
+
+      std::vector<float> points(2 * size);
+      simd::MapToScreen(left.data(), size, mapping, points.data());
+      for (size_t i = 0; i < points.size(); i++) {
+        REQUIRE(Approx(points[i]) == expected_points[i]);
+      }
+
+      REQUIRE(simd::DotProduct(left.data(), right.data(), size) ==
+              Approx(expected_dot).margin(1e-4));
+    }
+  }
+
+  SECTION("Empty ranges") {
+    REQUIRE(simd::AbsMax(left.data(), 0) == 0.0f);
+    REQUIRE(simd::DotProduct(left.data(), right.data(), 0) == 0.0f);
+  }
+
+  SECTION("Mixing in place") {
+    std::vector<float> mix = left;
+    const float *channels[] = {mix.data(), right.data()};
+    simd::MixDown(channels, 2, mix.size(), 0.5f, mix.data());
+    for (size_t i = 0; i < mix.size(); i++) {
+      REQUIRE(mix[i] == (left[i] + right[i]) * 0.5f);
+    }
+  }
+}
+
+TEST_CASE("Test SIMD kernels on a 2-hour track", "[.][perf]") {
+  namespace simd = visualmusic::simd;
+
+  // 2 hours of mono at 44.1 kHz, run with "[perf]" on an optimized build
+  std::vector<float> data = MakeNoise(2 * 3600 * 44100, 3);
+
+  auto time_kernels = [&data](const InstructionSet &set) -> double {
+    ScopedInstructionSet scoped(set);
+    float min, max;
+    auto start = std::chrono::steady_clock::now();
+    const float abs_max = simd::AbsMax(data.data(), data.size());
+    simd::MinMax(data.data(), data.size(), &min, &max);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    REQUIRE(abs_max >= max);
+    return elapsed.count();
+  };
+
+  const double scalar_seconds = time_kernels(InstructionSet::kScalar);
+  const double vector_seconds = time_kernels(simd::GetInstructionSet());
+  WARN("scalar " << scalar_seconds << " s, vector " << vector_seconds << " s");
+
+  if (simd::GetInstructionSet() != InstructionSet::kScalar) {
+    REQUIRE(vector_seconds < scalar_seconds);
+  }
+}
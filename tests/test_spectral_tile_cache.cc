@@ -0,0 +1,204 @@
+#include <catch2/catch.hpp>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#include "audio_visualizer.h"
+#include "spectral_tile_cache.h"
+#include "test_signals.h"
+
+using namespace ci;
+
+namespace {
+
+}  // namespace
+
+TEST_CASE("Test SpectralTileCache") {
+  const std::vector<float> signal = MakeNoise(200000, 5);
+  visualmusic::StftSettings stft_settings;
+  stft_settings.backend = visualmusic::FftBackend::kFixed;
+  const visualmusic::StftEngine engine(stft_settings);
+  const size_t num_frames = engine.CountFrames(signal.size());
+  std::vector<float> expected(num_frames * 512);
+  engine.Analyze(engine.MakeFrameView(signal.data(), signal.size()),
+                 expected.data());
+
+  // 13 tiles of 16 frames, 4 in memory
+  visualmusic::TileSettings settings;
+  settings.frames_per_tile = 16;
+  settings.max_tiles = 4;
+  settings.prefetch_tiles = 2;
+  visualmusic::SpectralTileCache tiles;
+  tiles.Start(&engine, nullptr, signal.data(), signal.size(), settings);
+  std::vector<float> row(512);
+
+  SECTION("Nothing is computed before it is requested") {
+    REQUIRE(tiles.IsActive());
+    REQUIRE_FALSE(tiles.ReadRow(0, false, row.data(), false));
+    REQUIRE(tiles.GetNumComputedTiles() == 0);
+    REQUIRE(tiles.GetCapacityBytes(false) == 0);
+  }
+
+  SECTION("Playing forward prefetches the history and the tiles ahead") {
+    tiles.Prefetch(40, 1, 20);
+    tiles.WaitIdle();
+
+    REQUIRE(tiles.IsResident(40));
+    REQUIRE(tiles.IsResident(20));
+    REQUIRE(tiles.IsResident(48));
+    REQUIRE(tiles.IsResident(64));
+    REQUIRE_FALSE(tiles.IsResident(80));
+    REQUIRE_FALSE(tiles.IsResident(0));
+    REQUIRE(tiles.GetNumComputedTiles() == 4);
+
+    // Rows match the spectra of the whole track
+    for (size_t index = 16; index < 80; index++) {
+      REQUIRE(tiles.ReadRow(index, false, row.data(), false));
+      REQUIRE(std::memcmp(row.data(), expected.data() + index * 512,
+                          512 * sizeof(float)) == 0);
+    }
+  }
+
+  SECTION("Scrubbing backward prefetches the tiles before the playhead") {
+    tiles.Prefetch(100, -1, 20);
+    tiles.WaitIdle();
+
+    REQUIRE(tiles.IsResident(96));
+    REQUIRE(tiles.IsResident(80));
+    REQUIRE(tiles.IsResident(64));
+    REQUIRE_FALSE(tiles.IsResident(112));
+  }
+
+  SECTION("Memory is bounded by the number of tiles") {
+    for (size_t index = 0; index < num_frames; index += 7) {
+      tiles.Prefetch(index, 1, 20);
+      tiles.WaitIdle();
+      REQUIRE(tiles.GetNumResidentTiles() <= 4);
+    }
+    REQUIRE(tiles.GetCapacityBytes(false) == 4 * 16 * 512 * sizeof(float));
+
+    // A waiting read brings back an evicted tile
+    REQUIRE_FALSE(tiles.IsResident(0));
+    REQUIRE(tiles.ReadRow(3, false, row.data(), true));
+    REQUIRE(std::memcmp(row.data(), expected.data() + 3 * 512,
+                        512 * sizeof(float)) == 0);
+    REQUIRE(tiles.GetNumResidentTiles() == 4);
+  }
+
+  SECTION("Blocking reads complete while the playhead moves") {
+    // Another thread replaces the requests with tiles far from the ones
+    // read, and keeps the tiles in memory busy
+    std::atomic<bool> reading(true);
+    std::thread playhead([&]() {
+      for (size_t step = 0; reading; step++) {
+        tiles.Prefetch(step % 2 == 0 ? num_frames - 1 : num_frames - 40, 1,
+                       16);
+      }
+    });
+
+    for (size_t pass = 0; pass < 20; pass++) {
+      for (size_t index = 0; index < 96; index += 16) {
+        REQUIRE(tiles.ReadRow(index + pass, false, row.data(), true));
+        REQUIRE(std::memcmp(row.data(),
+                            expected.data() + (index + pass) * 512,
+                            512 * sizeof(float)) == 0);
+      }
+    }
+    reading = false;
+    playhead.join();
+  }
+
+  SECTION("A blocking read survives a single tile") {
+    settings.max_tiles = 1;
+    tiles.Start(&engine, nullptr, signal.data(), signal.size(), settings);
+    std::atomic<bool> reading(true);
+    std::thread playhead([&]() {
+      for (size_t step = 0; reading; step++) {
+        tiles.Prefetch(num_frames - 1 - (step % 2) * 16, 1, 0);
+      }
+    });
+
+    for (size_t pass = 0; pass < 20; pass++) {
+      for (size_t index = 0; index < 96; index += 16) {
+        REQUIRE(tiles.ReadRow(index + pass, false, row.data(), true));
+      }
+    }
+    reading = false;
+    playhead.join();
+  }
+
+  SECTION("Stop frees the tiles") {
+    tiles.Prefetch(0, 1, 0);
+    tiles.Stop();
+    REQUIRE_FALSE(tiles.IsActive());
+    REQUIRE(tiles.GetCapacityBytes(false) == 0);
+    REQUIRE_FALSE(tiles.ReadRow(0, false, row.data(), true));
+  }
+}
+
+TEST_CASE("Test lazy spectra") {
+  audio::Buffer buffer(20 * 44100, 1);
+  const std::vector<float> noise = MakeNoise(buffer.getNumFrames(), 5);
+  std::copy(noise.begin(), noise.end(), buffer.getChannel(0));
+  const Rectf bounds(vec2(0, 0), vec2(800, 600));
+
+  visualmusic::AudioVisualizer exact;
+  exact.SetFftBackend(visualmusic::FftBackend::kFixed);
+  exact.Load(buffer, bounds, 44100);
+
+  visualmusic::TileSettings settings;
+  settings.max_tiles = 4;
+  visualmusic::AudioVisualizer lazy;
+  lazy.SetFftBackend(visualmusic::FftBackend::kFixed);
+  lazy.SetLazySpectra(true, settings);
+  lazy.Load(buffer, bounds, 44100);
+  const visualmusic::SpectralTileCache &tiles = lazy.GetSpectralTiles();
+
+  REQUIRE(tiles.IsActive());
+  REQUIRE(lazy.GetNumSpectralFrames() == exact.GetNumSpectralFrames());
+  REQUIRE(lazy.GetMemoryUsage().spectra < exact.GetMemoryUsage().spectra / 4);
+
+  SECTION("The 3D graph draws rows once their tiles are computed") {
+    const size_t frame = 500 * 1024;
+    const size_t first_rows = lazy.Update3DGraph(frame);
+    tiles.WaitIdle();
+    REQUIRE(first_rows + lazy.Update3DGraph(frame) == 50);
+    REQUIRE(tiles.GetNumComputedTiles() <= 4);
+
+    exact.Update3DGraph(frame);
+    for (size_t index = 451; index <= 500; index++) {
+      const std::vector<vec2> expected = exact.Get3DGraphRow(index);
+      const std::vector<vec2> actual = lazy.Get3DGraphRow(index);
+      REQUIRE(actual.size() == expected.size());
+      for (size_t bin = 0; bin < expected.size(); bin++) {
+        REQUIRE(actual[bin].y == expected[bin].y);
+      }
+    }
+
+    // The tiles ahead are ready before the playhead gets there
+    REQUIRE(tiles.IsResident(600));
+    REQUIRE(lazy.Update3DGraph(frame + 100 * 1024) == 50);
+  }
+
+  SECTION("A seek requests the tiles of its target at once") {
+    const size_t target = 700 * 1024;
+    lazy.Update3DGraph(100 * 1024);
+    lazy.BeginSeek(target);
+    tiles.WaitIdle();
+    REQUIRE(tiles.IsResident(700));
+    REQUIRE(tiles.IsResident(651));
+
+    REQUIRE(lazy.Update3DGraph(target) == 50);
+    lazy.MarkFrameDisplayed(target);
+    REQUIRE(lazy.GetSeekLatency().num_seeks == 1);
+  }
+
+  SECTION("Spectral frames wait for their tile") {
+    for (size_t index = 0; index < exact.GetNumSpectralFrames(); index += 97) {
+      REQUIRE(std::memcmp(lazy.GetSpectralFrame(index),
+                          exact.GetSpectralFrame(index),
+                          exact.GetNumSpectralBins() * sizeof(float)) == 0);
+    }
+    REQUIRE(tiles.GetNumResidentTiles() <= 4);
+  }
+}
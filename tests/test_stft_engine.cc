@@ -0,0 +1,64 @@
+#include <catch2/catch.hpp>
+#include <cstring>
+
+#include "stft_engine.h"
+
+using namespace ci;
+
+namespace {
+
+// A short chirp, so every frame has a different spectrum
+auto MakeChirp(const size_t &num_frames) -> audio::Buffer {
+  audio::Buffer buffer(num_frames, 2);
+
+  for (size_t i = 0; i < num_frames; i++) {
+    float t = static_cast<float>(i);
+    buffer.getChannel(0)[i] = std::sin(0.01f * t + 0.0005f * t * t);
+    buffer.getChannel(1)[i] = 0.5f * buffer.getChannel(0)[i];
+  }
+
+  return buffer;
+}
+
+}  // namespace
+
+TEST_CASE("Test StftEngine") {
+  visualmusic::StftSettings settings;
+  settings.fft_size = 64;
+  settings.hop_size = 16;
+  settings.window = visualmusic::WindowType::kHann;
+
+  audio::Buffer buffer = MakeChirp(1000);
+
+  SECTION("Frame count covers the whole buffer") {
+    visualmusic::StftEngine engine(settings);
+    REQUIRE(engine.CountFrames(1000) == 63);
+    REQUIRE(engine.CountFrames(992) == 62);
+    REQUIRE(engine.GetNumBins() == 32);
+  }
+
+  SECTION("Parallel result is byte-identical to the serial result") {
+    settings.num_threads = 1;
+    visualmusic::StftEngine serial(settings);
+    settings.num_threads = 4;
+    visualmusic::StftEngine parallel(settings);
+
+    size_t size = serial.CountFrames(buffer.getNumFrames()) *
+                  serial.GetNumBins();
+    std::vector<float> serial_output(size, -1.0f);
+    std::vector<float> parallel_output(size, -2.0f);
+
+    float serial_max = serial.Analyze(buffer, serial_output.data());
+    float parallel_max = parallel.Analyze(buffer, parallel_output.data());
+
+    REQUIRE(serial_max == parallel_max);
+    REQUIRE(std::memcmp(serial_output.data(), parallel_output.data(),
+                        size * sizeof(float)) == 0);
+  }
+
+  SECTION("Size must be a power of 2") {
+    settings.fft_size = 100;
+    REQUIRE_THROWS_AS(visualmusic::StftEngine(settings),
+                      std::invalid_argument);
+  }
+}
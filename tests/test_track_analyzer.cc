@@ -0,0 +1,85 @@
+#include <catch2/catch.hpp>
+#include <cstdio>
+#include <cstring>
+
+#include "audio_visualizer.h"
+#include "track_analyzer.h"
+
+using namespace ci;
+
+TEST_CASE("Test TrackAnalyzer") {
+  audio::Buffer buffer(30000, 2);
+  for (size_t i = 0; i < buffer.getNumFrames(); i++) {
+    buffer.getChannel(0)[i] = std::sin(0.03f * static_cast<float>(i));
+    buffer.getChannel(1)[i] = 0.5f * std::cos(0.07f * static_cast<float>(i));
+  }
+
+  visualmusic::TrackAnalyzer analyzer(
+      visualmusic::TrackAnalyzer::MakeDisplayParameters(44100));
+  analyzer.Analyze(buffer);
+  const visualmusic::AnalysisProducts products = analyzer.GetProducts();
+
+  Rectf bounds(vec2(0, 0), vec2(400, 300));
+  visualmusic::AudioVisualizer visualizer;
+  visualizer.Load(buffer, bounds, 44100);
+
+  SECTION("Results match the visualizer") {
+    REQUIRE(products.num_frames == 30000);
+    REQUIRE(products.num_spectral_frames == visualizer.GetNumSpectralFrames());
+    REQUIRE(products.num_spectral_bins == visualizer.GetNumSpectralBins());
+    for (size_t row = 0; row < products.num_spectral_frames; row++) {
+      REQUIRE(std::memcmp(products.spectral_rows +
+                              row * products.spectral_row_stride,
+                          visualizer.GetSpectralFrame(row),
+                          products.num_spectral_bins * sizeof(float)) == 0);
+    }
+    REQUIRE(products.max_magnitude_general == Approx(1.0f).margin(1e-3));
+  }
+
+  SECTION("The visualizer loads the written file") {
+    const std::string path = analyzer.Write(".");
+    REQUIRE_FALSE(path.empty());
+
+    visualmusic::AudioVisualizer cached;
+    cached.SetCacheDirectory(".");
+    cached.Load(buffer, bounds, 44100);
+    REQUIRE(cached.IsLoadedFromCache());
+    REQUIRE(cached.CalculateGeneralGraphInTimeDomain(30000) ==
+            visualizer.CalculateGeneralGraphInTimeDomain(30000));
+
+    std::remove(path.c_str());
+  }
+
+  SECTION("Bands match the visualizer") {
+    visualmusic::BandSettings bands;
+    bands.scale = visualmusic::BandScale::kConstantQ;
+    bands.num_bands = 96;
+    visualmusic::TrackAnalyzer band_analyzer(
+        visualmusic::TrackAnalyzer::MakeDisplayParameters(44100, bands));
+    band_analyzer.Analyze(buffer);
+    const visualmusic::AnalysisProducts band_products =
+        band_analyzer.GetProducts();
+
+    visualmusic::AudioVisualizer band_visualizer;
+    band_visualizer.SetFrequencyBands(bands);
+    band_visualizer.Load(buffer, bounds, 44100);
+
+    REQUIRE(band_products.num_bands == 96);
+    for (size_t row = 0; row < band_products.num_spectral_frames; row++) {
+      REQUIRE(std::memcmp(band_products.band_rows +
+                              row * band_products.band_row_stride,
+                          band_visualizer.GetBandFrame(row),
+                          96 * sizeof(float)) == 0);
+    }
+  }
+
+  SECTION("The estimate covers the analysis") {
+    const size_t bytes = visualmusic::TrackAnalyzer::EstimateBytes(
+        30000, 2, visualmusic::TrackAnalyzer::MakeDisplayParameters(44100));
+    REQUIRE(bytes >= buffer.getSize() * sizeof(float) +
+                         products.num_envelope_buckets *
+                             sizeof(visualmusic::EnvelopePyramid::Bucket) +
+                         products.num_spectral_frames *
+                             products.spectral_row_stride * sizeof(float));
+  }
+}
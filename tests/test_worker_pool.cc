@@ -0,0 +1,62 @@
+#include <catch2/catch.hpp>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "worker_pool.h"
+
+TEST_CASE("Test WorkerPool") {
+  visualmusic::WorkerPool pool(4);
+  REQUIRE(pool.GetNumWorkers() == 4);
+
+  SECTION("Every task runs once on a worker of the pool") {
+    // Many passes on the same workers, as a streamed track makes
+    for (size_t pass = 0; pass < 200; pass++) {
+      const size_t num_tasks = pass % 17;
+      std::vector<std::atomic<int>> runs(num_tasks);
+      for (std::atomic<int>& count : runs) {
+        count = 0;
+      }
+      std::atomic<bool> valid_workers(true);
+
+      pool.Run(num_tasks, [&](size_t task, size_t worker) {
+        runs[task]++;
+        if (worker >= pool.GetNumWorkers()) {
+          valid_workers = false;
+        }
+      });
+
+      REQUIRE(valid_workers);
+      for (const std::atomic<int>& count : runs) {
+        REQUIRE(count == 1);
+      }
+    }
+  }
+
+  SECTION("Passes from several threads all complete") {
+    std::atomic<int> total(0);
+    auto run_passes = [&]() {
+      for (size_t pass = 0; pass < 50; pass++) {
+        pool.Run(8, [&](size_t, size_t) { total++; });
+      }
+    };
+
+    std::thread other(run_passes);
+    run_passes();
+    other.join();
+
+    REQUIRE(total == 2 * 50 * 8);
+  }
+
+  SECTION("A single worker runs every task on the calling thread") {
+    visualmusic::WorkerPool single(1);
+    REQUIRE(single.GetNumWorkers() == 1);
+    const std::thread::id caller = std::this_thread::get_id();
+    bool on_caller = true;
+    single.Run(5, [&](size_t, size_t worker) {
+      on_caller = on_caller && worker == 0 &&
+                  std::this_thread::get_id() == caller;
+    });
+    REQUIRE(on_caller);
+  }
+}